@@ -0,0 +1,662 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sirf_msg.h"
+#include "sirf_codec_ai3.h"
+#include "sirf_proto_ai3.h"
+
+const char *progname = "ai3bench";
+const char *revision = "$Revision: 0.1 $";
+
+/* Compressed message can be 2 bytes longer than the input  */
+#define AI3_BUF_SIZE (SIRF_MSG_AI3_MAX_STRUCT_SIZE + 16)
+
+struct payload_t {
+   uint8_t *data;
+   uint16_t len;
+   uint8_t *comp;
+   uint16_t comp_len;
+};
+
+struct bench_ctx_t {
+   unsigned runs;
+   unsigned msg_cnt;
+   unsigned long fuzz_cnt;
+   unsigned seed;
+   struct payload_t *msg;
+   unsigned long long in_bytes;
+   unsigned long long out_bytes;
+};
+
+static void usage(void)
+{
+ fprintf(stdout, "\nUsage:\n    %s [-h] [options]\n"
+       ,progname);
+ return;
+}
+
+static void version(void)
+{
+ fprintf(stdout,"%s %s\n",progname,revision);
+}
+
+static void help(void)
+{
+
+ printf("%s - AI3 run length compression benchmark\t\t%s\n",
+       progname, revision);
+ usage();
+ printf(
+   "\nOptions:\n"
+   "    -n, --runs                  Runs per test, best is reported, default: 5\n"
+   "    -m, --messages              Aiding messages, default: 3000\n"
+   "    -F, --fuzz                  Fuzz equivalence iterations, default: 100000\n"
+   "    -r, --seed                  Random seed, default: 1\n"
+   "    -h, --help                  Help\n"
+   "    -v, --version               Show version\n"
+   "\n"
+   "Aiding messages (AI3 request with ephemeris, almanac and acquisition\n"
+   "assistance, nav subframes 1-3 and 4-5) are encoded once, then compressed\n"
+   "and decompressed by the byte at a time code of sirfdump <= 0.4 and by\n"
+   "SIRF_PROTO_AI3_compressAI3Msg() / SIRF_PROTO_AI3_decompressAI3Msg().\n"
+   "Fuzz test compares both on random inputs and exits with 1 on mismatch.\n"
+   "\n"
+ );
+ return;
+}
+
+static uint64_t clock_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static unsigned rnd(unsigned n)
+{
+   return n ? (unsigned)(random() % n) : 0;
+}
+
+static int32_t rnd_range(int32_t min, int32_t max)
+{
+   return min + (int32_t)rnd((unsigned)(max - min + 1));
+}
+
+/* Compressor of sirf_proto_ai3.c before the vectorised run search  */
+static tSIRF_UINT16 legacy_compress(tSIRF_UINT8 *in_buf,  tSIRF_UINT8 *out_buf, tSIRF_UINT16 in_len)
+{
+   tSIRF_UINT16 run_cnt,
+      non_run_cnt,
+      in_ind, out_ind,
+      cur_ind;
+   tSIRF_BOOL  ready_to_copy,match_end;
+
+   in_ind        = 0;
+   run_cnt       = 0;
+   non_run_cnt   = 0;
+   out_ind       = 0;
+   cur_ind       = 0;
+   ready_to_copy = SIRF_FALSE;
+   match_end     = SIRF_FALSE;
+
+   while(cur_ind < in_len - 1)
+   {
+      if(in_buf[cur_ind] == in_buf[cur_ind +1])
+      {
+         run_cnt++;
+         if( run_cnt < 4)
+         {
+            non_run_cnt++;
+         }
+         else
+         {
+            match_end = SIRF_TRUE;
+            if((non_run_cnt >= run_cnt) && (ready_to_copy))
+            {
+               out_buf[out_ind++] = 0x00 | ((non_run_cnt - run_cnt + 1) >> 8);
+               out_buf[out_ind++] = (tSIRF_UINT8)(non_run_cnt - run_cnt + 1);
+               memcpy(&out_buf[out_ind],&in_buf[in_ind],(non_run_cnt - run_cnt + 1));
+               in_ind = in_ind + non_run_cnt - run_cnt + 1;
+               out_ind = out_ind + non_run_cnt - run_cnt + 1;
+               ready_to_copy = SIRF_FALSE;
+            }
+            non_run_cnt = 0;
+         }
+      }
+      else
+      {
+         if(match_end)
+         {
+            run_cnt++;
+            match_end = SIRF_FALSE;
+         }
+         else
+         {
+            non_run_cnt++;
+         }
+         if(run_cnt >= 4)
+         {
+            if((non_run_cnt >= run_cnt) && (ready_to_copy))
+            {
+               out_buf[out_ind++] = ((non_run_cnt - run_cnt + 1) >> 8);
+               out_buf[out_ind++] = (tSIRF_UINT8)(non_run_cnt - run_cnt + 1);
+               memcpy(&out_buf[out_ind],&in_buf[in_ind],(non_run_cnt - run_cnt + 1));
+               in_ind = in_ind + non_run_cnt - run_cnt + 1;
+               out_ind = out_ind + non_run_cnt - run_cnt + 1;
+               ready_to_copy = SIRF_FALSE;
+            }
+            non_run_cnt = 0;
+            out_buf[out_ind++] = 0x80 | ((run_cnt) >> 8);
+            out_buf[out_ind++] = (tSIRF_UINT8)(run_cnt);
+            out_buf[out_ind++] = in_buf[in_ind];
+            in_ind = in_ind + run_cnt;
+         }
+         run_cnt = 0;
+         ready_to_copy = SIRF_TRUE;
+      }
+      cur_ind++;
+   }
+   if(run_cnt >= 4)
+   {
+      out_buf[out_ind++] = 0x80 | ((run_cnt + 1) >> 8);
+      out_buf[out_ind++] = (tSIRF_UINT8)(run_cnt + 1);
+      out_buf[out_ind++] = in_buf[in_ind];
+   }
+   else
+   {
+      out_buf[out_ind++] = ((non_run_cnt + 1) >> 8);
+      out_buf[out_ind++] = (tSIRF_UINT8)(non_run_cnt + 1);
+      memcpy(&out_buf[out_ind],&in_buf[in_ind],(non_run_cnt + 1));
+      out_ind = out_ind + non_run_cnt + 1;
+   }
+   return out_ind;
+}
+
+/* Decompressor of sirf_proto_ai3.c before the fixed size copies  */
+static tSIRF_UINT32 legacy_decompress( tSIRF_UINT8 *input,
+                                       tSIRF_UINT32 inputLen,
+                                       tSIRF_UINT8 *output,
+                                       tSIRF_UINT32 maxOutLen )
+{
+   tSIRF_UINT16 data_length;
+   tSIRF_UINT16 header;
+   tSIRF_UINT32 m, n;
+
+   m = 0;
+   n = 0;
+
+   while(((m+2) < inputLen) && (n < maxOutLen))
+   {
+      header        = (tSIRF_UINT16)(input[m] << 8 | input[m+1]);
+      data_length   = header & 0x7FFF;
+      m            += 2;
+      if((0 == data_length) || (n + data_length) > maxOutLen)
+      {
+         return 0;
+      }
+
+      if(header & 0x8000)
+      {
+         memset((output + n), input[m], data_length);
+         n += data_length;
+         m++;
+      }
+      else
+      {
+         if ((m + data_length) > inputLen)
+         {
+            return 0;
+         }
+
+         memcpy(&output[n],&input[m],data_length);
+         n += data_length;
+         m += data_length;
+      }
+   }
+   if( m < inputLen )
+   {
+      return 0;
+   }
+
+   return n;
+}
+
+static void gen_req(tSIRF_MSG_AI3_REQ *req, unsigned visible)
+{
+   unsigned i, prn;
+   tSIRF_MSG_AI3_EPHEMERIS_INFO_PER_SV *eph;
+   tSIRF_MSG_AI3_ALMANAC_PARAMETERS *alm;
+   tSIRF_MSG_AI3_ACQUISITION_ASSISTANCE_DATA *acq;
+
+   memset(req, 0, sizeof(*req));
+   req->icd_rev_num = 0x22;
+   req->pos_req_flag = 1;
+   req->pos_req_infol.num_fixes = 1;
+   req->pos_req_infol.hori_error_max = 50;
+   req->pos_req_infol.vert_error_max = 3;
+   req->pos_req_infol.resp_time_max = 16;
+   req->location_method = SIRF_MSG_AI3_REQ_LOCMETH_MS_BASED;
+   req->iono_flag = 1;
+   req->iono_data.alpha_0 = 12;
+   req->iono_data.alpha_1 = 1;
+   req->iono_data.alpha_2 = -8;
+   req->iono_data.beta_0 = 96;
+   req->iono_data.beta_1 = 1;
+   req->iono_data.beta_2 = -4;
+
+   /* ephemeris and acquisition assistance of visible SVs only  */
+   for (i=0; i < visible; i++) {
+      prn = 1 + rnd(SIRF_MAX_SVID_CNT);
+      eph = &req->eph_prms.sv_eph_prm[prn-1];
+      eph->eph_flag = 1;
+      eph->eph_data.sv_prn_num = prn;
+      eph->eph_data.iode = rnd(256);
+      eph->eph_data.c_rs = rnd_range(-3000, 3000);
+      eph->eph_data.delta_n = rnd_range(8000, 16000);
+      eph->eph_data.m0 = (int32_t)random();
+      eph->eph_data.c_uc = rnd_range(-4000, 4000);
+      eph->eph_data.eccentricity = rnd(0x1000000);
+      eph->eph_data.c_us = rnd_range(-4000, 8000);
+      eph->eph_data.a_sqrt = 0xa10d0000 + rnd(0x10000);
+      eph->eph_data.toe = 0x2a30;
+      eph->eph_data.c_ic = rnd_range(-200, 200);
+      eph->eph_data.omega_0 = (int32_t)random();
+      eph->eph_data.c_is = rnd_range(-200, 200);
+      eph->eph_data.i0 = 0x28000000 + rnd(0x1000000);
+      eph->eph_data.c_rc = rnd_range(4000, 10000);
+      eph->eph_data.omega = (int32_t)random();
+      eph->eph_data.omegadot = rnd_range(-24000, -20000);
+      eph->eph_data.idot = rnd_range(-300, 300);
+      eph->eph_data.toc = 0x2a30;
+      eph->eph_data.t_gd = rnd_range(-20, 20);
+      eph->eph_data.af1 = rnd_range(-20, 20);
+      eph->eph_data.af0 = rnd_range(-200000, 200000);
+
+      acq = &req->acq_info.acq_data[prn-1];
+      acq->acq_assist_valid_flag = 1;
+      acq->sv_prn_number = prn;
+      acq->doppler0 = rnd_range(-5000, 5000);
+      acq->doppler_uncertainty = 2;
+      acq->sv_code_phase = rnd(1023);
+      acq->sv_code_phase_int = rnd(20);
+      acq->gps_bit_num = rnd(4);
+      acq->code_phase_uncertainty = 16;
+      acq->azimuth = rnd(360);
+      acq->elevation = rnd(90);
+   }
+   req->acq_assist_flag = 1;
+   req->acq_info.reference_time = random();
+
+   /* almanac of the whole constellation  */
+   req->alm_data_flag = 1;
+   req->alm_data.alm_week_num = 0x3c5;
+   for (i=0; i < SIRF_MAX_SVID_CNT - 1; i++) {
+      alm = &req->alm_data.alm_params[i];
+      alm->alm_valid_flag = 1;
+      alm->alm_sv_prn_num = i + 1;
+      alm->alm_eccentricity = rnd(0x10000);
+      alm->alm_toa = 0x90;
+      alm->alm_delta_incl = rnd_range(-8000, 8000);
+      alm->alm_omegadot = rnd_range(-700, -600);
+      alm->alm_a_sqrt = 0xa10d00 + rnd(0x100);
+      alm->alm_omega_0 = rnd(0x1000000);
+      alm->alm_omega = rnd(0x1000000);
+      alm->alm_m0 = rnd(0x1000000);
+      alm->alm_af0 = rnd_range(-500, 500);
+      alm->alm_af1 = rnd_range(-5, 5);
+   }
+}
+
+static void gen_sf123(tSIRF_MSG_AI3_NAV_SF_123_RSP *sf, unsigned visible)
+{
+   unsigned i, j;
+
+   memset(sf, 0, sizeof(*sf));
+   for (i=0; i < visible && (i < SIRF_MSG_AI3_ANS123R_NUM_SF123); i++) {
+      sf->sf123[i].sf_123_flag = 1;
+      sf->sf123[i].sv_id = 1 + rnd(SIRF_MAX_SVID_CNT);
+      for (j=0; j < SIRF_MSG_AI3_ANS123R_NUM_BYTES_PER_SF123; j++)
+	 sf->sf123[i].sf123[j] = random();
+   }
+}
+
+static void gen_sf45(tSIRF_MSG_AI3_NAV_SF_45_RSP *sf)
+{
+   unsigned i, j;
+
+   memset(sf, 0, sizeof(*sf));
+   sf->sv_list = random();
+   /* pages with reserved and spare words filled with zeros  */
+   for (i=0; i < SIRF_MSG_AI3_ANS45R_NUM_SF45; i++) {
+      sf->sf45[i].frame_num = i + 1;
+      for (j=0; j < SIRF_MSG_AI3_ANS45R_NUM_BYTES_PER_SF45; j++)
+	 sf->sf45[i].SF45[j] = rnd(3) ? (uint8_t)random() : 0;
+      if (rnd(2))
+	 memset(&sf->sf45[i].SF45[20], 0, 40);
+   }
+}
+
+static int gen_payloads(struct bench_ctx_t *ctx)
+{
+   unsigned i;
+   tSIRF_UINT32 msg_id, msg_len, enc_len;
+   tSIRF_UINT8 buf[AI3_BUF_SIZE];
+   struct payload_t *p;
+   union {
+      tSIRF_MSG_AI3_REQ req;
+      tSIRF_MSG_AI3_NAV_SF_123_RSP sf123;
+      tSIRF_MSG_AI3_NAV_SF_45_RSP sf45;
+   } m;
+
+   ctx->msg = calloc(ctx->msg_cnt, sizeof(ctx->msg[0]));
+   if (ctx->msg == NULL) {
+      perror(NULL);
+      return -1;
+   }
+
+   for (i=0; i < ctx->msg_cnt; i++) {
+      switch (i % 3) {
+	 case 0:
+	    gen_req(&m.req, 6 + rnd(7));
+	    msg_id = SIRF_MSG_AI3_REQ;
+	    msg_len = sizeof(m.req);
+	    break;
+	 case 1:
+	    gen_sf123(&m.sf123, 6 + rnd(7));
+	    msg_id = SIRF_MSG_AI3_NAV_SF_123_RSP;
+	    msg_len = sizeof(m.sf123);
+	    break;
+	 default:
+	    gen_sf45(&m.sf45);
+	    msg_id = SIRF_MSG_AI3_NAV_SF_45_RSP;
+	    msg_len = sizeof(m.sf45);
+	    break;
+      }
+      enc_len = sizeof(buf);
+      if (SIRF_CODEC_AI3_Encode(msg_id, &m, msg_len, buf, &enc_len) != SIRF_SUCCESS) {
+	 fprintf(stderr, "Can not encode message 0x%x\n", (unsigned)msg_id);
+	 return -1;
+      }
+      p = &ctx->msg[i];
+      p->len = enc_len;
+      p->data = malloc(enc_len);
+      p->comp = malloc(AI3_BUF_SIZE);
+      if (p->data == NULL || (p->comp == NULL)) {
+	 perror(NULL);
+	 return -1;
+      }
+      memcpy(p->data, buf, enc_len);
+      p->comp_len = legacy_compress(p->data, p->comp, p->len);
+   }
+
+   return 0;
+}
+
+static void free_payloads(struct bench_ctx_t *ctx)
+{
+   unsigned i;
+
+   if (ctx->msg == NULL)
+      return;
+   for (i=0; i < ctx->msg_cnt; i++) {
+      free(ctx->msg[i].data);
+      free(ctx->msg[i].comp);
+   }
+   free(ctx->msg);
+}
+
+/* Random input of literal bytes, short and long runs  */
+static unsigned gen_fuzz_input(uint8_t *buf, unsigned size)
+{
+   unsigned len, l, alphabet;
+
+   len = 1 + rnd(size);
+   alphabet = 1 + rnd(rnd(2) ? 4 : 256);
+   for (l=0; l < len; ) {
+      unsigned n;
+      uint8_t b;
+
+      b = rnd(alphabet);
+      switch (rnd(4)) {
+	 case 0:
+	    n = 1 + rnd(8);
+	    break;
+	 case 1:
+	    n = 1 + rnd(40);
+	    break;
+	 case 2:
+	    n = 1 + rnd(rnd(16) ? 3 : 600);
+	    break;
+	 default:
+	    n = 1;
+	    break;
+      }
+      if (n > len - l)
+	 n = len - l;
+      if (rnd(2)) {
+	 memset(&buf[l], b, n);
+	 l += n;
+      }else {
+	 for (; n && (l < len); n--)
+	    buf[l++] = rnd(alphabet);
+      }
+   }
+
+   return len;
+}
+
+static int fuzz(struct bench_ctx_t *ctx)
+{
+   unsigned long i;
+   unsigned len, comp_len, j, out_max;
+   tSIRF_UINT16 l1, l2;
+   tSIRF_UINT32 n1, n2;
+   static uint8_t in[AI3_BUF_SIZE], c1[AI3_BUF_SIZE], c2[AI3_BUF_SIZE];
+   static uint8_t d1[AI3_BUF_SIZE], d2[AI3_BUF_SIZE];
+
+   for (i=0; i < ctx->fuzz_cnt; i++) {
+      len = gen_fuzz_input(in, SIRF_MSG_AI3_MAX_STRUCT_SIZE - 2);
+      l1 = legacy_compress(in, c1, len);
+      l2 = SIRF_PROTO_AI3_compressAI3Msg(in, c2, len);
+      if (l1 != l2 || memcmp(c1, c2, l1) != 0) {
+	 fprintf(stderr, "compress mismatch: iteration %lu, length %u\n", i, len);
+	 return -1;
+      }
+
+      n2 = SIRF_PROTO_AI3_decompressAI3Msg(c2, l2, d2, SIRF_MSG_AI3_MAX_STRUCT_SIZE);
+      if (n2 != len || memcmp(in, d2, len) != 0) {
+	 fprintf(stderr, "round trip mismatch: iteration %lu, length %u\n", i, len);
+	 return -1;
+      }
+
+      /* corrupted and truncated input, short output buffer  */
+      comp_len = l2;
+      for (j=rnd(4); j; j--)
+	 c2[rnd(comp_len)] = random();
+      if (rnd(4) == 0)
+	 comp_len = rnd(comp_len + 1);
+      out_max = rnd(4) ? SIRF_MSG_AI3_MAX_STRUCT_SIZE : rnd(len + 1);
+      n1 = legacy_decompress(c2, comp_len, d1, out_max);
+      n2 = SIRF_PROTO_AI3_decompressAI3Msg(c2, comp_len, d2, out_max);
+      if (n1 != n2 || memcmp(d1, d2, n1) != 0) {
+	 fprintf(stderr, "decompress mismatch: iteration %lu, length %u\n", i, comp_len);
+	 return -1;
+      }
+   }
+
+   return 0;
+}
+
+static void run_legacy_compress(struct bench_ctx_t *ctx)
+{
+   unsigned i;
+   uint8_t out[AI3_BUF_SIZE];
+
+   for (i=0; i < ctx->msg_cnt; i++) {
+      ctx->in_bytes += ctx->msg[i].len;
+      ctx->out_bytes += legacy_compress(ctx->msg[i].data, out, ctx->msg[i].len);
+   }
+}
+
+static void run_compress(struct bench_ctx_t *ctx)
+{
+   unsigned i;
+   uint8_t out[AI3_BUF_SIZE];
+
+   for (i=0; i < ctx->msg_cnt; i++) {
+      ctx->in_bytes += ctx->msg[i].len;
+      ctx->out_bytes += SIRF_PROTO_AI3_compressAI3Msg(ctx->msg[i].data, out, ctx->msg[i].len);
+   }
+}
+
+static void run_legacy_decompress(struct bench_ctx_t *ctx)
+{
+   unsigned i;
+   uint8_t out[AI3_BUF_SIZE];
+
+   for (i=0; i < ctx->msg_cnt; i++) {
+      ctx->in_bytes += ctx->msg[i].comp_len;
+      ctx->out_bytes += legacy_decompress(ctx->msg[i].comp, ctx->msg[i].comp_len,
+	    out, SIRF_MSG_AI3_MAX_STRUCT_SIZE);
+   }
+}
+
+static void run_decompress(struct bench_ctx_t *ctx)
+{
+   unsigned i;
+   uint8_t out[AI3_BUF_SIZE];
+
+   for (i=0; i < ctx->msg_cnt; i++) {
+      ctx->in_bytes += ctx->msg[i].comp_len;
+      ctx->out_bytes += SIRF_PROTO_AI3_decompressAI3Msg(ctx->msg[i].comp,
+	    ctx->msg[i].comp_len, out, SIRF_MSG_AI3_MAX_STRUCT_SIZE);
+   }
+}
+
+static uint64_t run_best(struct bench_ctx_t *ctx,
+      void (*f)(struct bench_ctx_t *ctx))
+{
+   unsigned i;
+   uint64_t t0, t, best;
+
+   best = UINT64_MAX;
+   for (i=0; i < ctx->runs; i++) {
+      ctx->in_bytes = ctx->out_bytes = 0;
+      t0 = clock_ns();
+      f(ctx);
+      t = clock_ns() - t0;
+      if (t < best)
+	 best = t;
+   }
+
+   return best;
+}
+
+/* MB/s of uncompressed data  */
+static void report(struct bench_ctx_t *ctx, const char *name, uint64_t ns,
+      unsigned long long raw_bytes)
+{
+   printf("%-20s %9.4f %10.1f %10.1f\n", name, ns / 1e9,
+	 ns / (double)(ctx->msg_cnt ? ctx->msg_cnt : 1),
+	 raw_bytes / (ns / 1e9) / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+   signed char c;
+   uint64_t legacy_ns, ns;
+   unsigned long long raw_bytes, comp_bytes;
+   struct bench_ctx_t ctx;
+
+   static struct option longopts[] = {
+      {"version",     no_argument,       0, 'v'},
+      {"help",        no_argument,       0, 'h'},
+      {"runs",        required_argument, 0, 'n'},
+      {"messages",    required_argument, 0, 'm'},
+      {"fuzz",        required_argument, 0, 'F'},
+      {"seed",        required_argument, 0, 'r'},
+      {0, 0, 0, 0}
+   };
+
+   memset(&ctx, 0, sizeof(ctx));
+   ctx.runs = 5;
+   ctx.msg_cnt = 3000;
+   ctx.fuzz_cnt = 100000;
+   ctx.seed = 1;
+
+   while ((c = getopt_long(argc, argv, "vh?n:m:F:r:",longopts,NULL)) != -1) {
+      switch (c) {
+	 case 'n':
+	    ctx.runs = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'm':
+	    ctx.msg_cnt = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'F':
+	    ctx.fuzz_cnt = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'r':
+	    ctx.seed = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'v':
+	    version();
+	    exit(0);
+	    break;
+	 default:
+	    help();
+	    exit(0);
+	    break;
+      }
+   }
+   argc -= optind;
+   argv += optind;
+
+   if (argc != 0 || (ctx.runs == 0) || (ctx.msg_cnt == 0)) {
+      help();
+      return 1;
+   }
+
+   srandom(ctx.seed);
+
+   if (fuzz(&ctx) < 0)
+      return 1;
+   printf("fuzz: %lu inputs, compress and decompress output identical\n",
+	 ctx.fuzz_cnt);
+
+   if (gen_payloads(&ctx) < 0) {
+      free_payloads(&ctx);
+      return 1;
+   }
+
+   legacy_ns = run_best(&ctx, run_legacy_compress);
+   raw_bytes = ctx.in_bytes;
+   comp_bytes = ctx.out_bytes;
+   printf("%u aiding messages, %llu bytes, compressed %llu bytes (%.1f%%)\n",
+	 ctx.msg_cnt, raw_bytes, comp_bytes,
+	 raw_bytes ? 100.0 * comp_bytes / raw_bytes : 0.0);
+   printf("%-20s %9s %10s %10s\n", "test", "time,s", "ns/msg", "MB/s");
+   report(&ctx, "compress legacy", legacy_ns, raw_bytes);
+   ns = run_best(&ctx, run_compress);
+   report(&ctx, "compress", ns, raw_bytes);
+   printf("compress speedup     %.2fx\n", ns ? (double)legacy_ns / ns : 0.0);
+
+   legacy_ns = run_best(&ctx, run_legacy_decompress);
+   report(&ctx, "decompress legacy", legacy_ns, raw_bytes);
+   ns = run_best(&ctx, run_decompress);
+   report(&ctx, "decompress", ns, raw_bytes);
+   printf("decompress speedup   %.2fx\n", ns ? (double)legacy_ns / ns : 0.0);
+
+   free_payloads(&ctx);
+
+   return 0;
+}
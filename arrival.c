@@ -0,0 +1,151 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _MSC_VER
+#include <io.h>
+#define ssize_t int
+#else
+#include <unistd.h>
+#endif
+
+#if !defined(WIN32)
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+#include "sirfdump.h"
+#include "stats.h"
+#include "arrival.h"
+
+#ifdef SO_TIMESTAMPNS
+static ssize_t recv_timestamped(struct arrival_t *a, int fd, void *buf,
+      size_t size, uint64_t *ns);
+#endif
+
+void arrival_init(struct arrival_t *a, int fd)
+{
+#ifdef SO_TIMESTAMPNS
+   int on;
+   struct stat st;
+#endif
+
+   assert(a);
+
+   memset(a, 0, sizeof(*a));
+   a->realtime_offset = stats_realtime_offset();
+
+#ifdef SO_TIMESTAMPNS
+   on = 1;
+   if (fstat(fd, &st) == 0 && S_ISSOCK(st.st_mode)
+	 && (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0))
+      a->use_cmsg = 1;
+#else
+   (void)fd;
+#endif
+}
+
+ssize_t arrival_read(struct arrival_t *a, int fd, void *buf, size_t size)
+{
+   ssize_t l;
+   uint64_t ns;
+   struct arrival_read_t *r;
+
+   assert(a);
+
+#ifdef SO_TIMESTAMPNS
+   if (a->use_cmsg)
+      l = recv_timestamped(a, fd, buf, size, &ns);
+   else
+#endif
+   {
+      l = read(fd, buf, size);
+      ns = stats_clock();
+   }
+   if (l <= 0)
+      return l;
+
+   a->total += l;
+   if (a->cnt == ARRIVAL_RING_SIZE) {
+      a->head = (a->head + 1) % ARRIVAL_RING_SIZE;
+      a->cnt--;
+   }
+   r = &a->r[(a->head + a->cnt) % ARRIVAL_RING_SIZE];
+   r->end = a->total;
+   r->ns = ns;
+   a->cnt++;
+
+   return l;
+}
+
+uint64_t arrival_time(struct arrival_t *a, uint64_t offset)
+{
+   unsigned i;
+   struct arrival_read_t *r;
+
+   assert(a);
+
+   if (a->cnt == 0)
+      return 0;
+
+   /* reads before offset will not be asked for again  */
+   while (a->cnt > 1 && (a->r[a->head].end <= offset)) {
+      a->head = (a->head + 1) % ARRIVAL_RING_SIZE;
+      a->cnt--;
+   }
+
+   for (i=0; i < a->cnt; i++) {
+      r = &a->r[(a->head + i) % ARRIVAL_RING_SIZE];
+      if (r->end > offset)
+	 return r->ns;
+   }
+
+   return r->ns;
+}
+
+#ifdef SO_TIMESTAMPNS
+/* Kernel receive time of the last segment read  */
+static ssize_t recv_timestamped(struct arrival_t *a, int fd, void *buf,
+      size_t size, uint64_t *ns)
+{
+   ssize_t l;
+   struct iovec iov;
+   struct msghdr msg;
+   struct cmsghdr *cmsg;
+   struct timespec ts;
+   union {
+      struct cmsghdr align;
+      char buf[CMSG_SPACE(sizeof(struct timespec))];
+   } control;
+
+   iov.iov_base = buf;
+   iov.iov_len = size;
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = control.buf;
+   msg.msg_controllen = sizeof(control.buf);
+
+   l = recvmsg(fd, &msg, 0);
+   *ns = stats_clock();
+   if (l <= 0)
+      return l;
+
+   for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET
+	    && (cmsg->cmsg_type == SCM_TIMESTAMPNS)) {
+	 memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+	 *ns = (uint64_t)((int64_t)((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec)
+	    - a->realtime_offset);
+	 break;
+      }
+   }
+
+   return l;
+}
+#endif
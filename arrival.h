@@ -0,0 +1,39 @@
+#ifndef ARRIVAL_H
+#define ARRIVAL_H
+
+#include <sys/types.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Arrival time of input bytes. Every read is recorded with its end
+ * offset in the stream; time of any byte still buffered can be looked
+ * up. Times are stats_clock() ns: kernel receive time for sockets with
+ * SO_TIMESTAMPNS, time read() returned for ttys, pipes and files  */
+
+#define ARRIVAL_RING_SIZE 256
+
+struct arrival_read_t {
+   /* stream offset after this read  */
+   uint64_t end;
+   uint64_t ns;
+};
+
+struct arrival_t {
+   struct arrival_read_t r[ARRIVAL_RING_SIZE];
+   unsigned head, cnt;
+   /* bytes read so far  */
+   uint64_t total;
+   unsigned use_cmsg;
+   /* system time minus stats_clock()  */
+   int64_t realtime_offset;
+};
+
+void arrival_init(struct arrival_t *a, int fd);
+/* read() recording arrival time  */
+ssize_t arrival_read(struct arrival_t *a, int fd, void *buf, size_t size);
+/* Arrival time of byte at stream offset. Offsets must not decrease
+ * between calls  */
+uint64_t arrival_time(struct arrival_t *a, uint64_t offset);
+
+#endif /* ARRIVAL_H */
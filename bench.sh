@@ -0,0 +1,116 @@
+#!/bin/sh
+#
+# Throughput of sirfdump output types, sirfsplitter and sirfzip on a
+# synthetic log.
+#
+# Environment:
+#   BENCH_DURATION  log duration, seconds, default: 3600
+#   BENCH_RATE      measurement rate, Hz, default: 5
+#   BENCH_CHANNELS  tracked channels, default: 12
+#   BENCH_RUNS      runs per test, best is reported, default: 3
+#   BENCH_GARBAGE   garbage ratio, default: 0.01
+#   BENCH_UDP       UDP destination of the latency test, default: 127.0.0.1:5999
+
+BENCH_DURATION=${BENCH_DURATION:-3600}
+BENCH_RATE=${BENCH_RATE:-5}
+BENCH_CHANNELS=${BENCH_CHANNELS:-12}
+BENCH_RUNS=${BENCH_RUNS:-3}
+BENCH_GARBAGE=${BENCH_GARBAGE:-0.01}
+BENCH_UDP=${BENCH_UDP:-127.0.0.1:5999}
+
+TMPDIR=$(mktemp -d "${TMPDIR:-/tmp}/sirfbench.XXXXXX") || exit 1
+trap 'rm -rf "$TMPDIR"' EXIT INT TERM
+
+LOG="$TMPDIR/bench.srf"
+
+./sirfgen -d "$BENCH_DURATION" -r "$BENCH_RATE" -c "$BENCH_CHANNELS" \
+   -g "$BENCH_GARBAGE" > "$LOG" 2> "$TMPDIR/gen.out" || exit 1
+PACKETS=$(awk '{print $1}' "$TMPDIR/gen.out")
+BYTES=$(wc -c < "$LOG")
+
+now_ns()
+{
+   date +%s%N
+}
+
+# best wall time of BENCH_RUNS runs, ns
+run_best()
+{
+   best=""
+   i=0
+   while [ $i -lt "$BENCH_RUNS" ]; do
+      t0=$(now_ns)
+      "$@" > /dev/null 2>&1 || return 1
+      t1=$(now_ns)
+      t=$((t1 - t0))
+      if [ -z "$best" ] || [ $t -lt $best ]; then
+	 best=$t
+      fi
+      i=$((i + 1))
+   done
+   echo $best
+}
+
+report()
+{
+   awk -v name="$1" -v ns="$2" -v bytes="$BYTES" -v pkts="$PACKETS" 'BEGIN {
+      s = ns / 1e9;
+      printf("%-14s %9.3f %10.1f %12.0f\n", name, s, bytes / s / 1e6, pkts / s);
+   }'
+}
+
+echo "log: $BENCH_DURATION s, $BENCH_RATE Hz, $BENCH_CHANNELS channels, $PACKETS packets, $BYTES bytes"
+printf "%-14s %9s %10s %12s\n" "test" "time,s" "MB/s" "packets/s"
+
+for o in dump nmea rinex rinex3 rinex-nav rtcm; do
+   ns=$(cd "$TMPDIR" && run_best "$OLDPWD/sirfdump" -f "$LOG" -o $o) || exit 1
+   report "$o" "$ns"
+   case $o in
+      rinex) rinex2_ns=$ns ;;
+      rinex3) rinex3_ns=$ns ;;
+   esac
+done
+awk -v r2="$rinex2_ns" -v r3="$rinex3_ns" 'BEGIN {
+   printf("rinex3 / rinex time: %.2f\n", r3 / r2);
+}'
+
+mkdir "$TMPDIR/split"
+ns=$(run_best ./sirfsplitter -f "$LOG" -d "$TMPDIR/split") || exit 1
+report "sirfsplitter" "$ns"
+
+echo
+echo "sirfzip ssb stream compression:"
+./sirfzip -s -f "$LOG" -F "$TMPDIR/bench.srfz" 2>&1 | head -n 1
+./sirfzip -d -s -f "$TMPDIR/bench.srfz" 2>&1 > /dev/null | head -n 1
+
+echo
+echo "nmea encoder, legacy per-sentence loop vs batch:"
+./nmeabench -n "$BENCH_RUNS" "$LOG" | tail -n +2
+
+echo
+echo "ai3 run length compression, byte at a time vs run search:"
+./ai3bench -n "$BENCH_RUNS" || exit 1
+
+echo
+echo "orbit engine, 32 satellites at 10 Hz for a day:"
+./orbitbench || exit 1
+
+echo
+echo "subframe parity and decoding:"
+./subframebench -n "$BENCH_RUNS" || exit 1
+
+echo
+echo "SiRF protocol parser, former vs reentrant:"
+./parsebench -n "$BENCH_RUNS" "$LOG" || exit 1
+
+echo
+echo "GPS time to calendar, gmtime() vs table-driven:"
+./gpstimebench -n "$BENCH_RUNS" -w 2100:2200 || exit 1
+
+# UDP output latency, where supported
+if ./sirfdump -h | grep -q -- --udp; then
+   echo
+   echo "udp rtcm, MID 7 arrival to datagram sent:"
+   ./sirfdump -f "$LOG" -o rtcm -U "$BENCH_UDP" -s 2>&1 > /dev/null \
+      | awk '$1 == "stage" || $1 == "send"'
+fi
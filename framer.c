@@ -0,0 +1,293 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#define ssize_t int
+#endif
+
+#include "sirfdump.h"
+#include "stats.h"
+#include "arrival.h"
+#include "framer.h"
+#ifdef HAVE_EPOLL
+#include "tcpsrv.h"
+#endif
+#ifdef HAVE_SENDMMSG
+#include "udpout.h"
+#endif
+
+/* Longer lines between SSB frames are garbage  */
+#define NMEA_MAX_LENGTH 1024
+
+#define FNV1A_PRIME 0x100000001b3ULL
+
+static int read_data(struct input_stream_t *stream);
+static void skip_bytes(struct input_stream_t *stream, unsigned n,
+      unsigned *garbage_bytes);
+static unsigned skip_garbage(struct input_stream_t *stream,
+      unsigned *garbage_bytes);
+static int nmea_sentence_length(struct input_stream_t *stream);
+
+void input_stream_init(struct input_stream_t *stream)
+{
+   assert(stream);
+
+   stream->fd = -1;
+   stream->head = stream->tail = 0;
+   stream->last_errno = 0;
+   stream->nmea_f = NULL;
+   stream->garbage_f = NULL;
+   stream->base = 0;
+   stream->hashing = 0;
+   stream->hash_pos = 0;
+   stream->hash = FNV1A_INIT;
+#ifdef HAVE_EPOLL
+   stream->srv = NULL;
+#endif
+#ifdef HAVE_SENDMMSG
+   stream->udp = NULL;
+#endif
+}
+
+uint64_t fnv1a(uint64_t h, const uint8_t *p, size_t n)
+{
+   while (n--) {
+      h ^= *p++;
+      h *= FNV1A_PRIME;
+   }
+   return h;
+}
+
+void input_hash_update(struct input_stream_t *stream)
+{
+   if (stream->hashing)
+      stream->hash = fnv1a(stream->hash, &stream->buf[stream->hash_pos],
+	    stream->head - stream->hash_pos);
+   stream->hash_pos = stream->head;
+}
+
+uint64_t input_offset(const struct input_stream_t *stream)
+{
+   return stream->base + stream->arrival.total - (stream->tail - stream->head);
+}
+
+static int read_data(struct input_stream_t *stream)
+{
+   ssize_t l;
+   uint64_t t0;
+
+   assert(
+      !(stream->tail == sizeof(stream->buf)
+	 && (stream->head == sizeof(stream->buf)))
+      );
+
+   if (stream->tail == sizeof(stream->buf)) {
+      input_hash_update(stream);
+      memmove(stream->buf, &stream->buf[stream->head],
+	    stream->tail - stream->head);
+      stream->tail = stream->tail - stream->head;
+      stream->head=0;
+      stream->hash_pos=0;
+   }
+
+#ifdef HAVE_EPOLL
+   if (stream->srv && (tcpsrv_wait_input(stream->srv, stream->fd) < 0)) {
+      stream->last_errno = errno;
+      return -1;
+   }
+#endif
+#ifdef HAVE_SENDMMSG
+   if (stream->udp)
+      udpout_flush_if_idle(stream->udp, stream->fd);
+#endif
+
+   t0 = stats_ctx ? stats_clock() : 0;
+   l = arrival_read(&stream->arrival, stream->fd,
+	 &stream->buf[stream->tail], sizeof(stream->buf) - stream->tail);
+   if (stats_ctx)
+      stats_ctx->io_ns += stats_clock() - t0;
+   if (l<0)
+      stream->last_errno = errno;
+   else
+      stream->tail = stream->tail+l;
+
+   return l;
+}
+
+static void skip_bytes(struct input_stream_t *stream, unsigned n,
+      unsigned *garbage_bytes)
+{
+   if (n == 0)
+      return;
+   if (stream->garbage_f)
+      fwrite(&stream->buf[stream->head], 1, n, stream->garbage_f);
+   stream->head += n;
+   *garbage_bytes += n;
+}
+
+/*
+ * Skip garbage up to the next SSB start sequence, or up to the next NMEA
+ * sentence if NMEA is passed through. Returns 1 if found at stream->head,
+ * 0 if more data is needed.
+ */
+static unsigned skip_garbage(struct input_stream_t *stream,
+      unsigned *garbage_bytes)
+{
+   uint8_t *p, *end, *nmea;
+
+   p = &stream->buf[stream->head];
+   end = &stream->buf[stream->tail];
+   nmea = stream->nmea_f ? memchr(p, '$', end - p) : NULL;
+   if (nmea)
+      end = nmea;
+
+   for (;;) {
+      p = memchr(p, 0xa0, end - p);
+      if (p == NULL || (p+1 == &stream->buf[stream->tail]))
+	 break;
+      if (p[1] == 0xa2) {
+	 skip_bytes(stream, p - &stream->buf[stream->head], garbage_bytes);
+	 return 1;
+      }
+      p++;
+   }
+
+   if (nmea) {
+      skip_bytes(stream, nmea - &stream->buf[stream->head], garbage_bytes);
+      return 1;
+   }
+
+   /* last byte can be the start of a sequence  */
+   skip_bytes(stream, stream->tail - 1 - stream->head, garbage_bytes);
+   return 0;
+}
+
+/*
+ * Length of NMEA sentence at stream->head including line end. 0 if
+ * incomplete, -1 if not a sentence
+ */
+static int nmea_sentence_length(struct input_stream_t *stream)
+{
+   unsigned i, n, avail;
+   const uint8_t *p, *lf;
+
+   p = &stream->buf[stream->head];
+   avail = stream->tail - stream->head;
+   if (avail > NMEA_MAX_LENGTH)
+      avail = NMEA_MAX_LENGTH;
+
+   lf = memchr(p, '\n', avail);
+   n = lf ? lf - p : avail;
+   /* \r of the line end, received or not  */
+   if (n > 1 && (p[n-1] == '\r'))
+      n--;
+   for (i=1; i < n; i++) {
+      if (p[i] < 0x20 || (p[i] > 0x7e) || (p[i] == '$'))
+	 return -1;
+   }
+
+   if (lf == NULL)
+      return avail == NMEA_MAX_LENGTH ? -1 : 0;
+
+   return lf - p + 1;
+}
+
+void *readpkt(struct input_stream_t *stream, struct transport_msg_t *res_msg)
+{
+   int nmea_len;
+   unsigned payload_length;
+   unsigned checksum;
+   unsigned garbage_bytes;
+   unsigned p0;
+   ssize_t l;
+   uint8_t *res;
+   uint64_t offset;
+
+   garbage_bytes = 0;
+   payload_length=0;
+
+   for (;;) {
+      while (stream->tail - stream->head < 8) {
+	 l = read_data(stream);
+	 if (l <= 0)
+	    return NULL;
+      }
+
+      /* search for start sequence  */
+      if (!skip_garbage(stream, &garbage_bytes))
+	 continue;
+
+      if (stream->buf[stream->head] == '$') {
+	 nmea_len = nmea_sentence_length(stream);
+	 if (nmea_len > 0) {
+	    fwrite(&stream->buf[stream->head], 1, nmea_len, stream->nmea_f);
+	    stream->head += nmea_len;
+	 }else if (nmea_len < 0) {
+	    skip_bytes(stream, 1, &garbage_bytes);
+	 }else {
+	    l = read_data(stream);
+	    if (l <= 0)
+	       return NULL;
+	 }
+	 continue;
+      }
+
+      while (stream->tail - stream->head < 6) {
+	 l = read_data(stream);
+	 if (l <= 0)
+	    return NULL;
+      }
+
+      /* get payload length  */
+      payload_length = (0xff00 & (stream->buf[stream->head+2] << 8))
+	 | (0xff & stream->buf[stream->head+3]);
+      if (payload_length >= 1023) {
+	 skip_bytes(stream, 1, &garbage_bytes);
+	 continue;
+      }
+
+      /* load payload data */
+      p0 = 2+2+payload_length;
+      while (stream->tail - stream->head < p0+2+2) {
+	 l = read_data(stream);
+	 if (l <= 0)
+	    return NULL;
+      }
+
+      /* checksum  */
+      checksum = (0xff00 & (stream->buf[stream->head+p0] << 8))
+	 | (0xff & stream->buf[stream->head+p0+1]);
+
+      /* end sequence  */
+      if (stream->buf[stream->head+p0+2] != 0xb0
+	    || (stream->buf[stream->head+p0+3] != 0xb3)) {
+	 skip_bytes(stream, 1, &garbage_bytes);
+	 continue;
+      }
+      break;
+   } /* for(;;)  */
+
+   res = &stream->buf[stream->head];
+   /* stream offset of the frame  */
+   offset = stream->arrival.total - (stream->tail - stream->head);
+   stream->head = stream->head + 2+2+payload_length+2+2;
+   if (stream->head == stream->tail) {
+      input_hash_update(stream);
+      stream->head = stream->tail = 0;
+      stream->hash_pos = 0;
+   }
+
+   if (res_msg) {
+      res_msg->payload = &res[4];
+      res_msg->payload_length = payload_length;
+      res_msg->checksum = checksum;
+      res_msg->skipped_bytes = garbage_bytes;
+      res_msg->first_byte_ns = arrival_time(&stream->arrival, offset);
+      res_msg->last_byte_ns = arrival_time(&stream->arrival,
+	    offset + 2+2+payload_length+2+2 - 1);
+   }
+
+   return res;
+}
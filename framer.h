@@ -0,0 +1,55 @@
+#ifndef FRAMER_H
+#define FRAMER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sirfdump.h"
+#include "arrival.h"
+
+/* SSB framer: frames of the input stream, NMEA sentences between them
+ * are passed through or skipped as garbage  */
+
+#define FNV1A_INIT 0xcbf29ce484222325ULL
+
+struct tcpsrv_t;
+struct udpout_t;
+
+struct input_stream_t {
+   int fd;
+   uint8_t buf[16384];
+   unsigned head, tail;
+   int last_errno;
+   struct arrival_t arrival;
+   /* NMEA sentences between SSB frames, skipped as garbage if NULL  */
+   FILE *nmea_f;
+   /* bytes neither SSB nor NMEA  */
+   FILE *garbage_f;
+   /* input offset of the first byte read, --resume  */
+   uint64_t base;
+   /* hash of consumed input up to buf[hash_pos], if hashing  */
+   unsigned hashing;
+   unsigned hash_pos;
+   uint64_t hash;
+#ifdef HAVE_EPOLL
+   /* served while waiting for input  */
+   struct tcpsrv_t *srv;
+#endif
+#ifdef HAVE_SENDMMSG
+   /* flushed when input is idle  */
+   struct udpout_t *udp;
+#endif
+};
+
+void input_stream_init(struct input_stream_t *stream);
+/* Next SSB frame, NULL at end of input or on error (last_errno)  */
+void *readpkt(struct input_stream_t *stream, struct transport_msg_t *res_msg);
+
+/* FNV-1a hash of p continued from h  */
+uint64_t fnv1a(uint64_t h, const uint8_t *p, size_t n);
+/* Hash bytes consumed since the last call, before they leave the buffer  */
+void input_hash_update(struct input_stream_t *stream);
+/* Input offset of the next frame  */
+uint64_t input_offset(const struct input_stream_t *stream);
+
+#endif /* FRAMER_H */
@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# Runs every sirffuzz target on a seed corpus from synthetic logs, both
+# byte orders, and reports execs/s. An input failing a target is kept as
+# crash-<target> in the current directory, its report is printed.
+#
+# Environment:
+#   FUZZ_DURATION   seconds per target, default: 60
+#   FUZZ_TARGETS    default: framer ssb ascii nmea rinex rinex3 rinex-nav rtcm
+#   FUZZ_SEED       random seed, default: 1
+#   FUZZ_CORPUS     corpus directory, one directory per target, kept;
+#                   default: a temporary one
+
+FUZZ_DURATION=${FUZZ_DURATION:-60}
+FUZZ_TARGETS=${FUZZ_TARGETS:-"framer ssb ascii nmea rinex rinex3 rinex-nav rtcm"}
+FUZZ_SEED=${FUZZ_SEED:-1}
+
+TMPDIR=$(mktemp -d "${TMPDIR:-/tmp}/sirffuzz.XXXXXX") || exit 1
+trap 'rm -rf "$TMPDIR"' EXIT INT TERM
+
+CORPUS=${FUZZ_CORPUS:-"$TMPDIR/corpus"}
+
+# short logs: 16 kB stream seeds hold a few epochs and subframes
+./sirfgen -d 300 -c 8 -g 0.01 -S "$FUZZ_SEED" \
+   > "$TMPDIR/seed.srf" 2> /dev/null || exit 1
+./sirfgen -d 120 -c 12 -r 5 -2 -S "$FUZZ_SEED" \
+   > "$TMPDIR/seed2.srf" 2> /dev/null || exit 1
+
+echo "$FUZZ_DURATION s per target, seed $FUZZ_SEED"
+printf "%-10s %12s %7s %10s\n" "target" "execs" "time,s" "execs/s"
+
+errors=0
+for t in $FUZZ_TARGETS; do
+   if [ ! -d "$CORPUS/$t" ]; then
+      mkdir -p "$CORPUS/$t" || exit 1
+      for log in "$TMPDIR/seed.srf" "$TMPDIR/seed2.srf"; do
+	 ./sirffuzz -t "$t" -s "$CORPUS/$t" < "$log" > /dev/null || exit 1
+      done
+   fi
+   if ./sirffuzz -q -t "$t" -d "$FUZZ_DURATION" -S "$FUZZ_SEED" "$CORPUS/$t" \
+	 > "$TMPDIR/$t.out" 2> "$TMPDIR/$t.err"; then
+      tail -n 1 "$TMPDIR/$t.out" | awk '{ printf("%-10s %12s %7s %10s\n", $1, $2, $4, $6) }'
+   else
+      echo "$t: failed, input: crash-$t"
+      cat "$TMPDIR/$t.err"
+      errors=$((errors + 1))
+   fi
+done
+
+[ $errors -eq 0 ]
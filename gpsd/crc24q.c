@@ -178,6 +178,20 @@ unsigned crc24q_hashv(struct crc24_iovec *iov, int iovcnt)
     return crc;
 }
 
+/* continue crc24q_hash() of preceding data  */
+unsigned crc24q_update(unsigned crc, unsigned char *data, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++) {
+	crc = (crc << 8) ^ crc24q[data[i] ^ (unsigned char)(crc >> 16)];
+    }
+
+    crc = (crc & 0x00ffffff);
+
+    return crc;
+}
+
 #define LO(x)	(unsigned char)((x) & 0xff)
 #define MID(x)	(unsigned char)(((x) >> 8) & 0xff)
 #define HI(x)	(unsigned char)(((x) >> 16) & 0xff)
@@ -18,4 +18,6 @@ extern unsigned crc24q_check(unsigned char *data, int len);
 extern unsigned crc24q_hash(unsigned char *data, int len);
 
 extern unsigned crc24q_hashv(struct crc24_iovec *iov, int iovcnt);
+
+extern unsigned crc24q_update(unsigned crc, unsigned char *data, int len);
 #endif /* _CRC24Q_H_ */
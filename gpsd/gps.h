@@ -345,6 +345,14 @@ unsigned gpsd_interpret_subframe_raw(struct subframe_t *subp,
       unsigned int tSVID, uint32_t words[]);
 
 unsigned int isgps_parity(isgps30bits_t th);
+void isgps_parity_batch(const isgps30bits_t *th, uint8_t *p, unsigned cnt);
+
+/* subframes checked per pass of the batch functions */
+#define SUBFRAME_BATCH_MAX 64
+unsigned gpsd_check_subframes_raw(uint32_t words[][10], unsigned cnt,
+      uint8_t valid[]);
+unsigned gpsd_interpret_subframes_raw(struct subframe_t *subp,
+      const unsigned int tSVID[], uint32_t words[][10], unsigned cnt);
 
 #ifdef __cplusplus
 }  /* End of the 'extern "C"' block */
@@ -67,25 +67,6 @@ BSD terms apply: see the file COPYING in the distribution root for details.
 #define W_DATA_MASK	0x3fffffc0u
 
 /*@ +charint @*/
-static unsigned char parity_array[] = {
-    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0
-};
-
 static unsigned int reverse_bits[] = {
     0, 32, 16, 48, 8, 40, 24, 56, 4, 36, 20, 52, 12, 44, 28, 60,
     2, 34, 18, 50, 10, 42, 26, 58, 6, 38, 22, 54, 14, 46, 30, 62,
@@ -95,17 +76,100 @@ static unsigned int reverse_bits[] = {
 
 /*@ -charint @*/
 
-unsigned int isgps_parity(isgps30bits_t th)
-{
-#define P_30_MASK	0x40000000u
-
 #define	PARITY_25	0xbb1f3480u
 #define	PARITY_26	0x5d8f9a40u
 #define	PARITY_27	0xaec7cd00u
 #define	PARITY_28	0x5763e680u
 #define	PARITY_29	0x6bb1f340u
 #define	PARITY_30	0x8b7a89c0u
-    isgps30bits_t t;
+
+/*
+ * Parity is linear over GF(2): parity bits D25-D30 of a word are the XOR
+ * of the parity bits of its four bytes taken separately.
+ * parity_bytes[i][b] holds D25-D30 (masks PARITY_25 - PARITY_30 above)
+ * for byte b at bit position 8*i.
+ */
+static const unsigned char parity_bytes[4][256] = {
+    {
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19,
+    19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19,
+    19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19,
+    19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19,
+    37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37,
+    37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37,
+    37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37,
+    37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37,
+    54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54,
+    54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54, 54
+    },
+    {
+     0, 11, 22, 29, 44, 39, 58, 49, 25, 18, 15,  4, 53, 62, 35, 40,
+    50, 57, 36, 47, 30, 21,  8,  3, 43, 32, 61, 54,  7, 12, 17, 26,
+    38, 45, 48, 59, 10,  1, 28, 23, 63, 52, 41, 34, 19, 24,  5, 14,
+    20, 31,  2,  9, 56, 51, 46, 37, 13,  6, 27, 16, 33, 42, 55, 60,
+    14,  5, 24, 19, 34, 41, 52, 63, 23, 28,  1, 10, 59, 48, 45, 38,
+    60, 55, 42, 33, 16, 27,  6, 13, 37, 46, 51, 56,  9,  2, 31, 20,
+    40, 35, 62, 53,  4, 15, 18, 25, 49, 58, 39, 44, 29, 22, 11,  0,
+    26, 17, 12,  7, 54, 61, 32, 43,  3,  8, 21, 30, 47, 36, 57, 50,
+    31, 20,  9,  2, 51, 56, 37, 46,  6, 13, 16, 27, 42, 33, 60, 55,
+    45, 38, 59, 48,  1, 10, 23, 28, 52, 63, 34, 41, 24, 19, 14,  5,
+    57, 50, 47, 36, 21, 30,  3,  8, 32, 43, 54, 61, 12,  7, 26, 17,
+    11,  0, 29, 22, 39, 44, 49, 58, 18, 25,  4, 15, 62, 53, 40, 35,
+    17, 26,  7, 12, 61, 54, 43, 32,  8,  3, 30, 21, 36, 47, 50, 57,
+    35, 40, 53, 62, 15,  4, 25, 18, 58, 49, 44, 39, 22, 29,  0, 11,
+    55, 60, 33, 42, 27, 16, 13,  6, 46, 37, 56, 51,  2,  9, 20, 31,
+     5, 14, 19, 24, 41, 34, 63, 52, 28, 23, 10,  1, 48, 59, 38, 45
+    },
+    {
+     0, 62, 61,  3, 56,  6,  5, 59, 49, 15, 12, 50,  9, 55, 52, 10,
+    35, 29, 30, 32, 27, 37, 38, 24, 18, 44, 47, 17, 42, 20, 23, 41,
+     7, 57, 58,  4, 63,  1,  2, 60, 54,  8, 11, 53, 14, 48, 51, 13,
+    36, 26, 25, 39, 28, 34, 33, 31, 21, 43, 40, 22, 45, 19, 16, 46,
+    13, 51, 48, 14, 53, 11,  8, 54, 60,  2,  1, 63,  4, 58, 57,  7,
+    46, 16, 19, 45, 22, 40, 43, 21, 31, 33, 34, 28, 39, 25, 26, 36,
+    10, 52, 55,  9, 50, 12, 15, 49, 59,  5,  6, 56,  3, 61, 62,  0,
+    41, 23, 20, 42, 17, 47, 44, 18, 24, 38, 37, 27, 32, 30, 29, 35,
+    26, 36, 39, 25, 34, 28, 31, 33, 43, 21, 22, 40, 19, 45, 46, 16,
+    57,  7,  4, 58,  1, 63, 60,  2,  8, 54, 53, 11, 48, 14, 13, 51,
+    29, 35, 32, 30, 37, 27, 24, 38, 44, 18, 17, 47, 20, 42, 41, 23,
+    62,  0,  3, 61,  6, 56, 59,  5, 15, 49, 50, 12, 55,  9, 10, 52,
+    23, 41, 42, 20, 47, 17, 18, 44, 38, 24, 27, 37, 30, 32, 35, 29,
+    52, 10,  9, 55, 12, 50, 49, 15,  5, 59, 56,  6, 61,  3,  0, 62,
+    16, 46, 45, 19, 40, 22, 21, 43, 33, 31, 28, 34, 25, 39, 36, 26,
+    51, 13, 14, 48, 11, 53, 54,  8,  2, 60, 63,  1, 58,  4,  7, 57
+    },
+    {
+     0, 55, 47, 24, 28, 43, 51,  4, 59, 12, 20, 35, 39, 16,  8, 63,
+    52,  3, 27, 44, 40, 31,  7, 48, 15, 56, 32, 23, 19, 36, 60, 11,
+    42, 29,  5, 50, 54,  1, 25, 46, 17, 38, 62,  9, 13, 58, 34, 21,
+    30, 41, 49,  6,  2, 53, 45, 26, 37, 18, 10, 61, 57, 14, 22, 33,
+    22, 33, 57, 14, 10, 61, 37, 18, 45, 26,  2, 53, 49,  6, 30, 41,
+    34, 21, 13, 58, 62,  9, 17, 38, 25, 46, 54,  1,  5, 50, 42, 29,
+    60, 11, 19, 36, 32, 23, 15, 56,  7, 48, 40, 31, 27, 44, 52,  3,
+     8, 63, 39, 16, 20, 35, 59, 12, 51,  4, 28, 43, 47, 24,  0, 55,
+    41, 30,  6, 49, 53,  2, 26, 45, 18, 37, 61, 10, 14, 57, 33, 22,
+    29, 42, 50,  5,  1, 54, 46, 25, 38, 17,  9, 62, 58, 13, 21, 34,
+     3, 52, 44, 27, 31, 40, 48,  7, 56, 15, 23, 32, 36, 19, 11, 60,
+    55,  0, 24, 47, 43, 28,  4, 51, 12, 59, 35, 20, 16, 39, 63,  8,
+    63,  8, 16, 39, 35, 20, 12, 59,  4, 51, 43, 28, 24, 47, 55,  0,
+    11, 60, 36, 19, 23, 32, 56, 15, 48,  7, 31, 40, 44, 27,  3, 52,
+    21, 34, 58, 13,  9, 62, 38, 17, 46, 25,  1, 54, 50,  5, 29, 42,
+    33, 22, 14, 57, 61, 10, 18, 37, 26, 45, 53,  2,  6, 49, 41, 30
+    }
+};
+
+#define ISGPS_PARITY(th) \
+    (parity_bytes[0][(th) & 0xff] ^ parity_bytes[1][((th) >> 8) & 0xff] ^ \
+     parity_bytes[2][((th) >> 16) & 0xff] ^ parity_bytes[3][((th) >> 24) & 0xff])
+
+unsigned int isgps_parity(isgps30bits_t th)
+{
     unsigned int p;
 
     /*
@@ -113,34 +177,21 @@ unsigned int isgps_parity(isgps30bits_t th)
      * th ^= W_DATA_MASK;
      */
 
-    /*@ +charint @*/
-    t = th & PARITY_25;
-    p = parity_array[t & 0xff] ^ parity_array[(t >> 8) & 0xff] ^
-	parity_array[(t >> 16) & 0xff] ^ parity_array[(t >> 24) & 0xff];
-    t = th & PARITY_26;
-    p = (p << 1) | (parity_array[t & 0xff] ^ parity_array[(t >> 8) & 0xff] ^
-		    parity_array[(t >> 16) & 0xff] ^ parity_array[(t >> 24) &
-								  0xff]);
-    t = th & PARITY_27;
-    p = (p << 1) | (parity_array[t & 0xff] ^ parity_array[(t >> 8) & 0xff] ^
-		    parity_array[(t >> 16) & 0xff] ^ parity_array[(t >> 24) &
-								  0xff]);
-    t = th & PARITY_28;
-    p = (p << 1) | (parity_array[t & 0xff] ^ parity_array[(t >> 8) & 0xff] ^
-		    parity_array[(t >> 16) & 0xff] ^ parity_array[(t >> 24) &
-								  0xff]);
-    t = th & PARITY_29;
-    p = (p << 1) | (parity_array[t & 0xff] ^ parity_array[(t >> 8) & 0xff] ^
-		    parity_array[(t >> 16) & 0xff] ^ parity_array[(t >> 24) &
-								  0xff]);
-    t = th & PARITY_30;
-    p = (p << 1) | (parity_array[t & 0xff] ^ parity_array[(t >> 8) & 0xff] ^
-		    parity_array[(t >> 16) & 0xff] ^ parity_array[(t >> 24) &
-								  0xff]);
-    /*@ -charint @*/
+    p = ISGPS_PARITY(th);
 
     gpsd_report(ISGPS_ERRLEVEL_BASE + 2, "ISGPS parity %u\n", p);
     return (p);
 }
 
+/*
+ * Parity of cnt words, no per-word logging.
+ */
+void isgps_parity_batch(const isgps30bits_t *th, uint8_t *p, unsigned cnt)
+{
+    unsigned i;
+
+    for (i = 0; i < cnt; i++)
+	p[i] = (uint8_t)ISGPS_PARITY(th[i]);
+}
+
 /*@ +usereleased +compdef @*/
@@ -4,6 +4,7 @@
  * BSD terms apply: see the file COPYING in the distribution root for details.
  */
 #include <math.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdarg.h>
 
@@ -16,20 +17,95 @@
 #define VERBOSITY 0
 #endif
 
+/* do not evaluate arguments of messages that will not be printed */
+#define REPORT_ON(level) ((level) <= VERBOSITY)
+
 static unsigned gpsd_interpret_subframe(struct subframe_t *subp,
 			     unsigned int tSVID, uint32_t words[]);
 static void subframe_almanac(uint8_t tSVID, uint32_t words[],
 			     uint8_t subframe, uint8_t sv,
 			     uint8_t data_id,
 			     /*@out@*/struct almanac_t *almp);
+static void subframe_ephemeris(struct subframe_t *subp, const uint32_t words[]);
+
+/*
+ * Ephemeris fields of subframes 1-3, IS-GPS-200 Table 20-I and 20-III.
+ * A field is hi_len bits of word hi_word ending at bit hi_shift,
+ * followed by lo_len bits of word lo_word ending at bit lo_shift.
+ */
+enum eph_type_t { ET_U8, ET_S8, ET_U16, ET_S16, ET_U32, ET_S32, ET_UINT };
+
+struct eph_field_t {
+    uint8_t subframe;
+    uint8_t hi_word, hi_shift, hi_len;
+    uint8_t lo_word, lo_shift, lo_len;
+    uint8_t is_signed;
+    uint8_t type;
+    uint16_t offset;
+    /* scaled value: offset of double, scale, semi-circles to radians */
+    int16_t d_offset;
+    double scale;
+    uint8_t semicircle;
+};
+
+#define EPH_RAW(sf, f) offsetof(struct subframe_t, sf.f)
+#define EPH_D(sf, f) (int16_t)offsetof(struct subframe_t, sf.f)
+#define EPH_NONE -1
+
+/* exact powers of 2 */
+#define P2_5  (1.0/32.0)
+#define P2_19 (1.0/524288.0)
+#define P2_29 (1.0/536870912.0)
+#define P2_31 (1.0/2147483648.0)
+#define P2_33 (1.0/8589934592.0)
+#define P2_43 (1.0/8796093022208.0)
+#define P2_55 (1.0/36028797018963968.0)
+
+static const struct eph_field_t eph_fields[] = {
+    /* subframe 1 */
+    {1, 2, 14, 10, 0, 0, 0,  0, ET_U16, EPH_RAW(sub1, WN), EPH_NONE, 0.0, 0},
+    {1, 2, 12, 2,  0, 0, 0,  0, ET_U8,  EPH_RAW(sub1, l2), EPH_NONE, 0.0, 0},
+    {1, 2, 8,  4,  0, 0, 0,  0, ET_UINT, EPH_RAW(sub1, ura), EPH_NONE, 0.0, 0},
+    {1, 2, 2,  6,  0, 0, 0,  0, ET_UINT, EPH_RAW(sub1, hlth), EPH_NONE, 0.0, 0},
+    {1, 2, 0,  2,  7, 16, 8, 0, ET_U16, EPH_RAW(sub1, IODC), EPH_NONE, 0.0, 0},
+    {1, 3, 23, 1,  0, 0, 0,  0, ET_U8,  EPH_RAW(sub1, l2p), EPH_NONE, 0.0, 0},
+    {1, 6, 0,  8,  0, 0, 0,  1, ET_S8,  EPH_RAW(sub1, Tgd), EPH_D(sub1, d_Tgd), P2_31, 0},
+    {1, 7, 0,  16, 0, 0, 0,  0, ET_U16, EPH_RAW(sub1, toc), EPH_NONE, 0.0, 0},
+    {1, 8, 16, 8,  0, 0, 0,  1, ET_S8,  EPH_RAW(sub1, af2), EPH_D(sub1, d_af2), P2_55, 0},
+    {1, 8, 0,  16, 0, 0, 0,  1, ET_S16, EPH_RAW(sub1, af1), EPH_D(sub1, d_af1), P2_43, 0},
+    {1, 9, 2,  22, 0, 0, 0,  1, ET_S32, EPH_RAW(sub1, af0), EPH_D(sub1, d_af0), P2_31, 0},
+    /* subframe 2 */
+    {2, 2, 16, 8,  0, 0, 0,  0, ET_U8,  EPH_RAW(sub2, IODE), EPH_NONE, 0.0, 0},
+    {2, 2, 0,  16, 0, 0, 0,  1, ET_S16, EPH_RAW(sub2, Crs), EPH_D(sub2, d_Crs), P2_5, 0},
+    {2, 3, 8,  16, 0, 0, 0,  1, ET_S16, EPH_RAW(sub2, deltan), EPH_D(sub2, d_deltan), P2_43, 0},
+    {2, 3, 0,  8,  4, 0, 24, 1, ET_S32, EPH_RAW(sub2, M0), EPH_D(sub2, d_M0), P2_31, 1},
+    {2, 5, 8,  16, 0, 0, 0,  1, ET_S16, EPH_RAW(sub2, Cuc), EPH_D(sub2, d_Cuc), P2_29, 0},
+    {2, 5, 0,  8,  6, 0, 24, 0, ET_U32, EPH_RAW(sub2, e), EPH_D(sub2, d_eccentricity), P2_33, 0},
+    {2, 7, 8,  16, 0, 0, 0,  1, ET_S16, EPH_RAW(sub2, Cus), EPH_D(sub2, d_Cus), P2_29, 0},
+    {2, 7, 0,  8,  8, 0, 24, 0, ET_U32, EPH_RAW(sub2, sqrtA), EPH_D(sub2, d_sqrtA), P2_19, 0},
+    {2, 9, 8,  16, 0, 0, 0,  0, ET_U16, EPH_RAW(sub2, toe), EPH_NONE, 0.0, 0},
+    {2, 9, 7,  1,  0, 0, 0,  0, ET_U8,  EPH_RAW(sub2, fit), EPH_NONE, 0.0, 0},
+    {2, 9, 2,  5,  0, 0, 0,  0, ET_U8,  EPH_RAW(sub2, AODO), EPH_NONE, 0.0, 0},
+    /* subframe 3 */
+    {3, 2, 8,  16, 0, 0, 0,  1, ET_S16, EPH_RAW(sub3, Cic), EPH_D(sub3, d_Cic), P2_29, 0},
+    {3, 2, 0,  8,  3, 0, 24, 1, ET_S32, EPH_RAW(sub3, Omega0), EPH_D(sub3, d_Omega0), P2_31, 0},
+    {3, 4, 8,  16, 0, 0, 0,  1, ET_S16, EPH_RAW(sub3, Cis), EPH_D(sub3, d_Cis), P2_29, 0},
+    {3, 4, 0,  8,  5, 0, 24, 1, ET_S32, EPH_RAW(sub3, i0), EPH_D(sub3, d_i0), P2_31, 0},
+    {3, 6, 8,  16, 0, 0, 0,  1, ET_S16, EPH_RAW(sub3, Crc), EPH_D(sub3, d_Crc), P2_5, 0},
+    {3, 6, 0,  8,  7, 0, 24, 1, ET_S32, EPH_RAW(sub3, omega), EPH_D(sub3, d_omega), P2_31, 0},
+    {3, 8, 0,  24, 0, 0, 0,  1, ET_S32, EPH_RAW(sub3, Omegad), EPH_D(sub3, d_Omegad), P2_43, 0},
+    {3, 9, 16, 8,  0, 0, 0,  0, ET_U8,  EPH_RAW(sub3, IODE), EPH_NONE, 0.0, 0},
+    {3, 9, 2,  14, 0, 0, 0,  1, ET_S16, EPH_RAW(sub3, IDOT), EPH_D(sub3, d_IDOT), P2_43, 0},
+};
+
+/* first entry of subframe n in eph_fields */
+static const uint8_t eph_fields_start[5] = {0, 0, 11, 22, 31};
 
 /*@ -usedef @*/
 unsigned gpsd_interpret_subframe_raw(struct subframe_t *subp,
       unsigned int tSVID, uint32_t words[])
 {
-    unsigned int i;
-    uint8_t preamble;
-    uint32_t parity;
+    uint8_t valid;
 
     /*
      * This function assumes an array of 10 ints, each of which carries
@@ -49,42 +125,178 @@ unsigned gpsd_interpret_subframe_raw(struct subframe_t *subp,
      * word is inverted.
      *
      */
-    gpsd_report(LOG_IO, "50B: gpsd_interpret_subframe_raw: "
-		"%08x %08x %08x %08x %08x %08x %08x %08x %08x %08x\n",
-		words[0], words[1], words[2], words[3], words[4],
-		words[5], words[6], words[7], words[8], words[9]);
-
-    preamble = (uint8_t)((words[0] >> 22) & 0xFF);
-    if (preamble == 0x8b) {	/* preamble is inverted */
-	words[0] ^= 0x3fffffc0;	/* invert */
-    } else if (preamble != 0x74) {
-	/* strangely this is very common, so don't log it */
-	gpsd_report(LOG_IO,
-		    "50B: gpsd_interpret_subframe_raw: bad preamble 0x%x\n",
-		    preamble);
+    if (REPORT_ON(LOG_IO))
+        gpsd_report(LOG_IO, "50B: gpsd_interpret_subframe_raw: "
+		    "%08x %08x %08x %08x %08x %08x %08x %08x %08x %08x\n",
+		    words[0], words[1], words[2], words[3], words[4],
+		    words[5], words[6], words[7], words[8], words[9]);
+
+    if (gpsd_check_subframes_raw((uint32_t (*)[10])words, 1, &valid) == 0) {
+	/* strangely bad preamble is very common, so don't log it */
 	return 0;
     }
-    words[0] = (words[0] >> 6) & 0xffffff;
-
-    for (i = 1; i < 10; i++) {
-	int invert;
-	/* D30* says invert */
-	invert = (words[i] & 0x40000000) ? 1 : 0;
-	/* inverted data, invert it back */
-	if (invert) {
-	    words[i] ^= 0x3fffffc0;
+
+    return gpsd_interpret_subframe(subp, tSVID, words);
+}
+
+/*
+ * Check parity of cnt raw subframes, de-invert them and strip parity bits
+ * in place, like gpsd_interpret_subframe_raw() does for one subframe.
+ * valid[i] is set to 1 for subframes that passed the check.
+ * Returns number of valid subframes.
+ */
+unsigned gpsd_check_subframes_raw(uint32_t words[][10], unsigned cnt,
+      uint8_t valid[])
+{
+    unsigned i, j, n, res;
+    uint32_t w, ok;
+    uint8_t parity[SUBFRAME_BATCH_MAX][10];
+
+    res = 0;
+    while (cnt > 0) {
+	n = cnt < SUBFRAME_BATCH_MAX ? cnt : SUBFRAME_BATCH_MAX;
+
+	/* D30* says invert: branchless de-inversion of words 1-9 */
+	for (i = 0; i < n; i++) {
+	    for (j = 1; j < 10; j++) {
+		w = words[i][j];
+		words[i][j] = w ^ ((0u - ((w >> 30) & 1)) & 0x3fffffc0u);
+	    }
 	}
-	parity = (uint32_t)isgps_parity((isgps30bits_t)words[i]);
-	if (parity != (words[i] & 0x3f)) {
-	    gpsd_report(LOG_IO,
-			"50B: gpsd_interpret_subframe_raw parity fail words[%d] 0x%x != 0x%x\n",
-			i, parity, (words[i] & 0x1));
-	    return 0;
+
+	isgps_parity_batch(&words[0][0], &parity[0][0], n * 10);
+
+	for (i = 0; i < n; i++) {
+	    uint8_t preamble;
+
+	    ok = 1;
+	    for (j = 1; j < 10; j++) {
+		ok &= (parity[i][j] == (words[i][j] & 0x3f));
+		words[i][j] = (words[i][j] >> 6) & 0xffffff;
+	    }
+
+	    preamble = (uint8_t)((words[i][0] >> 22) & 0xFF);
+	    if (preamble == 0x8b)
+		words[i][0] ^= 0x3fffffc0;
+	    else if (preamble != 0x74)
+		ok = 0;
+	    words[i][0] = (words[i][0] >> 6) & 0xffffff;
+
+	    valid[i] = (uint8_t)ok;
+	    res += ok;
 	}
-	words[i] = (words[i] >> 6) & 0xffffff;
+
+	words += n;
+	valid += n;
+	cnt -= n;
     }
 
-    return gpsd_interpret_subframe(subp, tSVID, words);
+    return res;
+}
+
+/*
+ * Batch version of gpsd_interpret_subframe_raw(). Subframes that fail
+ * the parity check get subframe_num 0.
+ * Returns number of decoded subframes.
+ */
+unsigned gpsd_interpret_subframes_raw(struct subframe_t *subp,
+      const unsigned int tSVID[], uint32_t words[][10], unsigned cnt)
+{
+    unsigned i, n, res;
+    uint8_t valid[SUBFRAME_BATCH_MAX];
+
+    res = 0;
+    while (cnt > 0) {
+	n = cnt < SUBFRAME_BATCH_MAX ? cnt : SUBFRAME_BATCH_MAX;
+	gpsd_check_subframes_raw(words, n, valid);
+	for (i = 0; i < n; i++) {
+	    if (valid[i] && (gpsd_interpret_subframe(&subp[i], tSVID[i], words[i]) > 0))
+		res++;
+	    else
+		subp[i].subframe_num = 0;
+	}
+	subp += n;
+	tSVID += n;
+	words += n;
+	cnt -= n;
+    }
+
+    return res;
+}
+
+/* Table-driven extraction of subframe 1-3 ephemeris fields */
+static void subframe_ephemeris(struct subframe_t *subp, const uint32_t words[])
+{
+    unsigned i, end, len;
+    uint32_t u;
+    int32_t v;
+    const struct eph_field_t *f;
+    char *base;
+
+    if ((subp->subframe_num < 1) || (subp->subframe_num > 3))
+	return;
+
+    base = (char *)subp;
+    end = eph_fields_start[subp->subframe_num + 1];
+    for (i = eph_fields_start[subp->subframe_num]; i < end; i++) {
+	f = &eph_fields[i];
+	u = (words[f->hi_word] >> f->hi_shift) & ((1u << f->hi_len) - 1);
+	len = f->hi_len;
+	if (f->lo_len) {
+	    u = (u << f->lo_len)
+		| ((words[f->lo_word] >> f->lo_shift) & ((1u << f->lo_len) - 1));
+	    len += f->lo_len;
+	}
+	if (f->is_signed && (len < 32) && (u & (1u << (len - 1))))
+	    v = (int32_t)(u | ~((1u << len) - 1));
+	else
+	    v = (int32_t)u;
+
+	switch (f->type) {
+	case ET_U8:
+	    *(uint8_t *)(base + f->offset) = (uint8_t)u;
+	    break;
+	case ET_S8:
+	    *(int8_t *)(base + f->offset) = (int8_t)v;
+	    break;
+	case ET_U16:
+	    *(uint16_t *)(base + f->offset) = (uint16_t)u;
+	    break;
+	case ET_S16:
+	    *(int16_t *)(base + f->offset) = (int16_t)v;
+	    break;
+	case ET_U32:
+	    *(uint32_t *)(base + f->offset) = u;
+	    break;
+	case ET_S32:
+	    *(int32_t *)(base + f->offset) = v;
+	    break;
+	case ET_UINT:
+	default:
+	    *(unsigned int *)(base + f->offset) = u;
+	    break;
+	}
+
+	if (f->d_offset != EPH_NONE) {
+	    double d;
+	    d = (f->is_signed ? (double)v : (double)u) * f->scale;
+	    if (f->semicircle)
+		d *= GPS_PI;
+	    *(double *)(base + f->d_offset) = d;
+	}
+    }
+
+    switch (subp->subframe_num) {
+    case 1:
+	subp->sub1.l_toc = (long)subp->sub1.toc << 4;
+	break;
+    case 2:
+	subp->sub2.l_toe = (long)(subp->sub2.toe << 4);
+	subp->sub2.u_AODO = subp->sub2.AODO * 900;
+	break;
+    default:
+	break;
+    }
 }
 
 /* you can find up to date almanac data for comparision here:
@@ -167,11 +379,12 @@ static unsigned gpsd_interpret_subframe(struct subframe_t *subp,
     /* FIXME!! I really doubt this is Big Endian compatible */
     uint8_t preamble;
     int i = 0;   /* handy loop counter */
-    gpsd_report(LOG_IO,
-		"50B: gpsd_interpret_subframe: (%d) "
-		"%06x %06x %06x %06x %06x %06x %06x %06x %06x %06x\n",
-		tSVID, words[0], words[1], words[2], words[3], words[4],
-		words[5], words[6], words[7], words[8], words[9]);
+    if (REPORT_ON(LOG_IO))
+        gpsd_report(LOG_IO,
+		    "50B: gpsd_interpret_subframe: (%d) "
+		    "%06x %06x %06x %06x %06x %06x %06x %06x %06x %06x\n",
+		    tSVID, words[0], words[1], words[2], words[3], words[4],
+		    words[5], words[6], words[7], words[8], words[9]);
 
     preamble = (uint8_t)((words[0] >> 16) & 0x0FF);
     if (preamble == 0x8b) {
@@ -193,11 +406,12 @@ static unsigned gpsd_interpret_subframe(struct subframe_t *subp,
     subp->subframe_num = ((words[1] >> 2) & 0x07);
     subp->alert = (bool)((words[1] >> 6) & 0x01);
     subp->antispoof = (bool)((words[1] >> 6) & 0x01);
-    gpsd_report(LOG_PROG,
-		"50B: SF:%d SV:%2u TOW17:%7lu Alert:%u AS:%u IF:%d\n",
-		subp->subframe_num, subp->tSVID, subp->l_TOW17,
-		(unsigned)subp->alert, (unsigned)subp->antispoof,
-		(unsigned)subp->integrity);
+    if (REPORT_ON(LOG_PROG))
+        gpsd_report(LOG_PROG,
+		    "50B: SF:%d SV:%2u TOW17:%7lu Alert:%u AS:%u IF:%d\n",
+		    subp->subframe_num, subp->tSVID, subp->l_TOW17,
+		    (unsigned)subp->alert, (unsigned)subp->antispoof,
+		    (unsigned)subp->integrity);
     /*
      * Consult the latest revision of IS-GPS-200 for the mapping
      * between magic SVIDs and pages.
@@ -216,120 +430,56 @@ static unsigned gpsd_interpret_subframe(struct subframe_t *subp,
 	 * which we don't decode yet because we don't know
 	 * of any receiver that reports it.
 	 */
-	subp->sub1.WN   = (uint16_t)((words[2] >> 14) & 0x03ff);
-	subp->sub1.l2   = (uint8_t)((words[2] >> 12) & 0x000003); /* L2 Code */
-	subp->sub1.ura  = (unsigned int)((words[2] >>  8) & 0x00000F); /* URA Index */
-	subp->sub1.hlth = (unsigned int)((words[2] >>  2) & 0x00003F); /* SV health */
-	subp->sub1.IODC = (words[2] & 0x000003); /* IODC 2 MSB */
-	subp->sub1.l2p  = ((words[3] >> 23) & 0x000001); /* L2 P flag */
-	subp->sub1.Tgd  = (int8_t)( words[6] & 0x0000FF);
-	subp->sub1.d_Tgd  = pow(2.0, -31) * (int)subp->sub1.Tgd;
-	subp->sub1.toc  = ( words[7] & 0x00FFFF);
-	subp->sub1.l_toc = (long)subp->sub1.toc  << 4;
-	subp->sub1.af2  = (int8_t)((words[8] >> 16) & 0x0FF);
-	subp->sub1.d_af2  = pow(2.0, -55) * (int)subp->sub1.af2;
-	subp->sub1.af1  = (int16_t)( words[8] & 0x00FFFF);
-	subp->sub1.d_af1  = pow(2.0, -43) * subp->sub1.af1;
-	subp->sub1.af0  = (int32_t)((words[9] >>  2) & 0x03FFFFF);
-	subp->sub1.af0  = uint2int(subp->sub1.af0, 22);
-	subp->sub1.d_af0  = pow(2.0, -31) * subp->sub1.af0;
-	subp->sub1.IODC <<= 8;
-	subp->sub1.IODC |= ((words[7] >> 16) & 0x00FF);
-	gpsd_report(LOG_PROG, "50B: SF:1 SV:%2u WN:%4u IODC:%4u"
-		    " L2:%u ura:%u hlth:%u L2P:%u Tgd:%g toc:%lu af2:%.4g"
-		    " af1:%.6e af0:%.7e\n",
-		    subp->tSVID,
-		    subp->sub1.WN,
-		    subp->sub1.IODC,
-		    subp->sub1.l2,
-		    subp->sub1.ura,
-		    subp->sub1.hlth,
-		    subp->sub1.l2p,
-		    subp->sub1.d_Tgd,
-		    subp->sub1.l_toc,
-		    subp->sub1.d_af2,
-		    subp->sub1.d_af1,
-		    subp->sub1.d_af0);
+	subframe_ephemeris(subp, words);
+	if (REPORT_ON(LOG_PROG))
+	    gpsd_report(LOG_PROG, "50B: SF:1 SV:%2u WN:%4u IODC:%4u"
+			" L2:%u ura:%u hlth:%u L2P:%u Tgd:%g toc:%lu af2:%.4g"
+			" af1:%.6e af0:%.7e\n",
+			subp->tSVID,
+			subp->sub1.WN,
+			subp->sub1.IODC,
+			subp->sub1.l2,
+			subp->sub1.ura,
+			subp->sub1.hlth,
+			subp->sub1.l2p,
+			subp->sub1.d_Tgd,
+			subp->sub1.l_toc,
+			subp->sub1.d_af2,
+			subp->sub1.d_af1,
+			subp->sub1.d_af0);
 	break;
     case 2:
 	/* subframe 2: ephemeris for transmitting SV */
-	subp->sub2.IODE   = ((words[2] >> 16) & 0x00FF);
-	subp->sub2.Crs    = (int16_t)( words[2] & 0x00FFFF);
-	subp->sub2.d_Crs  = pow(2.0,-5) * subp->sub2.Crs;
-	subp->sub2.deltan = (int16_t)((words[3] >>  8) & 0x00FFFF);
-	subp->sub2.d_deltan  = pow(2.0,-43) * subp->sub2.deltan;
-	subp->sub2.M0     = (int32_t)( words[3] & 0x0000FF);
-	subp->sub2.M0   <<= 24;
-	subp->sub2.M0    |= ( words[4] & 0x00FFFFFF);
-	subp->sub2.d_M0   = pow(2.0,-31) * subp->sub2.M0 * GPS_PI;
-	subp->sub2.Cuc    = (int16_t)((words[5] >>  8) & 0x00FFFF);
-	subp->sub2.d_Cuc  = pow(2.0,-29) * subp->sub2.Cuc;
-	subp->sub2.e      = ( words[5] & 0x0000FF);
-	subp->sub2.e    <<= 24;
-	subp->sub2.e     |= ( words[6] & 0x00FFFFFF);
-	subp->sub2.d_eccentricity  = pow(2.0,-33) * subp->sub2.e;
-	subp->sub2.Cus    = (int16_t)((words[7] >>  8) & 0x00FFFF);
-	subp->sub2.d_Cus  = pow(2.0,-29) * subp->sub2.Cus;
-	subp->sub2.sqrtA  = ( words[7] & 0x0000FF);
-	subp->sub2.sqrtA <<= 24;
-	subp->sub2.sqrtA |= ( words[8] & 0x00FFFFFF);
-	subp->sub2.d_sqrtA = pow(2.0, -19) * subp->sub2.sqrtA;
-	subp->sub2.toe    = ((words[9] >>  8) & 0x00FFFF);
-	subp->sub2.l_toe  = (long)(subp->sub2.toe << 4);
-	subp->sub2.fit    = ((words[9] >>  7) & 0x000001);
-	subp->sub2.AODO   = ((words[9] >>  2) & 0x00001F);
-	subp->sub2.u_AODO   = subp->sub2.AODO * 900;
-	gpsd_report(LOG_PROG,
-		    "50B: SF:2 SV:%2u IODE:%3u Crs:%.6e deltan:%.6e "
-		    "M0:%.11e Cuc:%.6e e:%f Cus:%.6e sqrtA:%.11g "
-		    "toe:%lu FIT:%u AODO:%5u\n",
-		    subp->tSVID,
-		    subp->sub2.IODE,
-		    subp->sub2.d_Crs,
-		    subp->sub2.d_deltan,
-		    subp->sub2.d_M0,
-		    subp->sub2.d_Cuc,
-		    subp->sub2.d_eccentricity,
-		    subp->sub2.d_Cus,
-		    subp->sub2.d_sqrtA,
-		    subp->sub2.l_toe,
-		    subp->sub2.fit,
-		    subp->sub2.u_AODO);
+	subframe_ephemeris(subp, words);
+	if (REPORT_ON(LOG_PROG))
+	    gpsd_report(LOG_PROG,
+			"50B: SF:2 SV:%2u IODE:%3u Crs:%.6e deltan:%.6e "
+			"M0:%.11e Cuc:%.6e e:%f Cus:%.6e sqrtA:%.11g "
+			"toe:%lu FIT:%u AODO:%5u\n",
+			subp->tSVID,
+			subp->sub2.IODE,
+			subp->sub2.d_Crs,
+			subp->sub2.d_deltan,
+			subp->sub2.d_M0,
+			subp->sub2.d_Cuc,
+			subp->sub2.d_eccentricity,
+			subp->sub2.d_Cus,
+			subp->sub2.d_sqrtA,
+			subp->sub2.l_toe,
+			subp->sub2.fit,
+			subp->sub2.u_AODO);
 	break;
     case 3:
 	/* subframe 3: ephemeris for transmitting SV */
-	subp->sub3.Cic      = (int16_t)((words[2] >>  8) & 0x00FFFF);
-	subp->sub3.d_Cic    = pow(2.0, -29) * subp->sub3.Cic;
-	subp->sub3.Omega0   = (int32_t)(words[2] & 0x0000FF);
-	subp->sub3.Omega0 <<= 24;
-	subp->sub3.Omega0  |= ( words[3] & 0x00FFFFFF);
-	subp->sub3.d_Omega0 = pow(2.0, -31) * subp->sub3.Omega0;
-	subp->sub3.Cis      = (int16_t)((words[4] >>  8) & 0x00FFFF);
-	subp->sub3.d_Cis    = pow(2.0, -29) * subp->sub3.Cis;
-	subp->sub3.i0       = (int32_t)(words[4] & 0x0000FF);
-	subp->sub3.i0     <<= 24;
-	subp->sub3.i0      |= ( words[5] & 0x00FFFFFF);
-	subp->sub3.d_i0     = pow(2.0, -31) * subp->sub3.i0;
-	subp->sub3.Crc      = (int16_t)((words[6] >>  8) & 0x00FFFF);
-	subp->sub3.d_Crc    = pow(2.0, -5) * subp->sub3.Crc;
-	subp->sub3.omega    = (int32_t)(words[6] & 0x0000FF);
-	subp->sub3.omega  <<= 24;
-	subp->sub3.omega   |= ( words[7] & 0x00FFFFFF);
-	subp->sub3.d_omega  = pow(2.0, -31) * subp->sub3.omega;
-	subp->sub3.Omegad   = (int32_t)(words[8] & 0x00FFFFFF);
-	subp->sub3.Omegad   = uint2int(subp->sub3.Omegad, 24);
-	subp->sub3.d_Omegad = pow(2.0, -43) * subp->sub3.Omegad;
-	subp->sub3.IODE     = ((words[9] >> 16) & 0x0000FF);
-	subp->sub3.IDOT     = (int16_t)((words[9] >>  2) & 0x003FFF);
-	subp->sub3.IDOT     = uint2int(subp->sub3.IDOT, 14);
-	subp->sub3.d_IDOT   = pow(2.0, -43) * subp->sub3.IDOT;
-	gpsd_report(LOG_PROG,
-	    "50B: SF:3 SV:%2u IODE:%3u I IDOT:%.6g Cic:%.6e Omega0:%.11e "
-	    " Cis:%.7g i0:%.11e Crc:%.7g omega:%.11e Omegad:%.6e\n",
-		    subp->tSVID, subp->sub3.IODE, subp->sub3.d_IDOT,
-		    subp->sub3.d_Cic, subp->sub3.d_Omega0, subp->sub3.d_Cis,
-		    subp->sub3.d_i0, subp->sub3.d_Crc, subp->sub3.d_omega,
-		    subp->sub3.d_Omegad );
+	subframe_ephemeris(subp, words);
+	if (REPORT_ON(LOG_PROG))
+	    gpsd_report(LOG_PROG,
+		"50B: SF:3 SV:%2u IODE:%3u I IDOT:%.6g Cic:%.6e Omega0:%.11e "
+		" Cis:%.7g i0:%.11e Crc:%.7g omega:%.11e Omegad:%.6e\n",
+			subp->tSVID, subp->sub3.IODE, subp->sub3.d_IDOT,
+			subp->sub3.d_Cic, subp->sub3.d_Omega0, subp->sub3.d_Cis,
+			subp->sub3.d_i0, subp->sub3.d_Crc, subp->sub3.d_omega,
+			subp->sub3.d_Omegad );
 	break;
     case 4:
 	{
@@ -692,9 +842,9 @@ static unsigned gpsd_interpret_subframe(struct subframe_t *subp,
 		subp->sub4_18.A1     = (int32_t)((words[5] >>  0) & 0xFFFFFF);
 		subp->sub4_18.A1     = uint2int(subp->sub4_18.A1, 24);
 		subp->sub4_18.d_A1   = pow(2.0,-50) * subp->sub4_18.A1;
-		subp->sub4_18.A0     = (int32_t)((words[6] >>  0) & 0xFFFFFF);
-		subp->sub4_18.A0   <<= 8;
-		subp->sub4_18.A0    |= ((words[7] >> 16) & 0x00FFFF);
+		/* shifted unsigned, A0 is negative when bit 23 is set */
+		subp->sub4_18.A0     = (int32_t)(((words[6] & 0xFFFFFF) << 8)
+		                       | ((words[7] >> 16) & 0x00FFFF));
 		subp->sub4_18.d_A0   = pow(2.0,-30) * subp->sub4_18.A0;
 
 		/* careful WN is 10 bits, but WNt is 8 bits! */
@@ -0,0 +1,263 @@
+#include <assert.h>
+#include <math.h>
+
+#include "sirfdump.h"
+#include "gpstime.h"
+
+#define SECS_PER_DAY 86400L
+#define SECS_PER_WEEK (7 * SECS_PER_DAY)
+
+#define YEAR_TABLE_FIRST 1980
+#define YEAR_TABLE_SIZE (sizeof(year_start)/sizeof(year_start[0]))
+
+/* Days since GPS epoch (1980-01-06) to January 1 of year 1980 + i */
+static const long year_start[] = {
+       -5,    361,    726,   1091,   1456,   1822,   2187,   2552,
+     2917,   3283,   3648,   4013,   4378,   4744,   5109,   5474,
+     5839,   6205,   6570,   6935,   7300,   7666,   8031,   8396,
+     8761,   9127,   9492,   9857,  10222,  10588,  10953,  11318,
+    11683,  12049,  12414,  12779,  13144,  13510,  13875,  14240,
+    14605,  14971,  15336,  15701,  16066,  16432,  16797,  17162,
+    17527,  17893,  18258,  18623,  18988,  19354,  19719,  20084,
+    20449,  20815,  21180,  21545,  21910,  22276,  22641,  23006,
+    23371,  23737,  24102,  24467,  24832,  25198,  25563,  25928,
+    26293,  26659,  27024,  27389,  27754,  28120,  28485,  28850,
+    29215,  29581,  29946,  30311,  30676,  31042,  31407,  31772,
+    32137,  32503,  32868,  33233,  33598,  33964,  34329,  34694,
+    35059,  35425,  35790,  36155,  36520,  36886,  37251,  37616,
+    37981,  38347,  38712,  39077,  39442,  39808,  40173,  40538,
+    40903,  41269,  41634,  41999,  42364,  42730,  43095,  43460,
+    43825,  44190,  44555,  44920,  45285,  45651,  46016,  46381,
+};
+
+/* Days before the first day of month, normal / leap year  */
+static const unsigned month_start[2][13] = {
+   {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365},
+   {0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335, 366}
+};
+
+/* GPS time (seconds since GPS epoch) when UTC-GPS offset became leap  */
+static const struct {
+   long gps_sec;
+   int leap;
+} leap_seconds[] = {
+   {   46828801,  1 }, /* 1981-07-01 */
+   {   78364802,  2 }, /* 1982-07-01 */
+   {  109900803,  3 }, /* 1983-07-01 */
+   {  173059204,  4 }, /* 1985-07-01 */
+   {  252028805,  5 }, /* 1988-01-01 */
+   {  315187206,  6 }, /* 1990-01-01 */
+   {  346723207,  7 }, /* 1991-01-01 */
+   {  393984008,  8 }, /* 1992-07-01 */
+   {  425520009,  9 }, /* 1993-07-01 */
+   {  457056010, 10 }, /* 1994-07-01 */
+   {  504489611, 11 }, /* 1996-01-01 */
+   {  551750412, 12 }, /* 1997-07-01 */
+   {  599184013, 13 }, /* 1999-01-01 */
+   {  820108814, 14 }, /* 2006-01-01 */
+   {  914803215, 15 }, /* 2009-01-01 */
+   { 1025136016, 16 }, /* 2012-07-01 */
+   { 1119744017, 17 }, /* 2015-07-01 */
+   { 1167264018, 18 }, /* 2017-01-01 */
+};
+
+static int is_leap_year(unsigned year)
+{
+   return ((year % 4 == 0) && (year % 100 != 0)) || (year % 400 == 0);
+}
+
+/* days since 1970-01-01 to civil date. Used outside of the year table.  */
+static void days_to_civil(long z, unsigned *year, unsigned *month, unsigned *day)
+{
+   long era;
+   unsigned doe, yoe, doy, mp;
+   long y;
+
+   z += 719468;
+   era = (z >= 0 ? z : z - 146096) / 146097;
+   doe = (unsigned)(z - era * 146097);
+   yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+   y = (long)yoe + era * 400;
+   doy = doe - (365*yoe + yoe/4 - yoe/100);
+   mp = (5*doy + 2)/153;
+   *day = doy - (153*mp+2)/5 + 1;
+   *month = mp < 10 ? mp+3 : mp-9;
+   *year = (unsigned)(y + (*month <= 2));
+}
+
+/* civil date to days since 1970-01-01  */
+static long days_from_civil(unsigned year, unsigned month, unsigned day)
+{
+   long y, era;
+   unsigned yoe, doy, doe;
+
+   y = (long)year - (month <= 2);
+   era = (y >= 0 ? y : y - 399) / 400;
+   yoe = (unsigned)(y - era * 400);
+   doy = (153*(month > 2 ? month-3 : month+9) + 2)/5 + day-1;
+   doe = yoe * 365 + yoe/4 - yoe/100 + doy;
+   return era * 146097 + (long)doe - 719468;
+}
+
+static void fill_day(struct gpstime_cache_t *c, long day_n)
+{
+   unsigned i, leap;
+   long yday;
+
+   c->day_n = day_n;
+
+   /* year estimate, corrected by the table  */
+   i = (unsigned)((day_n + 5) * 4 / 1461);
+   if ((day_n < year_start[0]) || (i + 2 >= YEAR_TABLE_SIZE)) {
+      days_to_civil(day_n + GPS_EPOCH / SECS_PER_DAY, &c->year, &c->month, &c->day);
+      leap = is_leap_year(c->year);
+      c->yday = month_start[leap][c->month-1] + c->day;
+      return;
+   }
+   while (i > 0 && year_start[i] > day_n)
+      --i;
+   while ((i + 1 < YEAR_TABLE_SIZE) && (year_start[i+1] <= day_n))
+      ++i;
+
+   c->year = YEAR_TABLE_FIRST + i;
+   yday = day_n - year_start[i];
+   c->yday = (unsigned)yday + 1;
+
+   leap = is_leap_year(c->year);
+   i = (unsigned)yday / 32;
+   while (month_start[leap][i+1] <= (unsigned)yday)
+      ++i;
+   c->month = i + 1;
+   c->day = (unsigned)yday - month_start[leap][i] + 1;
+}
+
+void gpstime_cache_init(struct gpstime_cache_t *cache)
+{
+   assert(cache);
+   cache->day_n = -1;
+   cache->year = cache->month = cache->day = cache->yday = 0;
+}
+
+static int gpssec2tm(struct gpstime_cache_t *cache, int64_t sec, double fractpart,
+      struct gps_tm *res)
+{
+   long day_n, sod;
+   struct gpstime_cache_t tmp;
+
+   day_n = (long)(sec >= 0 ? sec / SECS_PER_DAY : -((-sec + SECS_PER_DAY - 1) / SECS_PER_DAY));
+   sod = (long)(sec - (int64_t)day_n * SECS_PER_DAY);
+
+   if (cache == NULL) {
+      cache = &tmp;
+      cache->day_n = -1;
+   }
+
+   if (cache->day_n != day_n)
+      fill_day(cache, day_n);
+
+   res->year = cache->year;
+   res->month = cache->month;
+   res->day = cache->day;
+   res->yday = cache->yday;
+   res->hour = (unsigned)(sod / 3600);
+   res->min = (unsigned)(sod / 60 % 60);
+   res->sec = (sod % 60) + fractpart;
+
+   return 1;
+}
+
+static int64_t split_tow(unsigned gps_week, double gps_tow, double *fractpart)
+{
+   double intpart;
+
+   gps_tow = floor(gps_tow * 1e6 + 0.5)/1e6;
+   intpart = floor(gps_tow);
+   *fractpart = gps_tow - intpart;
+   assert(*fractpart < 1.0);
+
+   return (int64_t)gps_week * SECS_PER_WEEK + (int64_t)intpart;
+}
+
+int gpstime2tm(struct gpstime_cache_t *cache, unsigned gps_week, double gps_tow,
+      struct gps_tm *res)
+{
+   int64_t sec;
+   double fractpart;
+
+   assert(res);
+
+   sec = split_tow(gps_week, gps_tow, &fractpart);
+
+   return gpssec2tm(cache, sec, fractpart, res);
+}
+
+int gpstime2tm0(unsigned gps_week, double gps_tow, struct gps_tm *res)
+{
+   return gpstime2tm(NULL, gps_week, gps_tow, res);
+}
+
+static int leap_seconds_at(int64_t gps_sec)
+{
+   int i;
+
+   for (i=sizeof(leap_seconds)/sizeof(leap_seconds[0])-1; i >= 0; --i) {
+      if (gps_sec >= leap_seconds[i].gps_sec)
+	 return leap_seconds[i].leap;
+   }
+
+   return 0;
+}
+
+int gps_leap_seconds(unsigned gps_week, double gps_tow)
+{
+   return leap_seconds_at((int64_t)gps_week * SECS_PER_WEEK + (int64_t)floor(gps_tow));
+}
+
+int gpstime2utc(struct gpstime_cache_t *cache, unsigned gps_week, double gps_tow,
+      int leap, struct gps_tm *res)
+{
+   int64_t sec;
+   double fractpart;
+   unsigned i;
+   int err;
+
+   assert(res);
+
+   sec = split_tow(gps_week, gps_tow, &fractpart);
+
+   if (leap < 0) {
+      /* inserted leap second is shown as 23:59:60  */
+      for (i=0; i < sizeof(leap_seconds)/sizeof(leap_seconds[0]); i++) {
+	 if (sec == leap_seconds[i].gps_sec - 1) {
+	    err = gpssec2tm(cache, sec - leap_seconds[i].leap, fractpart, res);
+	    res->sec += 1.0;
+	    return err;
+	 }
+      }
+      leap = leap_seconds_at(sec);
+   }
+
+   return gpssec2tm(cache, sec - leap, fractpart, res);
+}
+
+int tm2gpstime(const struct gps_tm *tm, unsigned *gps_week, double *gps_tow)
+{
+   int64_t sec;
+
+   assert(tm);
+
+   if (tm->month < 1 || (tm->month > 12) || (tm->day < 1) || (tm->day > 31)
+	 || (tm->hour > 23) || (tm->min > 59) || (tm->sec < 0) || (tm->sec >= 61))
+      return -1;
+
+   sec = ((int64_t)days_from_civil(tm->year, tm->month, tm->day)
+	 - GPS_EPOCH / SECS_PER_DAY) * SECS_PER_DAY
+      + tm->hour * 3600 + tm->min * 60;
+   if (sec < 0)
+      return -1;
+
+   *gps_week = (unsigned)(sec / SECS_PER_WEEK);
+   *gps_tow = (double)(sec % SECS_PER_WEEK) + tm->sec;
+
+   return 0;
+}
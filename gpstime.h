@@ -0,0 +1,29 @@
+#ifndef GPSTIME_H
+#define GPSTIME_H
+
+#include "sirfdump.h"
+
+/* Calendar day cache. One per converting context, no shared state.  */
+struct gpstime_cache_t {
+   long day_n; /* days since GPS epoch, -1 - not valid */
+   unsigned year, month, day;
+   unsigned yday;
+};
+
+void gpstime_cache_init(struct gpstime_cache_t *cache);
+
+/* GPS time scale  */
+int gpstime2tm(struct gpstime_cache_t *cache, unsigned gps_week, double gps_tow,
+      struct gps_tm *res);
+
+/* UTC time scale. leap < 0 - use built-in leap second table  */
+int gpstime2utc(struct gpstime_cache_t *cache, unsigned gps_week, double gps_tow,
+      int leap, struct gps_tm *res);
+
+/* GPS time scale calendar date to GPS week / time of week. yday is
+ * not used. Returns -1 if invalid or before GPS epoch  */
+int tm2gpstime(const struct gps_tm *tm, unsigned *gps_week, double *gps_tow);
+
+int gps_leap_seconds(unsigned gps_week, double gps_tow);
+
+#endif /* GPSTIME_H */
@@ -0,0 +1,435 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sirfdump.h"
+#include "gpstime.h"
+
+const char *progname = "gpstimebench";
+const char *revision = "$Revision: 0.1 $";
+
+#define SECS_PER_DAY 86400L
+#define SECS_PER_WEEK (7 * SECS_PER_DAY)
+
+/* 2105-01-01 to 2110-01-01, the year table ends with 2107  */
+#define TABLE_END_FIRST_WEEK 6521
+#define TABLE_END_LAST_WEEK 6782
+
+struct bench_ctx_t {
+   unsigned runs;
+   unsigned first_week;
+   unsigned last_week;
+   unsigned sample_weeks;
+   unsigned long count;
+   unsigned seed;
+   unsigned errors;
+};
+
+static void usage(void)
+{
+ fprintf(stdout, "\nUsage:\n    %s [-h] [options]\n"
+       ,progname);
+ return;
+}
+
+static void version(void)
+{
+ fprintf(stdout,"%s %s\n",progname,revision);
+}
+
+static void help(void)
+{
+
+ printf("%s - GPS time to calendar check and benchmark\t\t%s\n",
+       progname, revision);
+ usage();
+ printf(
+   "\nOptions:\n"
+   "    -n, --runs                  Runs per test, best is reported, default: 3\n"
+   "    -w, --weeks                 Weeks checked every second, FIRST:LAST, default: 1700:2200\n"
+   "    -W, --sample-weeks          Weeks 0..N checked hourly, default: 9000\n"
+   "    -c, --count                 Conversions per benchmark run, default: 10000000\n"
+   "    -S, --seed                  Random seed, default: 1\n"
+   "    -h, --help                  Help\n"
+   "    -v, --version               Show version\n"
+   "\n"
+   "Check: gpstime2tm() with a day cache against gmtime() for every second\n"
+   "of the -w weeks, without cache hourly (at random fractions of a\n"
+   "second) over the -W weeks, tm2gpstime() round trip, every minute of\n"
+   "2105-2109 around the end of the year table, the leap second\n"
+   "table against the UTC dates of insertion and gpstime2utc() for every\n"
+   "second of two days around each leap second. Exits with 1 on error.\n"
+   "Benchmark: the former gmtime() based gpstime2tm0(), gpstime2tm()\n"
+   "of consecutive 10 Hz epochs with a cache and of random times without.\n"
+   "\n"
+ );
+ return;
+}
+
+static uint64_t clock_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* gpstime2tm0() before the table-driven converter  */
+static int legacy_gpstime2tm0(unsigned gps_week, double gps_tow, struct gps_tm *res)
+{
+   time_t tt;
+   struct tm tm;
+   double intpart, fractpart;
+
+   gps_tow = floor(gps_tow * 1e6 + 0.5)/1e6;
+   fractpart = modf(gps_tow, &intpart);
+
+   tt = (time_t)GPS_EPOCH + (time_t)gps_week * SECS_PER_WEEK + (time_t)intpart;
+
+   gmtime_r(&tt, &tm);
+
+   res->sec = tm.tm_sec + fractpart;
+   res->min = tm.tm_min;
+   res->hour = tm.tm_hour;
+   res->day = tm.tm_mday;
+   res->yday = tm.tm_yday + 1;
+   res->month = tm.tm_mon + 1;
+   res->year = tm.tm_year + 1900;
+
+   return 1;
+}
+
+static int tm_equal(const struct gps_tm *a, const struct gps_tm *b)
+{
+   return (a->year == b->year) && (a->month == b->month) && (a->day == b->day)
+      && (a->yday == b->yday) && (a->hour == b->hour) && (a->min == b->min)
+      && (a->sec == b->sec);
+}
+
+static void tm_error(struct bench_ctx_t *ctx, const char *name,
+      unsigned gps_week, double gps_tow, const struct gps_tm *ref,
+      const struct gps_tm *res)
+{
+   if (ctx->errors++ >= 10)
+      return;
+   printf("%s %u %.7f: %04u-%02u-%02u (%03u) %02u:%02u:%09.6f, "
+	 "expected %04u-%02u-%02u (%03u) %02u:%02u:%09.6f\n",
+	 name, gps_week, gps_tow,
+	 res->year, res->month, res->day, res->yday, res->hour, res->min, res->sec,
+	 ref->year, ref->month, ref->day, ref->yday, ref->hour, ref->min, ref->sec);
+}
+
+/* Every second, cache carried over like in the sinks  */
+static void check_seconds(struct bench_ctx_t *ctx)
+{
+   unsigned week;
+   long tow;
+   struct gps_tm ref, res;
+   struct gpstime_cache_t cache;
+
+   gpstime_cache_init(&cache);
+   for (week = ctx->first_week; week <= ctx->last_week; week++) {
+      for (tow = 0; tow < SECS_PER_WEEK; tow++) {
+	 legacy_gpstime2tm0(week, (double)tow, &ref);
+	 gpstime2tm(&cache, week, (double)tow, &res);
+	 if (!tm_equal(&ref, &res))
+	    tm_error(ctx, "gpstime2tm", week, (double)tow, &ref, &res);
+      }
+   }
+}
+
+/* Every minute of the last table years and the fallback after them,
+ * with and without cache  */
+static void check_table_end(struct bench_ctx_t *ctx)
+{
+   unsigned week;
+   long tow;
+   struct gps_tm ref, res;
+   struct gpstime_cache_t cache;
+
+   gpstime_cache_init(&cache);
+   for (week = TABLE_END_FIRST_WEEK; week <= TABLE_END_LAST_WEEK; week++) {
+      for (tow = 0; tow < SECS_PER_WEEK; tow += 60) {
+	 legacy_gpstime2tm0(week, (double)tow, &ref);
+	 gpstime2tm(&cache, week, (double)tow, &res);
+	 if (!tm_equal(&ref, &res))
+	    tm_error(ctx, "gpstime2tm", week, (double)tow, &ref, &res);
+	 gpstime2tm0(week, (double)tow + 59.0, &res);
+	 legacy_gpstime2tm0(week, (double)tow + 59.0, &ref);
+	 if (!tm_equal(&ref, &res))
+	    tm_error(ctx, "gpstime2tm0", week, (double)tow + 59.0, &ref, &res);
+      }
+   }
+}
+
+/* Hourly, random fraction, no cache; tm2gpstime() round trip  */
+static void check_sampled(struct bench_ctx_t *ctx)
+{
+   unsigned week, week2;
+   long hour;
+   double tow, tow2;
+   struct gps_tm ref, res;
+
+   for (week = 0; week <= ctx->sample_weeks; week++) {
+      for (hour = 0; hour < 7 * 24; hour++) {
+	 tow = hour * 3600.0 + random() % 3600 + random() % 1000000 / 1e6;
+	 legacy_gpstime2tm0(week, tow, &ref);
+	 gpstime2tm0(week, tow, &res);
+	 if (!tm_equal(&ref, &res))
+	    tm_error(ctx, "gpstime2tm0", week, tow, &ref, &res);
+	 if ((tm2gpstime(&res, &week2, &tow2) != 0) || (week2 != week)
+	       || (fabs(tow2 - tow) > 1e-6)) {
+	    if (ctx->errors++ < 10)
+	       printf("tm2gpstime %u %.7f: %u %.7f\n", week, tow, week2, tow2);
+	 }
+      }
+   }
+}
+
+/* UTC dates of inserted leap seconds: last day of month - 1 at 23:59:60  */
+static const struct {
+   unsigned year, month;
+} leap_dates[] = {
+   {1981, 7}, {1982, 7}, {1983, 7}, {1985, 7}, {1988, 1}, {1990, 1},
+   {1991, 1}, {1992, 7}, {1993, 7}, {1994, 7}, {1996, 1}, {1997, 7},
+   {1999, 1}, {2006, 1}, {2009, 1}, {2012, 7}, {2015, 7}, {2017, 1},
+};
+
+#define LEAP_DATES_CNT (sizeof(leap_dates)/sizeof(leap_dates[0]))
+
+static void check_leap(struct bench_ctx_t *ctx)
+{
+   unsigned i, leap;
+   long sec, gps_sec;
+   struct tm tm;
+   struct gps_tm ref, res;
+   struct gpstime_cache_t cache;
+
+   for (i=0; i < LEAP_DATES_CNT; i++) {
+      leap = i + 1;
+      memset(&tm, 0, sizeof(tm));
+      tm.tm_year = leap_dates[i].year - 1900;
+      tm.tm_mon = leap_dates[i].month - 1;
+      tm.tm_mday = 1;
+      /* GPS time of 00:00:00 UTC after the leap second  */
+      gps_sec = (long)(timegm(&tm) - GPS_EPOCH) + (long)leap;
+
+      if ((gps_leap_seconds(gps_sec / SECS_PER_WEEK, gps_sec % SECS_PER_WEEK) != (int)leap)
+	    || (gps_leap_seconds((gps_sec - 1) / SECS_PER_WEEK, (gps_sec - 1) % SECS_PER_WEEK) != (int)leap - 1)) {
+	 if (ctx->errors++ < 10)
+	    printf("gps_leap_seconds: leap second %u of %04u-%02u is not at %ld\n",
+		  leap, leap_dates[i].year, leap_dates[i].month, gps_sec);
+      }
+
+      gpstime_cache_init(&cache);
+      for (sec = gps_sec - SECS_PER_DAY; sec < gps_sec + SECS_PER_DAY; sec++) {
+	 if (sec == gps_sec - 1) {
+	    legacy_gpstime2tm0(0, (double)(sec - leap), &ref);
+	    ref.sec += 1.0;
+	 }else
+	    legacy_gpstime2tm0(0, (double)(sec - (sec < gps_sec ? leap - 1 : leap)), &ref);
+	 gpstime2utc(&cache, sec / SECS_PER_WEEK, (double)(sec % SECS_PER_WEEK), -1, &res);
+	 if (!tm_equal(&ref, &res)
+	       || ((sec == gps_sec - 1) && ((res.hour != 23) || (res.min != 59) || (res.sec != 60.0))))
+	    tm_error(ctx, "gpstime2utc", sec / SECS_PER_WEEK, (double)(sec % SECS_PER_WEEK), &ref, &res);
+      }
+   }
+}
+
+static uint64_t run_legacy(const struct bench_ctx_t *ctx, unsigned *sum)
+{
+   unsigned long n;
+   uint64_t t;
+   double tow;
+   struct gps_tm res;
+
+   tow = 0;
+   t = clock_ns();
+   for (n=0; n < ctx->count; n++) {
+      legacy_gpstime2tm0(ctx->first_week, tow, &res);
+      *sum += res.day;
+      tow += 0.1;
+   }
+   return clock_ns() - t;
+}
+
+static uint64_t run_cached(const struct bench_ctx_t *ctx, unsigned *sum)
+{
+   unsigned long n;
+   uint64_t t;
+   double tow;
+   struct gps_tm res;
+   struct gpstime_cache_t cache;
+
+   gpstime_cache_init(&cache);
+   tow = 0;
+   t = clock_ns();
+   for (n=0; n < ctx->count; n++) {
+      gpstime2tm(&cache, ctx->first_week, tow, &res);
+      *sum += res.day;
+      tow += 0.1;
+   }
+   return clock_ns() - t;
+}
+
+static uint64_t run_random(const struct bench_ctx_t *ctx, const uint32_t *secs,
+      unsigned secs_cnt, unsigned *sum)
+{
+   unsigned long n;
+   uint64_t t;
+   struct gps_tm res;
+
+   t = clock_ns();
+   for (n=0; n < ctx->count; n++) {
+      uint32_t s = secs[n % secs_cnt];
+      gpstime2tm0(s / SECS_PER_WEEK, (double)(s % SECS_PER_WEEK), &res);
+      *sum += res.day;
+   }
+   return clock_ns() - t;
+}
+
+static uint64_t run_random_legacy(const struct bench_ctx_t *ctx,
+      const uint32_t *secs, unsigned secs_cnt, unsigned *sum)
+{
+   unsigned long n;
+   uint64_t t;
+   struct gps_tm res;
+
+   t = clock_ns();
+   for (n=0; n < ctx->count; n++) {
+      uint32_t s = secs[n % secs_cnt];
+      legacy_gpstime2tm0(s / SECS_PER_WEEK, (double)(s % SECS_PER_WEEK), &res);
+      *sum += res.day;
+   }
+   return clock_ns() - t;
+}
+
+#define RANDOM_SECS_CNT 4096
+
+int main(int argc, char *argv[])
+{
+   signed char c;
+   unsigned i, k, sum;
+   uint64_t ns, best[4];
+   uint32_t secs[RANDOM_SECS_CNT];
+   struct bench_ctx_t ctx;
+   static const char *names[4] = {
+      "gmtime, 10 Hz", "gpstime2tm, 10 Hz", "gmtime, random", "gpstime2tm0, random"
+   };
+
+   static struct option longopts[] = {
+      {"version",      no_argument,       0, 'v'},
+      {"help",         no_argument,       0, 'h'},
+      {"runs",         required_argument, 0, 'n'},
+      {"weeks",        required_argument, 0, 'w'},
+      {"sample-weeks", required_argument, 0, 'W'},
+      {"count",        required_argument, 0, 'c'},
+      {"seed",         required_argument, 0, 'S'},
+      {0, 0, 0, 0}
+   };
+
+   memset(&ctx, 0, sizeof(ctx));
+   ctx.runs = 3;
+   ctx.first_week = 1700;
+   ctx.last_week = 2200;
+   ctx.sample_weeks = 9000;
+   ctx.count = 10000000;
+   ctx.seed = 1;
+
+   while ((c = getopt_long(argc, argv, "vh?n:w:W:c:S:",longopts,NULL)) != -1) {
+      switch (c) {
+	 case 'n':
+	    ctx.runs = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'w':
+	    if (sscanf(optarg, "%u:%u", &ctx.first_week, &ctx.last_week) != 2) {
+	       help();
+	       return 1;
+	    }
+	    break;
+	 case 'W':
+	    ctx.sample_weeks = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'c':
+	    ctx.count = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'S':
+	    ctx.seed = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'v':
+	    version();
+	    exit(0);
+	    break;
+	 default:
+	    help();
+	    exit(0);
+	    break;
+      }
+   }
+   argc -= optind;
+   argv += optind;
+
+   if (argc != 0 || (ctx.runs == 0) || (ctx.count == 0)
+	 || (ctx.first_week > ctx.last_week)) {
+      help();
+      return 1;
+   }
+
+   /* gmtime() of weeks after 2038 needs 64-bit time_t  */
+   if ((sizeof(time_t) < 8) && (ctx.sample_weeks > 3000))
+      ctx.sample_weeks = 3000;
+   if ((sizeof(time_t) < 8) && (ctx.last_week > 3000))
+      ctx.last_week = 3000;
+
+   srandom(ctx.seed);
+
+   check_seconds(&ctx);
+   check_sampled(&ctx);
+   if (sizeof(time_t) >= 8)
+      check_table_end(&ctx);
+   check_leap(&ctx);
+   if (ctx.errors) {
+      printf("check: %u errors\n", ctx.errors);
+      return 1;
+   }
+   printf("check: every second of weeks %u-%u, hourly of weeks 0-%u, "
+	 "%u leap seconds: ok\n", ctx.first_week, ctx.last_week,
+	 ctx.sample_weeks, (unsigned)LEAP_DATES_CNT);
+
+   for (i=0; i < RANDOM_SECS_CNT; i++)
+      secs[i] = (uint32_t)(random() % (3000 * SECS_PER_WEEK));
+
+   sum = 0;
+   for (k=0; k<4; k++)
+      best[k] = UINT64_MAX;
+   for (i=0; i < ctx.runs; i++) {
+      for (k=0; k<4; k++) {
+	 switch (k) {
+	    case 0: ns = run_legacy(&ctx, &sum); break;
+	    case 1: ns = run_cached(&ctx, &sum); break;
+	    case 2: ns = run_random_legacy(&ctx, secs, RANDOM_SECS_CNT, &sum); break;
+	    default: ns = run_random(&ctx, secs, RANDOM_SECS_CNT, &sum); break;
+	 }
+	 if (ns < best[k])
+	    best[k] = ns;
+      }
+   }
+
+   printf("%-20s %9s %12s %8s\n", "test", "time,s", "calls/s", "ns");
+   for (k=0; k<4; k++) {
+      printf("%-20s %9.3f %12.0f %8.1f\n", names[k], best[k] / 1e9,
+	    ctx.count / (best[k] / 1e9), best[k] / (double)ctx.count);
+   }
+   /* keeps the loops  */
+   if (sum == 1)
+      printf("\n");
+
+   return 0;
+}
@@ -1,12 +1,49 @@
 
 #include <assert.h>
+#include <math.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "gpsd/gps.h"
+#include "gpsd/crc24q.h"
 #include "sirfdump.h"
 #include "nav.h"
 #include "sirf_msg.h"
 #include "sirf_codec_ssb.h"
+#include "sirf_pal_storage.h"
+
+#define NAV_CACHE_STORAGE_ID SIRF_PAL_STORAGE_BBRAM
+#define NAV_CACHE_MAGIC 0x4e415643 /* NAVC */
+#define NAV_CACHE_VERSION 2
+/* Max |t - toe| of cached ephemeris, seconds  */
+#define NAV_CACHE_MAX_EPH_AGE (2*3600)
+/* Max age of cached iono/UTC parameters, seconds  */
+#define NAV_CACHE_MAX_IONO_AGE (7*86400)
+
+struct nav_cache_hdr_t {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t rec_size;
+   uint32_t rec_cnt;
+   uint32_t crc;
+   uint32_t gps_week;
+   double gps_tow;
+   unsigned time_is_valid;
+   unsigned iono_is_active;
+};
+
+struct nav_cache_rec_t {
+   uint32_t prn;
+   /* raw words of sub1..sub3  */
+   uint32_t words[3][10];
+};
+
+static int apply_subframe(struct nav_data_t *data,
+      const struct subframe_t *subp, const uint32_t *raw);
+static int is_eph_complete(const struct nav_sat_data_t *sat);
+static void eph_hist_push(struct nav_sat_data_t *sat);
+static double time_diff(unsigned wn, double tow, unsigned wn0, double tow0);
 
 void init_nav_data(struct nav_data_t *data)
 {
@@ -15,12 +52,17 @@ void init_nav_data(struct nav_data_t *data)
    assert(data);
 
    data->sub4_18.is_active=0;
+   data->time.is_valid = 0;
+   data->is_cache_loaded = 0;
 
    for(i=0; i < sizeof(data->prn)/sizeof(data->prn[0]); ++i) {
       data->prn[i].is_sub1_active =
 	 data->prn[i].is_sub2_active =
 	 data->prn[i].is_sub3_active =
+	 data->prn[i].is_cached =
 	 data->prn[i].is_printed = 0;
+      data->prn[i].hist_head = data->prn[i].hist_cnt = 0;
+      memset(data->prn[i].words, 0, sizeof(data->prn[i].words));
    }
 }
 
@@ -28,7 +70,7 @@ struct nav_sat_data_t *get_navdata_p(struct nav_data_t *data, unsigned prn)
 {
    assert(data);
 
-   if (prn > MAX_GPS_PRN)
+   if (prn == 0 || (prn > MAX_GPS_PRN))
       return NULL;
 
    return &data->prn[prn-1];
@@ -39,104 +81,119 @@ int populate_navdata_from_mid8(
       struct nav_data_t *data
       )
 {
-   int data_changed;
    unsigned i;
    struct subframe_t subp;
-   struct nav_sat_data_t *dst;
    uint32_t words[10];
 
    assert(msg);
    assert(data);
 
    for(i=0; i<10; i++)
-      words[i]=msg->word[i];
+      words[i] = msg->word[i];
 
    if (gpsd_interpret_subframe_raw(&subp, msg->svid, words) <= 0)
       return -1;
 
+   return apply_subframe(data, &subp, msg->word);
+}
+
+static int apply_subframe(struct nav_data_t *data,
+      const struct subframe_t *subp, const uint32_t *raw)
+{
+   int data_changed;
+   struct nav_sat_data_t *dst;
+
    data_changed = 0;
-   dst = get_navdata_p(data, subp.tSVID);
+   dst = get_navdata_p(data, subp->tSVID);
    /* XXX  */
    if (dst == NULL)
       return -2;
 
-   switch (subp.subframe_num) {
+   switch (subp->subframe_num) {
       case 1:
 	 if (dst->is_sub1_active
-	       && (dst->sub1.sub1.IODC == dst->sub1.sub1.IODC))
+	       && (dst->iodc == subp->sub1.IODC))
 	    /*  skip subframe */
 	    break;
 
-	 memcpy(&dst->sub1, &subp, sizeof(subp));
+	 dst->wn = subp->sub1.WN;
+	 dst->iodc = subp->sub1.IODC;
+	 dst->is_cached = 0;
+	 memcpy(dst->words[0], raw, sizeof(dst->words[0]));
 	 dst->is_sub1_active = 1;
 	 data_changed = 1;
 	 if (dst->is_sub2_active
-	       && ((dst->sub1.sub1.IODC & 0xff) != dst->sub2.sub2.IODE))
+	       && ((dst->iodc & 0xff) != dst->iode2))
 	    dst->is_sub2_active = 0;
 	 if (dst->is_sub3_active
-	       && ((dst->sub1.sub1.IODC & 0xff) != dst->sub3.sub3.IODE))
+	       && ((dst->iodc & 0xff) != dst->iode3))
 	    dst->is_sub3_active = 0;
 	 break;
       case 2:
 	 if (dst->is_sub2_active
-	       && (dst->sub2.sub2.IODE == subp.sub2.IODE))
+	       && (dst->iode2 == subp->sub2.IODE))
 	    /*  skip subframe */
 	    break;
 
-	 memcpy(&dst->sub2, &subp, sizeof(subp));
+	 dst->iode2 = subp->sub2.IODE;
+	 dst->toe = (int32_t)subp->sub2.l_toe;
+	 dst->is_cached = 0;
+	 memcpy(dst->words[1], raw, sizeof(dst->words[0]));
 	 data_changed = 1;
 	 dst->is_sub2_active = 1;
 	 if (dst->is_sub1_active
-	       && ((dst->sub1.sub1.IODC & 0xff) != dst->sub2.sub2.IODE))
+	       && ((dst->iodc & 0xff) != dst->iode2))
 	    dst->is_sub1_active = 0;
 	 if (dst->is_sub3_active
-	       && (dst->sub3.sub3.IODE != dst->sub2.sub2.IODE))
+	       && (dst->iode3 != dst->iode2))
 	    dst->is_sub3_active = 0;
 	 break;
       case 3:
 	 if (dst->is_sub3_active
-	       && (dst->sub3.sub3.IODE == subp.sub3.IODE))
+	       && (dst->iode3 == subp->sub3.IODE))
 	    /*  skip subframe */
 	    break;
 
-	 memcpy(&dst->sub3, &subp, sizeof(subp));
+	 dst->iode3 = subp->sub3.IODE;
+	 dst->is_cached = 0;
+	 memcpy(dst->words[2], raw, sizeof(dst->words[0]));
 	 data_changed = 1;
 	 dst->is_sub3_active = 1;
 	 if (dst->is_sub1_active
-	       && ((dst->sub1.sub1.IODC & 0xff) != dst->sub3.sub3.IODE))
+	       && ((dst->iodc & 0xff) != dst->iode3))
 	    dst->is_sub1_active = 0;
 	 if (dst->is_sub2_active
-	       && (dst->sub2.sub2.IODE != dst->sub3.sub3.IODE))
+	       && (dst->iode2 != dst->iode3))
 	    dst->is_sub2_active = 0;
 	 break;
       case 4:
-	 if (subp.pageid == 56) {
+	 if (subp->pageid == 56) {
 	    if ( data->sub4_18.is_active
-		  && ((data->sub4_18.ion_alpha[0] != subp.sub4_18.d_alpha0)
-		     || (data->sub4_18.ion_alpha[1] != subp.sub4_18.d_alpha1)
-		     || (data->sub4_18.ion_alpha[2] != subp.sub4_18.d_alpha2)
-		     || (data->sub4_18.ion_alpha[3] != subp.sub4_18.d_alpha3)
-		     || (data->sub4_18.ion_beta[0] != subp.sub4_18.d_beta0)
-		     || (data->sub4_18.ion_beta[1] != subp.sub4_18.d_beta1)
-		     || (data->sub4_18.ion_beta[2] != subp.sub4_18.d_beta2)
-		     || (data->sub4_18.ion_beta[3] != subp.sub4_18.d_beta3)
+		  && ((data->sub4_18.ion_alpha[0] != subp->sub4_18.d_alpha0)
+		     || (data->sub4_18.ion_alpha[1] != subp->sub4_18.d_alpha1)
+		     || (data->sub4_18.ion_alpha[2] != subp->sub4_18.d_alpha2)
+		     || (data->sub4_18.ion_alpha[3] != subp->sub4_18.d_alpha3)
+		     || (data->sub4_18.ion_beta[0] != subp->sub4_18.d_beta0)
+		     || (data->sub4_18.ion_beta[1] != subp->sub4_18.d_beta1)
+		     || (data->sub4_18.ion_beta[2] != subp->sub4_18.d_beta2)
+		     || (data->sub4_18.ion_beta[3] != subp->sub4_18.d_beta3)
 		     ))
 	       data->sub4_18.is_active = 0;
 
 	    if (data->sub4_18.is_active == 0) {
-	       data->sub4_18.ion_alpha[0] = subp.sub4_18.d_alpha0;
-	       data->sub4_18.ion_alpha[1] = subp.sub4_18.d_alpha1;
-	       data->sub4_18.ion_alpha[2] = subp.sub4_18.d_alpha2;
-	       data->sub4_18.ion_alpha[3] = subp.sub4_18.d_alpha3;
-	       data->sub4_18.ion_beta[0] = subp.sub4_18.d_beta0;
-	       data->sub4_18.ion_beta[1] = subp.sub4_18.d_beta1;
-	       data->sub4_18.ion_beta[2] = subp.sub4_18.d_beta2;
-	       data->sub4_18.ion_beta[3] = subp.sub4_18.d_beta3;
-	       data->sub4_18.a0 = subp.sub4_18.d_A0;
-	       data->sub4_18.a1 = subp.sub4_18.d_A1;
-	       data->sub4_18.tot = subp.sub4_18.d_tot;
-	       data->sub4_18.WNt = subp.sub4_18.WNt;
-	       data->sub4_18.leap = subp.sub4_18.leap;
+	       data->sub4_18.ion_alpha[0] = subp->sub4_18.d_alpha0;
+	       data->sub4_18.ion_alpha[1] = subp->sub4_18.d_alpha1;
+	       data->sub4_18.ion_alpha[2] = subp->sub4_18.d_alpha2;
+	       data->sub4_18.ion_alpha[3] = subp->sub4_18.d_alpha3;
+	       data->sub4_18.ion_beta[0] = subp->sub4_18.d_beta0;
+	       data->sub4_18.ion_beta[1] = subp->sub4_18.d_beta1;
+	       data->sub4_18.ion_beta[2] = subp->sub4_18.d_beta2;
+	       data->sub4_18.ion_beta[3] = subp->sub4_18.d_beta3;
+	       data->sub4_18.a0 = subp->sub4_18.d_A0;
+	       data->sub4_18.a1 = subp->sub4_18.d_A1;
+	       data->sub4_18.tot = subp->sub4_18.d_tot;
+	       data->sub4_18.WNt = subp->sub4_18.WNt;
+	       data->sub4_18.leap = subp->sub4_18.leap;
 	       data->sub4_18.is_active = 1;
 	       data_changed |= 0x02;
 	    }
@@ -146,7 +203,416 @@ int populate_navdata_from_mid8(
 	 break;
    }
 
+   if ((data_changed & 0x01) && is_eph_complete(dst))
+      eph_hist_push(dst);
+
    return data_changed;
 }
 
+/*
+ * Navigation data restored from a snapshot (sirfdump --state-in) is
+ * handled like the loaded cache: complete ephemerides are output again on
+ * the first nav_data_set_time() call, the outdated ones are dropped.
+ */
+void nav_data_restored(struct nav_data_t *data)
+{
+   unsigned i;
+   struct nav_sat_data_t *sat;
+
+   assert(data);
+
+   for(i=0; i < sizeof(data->prn)/sizeof(data->prn[0]); ++i) {
+      sat = &data->prn[i];
+      sat->is_cached = is_eph_complete(sat);
+   }
+   data->is_cache_loaded = 1;
+}
+
+/*
+ * Set current GPS time. First call after nav_cache_load() drops cached
+ * ephemerides and iono data that are too old for this time.
+ * Returns number of valid cached ephemerides on first call, 0 otherwise.
+ */
+int nav_data_set_time(struct nav_data_t *data, unsigned gps_week, double gps_tow)
+{
+   unsigned i;
+   int res;
+   struct nav_sat_data_t *sat;
+
+   assert(data);
+
+   if (data->is_cache_loaded) {
+      if (data->sub4_18.is_active
+	    && (!data->time.is_valid
+	       || (fabs(time_diff(gps_week, gps_tow,
+		     data->time.gps_week, data->time.gps_tow)) > NAV_CACHE_MAX_IONO_AGE)))
+	 data->sub4_18.is_active = 0;
+   }
+
+   data->time.gps_week = gps_week;
+   data->time.gps_tow = gps_tow;
+   data->time.is_valid = 1;
+
+   if (!data->is_cache_loaded)
+      return 0;
+   data->is_cache_loaded = 0;
+
+   res = 0;
+   for(i=0; i < sizeof(data->prn)/sizeof(data->prn[0]); ++i) {
+      sat = &data->prn[i];
+      if (!sat->is_cached)
+	 continue;
+      if (!is_eph_complete(sat)
+	    || (fabs(time_diff(sat->wn, (double)sat->toe,
+		  gps_week, gps_tow)) > NAV_CACHE_MAX_EPH_AGE)) {
+	 sat->is_sub1_active = sat->is_sub2_active = sat->is_sub3_active = 0;
+	 sat->is_cached = 0;
+	 sat->hist_head = sat->hist_cnt = 0;
+      }else
+	 res++;
+   }
+
+   return res;
+}
+
+int nav_cache_load(struct nav_data_t *data, const char *fname)
+{
+   unsigned i;
+   int loaded;
+   struct nav_cache_hdr_t hdr;
+   struct nav_cache_rec_t rec;
+   struct nav_eph_rec_t eph_rec;
+   struct nav_eph_t eph;
+   struct nav_sat_data_t *sat;
+   struct crc24_iovec iov[2];
+   unsigned crc;
+   unsigned offset;
+
+   assert(data);
+
+   SIRF_PAL_STORAGE_SetFileName(NAV_CACHE_STORAGE_ID, fname);
+   if (SIRF_PAL_STORAGE_Open(NAV_CACHE_STORAGE_ID) != SIRF_SUCCESS)
+      return -1;
+
+   loaded = -1;
+   if (SIRF_PAL_STORAGE_Read(NAV_CACHE_STORAGE_ID, 0,
+	    (tSIRF_UINT8 *)&hdr, sizeof(hdr)) != SIRF_SUCCESS)
+      goto close;
+
+   if ((hdr.magic != NAV_CACHE_MAGIC)
+	 || (hdr.version != NAV_CACHE_VERSION)
+	 || (hdr.rec_size != sizeof(rec))
+	 || (hdr.rec_cnt > MAX_GPS_PRN)) {
+      fputs("Navigation cache: wrong format, ignored\n", stderr);
+      goto close;
+   }
+
+   offset = sizeof(hdr);
+   if (SIRF_PAL_STORAGE_Read(NAV_CACHE_STORAGE_ID, offset,
+	    (tSIRF_UINT8 *)&data->sub4_18, sizeof(data->sub4_18)) != SIRF_SUCCESS)
+      goto close;
+   offset += sizeof(data->sub4_18);
+
+   iov[0].iov_base = &data->sub4_18;
+   iov[0].iov_len = sizeof(data->sub4_18);
+   crc = crc24q_hashv(iov, 1);
+
+   loaded = 0;
+   for (i=0; i < hdr.rec_cnt; i++, offset += sizeof(rec)) {
+      if (SIRF_PAL_STORAGE_Read(NAV_CACHE_STORAGE_ID, offset,
+	       (tSIRF_UINT8 *)&rec, sizeof(rec)) != SIRF_SUCCESS)
+	 break;
+      iov[0].iov_base = &crc;
+      iov[0].iov_len = sizeof(crc);
+      iov[1].iov_base = &rec;
+      iov[1].iov_len = sizeof(rec);
+      crc = crc24q_hashv(iov, 2);
+
+      sat = get_navdata_p(data, rec.prn);
+      if ((rec.prn == 0) || (sat == NULL))
+	 continue;
+      memcpy(eph_rec.words, rec.words, sizeof(eph_rec.words));
+      if ((nav_eph_decode(&eph_rec, rec.prn, &eph) != 0)
+	    || (eph.sub1.tSVID != rec.prn))
+	 continue;
+      sat->wn = eph.sub1.sub1.WN;
+      sat->iodc = eph.sub1.sub1.IODC;
+      sat->iode2 = eph.sub2.sub2.IODE;
+      sat->iode3 = eph.sub3.sub3.IODE;
+      sat->toe = (int32_t)eph.sub2.sub2.l_toe;
+      memcpy(sat->words, rec.words, sizeof(sat->words));
+      sat->is_sub1_active = sat->is_sub2_active = sat->is_sub3_active = 1;
+      sat->is_cached = 1;
+      eph_hist_push(sat);
+      loaded++;
+   }
+
+   if ((i != hdr.rec_cnt) || (crc != hdr.crc)) {
+      fputs("Navigation cache: checksum error, ignored\n", stderr);
+      SIRF_PAL_STORAGE_Close(NAV_CACHE_STORAGE_ID);
+      init_nav_data(data);
+      return -1;
+   }
+
+   data->sub4_18.is_active = hdr.iono_is_active ? 1 : 0;
+   data->time.gps_week = hdr.gps_week;
+   data->time.gps_tow = hdr.gps_tow;
+   data->time.is_valid = hdr.time_is_valid ? 1 : 0;
+   data->is_cache_loaded = 1;
+
+close:
+   SIRF_PAL_STORAGE_Close(NAV_CACHE_STORAGE_ID);
+   if (loaded < 0)
+      data->sub4_18.is_active = 0;
+   return loaded;
+}
+
+/* Newer of two current ephemerides, NULL if none is complete  */
+static const struct nav_eph_rec_t *newer_eph(const struct nav_eph_rec_t *a,
+      const struct nav_eph_rec_t *b)
+{
+   if (b == NULL)
+      return a;
+   if (a == NULL)
+      return b;
+   return time_diff(b->wn, (double)b->toe, a->wn, (double)a->toe) > 0 ? b : a;
+}
+
+/*
+ * Cache is shared by all runs using the file: data saved meanwhile by
+ * another run is merged, newer ephemerides win, iono/UTC data of this
+ * run wins.
+ */
+int nav_cache_save(const struct nav_data_t *data, const char *fname)
+{
+   unsigned i;
+   struct nav_cache_hdr_t hdr;
+   struct nav_cache_rec_t rec;
+   const struct nav_eph_rec_t *eph;
+   const struct nav_data_t *iono, *time;
+   struct nav_data_t *saved;
+   struct crc24_iovec iov[2];
+   unsigned offset;
+   int res;
+
+   assert(data);
+
+   saved = malloc(sizeof(*saved));
+   if (saved == NULL) {
+      perror(NULL);
+      return -1;
+   }
+   init_nav_data(saved);
+   if (nav_cache_load(saved, fname) < 0)
+      init_nav_data(saved);
+   iono = data->sub4_18.is_active || !saved->sub4_18.is_active ? data : saved;
+   time = saved->time.is_valid && (!data->time.is_valid
+	 || (time_diff(saved->time.gps_week, saved->time.gps_tow,
+	       data->time.gps_week, data->time.gps_tow) > 0)) ? saved : data;
+
+   SIRF_PAL_STORAGE_SetFileName(NAV_CACHE_STORAGE_ID, fname);
+   if (SIRF_PAL_STORAGE_Open(NAV_CACHE_STORAGE_ID) != SIRF_SUCCESS) {
+      fputs("Navigation cache: can not open storage\n", stderr);
+      free(saved);
+      return -1;
+   }
+
+   memset(&hdr, 0, sizeof(hdr));
+   hdr.magic = NAV_CACHE_MAGIC;
+   hdr.version = NAV_CACHE_VERSION;
+   hdr.rec_size = sizeof(rec);
+   hdr.rec_cnt = 0;
+   hdr.gps_week = time->time.gps_week;
+   hdr.gps_tow = time->time.gps_tow;
+   hdr.time_is_valid = time->time.is_valid;
+   hdr.iono_is_active = iono->sub4_18.is_active;
+
+   res = 0;
+   offset = sizeof(hdr);
+   if (SIRF_PAL_STORAGE_Write(NAV_CACHE_STORAGE_ID, offset,
+	    (tSIRF_UINT8 *)&iono->sub4_18, sizeof(iono->sub4_18)) != SIRF_SUCCESS)
+      res = -1;
+   offset += sizeof(iono->sub4_18);
+
+   iov[0].iov_base = (void *)&iono->sub4_18;
+   iov[0].iov_len = sizeof(iono->sub4_18);
+   hdr.crc = crc24q_hashv(iov, 1);
+
+   for (i=1; (res == 0) && (i <= MAX_GPS_PRN); i++) {
+      eph = newer_eph(nav_eph_current(data, i), nav_eph_current(saved, i));
+      if (eph == NULL)
+	 continue;
+      memset(&rec, 0, sizeof(rec));
+      rec.prn = i;
+      memcpy(rec.words, eph->words, sizeof(rec.words));
+      if (SIRF_PAL_STORAGE_Write(NAV_CACHE_STORAGE_ID, offset,
+	       (tSIRF_UINT8 *)&rec, sizeof(rec)) != SIRF_SUCCESS) {
+	 res = -1;
+	 break;
+      }
+      offset += sizeof(rec);
+      hdr.rec_cnt++;
+      iov[0].iov_base = &hdr.crc;
+      iov[0].iov_len = sizeof(hdr.crc);
+      iov[1].iov_base = &rec;
+      iov[1].iov_len = sizeof(rec);
+      hdr.crc = crc24q_hashv(iov, 2);
+   }
+
+   /* header goes last: interrupted write leaves old header with wrong crc  */
+   if ((res == 0)
+	 && (SIRF_PAL_STORAGE_Write(NAV_CACHE_STORAGE_ID, 0,
+	       (tSIRF_UINT8 *)&hdr, sizeof(hdr)) != SIRF_SUCCESS))
+      res = -1;
+
+   if (res != 0)
+      fputs("Navigation cache: write error\n", stderr);
+
+   SIRF_PAL_STORAGE_Close(NAV_CACHE_STORAGE_ID);
+   free(saved);
+
+   return res;
+}
+
+static int is_eph_complete(const struct nav_sat_data_t *sat)
+{
+   return sat->is_sub1_active
+      && sat->is_sub2_active
+      && sat->is_sub3_active
+      && ((sat->iodc & 0xff) == sat->iode2)
+      && (sat->iode2 == sat->iode3);
+}
+
+/* (wn, tow) - (wn0, tow0), seconds. wn may be 10-bit truncated  */
+static double time_diff(unsigned wn, double tow, unsigned wn0, double tow0)
+{
+   int dwn;
+
+   dwn = (int)((wn - wn0) & 0x3ff);
+   if (dwn >= 512)
+      dwn -= 1024;
+
+   return dwn * 604800.0 + tow - tow0;
+}
+
+/* Current complete set: the newest one of the ring  */
+const struct nav_eph_rec_t *nav_eph_current(const struct nav_data_t *data,
+      unsigned prn)
+{
+   const struct nav_sat_data_t *sat;
+   const struct nav_eph_rec_t *rec;
+
+   sat = get_navdata_p((struct nav_data_t *)data, prn);
+   if (sat == NULL || !is_eph_complete(sat) || (sat->hist_cnt == 0))
+      return NULL;
+
+   rec = &sat->hist[sat->hist_head];
+   if ((rec->iodc != sat->iodc)
+	 || (rec->toe != sat->toe))
+      return NULL;
+
+   return rec;
+}
+
+/* Newest set of the ring with the IODE, sets older than the current one
+ * included  */
+const struct nav_eph_rec_t *nav_eph_find_iode(const struct nav_data_t *data,
+      unsigned prn, unsigned iode)
+{
+   unsigned i;
+   const struct nav_sat_data_t *sat;
+   const struct nav_eph_rec_t *rec;
+
+   sat = get_navdata_p((struct nav_data_t *)data, prn);
+   if (sat == NULL)
+      return NULL;
+
+   for (i=0; i < sat->hist_cnt; i++) {
+      rec = &sat->hist[(sat->hist_head + NAV_EPH_HISTORY - i) % NAV_EPH_HISTORY];
+      if ((rec->iodc & 0xff) == iode)
+	 return rec;
+   }
+
+   return NULL;
+}
+
+/* Find ephemeris set with toe nearest to given time  */
+const struct nav_eph_rec_t *nav_eph_find_time(const struct nav_data_t *data,
+      unsigned prn, unsigned gps_week, double gps_tow)
+{
+   unsigned i;
+   double dt, best_dt;
+   const struct nav_sat_data_t *sat;
+   const struct nav_eph_rec_t *rec, *best;
+
+   sat = get_navdata_p((struct nav_data_t *)data, prn);
+   if (sat == NULL)
+      return NULL;
+
+   best = NULL;
+   best_dt = 0;
+   for (i=0; i < sat->hist_cnt; i++) {
+      rec = &sat->hist[(sat->hist_head + NAV_EPH_HISTORY - i) % NAV_EPH_HISTORY];
+      dt = fabs(time_diff(rec->wn, rec->toe, gps_week, gps_tow));
+      if ((best == NULL) || (dt < best_dt)) {
+	 best = rec;
+	 best_dt = dt;
+      }
+   }
+
+   return best;
+}
 
+/* Add current set to the ring, unless it is the newest set already  */
+static void eph_hist_push(struct nav_sat_data_t *sat)
+{
+   struct nav_eph_rec_t *rec;
+
+   if (sat->hist_cnt) {
+      rec = &sat->hist[sat->hist_head];
+      if ((rec->iodc == sat->iodc)
+	    && (rec->toe == sat->toe)
+	    && (rec->wn == sat->wn))
+	 return;
+      sat->hist_head = (sat->hist_head + 1) % NAV_EPH_HISTORY;
+   }
+   if (sat->hist_cnt < NAV_EPH_HISTORY)
+      sat->hist_cnt++;
+
+   rec = &sat->hist[sat->hist_head];
+   rec->wn = sat->wn;
+   rec->iodc = sat->iodc;
+   rec->toe = sat->toe;
+   memcpy(rec->words, sat->words, sizeof(rec->words));
+}
+
+/* Parity of the 30 words is checked in one batch  */
+int nav_eph_decode(const struct nav_eph_rec_t *rec, unsigned prn,
+      struct nav_eph_t *res)
+{
+   unsigned i;
+   unsigned svid[3];
+   uint32_t words[3][10];
+   struct subframe_t subp[3];
+
+   assert(rec);
+   assert(res);
+
+   svid[0] = svid[1] = svid[2] = prn;
+   memcpy(words, rec->words, sizeof(words));
+   if (gpsd_interpret_subframes_raw(subp, svid, words, 3) != 3)
+      return -1;
+   for (i=0; i<3; i++) {
+      if (subp[i].subframe_num != i + 1)
+	 return -1;
+   }
+   memcpy(&res->sub1, &subp[0], sizeof(subp[0]));
+   memcpy(&res->sub2, &subp[1], sizeof(subp[1]));
+   memcpy(&res->sub3, &subp[2], sizeof(subp[2]));
+
+   if (((res->sub1.sub1.IODC & 0xff) != res->sub2.sub2.IODE)
+	 || (res->sub2.sub2.IODE != res->sub3.sub3.IODE))
+      return -1;
+
+   return 0;
+}
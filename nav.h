@@ -4,6 +4,24 @@
 #include "gpsd/gps.h"
 #include "sirf_msg.h"
 
+/* Number of complete ephemeris sets kept per PRN  */
+#define NAV_EPH_HISTORY 8
+
+/* Decoded ephemeris set  */
+struct nav_eph_t {
+   struct subframe_t sub1;
+   struct subframe_t sub2;
+   struct subframe_t sub3;
+};
+
+/* Complete ephemeris set: raw subframe 1-3 words as received in MID 8  */
+struct nav_eph_rec_t {
+   uint16_t wn;
+   uint16_t iodc;
+   int32_t toe;
+   uint32_t words[3][10];
+};
+
 struct nav_data_t {
    struct {
       double ion_alpha[4];
@@ -13,14 +31,32 @@ struct nav_data_t {
       unsigned leap;
       unsigned is_active;
    } sub4_18;
+   struct {
+      unsigned gps_week;
+      double gps_tow;
+      unsigned is_valid;
+   } time;
+   unsigned is_cache_loaded;
    struct nav_sat_data_t {
       unsigned is_printed;
+      unsigned is_cached;
       unsigned is_sub1_active;
       unsigned is_sub2_active;
       unsigned is_sub3_active;
-      struct subframe_t sub1;
-      struct subframe_t sub2;
-      struct subframe_t sub3;
+      /* sub1..sub3 being received: IODC and WN of sub1, IODE of sub2 and
+       * sub3, toe of sub2, raw words. Complete sets are decoded from
+       * hist[] only  */
+      uint16_t wn;
+      uint16_t iodc;
+      uint8_t iode2;
+      uint8_t iode3;
+      int32_t toe;
+      uint32_t words[3][10];
+      /* ring of complete sets, newest at hist[hist_head]. The current
+       * set is the newest one when it is complete  */
+      unsigned hist_head;
+      unsigned hist_cnt;
+      struct nav_eph_rec_t hist[NAV_EPH_HISTORY];
    } prn[MAX_GPS_PRN+1];
 };
 
@@ -30,6 +66,27 @@ int populate_navdata_from_mid8(
       const tSIRF_MSG_SSB_50BPS_DATA *msg,
       struct nav_data_t *data
       );
+int nav_data_set_time(struct nav_data_t *data, unsigned gps_week, double gps_tow);
+/* Navigation data copied from a snapshot of another run  */
+void nav_data_restored(struct nav_data_t *data);
+
+/* Ephemeris history lookup, NULL if not found  */
+const struct nav_eph_rec_t *nav_eph_current(const struct nav_data_t *data,
+      unsigned prn);
+/* Newest set with the given IODE  */
+const struct nav_eph_rec_t *nav_eph_find_iode(const struct nav_data_t *data,
+      unsigned prn, unsigned iode);
+/* Set with toe nearest to the given time  */
+const struct nav_eph_rec_t *nav_eph_find_time(const struct nav_data_t *data,
+      unsigned prn, unsigned gps_week, double gps_tow);
+/* Decode set of prn. Returns -1 on parity error or IODE/IODC mismatch  */
+int nav_eph_decode(const struct nav_eph_rec_t *rec, unsigned prn,
+      struct nav_eph_t *res);
+
+/* Ephemeris and iono/UTC cache kept in PAL storage, file fname
+ * (NULL: NVM0 in the current directory)  */
+int nav_cache_load(struct nav_data_t *data, const char *fname);
+int nav_cache_save(const struct nav_data_t *data, const char *fname);
 
 
 #endif /* NAV_H */
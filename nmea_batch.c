@@ -0,0 +1,394 @@
+#include <assert.h>
+#include <ctype.h>
+#include <math.h>
+#include <string.h>
+
+#include "sirf_types.h"
+#include "sirf_msg.h"
+#include "sirf_msg_ssb.h"
+#include "nmea_batch.h"
+
+struct sentence_t {
+   char *p;
+   unsigned ck;
+};
+
+static const char *const sentence_names[] = {
+   "GGA", "RMC", "GLL", "GSA", "VTG", "GSV"
+};
+
+static const uint32_t pow10_tbl[] = {
+   1, 10, 100, 1000, 10000, 100000, 1000000
+};
+
+static char *encode_geodetic(unsigned mask,
+      const tSIRF_MSG_SSB_GEODETIC_NAVIGATION *data, char *p, char *end);
+static char *encode_gsv(const tSIRF_MSG_SSB_MEASURED_TRACKER *data,
+      char *p, char *end);
+
+int nmea_batch_encode(unsigned mask, uint32_t msg_id, const void *msg,
+      char *buf, size_t size)
+{
+   char *p;
+
+   assert(msg);
+   assert(buf);
+
+   switch (msg_id) {
+      case SIRF_MSG_SSB_GEODETIC_NAVIGATION:
+	 p = encode_geodetic(mask,
+	       (const tSIRF_MSG_SSB_GEODETIC_NAVIGATION *)msg, buf, buf + size);
+	 break;
+      case SIRF_MSG_SSB_MEASURED_TRACKER:
+	 if (!(mask & NMEA_GSV))
+	    return 0;
+	 p = encode_gsv((const tSIRF_MSG_SSB_MEASURED_TRACKER *)msg,
+	       buf, buf + size);
+	 break;
+      default:
+	 return 0;
+   }
+
+   if (p == NULL)
+      return -1;
+
+   return p - buf;
+}
+
+int nmea_batch_parse_mask(const char *list, unsigned *mask)
+{
+   unsigned i, l;
+   const char *p;
+
+   assert(list);
+   assert(mask);
+
+   *mask = 0;
+   for (p = list; *p; ) {
+      for (l=0; p[l] && p[l] != ','; l++);
+      if (l == 3 && toupper((unsigned char)p[0]) == 'A'
+	    && toupper((unsigned char)p[1]) == 'L'
+	    && toupper((unsigned char)p[2]) == 'L') {
+	 *mask |= NMEA_ALL;
+      }else {
+	 for (i=0; i < sizeof(sentence_names)/sizeof(sentence_names[0]); i++) {
+	    if (l == 3 && toupper((unsigned char)p[0]) == sentence_names[i][0]
+		  && toupper((unsigned char)p[1]) == sentence_names[i][1]
+		  && toupper((unsigned char)p[2]) == sentence_names[i][2])
+	       break;
+	 }
+	 if (i == sizeof(sentence_names)/sizeof(sentence_names[0]))
+	    return -1;
+	 *mask |= 1 << i;
+      }
+      p += l;
+      if (*p == ',')
+	 p++;
+   }
+
+   return 0;
+}
+
+static void put_c(struct sentence_t *s, char c)
+{
+   *s->p++ = c;
+   s->ck ^= (unsigned char)c;
+}
+
+static void put_str(struct sentence_t *s, const char *str)
+{
+   while (*str)
+      put_c(s, *str++);
+}
+
+/* v, zero padded to width digits  */
+static void put_uint(struct sentence_t *s, uint64_t v, unsigned width)
+{
+   char tmp[24];
+   unsigned n;
+
+   assert(width <= sizeof(tmp));
+
+   n = 0;
+   do {
+      tmp[n++] = '0' + (char)(v % 10);
+      v /= 10;
+   } while (v);
+   while (n < width)
+      tmp[n++] = '0';
+   while (n)
+      put_c(s, tmp[--n]);
+}
+
+/* v rounded to decimals (<= 6) digits after the point  */
+static void put_fixed(struct sentence_t *s, double v, unsigned decimals)
+{
+   uint64_t i, scale;
+
+   scale = pow10_tbl[decimals];
+   i = (uint64_t)(fabs(v) * scale + 0.5);
+   if (v < 0 && (i != 0))
+      put_c(s, '-');
+   put_uint(s, i / scale, 1);
+   if (decimals) {
+      put_c(s, '.');
+      put_uint(s, i % scale, decimals);
+   }
+}
+
+/* 1e-7 degrees to dddmm.mmmm,H. Minutes are exact: 1e-7 deg is 6e-6 min.
+ * Truncated to decimals (<= 6) digits  */
+static void put_angle(struct sentence_t *s, int32_t v, unsigned deg_width,
+      unsigned decimals, char pos, char neg)
+{
+   uint32_t a, min;
+
+   a = v < 0 ? (uint32_t)0 - (uint32_t)v : (uint32_t)v;
+   /* minutes, 1e-6  */
+   min = (a % 10000000) * 6 / pow10_tbl[6 - decimals];
+
+   put_uint(s, a / 10000000, deg_width);
+   put_uint(s, min / pow10_tbl[decimals], 2);
+   put_c(s, '.');
+   put_uint(s, min % pow10_tbl[decimals], decimals);
+   put_c(s, ',');
+   put_c(s, v < 0 ? neg : pos);
+}
+
+/* hhmmss.sss  */
+static void put_time(struct sentence_t *s,
+      const tSIRF_MSG_SSB_GEODETIC_NAVIGATION *data)
+{
+   put_uint(s, data->utc_hour, 2);
+   put_uint(s, data->utc_min, 2);
+   put_uint(s, data->utc_sec / 1000, 2);
+   put_c(s, '.');
+   put_uint(s, data->utc_sec % 1000, 3);
+}
+
+static void begin(struct sentence_t *s, char *p, const char *name)
+{
+   *p++ = '$';
+   s->p = p;
+   s->ck = 0;
+   put_str(s, name);
+}
+
+static char *finish(struct sentence_t *s)
+{
+   static const char hex[] = "0123456789ABCDEF";
+   char *p;
+
+   p = s->p;
+   *p++ = '*';
+   *p++ = hex[(s->ck >> 4) & 0x0f];
+   *p++ = hex[s->ck & 0x0f];
+   *p++ = '\r';
+   *p++ = '\n';
+
+   return p;
+}
+
+static char *encode_geodetic(unsigned mask,
+      const tSIRF_MSG_SSB_GEODETIC_NAVIGATION *data, char *p, char *end)
+{
+   unsigned i, n, mode, hdop;
+   char mode_c, status_c;
+   double speed_knots, speed_kmh;
+   struct sentence_t s;
+
+   mode = data->nav_mode & SIRF_MSG_SSB_MODE_MASK;
+   if (mode == 0) {
+      mode_c = 'N';
+      status_c = 'V';
+   }else if (mode == 7) {
+      mode_c = 'E';
+      status_c = 'A';
+   }else if (data->nav_mode & SIRF_MSG_SSB_MODE_DGPS_USED) {
+      mode_c = 'D';
+      status_c = 'A';
+   }else {
+      mode_c = 'A';
+      status_c = 'A';
+   }
+
+   /* 0.2 LSB, in 0.1  */
+   hdop = data->hdop * 2;
+   speed_knots = data->sog * 1e-2 * 3600.0 / (0.3048 * 6076.0);
+   speed_kmh = data->sog * 1e-2 * 3.6;
+
+   if (mask & NMEA_GGA) {
+      if (end - p < NMEA_MAX_SENTENCE)
+	 return NULL;
+      begin(&s, p, "GPGGA,");
+      put_time(&s, data);
+      put_c(&s, ',');
+      if (mode == 0) {
+	 put_str(&s, ",,,,0,00,,,M,,M,,");
+      }else {
+	 put_angle(&s, data->lat, 2, 6, 'N', 'S');
+	 put_c(&s, ',');
+	 put_angle(&s, data->lon, 3, 6, 'E', 'W');
+	 put_c(&s, ',');
+	 put_c(&s, mode == 7 ? '6'
+	       : (data->nav_mode & SIRF_MSG_SSB_MODE_DGPS_USED) ? '2' : '1');
+	 put_c(&s, ',');
+	 put_uint(&s, data->sv_used_cnt, 2);
+	 put_c(&s, ',');
+	 put_uint(&s, hdop / 10, 1);
+	 put_c(&s, '.');
+	 put_uint(&s, hdop % 10, 1);
+	 put_c(&s, ',');
+	 put_fixed(&s, data->alt_msl * 1e-2, 1);
+	 put_str(&s, ",M,");
+	 put_fixed(&s, ((double)data->alt_ellips - data->alt_msl) * 1e-2, 1);
+	 put_str(&s, ",M,,");
+      }
+      p = finish(&s);
+   }
+
+   if (mask & NMEA_RMC) {
+      if (end - p < NMEA_MAX_SENTENCE)
+	 return NULL;
+      begin(&s, p, "GPRMC,");
+      put_time(&s, data);
+      put_c(&s, ',');
+      put_c(&s, status_c);
+      put_c(&s, ',');
+      if (mode == 0) {
+	 put_str(&s, ",,,,,,");
+      }else {
+	 put_angle(&s, data->lat, 2, 6, 'N', 'S');
+	 put_c(&s, ',');
+	 put_angle(&s, data->lon, 3, 6, 'E', 'W');
+	 put_c(&s, ',');
+	 put_fixed(&s, speed_knots, 1);
+	 put_c(&s, ',');
+	 put_fixed(&s, data->hdg * 1e-2, 1);
+	 put_c(&s, ',');
+      }
+      put_uint(&s, data->utc_day, 2);
+      put_uint(&s, data->utc_month, 2);
+      put_uint(&s, data->utc_year % 100, 2);
+      put_str(&s, ",,,");
+      put_c(&s, mode_c);
+      p = finish(&s);
+   }
+
+   if (mask & NMEA_GLL) {
+      if (end - p < NMEA_MAX_SENTENCE)
+	 return NULL;
+      begin(&s, p, "GPGLL,");
+      put_angle(&s, data->lat, 2, 4, 'N', 'S');
+      put_c(&s, ',');
+      put_angle(&s, data->lon, 3, 4, 'E', 'W');
+      put_c(&s, ',');
+      put_time(&s, data);
+      put_c(&s, ',');
+      put_c(&s, status_c);
+      put_c(&s, ',');
+      put_c(&s, mode_c);
+      p = finish(&s);
+   }
+
+   if (mask & NMEA_GSA) {
+      if (end - p < NMEA_MAX_SENTENCE)
+	 return NULL;
+      begin(&s, p, "GPGSA,A,");
+      put_c(&s, mode == 0 ? '1' : (mode == 4 || mode == 6) ? '3' : '2');
+      put_c(&s, ',');
+      /* 12 PRN fields  */
+      n = 0;
+      for (i=0; i < 32 && (n < 12); i++) {
+	 if (data->sv_used & (1u << i)) {
+	    put_uint(&s, i+1, 2);
+	    put_c(&s, ',');
+	    n++;
+	 }
+      }
+      for (; n < 12; n++)
+	 put_c(&s, ',');
+      /* PDOP and VDOP are not in MID 41  */
+      put_c(&s, ',');
+      if (mode != 0) {
+	 put_uint(&s, hdop / 10, 1);
+	 put_c(&s, '.');
+	 put_uint(&s, hdop % 10, 1);
+      }
+      put_c(&s, ',');
+      p = finish(&s);
+   }
+
+   if (mask & NMEA_VTG) {
+      if (end - p < NMEA_MAX_SENTENCE)
+	 return NULL;
+      begin(&s, p, "GPVTG,");
+      put_fixed(&s, data->hdg * 1e-2, 1);
+      put_str(&s, ",T,,M,");
+      put_fixed(&s, speed_knots, 1);
+      put_str(&s, ",N,");
+      put_fixed(&s, speed_kmh, 1);
+      put_str(&s, ",K,");
+      put_c(&s, mode_c);
+      p = finish(&s);
+   }
+
+   return p;
+}
+
+static char *encode_gsv(const tSIRF_MSG_SSB_MEASURED_TRACKER *data,
+      char *p, char *end)
+{
+   unsigned i, j, k, sv_cnt, msg_cnt, msg_n, cno_sum, cno_cnt, svid;
+   struct sentence_t s;
+
+   if (data->chnl_cnt > SIRF_NUM_CHANNELS)
+      return NULL;
+
+   sv_cnt = 0;
+   for (i=0; i < data->chnl_cnt; i++) {
+      if (data->chnl[i].svid != 0 && (data->chnl[i].cno[0] != 0))
+	 sv_cnt++;
+   }
+   msg_cnt = sv_cnt ? (sv_cnt + 3) / 4 : 1;
+
+   i = 0;
+   for (msg_n = 1; msg_n <= msg_cnt; msg_n++) {
+      if (end - p < NMEA_MAX_SENTENCE)
+	 return NULL;
+      begin(&s, p, "GPGSV,");
+      put_uint(&s, msg_cnt, 1);
+      put_c(&s, ',');
+      put_uint(&s, msg_n, 1);
+      put_c(&s, ',');
+      put_uint(&s, sv_cnt, 2);
+      /* 4 satellites per sentence  */
+      for (j = 0; j < 4 && (i < data->chnl_cnt); i++) {
+	 if (data->chnl[i].svid == 0 || (data->chnl[i].cno[0] == 0))
+	    continue;
+	 cno_sum = cno_cnt = 0;
+	 for (k=0; k < SIRF_NUM_POINTS; k++) {
+	    if (data->chnl[i].cno[k]) {
+	       cno_sum += data->chnl[i].cno[k];
+	       cno_cnt++;
+	    }
+	 }
+	 svid = data->chnl[i].svid;
+	 /* SBAS PRN  */
+	 if (svid >= 120)
+	    svid -= 87;
+	 put_c(&s, ',');
+	 put_uint(&s, svid, 2);
+	 put_c(&s, ',');
+	 put_uint(&s, data->chnl[i].elevation / 2, 2);
+	 put_c(&s, ',');
+	 put_uint(&s, data->chnl[i].azimuth * 3 / 2, 3);
+	 put_c(&s, ',');
+	 put_uint(&s, cno_sum / cno_cnt, 2);
+	 j++;
+      }
+      p = finish(&s);
+   }
+
+   return p;
+}
@@ -0,0 +1,32 @@
+#ifndef NMEA_BATCH_H
+#define NMEA_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* NMEA sentences from MID 41 (GGA, RMC, GLL, GSA, VTG) and MID 4 (GSV)
+ * in one pass into one buffer. Fixed-point formatting from the integer
+ * message fields, checksums computed while writing.  */
+
+#define NMEA_GGA (1 << 0)
+#define NMEA_RMC (1 << 1)
+#define NMEA_GLL (1 << 2)
+#define NMEA_GSA (1 << 3)
+#define NMEA_VTG (1 << 4)
+#define NMEA_GSV (1 << 5)
+#define NMEA_ALL (NMEA_GGA | NMEA_RMC | NMEA_GLL | NMEA_GSA | NMEA_VTG | NMEA_GSV)
+
+/* Longest sentence written, including $ and *CK\r\n  */
+#define NMEA_MAX_SENTENCE 128
+/* Enough for all sentences of one message  */
+#define NMEA_BATCH_BUF_SIZE (8 * NMEA_MAX_SENTENCE)
+
+/* Returns number of bytes written, 0 if msg_id gives no selected
+ * sentences, -1 on error  */
+int nmea_batch_encode(unsigned mask, uint32_t msg_id, const void *msg,
+      char *buf, size_t size);
+
+/* "GGA,RMC,..." to mask. Returns -1 on unknown sentence  */
+int nmea_batch_parse_mask(const char *list, unsigned *mask);
+
+#endif /* NMEA_BATCH_H */
@@ -0,0 +1,298 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sirf_msg.h"
+#include "sirf_codec.h"
+#include "sirf_codec_nmea.h"
+#include "sirf_codec_ssb.h"
+#include "sirf_proto_nmea.h"
+#include "nmea_batch.h"
+
+const char *progname = "nmeabench";
+const char *revision = "$Revision: 0.1 $";
+
+struct decoded_t {
+   tSIRF_UINT32 msg_id;
+   tSIRF_UINT32 msg_length;
+   union {
+      tSIRF_MSG_SSB_GEODETIC_NAVIGATION geo;
+      tSIRF_MSG_SSB_MEASURED_TRACKER tracker;
+   } m;
+};
+
+struct bench_ctx_t {
+   unsigned runs;
+   unsigned mask;
+   struct decoded_t *msg;
+   unsigned msg_cnt;
+   FILE *out_f;
+   unsigned long long bytes;
+};
+
+static void usage(void)
+{
+ fprintf(stdout, "\nUsage:\n    %s [-h] [options] file.srf\n"
+       ,progname);
+ return;
+}
+
+static void version(void)
+{
+ fprintf(stdout,"%s %s\n",progname,revision);
+}
+
+static void help(void)
+{
+
+ printf("%s - NMEA encoder benchmark\t\t%s\n",
+       progname, revision);
+ usage();
+ printf(
+   "\nOptions:\n"
+   "    -n, --runs                  Runs per encoder, best is reported, default: 5\n"
+   "    -S, --sentences             NMEA sentences, default: GGA,RMC,GLL,GSA,VTG,GSV\n"
+   "    -h, --help                  Help\n"
+   "    -v, --version               Show version\n"
+   "\n"
+   "MID 41 and MID 4 messages of the log are decoded once, then encoded\n"
+   "by SIRF_PROTO_NMEA_Encode() one sentence per call (sirfdump <= 0.4)\n"
+   "and by nmea_batch_encode(). Output goes to /dev/null.\n"
+   "\n"
+ );
+ return;
+}
+
+static uint64_t clock_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int load_log(struct bench_ctx_t *ctx, const char *fname)
+{
+   int fd;
+   uint8_t *data;
+   size_t size, i, len, max_cnt;
+   struct stat st;
+   struct decoded_t *d;
+   tSIRF_UINT32 options;
+   ssize_t l;
+
+   fd = open(fname, O_RDONLY);
+   if (fd < 0 || (fstat(fd, &st) < 0)) {
+      perror(fname);
+      if (fd >= 0)
+	 close(fd);
+      return -1;
+   }
+   size = st.st_size;
+
+   data = malloc(size ? size : 1);
+   if (data == NULL) {
+      perror(NULL);
+      close(fd);
+      return -1;
+   }
+   for (i=0; i < size; i += l) {
+      l = read(fd, &data[i], size - i);
+      if (l <= 0) {
+	 perror(fname);
+	 free(data);
+	 close(fd);
+	 return -1;
+      }
+   }
+   close(fd);
+
+   /* upper bound: smallest frame is 9 bytes  */
+   max_cnt = size / 9 + 1;
+   ctx->msg = malloc(max_cnt * sizeof(ctx->msg[0]));
+   if (ctx->msg == NULL) {
+      perror(NULL);
+      free(data);
+      return -1;
+   }
+
+   ctx->msg_cnt = 0;
+   for (i=0; i+8 <= size; ) {
+      if (data[i] != 0xa0 || (data[i+1] != 0xa2)) {
+	 i++;
+	 continue;
+      }
+      len = ((size_t)data[i+2] << 8) | data[i+3];
+      if (len == 0 || (len >= 1023) || (i+len+8 > size)
+	    || data[i+len+6] != 0xb0 || (data[i+len+7] != 0xb3)) {
+	 i++;
+	 continue;
+      }
+      if (data[i+4] == SIRF_GET_MID(SIRF_MSG_SSB_GEODETIC_NAVIGATION)
+	    || (data[i+4] == SIRF_GET_MID(SIRF_MSG_SSB_MEASURED_TRACKER))) {
+	 d = &ctx->msg[ctx->msg_cnt];
+	 options = 0;
+	 if (SIRF_CODEC_SSB_Decode(&data[i+4], len, &d->msg_id,
+		  (tSIRF_UINT8 *)&d->m, &d->msg_length, &options) == SIRF_SUCCESS
+	       && (d->msg_id == SIRF_MSG_SSB_GEODETIC_NAVIGATION
+		  || (d->msg_id == SIRF_MSG_SSB_MEASURED_TRACKER)))
+	    ctx->msg_cnt++;
+      }
+      i += len + 8;
+   }
+   free(data);
+
+   return 0;
+}
+
+/* Loop of output_nmea() before the batch encoder  */
+static void run_legacy(struct bench_ctx_t *ctx)
+{
+   unsigned i, msg_n, max_msg;
+   tSIRF_UINT32 options, str_size;
+   char str[1024];
+   struct decoded_t *d;
+
+   for (i=0; i < ctx->msg_cnt; i++) {
+      d = &ctx->msg[i];
+      msg_n = SIRF_CODEC_OPTIONS_GET_FIRST_MSG;
+      max_msg = msg_n + 1;
+      do {
+	 options = msg_n;
+	 str_size = sizeof(str);
+	 if (SIRF_PROTO_NMEA_Encode(d->msg_id, &d->m, d->msg_length,
+		  (tSIRF_UINT8 *)str, &str_size, &options) != SIRF_SUCCESS)
+	    break;
+	 msg_n = SIRF_CODEC_OPTIONS_GET_MSG_NUMBER(options) + 1;
+	 max_msg = SIRF_CODEC_OPTIONS_GET_MAX_MSG_NUMBER(options);
+	 ctx->bytes += strlen(str);
+	 fputs(str, ctx->out_f);
+      } while (msg_n < max_msg);
+   }
+}
+
+static void run_batch(struct bench_ctx_t *ctx)
+{
+   unsigned i;
+   int l;
+   char str[NMEA_BATCH_BUF_SIZE];
+   struct decoded_t *d;
+
+   for (i=0; i < ctx->msg_cnt; i++) {
+      d = &ctx->msg[i];
+      l = nmea_batch_encode(ctx->mask, d->msg_id, &d->m, str, sizeof(str));
+      if (l > 0) {
+	 ctx->bytes += l;
+	 fwrite(str, 1, l, ctx->out_f);
+      }
+   }
+}
+
+static uint64_t run_best(struct bench_ctx_t *ctx,
+      void (*f)(struct bench_ctx_t *ctx))
+{
+   unsigned i;
+   uint64_t t0, t, best;
+
+   best = UINT64_MAX;
+   for (i=0; i < ctx->runs; i++) {
+      ctx->bytes = 0;
+      t0 = clock_ns();
+      f(ctx);
+      fflush(ctx->out_f);
+      t = clock_ns() - t0;
+      if (t < best)
+	 best = t;
+   }
+
+   return best;
+}
+
+static void report(struct bench_ctx_t *ctx, const char *name, uint64_t ns)
+{
+   printf("%-8s %9.3f %10.1f %12.0f %10.1f\n", name, ns / 1e9,
+	 ns / (double)(ctx->msg_cnt ? ctx->msg_cnt : 1),
+	 ctx->msg_cnt / (ns / 1e9), ctx->bytes / (ns / 1e9) / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+   signed char c;
+   uint64_t legacy_ns, batch_ns;
+   struct bench_ctx_t ctx;
+
+   static struct option longopts[] = {
+      {"version",     no_argument,       0, 'v'},
+      {"help",        no_argument,       0, 'h'},
+      {"runs",        required_argument, 0, 'n'},
+      {"sentences",   required_argument, 0, 'S'},
+      {0, 0, 0, 0}
+   };
+
+   memset(&ctx, 0, sizeof(ctx));
+   ctx.runs = 5;
+   ctx.mask = NMEA_ALL;
+
+   while ((c = getopt_long(argc, argv, "vh?n:S:",longopts,NULL)) != -1) {
+      switch (c) {
+	 case 'n':
+	    ctx.runs = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'S':
+	    if (nmea_batch_parse_mask(optarg, &ctx.mask) != 0) {
+	       fputs("Wrong NMEA sentence list\n", stderr);
+	       return 1;
+	    }
+	    break;
+	 case 'v':
+	    version();
+	    exit(0);
+	    break;
+	 default:
+	    help();
+	    exit(0);
+	    break;
+      }
+   }
+   argc -= optind;
+   argv += optind;
+
+   if (argc != 1 || (ctx.runs == 0)) {
+      help();
+      return 1;
+   }
+
+   if (load_log(&ctx, argv[0]) < 0)
+      return 1;
+
+   ctx.out_f = fopen("/dev/null", "w");
+   if (ctx.out_f == NULL) {
+      perror("/dev/null");
+      free(ctx.msg);
+      return 1;
+   }
+
+   printf("%u MID 41 / MID 4 messages\n", ctx.msg_cnt);
+   printf("%-8s %9s %10s %12s %10s\n", "encoder", "time,s", "ns/msg", "msgs/s", "MB/s");
+   legacy_ns = run_best(&ctx, run_legacy);
+   report(&ctx, "legacy", legacy_ns);
+   batch_ns = run_best(&ctx, run_batch);
+   report(&ctx, "batch", batch_ns);
+   printf("speedup  %.2fx\n", batch_ns ? (double)legacy_ns / batch_ns : 0.0);
+
+   fclose(ctx.out_f);
+   free(ctx.msg);
+
+   return 0;
+}
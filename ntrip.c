@@ -0,0 +1,207 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "ntrip.h"
+
+#define NTRIP_SERVER "NTRIP sirfdump"
+
+/* Stream format of output_rtcm()  */
+#define NTRIP_STR_FORMAT "RTCM 3.0;1002(1),1019"
+
+/* STR;mountpoint;identifier;format;format-details;carrier;nav-system;
+ * network;country;latitude;longitude;nmea;solution;generator;
+ * compr-encryp;authentication;fee;bitrate;misc  */
+#define NTRIP_SOURCETABLE "STR;%s;%s;" NTRIP_STR_FORMAT \
+   ";1;GPS;SiRF;;0.00;0.00;0;0;sirfdump;none;N;N;0;\r\n" \
+   "ENDSOURCETABLE\r\n"
+
+static int handle_request(struct tcpsrv_t *srv, struct tcpsrv_client_t *c,
+      const char *req, size_t len, void *arg);
+static size_t header_end(const char *req, size_t len);
+static const char *get_header(const char *req, size_t len,
+      const char *name, size_t *value_len);
+static int reply_str(struct tcpsrv_client_t *c, const char *str);
+
+struct ntrip_caster_t *new_ntrip_caster(struct tcpsrv_t *srv,
+      const char *mountpoint)
+{
+   int l;
+   size_t size;
+   struct ntrip_caster_t *caster;
+
+   assert(srv);
+   assert(mountpoint);
+
+   if (mountpoint[0] == '/')
+      mountpoint++;
+   if (mountpoint[0] == '\0' || strpbrk(mountpoint, " ;/?\r\n")) {
+      fputs("Wrong NTRIP mountpoint\n", stderr);
+      return NULL;
+   }
+
+   caster = calloc(1, sizeof(*caster));
+   if (caster == NULL) {
+      perror(NULL);
+      return NULL;
+   }
+
+   caster->mountpoint = strdup(mountpoint);
+   /* mountpoint is printed twice  */
+   size = sizeof(NTRIP_SOURCETABLE) + 2 * strlen(mountpoint);
+   caster->sourcetable = malloc(size);
+   if (caster->mountpoint == NULL || (caster->sourcetable == NULL)) {
+      perror(NULL);
+      free_ntrip_caster(caster);
+      return NULL;
+   }
+
+   l = snprintf(caster->sourcetable, size, NTRIP_SOURCETABLE,
+	 caster->mountpoint, caster->mountpoint);
+   caster->sourcetable_len = l;
+
+   tcpsrv_set_request_handler(srv, handle_request, caster);
+
+   return caster;
+}
+
+void free_ntrip_caster(struct ntrip_caster_t *caster)
+{
+   if (caster == NULL)
+      return;
+   free(caster->mountpoint);
+   free(caster->sourcetable);
+   free(caster);
+}
+
+/*
+ * GET /mountpoint starts the stream: "ICY 200 OK" for NTRIP 1.0 clients,
+ * HTTP/1.1 response for clients sending Ntrip-Version: Ntrip/2.0.
+ * Stream is sent as is until the connection is closed, without chunked
+ * transfer encoding. Any other mountpoint gets the sourcetable.
+ */
+static int handle_request(struct tcpsrv_t *srv, struct tcpsrv_client_t *c,
+      const char *req, size_t len, void *arg)
+{
+   unsigned v2;
+   size_t hdr_len, eol, uri_len, value_len;
+   const char *uri, *value;
+   char hdr[256];
+   struct ntrip_caster_t *caster;
+
+   (void)srv;
+   assert(c);
+
+   caster = (struct ntrip_caster_t *)arg;
+
+   hdr_len = header_end(req, len);
+   if (hdr_len == 0)
+      return TCPSRV_REQ_MORE;
+
+   caster->requests++;
+
+   for (eol=0; eol < hdr_len && req[eol] != '\r' && req[eol] != '\n'; eol++);
+
+   value = get_header(req, hdr_len, "Ntrip-Version", &value_len);
+   v2 = value && (value_len >= 9) && (strncasecmp(value, "Ntrip/2.0", 9) == 0);
+
+   if (eol < 5 || (strncmp(req, "GET /", 5) != 0)) {
+      reply_str(c, v2 ? "HTTP/1.1 400 Bad Request\r\n"
+	    "Ntrip-Version: Ntrip/2.0\r\n"
+	    "Server: " NTRIP_SERVER "\r\n"
+	    "Connection: close\r\n\r\n"
+	    : "HTTP/1.0 400 Bad Request\r\n\r\n");
+      return TCPSRV_REQ_CLOSE;
+   }
+
+   uri = &req[5];
+   for (uri_len=0; &uri[uri_len] < &req[eol]
+	 && uri[uri_len] != ' ' && uri[uri_len] != '?'; uri_len++);
+
+   if (uri_len == strlen(caster->mountpoint)
+	 && (memcmp(uri, caster->mountpoint, uri_len) == 0)) {
+      if (reply_str(c, v2 ? "HTTP/1.1 200 OK\r\n"
+	       "Ntrip-Version: Ntrip/2.0\r\n"
+	       "Server: " NTRIP_SERVER "\r\n"
+	       "Content-Type: gnss/data\r\n"
+	       "Cache-Control: no-store, no-cache, max-age=0\r\n"
+	       "Pragma: no-cache\r\n"
+	       "Connection: close\r\n\r\n"
+	       : "ICY 200 OK\r\n\r\n") < 0)
+	 return TCPSRV_REQ_CLOSE;
+      return TCPSRV_REQ_ACCEPT;
+   }
+
+   caster->sourcetable_requests++;
+   if (v2)
+      snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\n"
+	    "Ntrip-Version: Ntrip/2.0\r\n"
+	    "Server: " NTRIP_SERVER "\r\n"
+	    "Content-Type: gnss/sourcetable\r\n"
+	    "Content-Length: %u\r\n"
+	    "Connection: close\r\n\r\n",
+	    (unsigned)caster->sourcetable_len);
+   else
+      snprintf(hdr, sizeof(hdr), "SOURCETABLE 200 OK\r\n"
+	    "Server: " NTRIP_SERVER "\r\n"
+	    "Content-Type: text/plain\r\n"
+	    "Content-Length: %u\r\n\r\n",
+	    (unsigned)caster->sourcetable_len);
+   if (reply_str(c, hdr) == 0)
+      tcpsrv_reply(c, caster->sourcetable, caster->sourcetable_len);
+
+   return TCPSRV_REQ_CLOSE;
+}
+
+/* Length of request up to and including empty line, 0 if incomplete  */
+static size_t header_end(const char *req, size_t len)
+{
+   size_t i;
+
+   for (i=0; i+1 < len; i++) {
+      if (req[i] != '\n')
+	 continue;
+      if (req[i+1] == '\n')
+	 return i+2;
+      if (req[i+1] == '\r' && (i+2 < len) && (req[i+2] == '\n'))
+	 return i+3;
+   }
+
+   return 0;
+}
+
+static const char *get_header(const char *req, size_t len,
+      const char *name, size_t *value_len)
+{
+   size_t i, name_len, l;
+   const char *line, *v;
+
+   name_len = strlen(name);
+
+   for (i=0; i < len; ) {
+      /* skip request line and previous headers  */
+      while (i < len && (req[i] != '\n'))
+	 i++;
+      if (++i >= len)
+	 break;
+      line = &req[i];
+      for (l=0; i+l < len && (line[l] != '\r') && (line[l] != '\n'); l++);
+      if (l > name_len && (line[name_len] == ':')
+	    && (strncasecmp(line, name, name_len) == 0)) {
+	 v = &line[name_len+1];
+	 while (v < &line[l] && (*v == ' ' || *v == '\t'))
+	    v++;
+	 *value_len = &line[l] - v;
+	 return v;
+      }
+   }
+
+   return NULL;
+}
+
+static int reply_str(struct tcpsrv_client_t *c, const char *str)
+{
+   return tcpsrv_reply(c, str, strlen(str));
+}
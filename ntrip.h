@@ -0,0 +1,21 @@
+#ifndef NTRIP_H
+#define NTRIP_H
+
+#include "tcpsrv.h"
+
+/* NTRIP v1 / v2 caster on top of tcpsrv. Serves published output
+ * under one mountpoint, sourcetable for anything else  */
+
+struct ntrip_caster_t {
+   char *mountpoint;
+   char *sourcetable;
+   size_t sourcetable_len;
+   unsigned long requests;
+   unsigned long sourcetable_requests;
+};
+
+struct ntrip_caster_t *new_ntrip_caster(struct tcpsrv_t *srv,
+      const char *mountpoint);
+void free_ntrip_caster(struct ntrip_caster_t *caster);
+
+#endif /* NTRIP_H */
@@ -0,0 +1,558 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+const char *progname = "ntripload";
+const char *revision = "$Revision: 0.1 $";
+
+#define RTCM3_PREAMBLE 0xd3
+#define RTCM3_MAX_FRAME (3 + 1023 + 3)
+
+/* Frames seen by the first client, keyed by CRC  */
+#define SEEN_TABLE_SIZE 65536
+/* Older entries are repeated frames, not the same one  */
+#define SEEN_STALE_NS 1000000000ULL
+
+#define MAX_EVENTS 64
+
+struct opts_t {
+   char *addr;
+   char *mountpoint;
+   unsigned clients;
+   unsigned duration;
+   unsigned ntrip_v2;
+};
+
+struct client_t {
+   int fd;
+   enum {
+      CLIENT_CONNECTING,
+      CLIENT_RESPONSE,
+      CLIENT_STREAMING,
+      CLIENT_CLOSED
+   } state;
+   uint64_t start_ns;
+   char hdr[1024];
+   unsigned hdr_len;
+   uint8_t frame[RTCM3_MAX_FRAME];
+   unsigned frame_len;
+   unsigned long long bytes;
+   unsigned long frames;
+};
+
+struct seen_t {
+   uint32_t key;
+   uint64_t ns;
+};
+
+struct samples_t {
+   uint32_t *v;
+   size_t cnt;
+   size_t size;
+};
+
+struct load_ctx_t {
+   struct opts_t opts;
+   struct client_t *clients;
+   int epoll_fd;
+   struct addrinfo *ai;
+   struct seen_t *seen;
+   struct samples_t handshake_us;
+   struct samples_t delay_us;
+   unsigned connected, failed, closed;
+   unsigned long skipped_bytes;
+};
+
+
+static void usage(void)
+{
+ fprintf(stdout, "\nUsage:\n    %s [-h] [options] host:port\n"
+       ,progname);
+ return;
+}
+
+static void version(void)
+{
+ fprintf(stdout,"%s %s\n",progname,revision);
+}
+
+static void help(void)
+{
+
+ printf("%s - NTRIP caster load test client\t\t%s\n",
+       progname, revision);
+ usage();
+ printf(
+   "\nOptions:\n"
+   "    -m, --mountpoint            Mountpoint, default: SIRF\n"
+   "    -n, --clients               Number of concurrent clients, default: 100\n"
+   "    -d, --duration              Test duration, seconds, default: 10\n"
+   "    -2, --ntrip2                Use NTRIP 2.0 requests\n"
+   "    -h, --help                  Help\n"
+   "    -v, --version               Show version\n"
+   "\n"
+   "Frame delay is the time from the first client receiving an RTCM 3\n"
+   "observation frame to each other client receiving it.\n"
+   "\n"
+ );
+ return;
+}
+
+static uint64_t clock_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int samples_add(struct samples_t *s, uint64_t ns)
+{
+   size_t new_size;
+   uint32_t *p;
+
+   if (s->cnt == s->size) {
+      new_size = s->size ? s->size * 2 : 4096;
+      p = realloc(s->v, new_size * sizeof(s->v[0]));
+      if (p == NULL) {
+	 perror(NULL);
+	 return -1;
+      }
+      s->v = p;
+      s->size = new_size;
+   }
+   ns /= 1000;
+   s->v[s->cnt++] = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+
+   return 0;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+   uint32_t x = *(const uint32_t *)a;
+   uint32_t y = *(const uint32_t *)b;
+
+   return x < y ? -1 : (x > y);
+}
+
+static void samples_print(const char *name, struct samples_t *s)
+{
+   double sum;
+   size_t i;
+
+   if (s->cnt == 0) {
+      printf("%-14s %10s\n", name, "-");
+      return;
+   }
+
+   qsort(s->v, s->cnt, sizeof(s->v[0]), cmp_u32);
+   sum = 0;
+   for (i=0; i < s->cnt; i++)
+      sum += s->v[i];
+
+   printf("%-14s %10lu %10.3f %10.3f %10.3f %10.3f\n",
+	 name,
+	 (unsigned long)s->cnt,
+	 sum / s->cnt / 1000.0,
+	 s->v[(s->cnt - 1) * 50 / 100] / 1000.0,
+	 s->v[(s->cnt - 1) * 99 / 100] / 1000.0,
+	 s->v[s->cnt - 1] / 1000.0);
+}
+
+static int resolve(struct load_ctx_t *ctx)
+{
+   int err;
+   char *host, *port;
+   struct addrinfo hints;
+
+   host = strdup(ctx->opts.addr);
+   if (host == NULL) {
+      perror(NULL);
+      return -1;
+   }
+   port = strrchr(host, ':');
+   if (port == NULL) {
+      fputs("Wrong address, host:port expected\n", stderr);
+      free(host);
+      return -1;
+   }
+   *port++ = '\0';
+
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+
+   err = getaddrinfo(host[0] ? host : NULL, port, &hints, &ctx->ai);
+   free(host);
+   if (err != 0) {
+      fprintf(stderr, "%s: %s\n", ctx->opts.addr, gai_strerror(err));
+      return -1;
+   }
+
+   return 0;
+}
+
+static void client_close(struct load_ctx_t *ctx, struct client_t *c, unsigned failed)
+{
+   if (c->state == CLIENT_CLOSED)
+      return;
+   epoll_ctl(ctx->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+   close(c->fd);
+   c->fd = -1;
+   if (failed)
+      ctx->failed++;
+   else
+      ctx->closed++;
+   c->state = CLIENT_CLOSED;
+}
+
+static int client_connect(struct load_ctx_t *ctx, struct client_t *c)
+{
+   struct epoll_event ev;
+
+   c->start_ns = clock_ns();
+   c->fd = socket(ctx->ai->ai_family, ctx->ai->ai_socktype | SOCK_NONBLOCK,
+	 ctx->ai->ai_protocol);
+   if (c->fd < 0) {
+      perror("socket");
+      return -1;
+   }
+
+   if (connect(c->fd, ctx->ai->ai_addr, ctx->ai->ai_addrlen) < 0
+	 && (errno != EINPROGRESS)) {
+      perror("connect");
+      close(c->fd);
+      return -1;
+   }
+
+   c->state = CLIENT_CONNECTING;
+   memset(&ev, 0, sizeof(ev));
+   ev.events = EPOLLIN | EPOLLOUT;
+   ev.data.ptr = c;
+   if (epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, c->fd, &ev) < 0) {
+      perror("epoll_ctl");
+      close(c->fd);
+      return -1;
+   }
+
+   return 0;
+}
+
+static void client_send_request(struct load_ctx_t *ctx, struct client_t *c)
+{
+   int l;
+   char req[512];
+   struct epoll_event ev;
+
+   if (ctx->opts.ntrip_v2)
+      l = snprintf(req, sizeof(req), "GET /%s HTTP/1.1\r\n"
+	    "Host: %s\r\n"
+	    "Ntrip-Version: Ntrip/2.0\r\n"
+	    "User-Agent: NTRIP %s\r\n"
+	    "Connection: close\r\n\r\n",
+	    ctx->opts.mountpoint, ctx->opts.addr, progname);
+   else
+      l = snprintf(req, sizeof(req), "GET /%s HTTP/1.0\r\n"
+	    "User-Agent: NTRIP %s\r\n\r\n",
+	    ctx->opts.mountpoint, progname);
+
+   /* Fits into empty socket buffer  */
+   if (send(c->fd, req, l, MSG_NOSIGNAL) != l) {
+      client_close(ctx, c, 1);
+      return;
+   }
+
+   memset(&ev, 0, sizeof(ev));
+   ev.events = EPOLLIN;
+   ev.data.ptr = c;
+   epoll_ctl(ctx->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+   c->state = CLIENT_RESPONSE;
+}
+
+static void frame_received(struct load_ctx_t *ctx, struct client_t *c, uint64_t now)
+{
+   unsigned type;
+   uint32_t key;
+   struct seen_t *s;
+
+   c->frames++;
+
+   /* Ephemerides are repeated unchanged, observations carry epoch time  */
+   type = (c->frame[3] << 4) | (c->frame[4] >> 4);
+   if (type == 1019 || (type == 1020) || (type >= 1044 && type <= 1046))
+      return;
+
+   key = ((uint32_t)c->frame[c->frame_len-3] << 16)
+      | ((uint32_t)c->frame[c->frame_len-2] << 8)
+      | c->frame[c->frame_len-1];
+   s = &ctx->seen[key % SEEN_TABLE_SIZE];
+
+   if (s->ns != 0 && (s->key == key) && (now - s->ns < SEEN_STALE_NS)) {
+      samples_add(&ctx->delay_us, now - s->ns);
+   }else {
+      s->key = key;
+      s->ns = now;
+      samples_add(&ctx->delay_us, 0);
+   }
+}
+
+static void stream_data(struct load_ctx_t *ctx, struct client_t *c,
+      const uint8_t *data, size_t len, uint64_t now)
+{
+   size_t i;
+   unsigned frame_size;
+
+   c->bytes += len;
+   for (i=0; i < len; i++) {
+      if (c->frame_len == 0 && (data[i] != RTCM3_PREAMBLE)) {
+	 ctx->skipped_bytes++;
+	 continue;
+      }
+      c->frame[c->frame_len++] = data[i];
+      if (c->frame_len < 3)
+	 continue;
+      frame_size = 3 + (((c->frame[1] & 0x03) << 8) | c->frame[2]) + 3;
+      if (c->frame_len == frame_size) {
+	 frame_received(ctx, c, now);
+	 c->frame_len = 0;
+      }
+   }
+}
+
+static void client_read(struct load_ctx_t *ctx, struct client_t *c)
+{
+   ssize_t l;
+   char *eoh;
+   unsigned hdr_size;
+   uint64_t now;
+   uint8_t buf[16384];
+
+   for (;;) {
+      l = recv(c->fd, buf, sizeof(buf), 0);
+      if (l < 0 && (errno == EINTR))
+	 continue;
+      if (l < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	 return;
+      if (l <= 0) {
+	 client_close(ctx, c, c->state != CLIENT_STREAMING);
+	 return;
+      }
+      now = clock_ns();
+
+      if (c->state == CLIENT_STREAMING) {
+	 stream_data(ctx, c, buf, l, now);
+	 continue;
+      }
+
+      if (c->hdr_len + (size_t)l >= sizeof(c->hdr))
+	 l = sizeof(c->hdr) - 1 - c->hdr_len;
+      memcpy(&c->hdr[c->hdr_len], buf, l);
+      c->hdr_len += l;
+      c->hdr[c->hdr_len] = '\0';
+      eoh = strstr(c->hdr, "\r\n\r\n");
+      if (eoh == NULL) {
+	 if (c->hdr_len == sizeof(c->hdr) - 1)
+	    client_close(ctx, c, 1);
+	 continue;
+      }
+
+      if (strncmp(c->hdr, "ICY 200", 7) != 0
+	    && (strncmp(c->hdr, "HTTP/1.1 200", 12) != 0
+	       || (strstr(c->hdr, "gnss/data") == NULL))) {
+	 if (ctx->failed == 0)
+	    fprintf(stderr, "Unexpected response: %.*s\n",
+		  (int)(strcspn(c->hdr, "\r\n")), c->hdr);
+	 client_close(ctx, c, 1);
+	 return;
+      }
+
+      samples_add(&ctx->handshake_us, now - c->start_ns);
+      ctx->connected++;
+      c->state = CLIENT_STREAMING;
+      hdr_size = eoh + 4 - c->hdr;
+      stream_data(ctx, c, (uint8_t *)&c->hdr[hdr_size], c->hdr_len - hdr_size, now);
+   }
+}
+
+static void raise_fd_limit(unsigned need)
+{
+   struct rlimit rl;
+
+   if (getrlimit(RLIMIT_NOFILE, &rl) != 0)
+      return;
+   if (rl.rlim_cur >= need)
+      return;
+   rl.rlim_cur = rl.rlim_max < need ? rl.rlim_max : need;
+   if (setrlimit(RLIMIT_NOFILE, &rl) != 0 || (rl.rlim_cur < need))
+      fprintf(stderr, "Open files limit %lu is too low for %u clients\n",
+	    (unsigned long)rl.rlim_cur, need - 16);
+}
+
+static void print_report(struct load_ctx_t *ctx, uint64_t elapsed_ns)
+{
+   unsigned i;
+   unsigned long long total, min, max;
+   double s;
+
+   total = 0;
+   min = ~0ULL;
+   max = 0;
+   for (i=0; i < ctx->opts.clients; i++) {
+      if (ctx->clients[i].bytes == 0 && (ctx->clients[i].state != CLIENT_STREAMING))
+	 continue;
+      total += ctx->clients[i].bytes;
+      if (ctx->clients[i].bytes < min)
+	 min = ctx->clients[i].bytes;
+      if (ctx->clients[i].bytes > max)
+	 max = ctx->clients[i].bytes;
+   }
+   if (max == 0)
+      min = 0;
+   s = elapsed_ns / 1e9;
+
+   printf("clients: %u requested, %u streaming, %u failed, %u closed by caster\n",
+	 ctx->opts.clients, ctx->connected, ctx->failed, ctx->closed);
+   printf("received: %llu bytes, %.3f MB/s total, per client %.1f - %.1f KB/s, "
+	 "%lu bytes outside frames\n",
+	 total, total / s / 1e6, min / s / 1e3, max / s / 1e3, ctx->skipped_bytes);
+   printf("%-14s %10s %10s %10s %10s %10s\n",
+	 "", "count", "mean,ms", "p50,ms", "p99,ms", "max,ms");
+   samples_print("handshake", &ctx->handshake_us);
+   samples_print("frame delay", &ctx->delay_us);
+}
+
+int main(int argc, char *argv[])
+{
+   signed char c;
+   int i, n, timeout;
+   unsigned k;
+   uint64_t start, now, end;
+   struct load_ctx_t ctx;
+   struct client_t *cl;
+   struct epoll_event ev[MAX_EVENTS];
+
+   static struct option longopts[] = {
+      {"version",     no_argument,       0, 'v'},
+      {"help",        no_argument,       0, 'h'},
+      {"mountpoint",  required_argument, 0, 'm'},
+      {"clients",     required_argument, 0, 'n'},
+      {"duration",    required_argument, 0, 'd'},
+      {"ntrip2",      no_argument,       0, '2'},
+      {0, 0, 0, 0}
+   };
+
+   memset(&ctx, 0, sizeof(ctx));
+   ctx.opts.mountpoint = "SIRF";
+   ctx.opts.clients = 100;
+   ctx.opts.duration = 10;
+   ctx.epoll_fd = -1;
+
+   while ((c = getopt_long(argc, argv, "vh?m:n:d:2",longopts,NULL)) != -1) {
+      switch (c) {
+	 case 'm':
+	    ctx.opts.mountpoint = optarg[0] == '/' ? optarg + 1 : optarg;
+	    break;
+	 case 'n':
+	    ctx.opts.clients = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'd':
+	    ctx.opts.duration = strtoul(optarg, NULL, 10);
+	    break;
+	 case '2':
+	    ctx.opts.ntrip_v2 = 1;
+	    break;
+	 case 'v':
+	    version();
+	    exit(0);
+	    break;
+	 default:
+	    help();
+	    exit(0);
+	    break;
+      }
+   }
+   argc -= optind;
+   argv += optind;
+
+   if (argc != 1 || (ctx.opts.clients == 0)) {
+      help();
+      return 1;
+   }
+   ctx.opts.addr = argv[0];
+
+   if (resolve(&ctx) < 0)
+      return 1;
+
+   raise_fd_limit(ctx.opts.clients + 16);
+
+   ctx.clients = calloc(ctx.opts.clients, sizeof(ctx.clients[0]));
+   ctx.seen = calloc(SEEN_TABLE_SIZE, sizeof(ctx.seen[0]));
+   ctx.epoll_fd = epoll_create(MAX_EVENTS);
+   if (ctx.clients == NULL || (ctx.seen == NULL) || (ctx.epoll_fd < 0)) {
+      perror(NULL);
+      return 1;
+   }
+
+   start = clock_ns();
+   for (k=0; k < ctx.opts.clients; k++) {
+      cl = &ctx.clients[k];
+      if (client_connect(&ctx, cl) < 0) {
+	 cl->state = CLIENT_CLOSED;
+	 ctx.failed++;
+      }
+   }
+
+   end = start + (uint64_t)ctx.opts.duration * 1000000000;
+   for (now = clock_ns(); now < end; now = clock_ns()) {
+      timeout = (int)((end - now) / 1000000) + 1;
+      n = epoll_wait(ctx.epoll_fd, ev, MAX_EVENTS, timeout);
+      if (n < 0) {
+	 if (errno == EINTR)
+	    continue;
+	 perror("epoll_wait");
+	 break;
+      }
+      for (i=0; i < n; i++) {
+	 cl = (struct client_t *)ev[i].data.ptr;
+	 if (cl->state == CLIENT_CONNECTING) {
+	    if (ev[i].events & (EPOLLERR | EPOLLHUP))
+	       client_close(&ctx, cl, 1);
+	    else if (ev[i].events & EPOLLOUT)
+	       client_send_request(&ctx, cl);
+	    continue;
+	 }
+	 if (ev[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+	    client_read(&ctx, cl);
+      }
+   }
+
+   print_report(&ctx, clock_ns() - start);
+
+   for (k=0; k < ctx.opts.clients; k++) {
+      if (ctx.clients[k].state != CLIENT_CLOSED)
+	 close(ctx.clients[k].fd);
+   }
+   close(ctx.epoll_fd);
+   freeaddrinfo(ctx.ai);
+   free(ctx.clients);
+   free(ctx.seen);
+   free(ctx.handshake_us.v);
+   free(ctx.delay_us.v);
+
+   return 0;
+}
@@ -0,0 +1,239 @@
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "gpsd/gps.h"
+#include "sirfdump.h"
+#include "nav.h"
+#include "orbit.h"
+
+/* WGS-84 constants, IS-GPS-200 Table 20-IV  */
+#define ORBIT_MU 3.986005e14
+#define ORBIT_OMEGA_E 7.2921151467e-5
+#define ORBIT_F -4.442807633e-10
+#define WGS84_A 6378137.0
+#define WGS84_F (1.0/298.257223563)
+
+/* Newton iterations for Kepler equation. Error after 5 iterations
+ * is below 1e-15 rad for e < 0.1  */
+#define ORBIT_KEPLER_ITER 5
+
+static double wrap_week(double t);
+
+void orbit_init(struct orbit_t *o)
+{
+   assert(o);
+   o->cnt = 0;
+   o->tow = 0;
+}
+
+unsigned orbit_load(struct orbit_t *o, const struct nav_data_t *nav,
+      unsigned gps_week, double gps_tow)
+{
+   unsigned prn, n;
+   const struct nav_eph_rec_t *rec;
+   struct nav_eph_t eph;
+   struct orbit_eph_t *e;
+
+   assert(o);
+   assert(nav);
+
+   e = &o->eph;
+   n = 0;
+   for (prn=1; prn <= MAX_GPS_PRN; prn++) {
+      rec = nav_eph_find_time(nav, prn, gps_week, gps_tow);
+      if ((rec == NULL) || (nav_eph_decode(rec, prn, &eph) != 0))
+	 continue;
+
+      o->prn[n] = prn;
+      e->toe[n] = (double)eph.sub2.sub2.l_toe;
+      e->toc[n] = (double)eph.sub1.sub1.l_toc;
+      e->sqrtA[n] = eph.sub2.sub2.d_sqrtA;
+      e->e[n] = eph.sub2.sub2.d_eccentricity;
+      e->M0[n] = eph.sub2.sub2.d_M0;
+      e->deltan[n] = eph.sub2.sub2.d_deltan * GPS_PI;
+      e->Omega0[n] = eph.sub3.sub3.d_Omega0 * GPS_PI;
+      e->Omegad[n] = eph.sub3.sub3.d_Omegad * GPS_PI;
+      e->i0[n] = eph.sub3.sub3.d_i0 * GPS_PI;
+      e->IDOT[n] = eph.sub3.sub3.d_IDOT * GPS_PI;
+      e->omega[n] = eph.sub3.sub3.d_omega * GPS_PI;
+      e->Cuc[n] = eph.sub2.sub2.d_Cuc;
+      e->Cus[n] = eph.sub2.sub2.d_Cus;
+      e->Crc[n] = eph.sub3.sub3.d_Crc;
+      e->Crs[n] = eph.sub2.sub2.d_Crs;
+      e->Cic[n] = eph.sub3.sub3.d_Cic;
+      e->Cis[n] = eph.sub3.sub3.d_Cis;
+      e->af0[n] = eph.sub1.sub1.d_af0;
+      e->af1[n] = eph.sub1.sub1.d_af1;
+      e->af2[n] = eph.sub1.sub1.d_af2;
+      e->Tgd[n] = eph.sub1.sub1.d_Tgd;
+      n++;
+   }
+   o->cnt = n;
+
+   return n;
+}
+
+int orbit_find(const struct orbit_t *o, unsigned prn)
+{
+   unsigned i;
+
+   for (i=0; i < o->cnt; i++) {
+      if (o->prn[i] == prn)
+	 return (int)i;
+   }
+
+   return -1;
+}
+
+/*
+ * Each step is a separate loop over all satellites without branches,
+ * so the compiler can keep the arrays in vector registers.
+ */
+void orbit_compute(struct orbit_t *o, double gps_tow)
+{
+   unsigned i, k, n;
+   const struct orbit_eph_t *e;
+
+   assert(o);
+
+   e = &o->eph;
+   n = o->cnt;
+   o->tow = gps_tow;
+
+   /* Mean anomaly  */
+   for (i=0; i < n; i++) {
+      double a, n0;
+      a = e->sqrtA[i] * e->sqrtA[i];
+      n0 = sqrt(ORBIT_MU / (a * a * a));
+      o->tk[i] = wrap_week(gps_tow - e->toe[i]);
+      o->M[i] = e->M0[i] + (n0 + e->deltan[i]) * o->tk[i];
+      o->E[i] = o->M[i];
+   }
+
+   /* Kepler equation, fixed number of Newton iterations from E = M  */
+   for (k=0; k < ORBIT_KEPLER_ITER; k++) {
+      for (i=0; i < n; i++) {
+	 o->E[i] -= (o->E[i] - e->e[i] * sin(o->E[i]) - o->M[i])
+	    / (1.0 - e->e[i] * cos(o->E[i]));
+      }
+   }
+
+   /* Position, velocity, clock  */
+   for (i=0; i < n; i++) {
+      double a, n0, tk, E, sinE, cosE, ecc, one_m_ecosE;
+      double v, phi, sin2p, cos2p, du, dr, di;
+      double u, r, inc, sinu, cosu, xp, yp;
+      double Om, sinOm, cosOm, sini, cosi;
+      double Edot, vdot, udot, rdot, idot, xpdot, ypdot, Omdot;
+      double dt;
+
+      a = e->sqrtA[i] * e->sqrtA[i];
+      n0 = sqrt(ORBIT_MU / (a * a * a)) + e->deltan[i];
+      tk = o->tk[i];
+      E = o->E[i];
+      sinE = sin(E);
+      cosE = cos(E);
+      ecc = e->e[i];
+      one_m_ecosE = 1.0 - ecc * cosE;
+
+      v = atan2(sqrt(1.0 - ecc * ecc) * sinE, cosE - ecc);
+      phi = v + e->omega[i];
+      sin2p = sin(2.0 * phi);
+      cos2p = cos(2.0 * phi);
+
+      du = e->Cus[i] * sin2p + e->Cuc[i] * cos2p;
+      dr = e->Crs[i] * sin2p + e->Crc[i] * cos2p;
+      di = e->Cis[i] * sin2p + e->Cic[i] * cos2p;
+
+      u = phi + du;
+      r = a * one_m_ecosE + dr;
+      inc = e->i0[i] + di + e->IDOT[i] * tk;
+      sinu = sin(u);
+      cosu = cos(u);
+      xp = r * cosu;
+      yp = r * sinu;
+
+      Omdot = e->Omegad[i] - ORBIT_OMEGA_E;
+      Om = e->Omega0[i] + Omdot * tk - ORBIT_OMEGA_E * e->toe[i];
+      sinOm = sin(Om);
+      cosOm = cos(Om);
+      sini = sin(inc);
+      cosi = cos(inc);
+
+      o->x[i] = xp * cosOm - yp * cosi * sinOm;
+      o->y[i] = xp * sinOm + yp * cosi * cosOm;
+      o->z[i] = yp * sini;
+
+      Edot = n0 / one_m_ecosE;
+      vdot = Edot * sqrt(1.0 - ecc * ecc) / one_m_ecosE;
+      udot = vdot * (1.0 + 2.0 * (e->Cus[i] * cos2p - e->Cuc[i] * sin2p));
+      rdot = a * ecc * Edot * sinE
+	 + 2.0 * vdot * (e->Crs[i] * cos2p - e->Crc[i] * sin2p);
+      idot = e->IDOT[i] + 2.0 * vdot * (e->Cis[i] * cos2p - e->Cic[i] * sin2p);
+      xpdot = rdot * cosu - r * udot * sinu;
+      ypdot = rdot * sinu + r * udot * cosu;
+
+      o->vx[i] = xpdot * cosOm - ypdot * cosi * sinOm
+	 + yp * sini * sinOm * idot - o->y[i] * Omdot;
+      o->vy[i] = xpdot * sinOm + ypdot * cosi * cosOm
+	 - yp * sini * cosOm * idot + o->x[i] * Omdot;
+      o->vz[i] = ypdot * sini + yp * cosi * idot;
+
+      dt = wrap_week(gps_tow - e->toc[i]);
+      o->clk_bias[i] = e->af0[i] + (e->af1[i] + e->af2[i] * dt) * dt
+	 + ORBIT_F * ecc * e->sqrtA[i] * sinE
+	 - e->Tgd[i];
+      o->clk_drift[i] = e->af1[i] + 2.0 * e->af2[i] * dt
+	 + ORBIT_F * ecc * e->sqrtA[i] * cosE * Edot;
+   }
+}
+
+void orbit_azel(const struct orbit_t *o, unsigned idx, const double rcv[3],
+      double *az, double *el)
+{
+   unsigned k;
+   double p, lat, lon, e2, N, sinlat;
+   double dx, dy, dz, east, north, up;
+
+   assert(o);
+   assert(idx < o->cnt);
+
+   /* Receiver geodetic latitude and longitude  */
+   e2 = WGS84_F * (2.0 - WGS84_F);
+   p = sqrt(rcv[0] * rcv[0] + rcv[1] * rcv[1]);
+   lon = atan2(rcv[1], rcv[0]);
+   lat = atan2(rcv[2], p * (1.0 - e2));
+   for (k=0; k < 5; k++) {
+      sinlat = sin(lat);
+      N = WGS84_A / sqrt(1.0 - e2 * sinlat * sinlat);
+      lat = atan2(rcv[2] + N * e2 * sinlat, p);
+   }
+
+   dx = o->x[idx] - rcv[0];
+   dy = o->y[idx] - rcv[1];
+   dz = o->z[idx] - rcv[2];
+
+   east = -sin(lon) * dx + cos(lon) * dy;
+   north = -sin(lat) * cos(lon) * dx - sin(lat) * sin(lon) * dy + cos(lat) * dz;
+   up = cos(lat) * cos(lon) * dx + cos(lat) * sin(lon) * dy + sin(lat) * dz;
+
+   if (az) {
+      *az = atan2(east, north);
+      if (*az < 0)
+	 *az += 2.0 * GPS_PI;
+   }
+   if (el)
+      *el = atan2(up, sqrt(east * east + north * north));
+}
+
+/* IS-GPS-200 20.3.3.4.3: account for beginning or end of week crossovers  */
+static double wrap_week(double t)
+{
+   if (t > 302400.0)
+      t -= 604800.0;
+   else if (t < -302400.0)
+      t += 604800.0;
+   return t;
+}
@@ -0,0 +1,68 @@
+#ifndef ORBIT_H
+#define ORBIT_H
+
+#include "sirfdump.h"
+#include "nav.h"
+
+/* Satellite position, velocity and clock from broadcast ephemeris,
+ * IS-GPS-200 20.3.3.4.3. All satellites are computed in one pass.  */
+
+#define ORBIT_MAX_SATS MAX_GPS_PRN
+
+/* Ephemerides, structure of arrays. Angles in radians  */
+struct orbit_eph_t {
+   double toe[ORBIT_MAX_SATS];
+   double toc[ORBIT_MAX_SATS];
+   double sqrtA[ORBIT_MAX_SATS];
+   double e[ORBIT_MAX_SATS];
+   double M0[ORBIT_MAX_SATS];
+   double deltan[ORBIT_MAX_SATS];
+   double Omega0[ORBIT_MAX_SATS];
+   double Omegad[ORBIT_MAX_SATS];
+   double i0[ORBIT_MAX_SATS];
+   double IDOT[ORBIT_MAX_SATS];
+   double omega[ORBIT_MAX_SATS];
+   double Cuc[ORBIT_MAX_SATS], Cus[ORBIT_MAX_SATS];
+   double Crc[ORBIT_MAX_SATS], Crs[ORBIT_MAX_SATS];
+   double Cic[ORBIT_MAX_SATS], Cis[ORBIT_MAX_SATS];
+   double af0[ORBIT_MAX_SATS], af1[ORBIT_MAX_SATS], af2[ORBIT_MAX_SATS];
+   double Tgd[ORBIT_MAX_SATS];
+};
+
+struct orbit_t {
+   unsigned cnt;
+   unsigned prn[ORBIT_MAX_SATS];
+   struct orbit_eph_t eph;
+
+   /* Results of orbit_compute(), ECEF WGS-84  */
+   double tow;
+   double x[ORBIT_MAX_SATS], y[ORBIT_MAX_SATS], z[ORBIT_MAX_SATS];
+   double vx[ORBIT_MAX_SATS], vy[ORBIT_MAX_SATS], vz[ORBIT_MAX_SATS];
+   /* SV clock offset (L1, Tgd applied), s and drift, s/s  */
+   double clk_bias[ORBIT_MAX_SATS];
+   double clk_drift[ORBIT_MAX_SATS];
+
+   /* scratch  */
+   double tk[ORBIT_MAX_SATS];
+   double M[ORBIT_MAX_SATS];
+   double E[ORBIT_MAX_SATS];
+};
+
+void orbit_init(struct orbit_t *o);
+
+/* Load ephemerides with toe nearest to the given time. Sets with
+ * disagreeing IODC / IODE are skipped. Returns number of satellites  */
+unsigned orbit_load(struct orbit_t *o, const struct nav_data_t *nav,
+      unsigned gps_week, double gps_tow);
+
+/* Compute all loaded satellites at GPS time of week (transmit time)  */
+void orbit_compute(struct orbit_t *o, double gps_tow);
+
+/* Index of prn in o, -1 if not loaded  */
+int orbit_find(const struct orbit_t *o, unsigned prn);
+
+/* Azimuth, elevation of satellite idx from receiver ECEF position, radians  */
+void orbit_azel(const struct orbit_t *o, unsigned idx, const double rcv[3],
+      double *az, double *el);
+
+#endif /* ORBIT_H */
@@ -0,0 +1,576 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+
+#include <assert.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gpsd/gps.h"
+#include "sirfdump.h"
+#include "nav.h"
+#include "orbit.h"
+
+const char *progname = "orbitbench";
+const char *revision = "$Revision: 0.1 $";
+
+/* IS-GPS-200 Table 20-IV  */
+#define REF_MU 3.986005e14
+#define REF_OMEGA_E 7.2921151467e-5
+#define REF_F -4.442807633e-10
+
+/* Max position error, m; clock error, s; velocity error vs central
+ * difference of position, m/s  */
+#define CHECK_POS_TOL 1e-6
+#define CHECK_CLK_TOL 1e-15
+#define CHECK_VEL_TOL 1e-3
+
+struct bench_ctx_t {
+   unsigned runs;
+   unsigned sats;
+   unsigned rate;
+   unsigned duration;
+   unsigned check_cnt;
+   unsigned seed;
+   unsigned errors;
+};
+
+static void usage(void)
+{
+ fprintf(stdout, "\nUsage:\n    %s [-h] [options]\n"
+       ,progname);
+ return;
+}
+
+static void version(void)
+{
+ fprintf(stdout,"%s %s\n",progname,revision);
+}
+
+static void help(void)
+{
+
+ printf("%s - Satellite orbit engine check and benchmark\t\t%s\n",
+       progname, revision);
+ usage();
+ printf(
+   "\nOptions:\n"
+   "    -n, --runs                  Runs per test, best is reported, default: 1\n"
+   "    -c, --sats                  Satellites, default: 32\n"
+   "    -r, --rate                  Epochs per second, default: 10\n"
+   "    -d, --duration              Seconds of orbit, default: 86400\n"
+   "    -C, --check                 Random ephemerides compared with the reference, default: 10000\n"
+   "    -S, --seed                  Random seed, default: 1\n"
+   "    -h, --help                  Help\n"
+   "    -v, --version               Show version\n"
+   "\n"
+   "Check: orbits with a closed form solution (circular equatorial and polar,\n"
+   "perigee and apogee of an eccentric orbit), orbit_load() of subframes 1-3\n"
+   "including a set with IODE / IODC mismatch, nav_eph_find_iode() of the\n"
+   "ephemeris history, and random GPS-like\n"
+   "ephemerides against a per-satellite implementation of IS-GPS-200\n"
+   "20.3.3.4.3 with Kepler's equation solved to convergence. Velocity is\n"
+   "compared with the central difference of position. Exits with 1 on\n"
+   "error.\n"
+   "Benchmark: orbit_compute() of all satellites at every epoch.\n"
+   "\n"
+ );
+ return;
+}
+
+static uint64_t clock_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static double rnd_uniform(double min, double max)
+{
+   return min + (max - min) * (random() / (RAND_MAX + 1.0));
+}
+
+static double wrap_week(double t)
+{
+   if (t > 302400.0)
+      t -= 604800.0;
+   else if (t < -302400.0)
+      t += 604800.0;
+   return t;
+}
+
+/* Position and clock of satellite i, one satellite at a time  */
+static void ref_sat(const struct orbit_eph_t *e, unsigned i, double t,
+      double pos[3], double *clk)
+{
+   unsigned k;
+   double a, n, tk, M, E, dE, v, phi, u, r, inc, Om, xp, yp;
+
+   a = e->sqrtA[i] * e->sqrtA[i];
+   n = sqrt(REF_MU / (a * a * a)) + e->deltan[i];
+   tk = wrap_week(t - e->toe[i]);
+   M = e->M0[i] + n * tk;
+
+   E = M;
+   for (k=0; k < 50; k++) {
+      dE = (M - E + e->e[i] * sin(E)) / (1.0 - e->e[i] * cos(E));
+      E += dE;
+      if (fabs(dE) < 1e-15)
+	 break;
+   }
+
+   v = atan2(sqrt(1.0 - e->e[i] * e->e[i]) * sin(E), cos(E) - e->e[i]);
+   phi = v + e->omega[i];
+   u = phi + e->Cus[i] * sin(2.0 * phi) + e->Cuc[i] * cos(2.0 * phi);
+   r = a * (1.0 - e->e[i] * cos(E))
+      + e->Crs[i] * sin(2.0 * phi) + e->Crc[i] * cos(2.0 * phi);
+   inc = e->i0[i] + e->IDOT[i] * tk
+      + e->Cis[i] * sin(2.0 * phi) + e->Cic[i] * cos(2.0 * phi);
+   xp = r * cos(u);
+   yp = r * sin(u);
+   Om = e->Omega0[i] + (e->Omegad[i] - REF_OMEGA_E) * tk
+      - REF_OMEGA_E * e->toe[i];
+
+   pos[0] = xp * cos(Om) - yp * cos(inc) * sin(Om);
+   pos[1] = xp * sin(Om) + yp * cos(inc) * cos(Om);
+   pos[2] = yp * sin(inc);
+
+   tk = wrap_week(t - e->toc[i]);
+   *clk = e->af0[i] + e->af1[i] * tk + e->af2[i] * tk * tk
+      + REF_F * e->e[i] * e->sqrtA[i] * sin(E)
+      - e->Tgd[i];
+}
+
+static void eph_clear(struct orbit_t *o, unsigned i)
+{
+   struct orbit_eph_t *e;
+
+   e = &o->eph;
+   e->toe[i] = e->toc[i] = 0;
+   e->sqrtA[i] = 5153.6;
+   e->e[i] = e->M0[i] = e->deltan[i] = 0;
+   e->Omega0[i] = e->Omegad[i] = e->i0[i] = e->IDOT[i] = e->omega[i] = 0;
+   e->Cuc[i] = e->Cus[i] = e->Crc[i] = e->Crs[i] = e->Cic[i] = e->Cis[i] = 0;
+   e->af0[i] = e->af1[i] = e->af2[i] = e->Tgd[i] = 0;
+   o->prn[i] = i + 1;
+}
+
+static void eph_random(struct orbit_t *o, unsigned i)
+{
+   struct orbit_eph_t *e;
+
+   e = &o->eph;
+   o->prn[i] = i + 1;
+   e->toe[i] = 16.0 * (unsigned)rnd_uniform(0, 604800 / 16);
+   e->toc[i] = e->toe[i];
+   e->sqrtA[i] = rnd_uniform(5153.0, 5154.0);
+   e->e[i] = rnd_uniform(0, 0.03);
+   e->M0[i] = rnd_uniform(-GPS_PI, GPS_PI);
+   e->deltan[i] = rnd_uniform(3e-9, 6e-9);
+   e->Omega0[i] = rnd_uniform(-GPS_PI, GPS_PI);
+   e->Omegad[i] = rnd_uniform(-9e-9, -7e-9);
+   e->i0[i] = rnd_uniform(0.93, 0.99);
+   e->IDOT[i] = rnd_uniform(-5e-10, 5e-10);
+   e->omega[i] = rnd_uniform(-GPS_PI, GPS_PI);
+   e->Cuc[i] = rnd_uniform(-1e-5, 1e-5);
+   e->Cus[i] = rnd_uniform(-1e-5, 1e-5);
+   e->Crc[i] = rnd_uniform(100, 400);
+   e->Crs[i] = rnd_uniform(-150, 150);
+   e->Cic[i] = rnd_uniform(-3e-7, 3e-7);
+   e->Cis[i] = rnd_uniform(-3e-7, 3e-7);
+   e->af0[i] = rnd_uniform(-1e-3, 1e-3);
+   e->af1[i] = rnd_uniform(-1e-11, 1e-11);
+   e->af2[i] = 0;
+   e->Tgd[i] = rnd_uniform(-2e-8, 2e-8);
+}
+
+static void check_pos(struct bench_ctx_t *ctx, const char *name,
+      const struct orbit_t *o, unsigned i, const double exp[3])
+{
+   double d;
+
+   d = sqrt((o->x[i] - exp[0]) * (o->x[i] - exp[0])
+	 + (o->y[i] - exp[1]) * (o->y[i] - exp[1])
+	 + (o->z[i] - exp[2]) * (o->z[i] - exp[2]));
+   if (!(d <= CHECK_POS_TOL)) {
+      printf("%s: prn %u t %.3f position error %.3e m\n",
+	    name, o->prn[i], o->tow, d);
+      ctx->errors++;
+   }
+}
+
+/* Orbits with a closed form solution. All harmonic corrections are 0  */
+static void check_closed_form(struct bench_ctx_t *ctx)
+{
+   unsigned k;
+   double t, a, n0, u, Om, exp[3];
+   struct orbit_t o;
+
+   orbit_init(&o);
+   o.cnt = 4;
+   for (k=0; k < o.cnt; k++)
+      eph_clear(&o, k);
+
+   /* 1: circular polar, 2: perigee and 3: apogee of e = 0.02, argument
+    * of perigee 1 rad  */
+   o.eph.i0[1] = GPS_PI / 2.0;
+   o.eph.e[2] = o.eph.e[3] = 0.02;
+   o.eph.omega[2] = o.eph.omega[3] = 1.0;
+   o.eph.M0[3] = GPS_PI;
+
+   a = o.eph.sqrtA[0] * o.eph.sqrtA[0];
+   n0 = sqrt(REF_MU / (a * a * a));
+
+   for (t=0; t < 43200.0; t += 61.0) {
+      orbit_compute(&o, t);
+      u = n0 * t;
+      Om = -REF_OMEGA_E * t;
+
+      exp[0] = a * cos(u + Om);
+      exp[1] = a * sin(u + Om);
+      exp[2] = 0;
+      check_pos(ctx, "circular equatorial", &o, 0, exp);
+
+      exp[0] = a * cos(u) * cos(Om);
+      exp[1] = a * cos(u) * sin(Om);
+      exp[2] = a * sin(u);
+      check_pos(ctx, "circular polar", &o, 1, exp);
+
+      if (t == 0) {
+	 exp[0] = a * (1.0 - 0.02) * cos(1.0);
+	 exp[1] = a * (1.0 - 0.02) * sin(1.0);
+	 exp[2] = 0;
+	 check_pos(ctx, "perigee", &o, 2, exp);
+	 exp[0] = a * (1.0 + 0.02) * cos(1.0 + GPS_PI);
+	 exp[1] = a * (1.0 + 0.02) * sin(1.0 + GPS_PI);
+	 check_pos(ctx, "apogee", &o, 3, exp);
+      }
+   }
+}
+
+static uint32_t put_bits(uint32_t word, unsigned hi_bit, unsigned len, int32_t val)
+{
+   uint32_t mask;
+
+   mask = (len >= 32) ? 0xffffffff : ((1u << len) - 1);
+   return word | (((uint32_t)val & mask) << (hi_bit + 1 - len));
+}
+
+/* Raw 30-bit words with parity from 24-bit subframe data, as in MID 8  */
+static void subframe_to_raw(const uint32_t data[10], uint32_t raw[10])
+{
+   unsigned i;
+   uint32_t w, parity, prev;
+
+   prev = 0;
+   for (i=0; i<10; i++) {
+      w = ((prev & 0x03) << 30) | ((data[i] & 0xffffff) << 6);
+      parity = isgps_parity(w);
+      if (w & 0x40000000)
+	 w ^= 0x3fffffc0;
+      raw[i] = w | parity;
+      prev = parity;
+   }
+}
+
+/* Subframes 1-3 of prn, IODE of subframe 3 given separately  */
+static void fill_eph_rec(struct nav_eph_rec_t *rec, unsigned prn,
+      unsigned iode, unsigned iode3)
+{
+   unsigned n;
+   uint32_t w[10];
+
+   for (n=1; n <= 3; n++) {
+      memset(w, 0, sizeof(w));
+      w[0] = put_bits(0, 23, 8, 0x74);
+      w[1] = put_bits(0, 23, 17, 1000);
+      w[1] = put_bits(w[1], 4, 3, n);
+      switch (n) {
+	 case 1:
+	    w[2] = put_bits(0, 23, 10, 745);
+	    w[6] = put_bits(0, 7, 8, -11);
+	    w[7] = put_bits(0, 23, 8, iode);
+	    w[7] = put_bits(w[7], 15, 16, 7200 / 16);
+	    w[8] = put_bits(0, 15, 16, -9 * (int)prn);
+	    w[9] = put_bits(0, 23, 22, 12000 * (int)prn - 150000);
+	    break;
+	 case 2:
+	    w[2] = put_bits(0, 23, 8, iode);
+	    w[2] = put_bits(w[2], 15, 16, -3000 + 97 * (int)prn);
+	    w[3] = put_bits(0, 23, 16, 11000 + 13 * (int)prn);
+	    w[3] = put_bits(w[3], 7, 8, (int32_t)(prn * 130000000u) >> 24);
+	    w[4] = put_bits(0, 23, 24, (int32_t)(prn * 130000000u));
+	    w[5] = put_bits(0, 23, 16, -1500 + 11 * (int)prn);
+	    w[5] = put_bits(w[5], 7, 8, (85899345u + prn * 1000000u) >> 24);
+	    w[6] = put_bits(0, 23, 24, 85899345u + prn * 1000000u);
+	    w[7] = put_bits(0, 23, 16, 4500 - 7 * (int)prn);
+	    w[7] = put_bits(w[7], 7, 8, 2702000000u >> 24);
+	    w[8] = put_bits(0, 23, 24, 2702000000u + prn * 1000);
+	    w[9] = put_bits(0, 23, 16, 7200 / 16);
+	    break;
+	 default:
+	    w[2] = put_bits(0, 23, 16, 40 + (int)prn);
+	    w[2] = put_bits(w[2], 7, 8, (int32_t)(prn * 67000000u - 1073741824u) >> 24);
+	    w[3] = put_bits(0, 23, 24, (int32_t)(prn * 67000000u - 1073741824u));
+	    w[4] = put_bits(0, 23, 16, -60 + (int)prn);
+	    w[4] = put_bits(w[4], 7, 8, 660000000 >> 24);
+	    w[5] = put_bits(0, 23, 24, 660000000 + (int)prn * 1000);
+	    w[6] = put_bits(0, 23, 16, 6400 + 3 * (int)prn);
+	    w[6] = put_bits(w[6], 7, 8, (int32_t)(prn * 50000000u) >> 24);
+	    w[7] = put_bits(0, 23, 24, (int32_t)(prn * 50000000u));
+	    w[8] = put_bits(0, 23, 24, -21000 - (int)prn);
+	    w[9] = put_bits(0, 23, 8, iode3);
+	    w[9] = put_bits(w[9], 15, 14, -120 + (int)prn);
+	    break;
+      }
+      subframe_to_raw(w, rec->words[n-1]);
+   }
+   rec->wn = 745;
+   rec->iodc = iode;
+   rec->toe = 7200;
+}
+
+/* orbit_load() from raw subframes: scale factors, IODE / IODC check  */
+static void check_load(struct bench_ctx_t *ctx)
+{
+   unsigned prn;
+   int idx;
+   double pos[3], clk;
+   struct nav_data_t *nav;
+   struct nav_sat_data_t *sat;
+   struct orbit_t o;
+
+   nav = malloc(sizeof(*nav));
+   if (nav == NULL) {
+      perror(NULL);
+      ctx->errors++;
+      return;
+   }
+   init_nav_data(nav);
+
+   for (prn=1; prn <= 4; prn++) {
+      sat = get_navdata_p(nav, prn);
+      fill_eph_rec(&sat->hist[0], prn, 10 + prn, prn == 3 ? 99 : 10 + prn);
+      sat->hist_head = 0;
+      sat->hist_cnt = 1;
+   }
+
+   orbit_init(&o);
+   if (orbit_load(&o, nav, 745, 7200.0) != 3 || (orbit_find(&o, 3) >= 0)) {
+      printf("orbit_load: %u satellites loaded, set with IODE mismatch %s\n",
+	    o.cnt, orbit_find(&o, 3) >= 0 ? "loaded" : "skipped");
+      ctx->errors++;
+   }
+
+   idx = orbit_find(&o, 2);
+   if ((idx < 0)
+	 || (o.eph.toe[idx] != 7200.0)
+	 || (o.eph.sqrtA[idx] != (2702000000.0 + 2000) / 524288.0)
+	 || (o.eph.Crc[idx] != (6400 + 6) / 32.0)
+	 || (fabs(o.eph.i0[idx] - 660002000 * GPS_PI / 2147483648.0) > 1e-15)
+	 || (o.eph.af0[idx] != (12000 * 2 - 150000) / 2147483648.0)) {
+      printf("orbit_load: wrong ephemeris of prn 2\n");
+      ctx->errors++;
+   }
+
+   orbit_compute(&o, 9000.0);
+   for (idx=0; (unsigned)idx < o.cnt; idx++) {
+      ref_sat(&o.eph, idx, 9000.0, pos, &clk);
+      check_pos(ctx, "orbit_load", &o, idx, pos);
+   }
+
+   /* newer set of prn 1, the older one still found by its IODE  */
+   sat = get_navdata_p(nav, 1);
+   fill_eph_rec(&sat->hist[1], 1, 40, 40);
+   sat->hist_head = 1;
+   sat->hist_cnt = 2;
+   if ((nav_eph_find_iode(nav, 1, 40) != &sat->hist[1])
+	 || (nav_eph_find_iode(nav, 1, 11) != &sat->hist[0])
+	 || (nav_eph_find_iode(nav, 1, 12) != NULL)
+	 || (nav_eph_find_iode(nav, 5, 11) != NULL)) {
+      printf("nav_eph_find_iode: wrong set\n");
+      ctx->errors++;
+   }
+
+   free(nav);
+}
+
+/* Random ephemerides against ref_sat(), velocity and clock drift against
+ * central differences  */
+static void check_random(struct bench_ctx_t *ctx)
+{
+   unsigned k, i;
+   double t, h, pos[3], clk, d;
+   struct orbit_t o, o1, o2;
+
+   h = 0.5;
+   orbit_init(&o);
+   o.cnt = ORBIT_MAX_SATS;
+   for (k=0; k < ctx->check_cnt; k += o.cnt) {
+      for (i=0; i < o.cnt; i++)
+	 eph_random(&o, i);
+      o1 = o;
+      o2 = o;
+      /* within 4 hours of toe, week crossover included  */
+      t = wrap_week(o.eph.toe[0] + rnd_uniform(-14400, 14400));
+      if (t < 0)
+	 t += 604800.0;
+      orbit_compute(&o, t);
+      orbit_compute(&o1, t - h);
+      orbit_compute(&o2, t + h);
+
+      for (i=0; i < o.cnt; i++) {
+	 ref_sat(&o.eph, i, t, pos, &clk);
+	 check_pos(ctx, "reference", &o, i, pos);
+	 if (!(fabs(o.clk_bias[i] - clk) <= CHECK_CLK_TOL)) {
+	    printf("reference: prn %u t %.3f clock error %.3e s\n",
+		  o.prn[i], t, o.clk_bias[i] - clk);
+	    ctx->errors++;
+	 }
+	 d = fabs(o.vx[i] - (o2.x[i] - o1.x[i]) / (2 * h))
+	    + fabs(o.vy[i] - (o2.y[i] - o1.y[i]) / (2 * h))
+	    + fabs(o.vz[i] - (o2.z[i] - o1.z[i]) / (2 * h));
+	 if (!(d <= CHECK_VEL_TOL)) {
+	    printf("velocity: prn %u t %.3f error %.3e m/s\n", o.prn[i], t, d);
+	    ctx->errors++;
+	 }
+	 d = fabs(o.clk_drift[i] - (o2.clk_bias[i] - o1.clk_bias[i]) / (2 * h));
+	 if (!(d <= 1e-15)) {
+	    printf("clock drift: prn %u t %.3f error %.3e s/s\n", o.prn[i], t, d);
+	    ctx->errors++;
+	 }
+      }
+   }
+}
+
+/* All satellites at every epoch of duration seconds  */
+static uint64_t run_compute(struct bench_ctx_t *ctx, struct orbit_t *o,
+      double *sum)
+{
+   unsigned long k, epochs;
+   double t0;
+   uint64_t t;
+
+   epochs = (unsigned long)ctx->duration * ctx->rate;
+   t0 = o->eph.toe[0] - ctx->duration / 2;
+   *sum = 0;
+   t = clock_ns();
+   for (k=0; k < epochs; k++) {
+      orbit_compute(o, wrap_week(t0 + (double)k / ctx->rate));
+      *sum += o->x[k % o->cnt];
+   }
+
+   return clock_ns() - t;
+}
+
+int main(int argc, char *argv[])
+{
+   signed char c;
+   unsigned i;
+   uint64_t ns, best;
+   unsigned long epochs;
+   double sum;
+   struct bench_ctx_t ctx;
+   struct orbit_t o;
+
+   static struct option longopts[] = {
+      {"version",     no_argument,       0, 'v'},
+      {"help",        no_argument,       0, 'h'},
+      {"runs",        required_argument, 0, 'n'},
+      {"sats",        required_argument, 0, 'c'},
+      {"rate",        required_argument, 0, 'r'},
+      {"duration",    required_argument, 0, 'd'},
+      {"check",       required_argument, 0, 'C'},
+      {"seed",        required_argument, 0, 'S'},
+      {0, 0, 0, 0}
+   };
+
+   memset(&ctx, 0, sizeof(ctx));
+   ctx.runs = 1;
+   ctx.sats = ORBIT_MAX_SATS;
+   ctx.rate = 10;
+   ctx.duration = 86400;
+   ctx.check_cnt = 10000;
+   ctx.seed = 1;
+
+   while ((c = getopt_long(argc, argv, "vh?n:c:r:d:C:S:",longopts,NULL)) != -1) {
+      switch (c) {
+	 case 'n':
+	    ctx.runs = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'c':
+	    ctx.sats = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'r':
+	    ctx.rate = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'd':
+	    ctx.duration = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'C':
+	    ctx.check_cnt = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'S':
+	    ctx.seed = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'v':
+	    version();
+	    exit(0);
+	    break;
+	 default:
+	    help();
+	    exit(0);
+	    break;
+      }
+   }
+   argc -= optind;
+   argv += optind;
+
+   if (argc != 0 || (ctx.runs == 0) || (ctx.rate == 0) || (ctx.duration == 0)
+	 || (ctx.sats == 0) || (ctx.sats > ORBIT_MAX_SATS)) {
+      help();
+      return 1;
+   }
+
+   srandom(ctx.seed);
+
+   check_closed_form(&ctx);
+   check_load(&ctx);
+   check_random(&ctx);
+   if (ctx.errors) {
+      printf("check: %u errors\n", ctx.errors);
+      return 1;
+   }
+   printf("check: closed form orbits, orbit_load, %u random ephemerides: ok\n",
+	 ctx.check_cnt);
+
+   sum = 0;
+   orbit_init(&o);
+   o.cnt = ctx.sats;
+   for (i=0; i < o.cnt; i++)
+      eph_random(&o, i);
+
+   best = UINT64_MAX;
+   for (i=0; i < ctx.runs; i++) {
+      ns = run_compute(&ctx, &o, &sum);
+      if (ns < best)
+	 best = ns;
+   }
+
+   epochs = (unsigned long)ctx.duration * ctx.rate;
+   printf("orbit_compute: %u sats, %u Hz, %u s: %lu epochs\n",
+	 ctx.sats, ctx.rate, ctx.duration, epochs);
+   printf("%-20s %9s %12s %10s\n", "test", "time,s", "epochs/s", "ns/sat");
+   printf("%-20s %9.3f %12.0f %10.1f\n", "orbit_compute", best / 1e9,
+	 epochs / (best / 1e9), best / ((double)epochs * ctx.sats));
+   /* keeps the loop  */
+   if (sum == 1.0)
+      printf("\n");
+
+   return 0;
+}
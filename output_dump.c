@@ -1,12 +1,16 @@
 
 #include <stdio.h>
 #include "sirfdump.h"
+#include "stats.h"
 #include "sirf_msg.h"
+#include "sirf_codec.h"
 #include "sirf_codec_ssb.h"
 #include "sirf_codec_ascii.h"
 
 /*  XXX  */
 extern unsigned output_dump_use_gsw230_byte_order;
+extern unsigned output_dump_arrival_time;
+extern int64_t output_dump_realtime_offset;
 
 int output_dump(struct transport_msg_t *msg, FILE *out_f, void *user_ctx)
 {
@@ -20,13 +24,16 @@ int output_dump(struct transport_msg_t *msg, FILE *out_f, void *user_ctx)
    if (!msg || msg->payload_length < 1)
       return 1;
 
-   options = output_dump_use_gsw230_byte_order;
+   options = output_dump_use_gsw230_byte_order
+      ? SIRF_CODEC_FLAGS_GSW230_BYTE_ORDER : 0;
+   STATS_DECODE_BEGIN();
    err = SIRF_CODEC_SSB_Decode(msg->payload,
 	 msg->payload_length,
 	 &msg_id,
 	 msg_structure,
 	 &msg_length,
          &options);
+   STATS_DECODE_END(err);
    if (err)
       return err;
 
@@ -39,6 +46,9 @@ int output_dump(struct transport_msg_t *msg, FILE *out_f, void *user_ctx)
             &options);
 
    if (err == 0 && out_f) {
+      if (output_dump_arrival_time)
+	 fprintf(out_f, "%.6f,",
+	       (double)((int64_t)msg->last_byte_ns + output_dump_realtime_offset) / 1e9);
       fputs(str, out_f);
    }
 
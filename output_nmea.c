@@ -1,37 +1,54 @@
 
 #include <stdio.h>
 #include "sirfdump.h"
+#include "stats.h"
 #include "sirf_msg.h"
 #include "sirf_codec.h"
 #include "sirf_codec_nmea.h"
 #include "sirf_codec_ssb.h"
 #include "sirf_proto_nmea.h"
+#include "nmea_batch.h"
+
+extern unsigned output_nmea_sentences;
 
 int output_nmea(struct transport_msg_t *msg, FILE *out_f, void *ctx)
 {
-   int err;
+   int err, l;
    tSIRF_UINT32 msg_id, msg_length;
    tSIRF_UINT32 options;
    tSIRF_UINT32 str_size;
    unsigned msg_n;
    unsigned max_msg;
    uint8_t msg_structure[SIRF_MSG_SSB_MAX_MESSAGE_LEN];
-   char str[1024];
+   char str[NMEA_BATCH_BUF_SIZE];
 
    if (!msg || msg->payload_length < 1)
       return 1;
 
    options = 0;
+   STATS_DECODE_BEGIN();
    err = SIRF_CODEC_SSB_Decode(msg->payload,
 	 msg->payload_length,
 	 &msg_id,
 	 msg_structure,
 	 &msg_length,
          &options);
+   STATS_DECODE_END(err);
 
    if (err)
       return err;
 
+   if (msg_id == SIRF_MSG_SSB_GEODETIC_NAVIGATION
+	 || (msg_id == SIRF_MSG_SSB_MEASURED_TRACKER)) {
+      l = nmea_batch_encode(output_nmea_sentences, msg_id, msg_structure,
+	    str, sizeof(str));
+      if (l < 0)
+	 return 1;
+      if (l > 0)
+	 fwrite(str, 1, l, out_f);
+      return 0;
+   }
+
    str[0]='\0';
    str_size = sizeof(str);
 
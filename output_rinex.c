@@ -1,11 +1,17 @@
 
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <math.h>
 
 #include "sirfdump.h"
+#include "stats.h"
+#include "gpstime.h"
+#include "nav.h"
+#include "orbit.h"
 #include "sirf_msg.h"
 #include "sirf_codec.h"
 #include "sirf_codec_ssb.h"
@@ -40,6 +46,45 @@ struct epoch_t {
       double epoch_time;
 };
 
+/* Observables of one channel  */
+struct ch_obs_t {
+   double c1, l1, d1, s1;
+   char l1_lli;
+   char ssi;
+};
+
+/* RINEX 3 observation types  */
+enum rnx3_obs_type_t {
+   RNX3_OBS_C1C,
+   RNX3_OBS_L1C,
+   RNX3_OBS_D1C,
+   RNX3_OBS_S1C,
+   RNX3_OBS_MAX
+};
+
+static const char * const rnx3_obs_names[RNX3_OBS_MAX] = {
+   "C1C", "L1C", "D1C", "S1C"
+};
+
+#define RNX3_DEFAULT_OBS_TYPES "C1C,L1C,D1C,S1C"
+/* 'Gnn' + (F14.3 + LLI + SSI) * obs + '\n'  */
+#define RNX3_REC_LEN(_nobs) (3 + 16 * (_nobs) + 1)
+#define RNX3_EPOCH_LINE_LEN 36
+
+/* Ephemerides of the elevation mask are selected again after this time
+ * even without new MID 8 data, seconds  */
+#define ELEV_MASK_RELOAD_INTERVAL 900
+
+/* Record layout of the RINEX 3 observation block. Built once per header,
+ * every epoch only numeric slots are filled in.  */
+struct rnx3_tmpl_t {
+   unsigned nobs;
+   enum rnx3_obs_type_t obs[RNX3_OBS_MAX];
+   unsigned rec_len;
+   char rec[RNX3_REC_LEN(RNX3_OBS_MAX)];
+   char buf[RNX3_EPOCH_LINE_LEN + 1 + SIRF_NUM_CHANNELS * RNX3_REC_LEN(RNX3_OBS_MAX)];
+};
+
 struct rinex_ctx_t {
 
    struct {
@@ -74,8 +119,28 @@ struct rinex_ctx_t {
    int header_printed;
 
    struct epoch_t epoch;
+   struct gpstime_cache_t tm_cache;
 
    unsigned sirf_flags;
+
+   unsigned version; /* 2 - RINEX 2.11, 3 - RINEX 3.04  */
+   struct rnx3_tmpl_t rnx3;
+
+   /* Elevation mask, radians. Satellites positions from MID 8 ephemerides,
+    * navdata is NULL when the mask is off  */
+   double elev_mask;
+   struct nav_data_t *navdata;
+   struct orbit_t *orbit;
+   unsigned orbit_is_stale;
+   double orbit_time;
+};
+
+/* Snapshot: epoch in progress and header data learned from the stream  */
+struct rinex_state_t {
+   struct epoch_t epoch;
+   float x, y, z;
+   int first_obs_found;
+   int header_printed;
 };
 
 static int handle_nl_meas_data_msg(struct rinex_ctx_t *ctx,
@@ -84,13 +149,21 @@ static int handle_meas_nav_msg(struct rinex_ctx_t *ctx,
       tSIRF_MSG_SSB_MEASURED_NAVIGATION *msg);
 static int handle_clock_status_msg(struct rinex_ctx_t *ctx,
       tSIRF_MSG_SSB_CLOCK_STATUS *msg, FILE *out_f);
+static void epoch_apply_elev_mask(struct rinex_ctx_t *ctx);
 static int printf_obs_header(FILE *out_f, struct rinex_ctx_t *ctx);
+static int printf_obs_header_rnx3(FILE *out_f, struct rinex_ctx_t *ctx);
+static int rnx3_parse_obs_types(struct rnx3_tmpl_t *tmpl, const char *obs_types);
+static void rnx3_build_template(struct rnx3_tmpl_t *tmpl);
 
 static void epoch_clear (struct epoch_t *e);
 static void epoch_close(struct epoch_t *e);
-static int epoch_printf(FILE *out_f, struct epoch_t *e);
+static int epoch_printf(FILE *out_f, struct epoch_t *e, struct gpstime_cache_t *tm_cache);
+static void epoch_ch_obs(const struct epoch_t *e, unsigned chan_id, struct ch_obs_t *obs);
+static int epoch_printf_rnx3(FILE *out_f, struct epoch_t *e, struct rnx3_tmpl_t *tmpl,
+      struct gpstime_cache_t *tm_cache);
 
-void *new_rinex_ctx(int argc, char **argv, unsigned gsw230_byte_order)
+void *new_rinex_ctx(int argc, char **argv, unsigned gsw230_byte_order,
+      double elev_mask)
 {
    struct rinex_ctx_t *ctx;
    struct tm *tm;
@@ -103,6 +176,9 @@ void *new_rinex_ctx(int argc, char **argv, unsigned gsw230_byte_order)
    if (ctx == NULL)
       return NULL;
 
+   ctx->version = 2;
+   ctx->rnx3.nobs = 0;
+
    snprintf(ctx->file.pgm, sizeof(ctx->file.pgm), "sirfdump");
    ctx->file.run_by[0]='\0';
    time(&clock);
@@ -138,6 +214,54 @@ void *new_rinex_ctx(int argc, char **argv, unsigned gsw230_byte_order)
    ctx->sirf_flags = gsw230_byte_order ? SIRF_CODEC_FLAGS_GSW230_BYTE_ORDER : 0;
 
    epoch_clear(&ctx->epoch);
+   gpstime_cache_init(&ctx->tm_cache);
+
+   ctx->elev_mask = elev_mask * GPS_PI / 180.0;
+   ctx->navdata = NULL;
+   ctx->orbit = NULL;
+   ctx->orbit_is_stale = 1;
+   ctx->orbit_time = 0;
+   if (elev_mask >= 0) {
+      ctx->navdata = malloc(sizeof(*ctx->navdata));
+      ctx->orbit = malloc(sizeof(*ctx->orbit));
+      if ((ctx->navdata == NULL) || (ctx->orbit == NULL)) {
+	 free_rinex_ctx(ctx);
+	 return NULL;
+      }
+      init_nav_data(ctx->navdata);
+      orbit_init(ctx->orbit);
+   }
+
+   return ctx;
+}
+
+void *new_rinex3_ctx(int argc, char **argv, unsigned gsw230_byte_order,
+      const char *obs_types, double elev_mask)
+{
+   struct rinex_ctx_t *ctx;
+   struct tm *tm;
+   time_t clock;
+
+   ctx = new_rinex_ctx(argc, argv, gsw230_byte_order, elev_mask);
+   if (ctx == NULL)
+      return NULL;
+
+   ctx->version = 3;
+
+   /* PGM / RUN BY / DATE: yyyymmdd hhmmss zone  */
+   time(&clock);
+   tm = gmtime(&clock);
+   snprintf(ctx->file.date, sizeof(ctx->file.date), "%04u%02u%02u %02u%02u%02u UTC",
+	 (unsigned)(tm->tm_year + 1900) % 10000, (unsigned)(tm->tm_mon + 1) % 100,
+	 (unsigned)tm->tm_mday % 100, (unsigned)tm->tm_hour % 100,
+	 (unsigned)tm->tm_min % 100, (unsigned)tm->tm_sec % 100);
+
+   if (rnx3_parse_obs_types(&ctx->rnx3,
+	    obs_types ? obs_types : RNX3_DEFAULT_OBS_TYPES) != 0) {
+      free_rinex_ctx(ctx);
+      errno = EINVAL;
+      return NULL;
+   }
 
    return ctx;
 }
@@ -146,6 +270,10 @@ void free_rinex_ctx(void *ctx)
 {
    struct rinex_ctx_t *c;
    c = (struct rinex_ctx_t *)ctx;
+   if (c == NULL)
+      return;
+   free(c->navdata);
+   free(c->orbit);
    free(c);
 }
 
@@ -169,12 +297,14 @@ int output_rinex(struct transport_msg_t *msg, FILE *out_f, void *user_ctx)
    ctx = (struct rinex_ctx_t *)user_ctx;
 
    options = ctx->sirf_flags;
+   STATS_DECODE_BEGIN();
    err = SIRF_CODEC_SSB_Decode(msg->payload,
 	 msg->payload_length,
 	 &msg_id,
 	 m.u8,
 	 &msg_length,
          &options);
+   STATS_DECODE_END(err);
 
    if (err)
       return err;
@@ -189,6 +319,12 @@ int output_rinex(struct transport_msg_t *msg, FILE *out_f, void *user_ctx)
       case SIRF_MSG_SSB_CLOCK_STATUS:
 	 handle_clock_status_msg(ctx, (tSIRF_MSG_SSB_CLOCK_STATUS *)&m, out_f);
 	 break;
+      case SIRF_MSG_SSB_50BPS_DATA:
+	 if (ctx->navdata
+	       && (populate_navdata_from_mid8((tSIRF_MSG_SSB_50BPS_DATA *)&m,
+		     ctx->navdata) > 0))
+	    ctx->orbit_is_stale = 1;
+	 break;
       default:
 	 break;
    }
@@ -197,6 +333,71 @@ int output_rinex(struct transport_msg_t *msg, FILE *out_f, void *user_ctx)
    return err;
 }
 
+/* Header with TIME OF FIRST OBS is written on the next epoch, epoch in
+ * progress goes to the new file  */
+int rinex_new_file(FILE *out_f, void *user_ctx)
+{
+   struct rinex_ctx_t *ctx;
+
+   assert(user_ctx);
+
+   (void)out_f;
+
+   ctx = (struct rinex_ctx_t *)user_ctx;
+   ctx->first_obs_found = 0;
+   ctx->header_printed = 0;
+
+   return 0;
+}
+
+size_t rinex_get_state(void *user_ctx, void *buf, size_t size)
+{
+   struct rinex_ctx_t *ctx;
+   struct rinex_state_t *st;
+
+   assert(user_ctx);
+
+   ctx = (struct rinex_ctx_t *)user_ctx;
+   if (size < sizeof(*st))
+      return sizeof(*st);
+
+   st = (struct rinex_state_t *)buf;
+   st->epoch = ctx->epoch;
+   st->x = ctx->approx_pos.x;
+   st->y = ctx->approx_pos.y;
+   st->z = ctx->approx_pos.z;
+   st->first_obs_found = ctx->first_obs_found;
+   st->header_printed = ctx->header_printed;
+
+   return sizeof(*st);
+}
+
+int rinex_set_state(void *user_ctx, const void *buf, size_t size,
+      unsigned new_file)
+{
+   struct rinex_ctx_t *ctx;
+   const struct rinex_state_t *st;
+
+   assert(user_ctx);
+
+   if (size != sizeof(*st))
+      return -1;
+
+   ctx = (struct rinex_ctx_t *)user_ctx;
+   st = (const struct rinex_state_t *)buf;
+   ctx->epoch = st->epoch;
+   ctx->approx_pos.x = st->x;
+   ctx->approx_pos.y = st->y;
+   ctx->approx_pos.z = st->z;
+   /* new file gets its header on the first epoch  */
+   if (!new_file) {
+      ctx->first_obs_found = st->first_obs_found;
+      ctx->header_printed = st->header_printed;
+   }
+
+   return 0;
+}
+
 static int handle_nl_meas_data_msg(struct rinex_ctx_t *ctx,
       tSIRF_MSG_SSB_NL_MEAS_DATA *msg)
 {
@@ -292,13 +493,20 @@ static int handle_clock_status_msg(struct rinex_ctx_t *ctx,
       assert(!ctx->header_printed);
       gpstime2tm0(ctx->epoch.gps_week, ctx->epoch.gps_tow, &ctx->time_of_first_obs);
       ctx->first_obs_found=1;
-      printf_obs_header(out_f, ctx);
+      if (ctx->version == 3)
+	 printf_obs_header_rnx3(out_f, ctx);
+      else
+	 printf_obs_header(out_f, ctx);
       ctx->header_printed = 1;
    }
 
    if (ctx->header_printed) {
+      epoch_apply_elev_mask(ctx);
       epoch_close(&ctx->epoch);
-      epoch_printf(out_f, &ctx->epoch);
+      if (ctx->version == 3)
+	 epoch_printf_rnx3(out_f, &ctx->epoch, &ctx->rnx3, &ctx->tm_cache);
+      else
+	 epoch_printf(out_f, &ctx->epoch, &ctx->tm_cache);
       epoch_clear(&ctx->epoch);
    }
 
@@ -342,32 +550,120 @@ static int printf_obs_header(FILE *out_f, struct rinex_ctx_t *ctx)
    return 1;
 }
 
-int gpstime2tm0(unsigned gps_week, double gps_tow, struct gps_tm *res)
+static int printf_obs_header_rnx3(FILE *out_f, struct rinex_ctx_t *ctx)
 {
-   time_t tt;
-   struct tm *tm;
-   double intpart, fractpart;
+   unsigned i;
+   int pos;
+   char obs_list[61];
 
-   assert(res);
+   assert(ctx);
+   assert(out_f);
 
-   gps_tow = floor(gps_tow * 1e6 + 0.5)/1e6;
-   fractpart = modf(gps_tow, &intpart);
-   assert(fractpart<1.0);
+   pos = 0;
+   for (i=0; i < ctx->rnx3.nobs; i++)
+      pos += snprintf(&obs_list[pos], sizeof(obs_list)-pos, " %3s",
+	    rnx3_obs_names[ctx->rnx3.obs[i]]);
+   obs_list[pos] = '\0';
 
-   tt = GPS_EPOCH + gps_week * 60 * 60 * 24 * 7 + (int)intpart;
+   /* Mixed: GPS and SBAS (sat_id >= 100) records  */
+   fprintf(out_f, "%9.2f%-11s%-20s%-20s%-20s\n", 3.04, "", "OBSERVATION DATA", "M",
+	 "RINEX VERSION / TYPE");
+   fprintf(out_f, "%-20s%-20s%-20s%-20s\n", ctx->file.pgm, ctx->file.run_by, ctx->file.date,
+	 "PGM / RUN BY / DATE");
+   fprintf(out_f, "%-60s%-20s\n", ctx->marker_name,
+	 "MARKER NAME");
+   fprintf(out_f, "%-60s%-20s\n", "NON_GEODETIC",
+	 "MARKER TYPE");
+   fprintf(out_f, "%-20s%-40s%-20s\n", ctx->observer, ctx->agency,
+	 "OBSERVER / AGENCY");
+   fprintf(out_f, "%-20s%-20s%-20s%-20s\n", ctx->rec.no, ctx->rec.type, ctx->rec.version,
+	 "REC # / TYPE / VERS");
+   fprintf(out_f, "%-20s%-40s%-20s\n", ctx->antenna.no, ctx->antenna.type,
+	 "ANT # / TYPE");
+   fprintf(out_f, "%14.4f%14.4f%14.4f%18s%-20s\n", ctx->approx_pos.x, ctx->approx_pos.y, ctx->approx_pos.z, "",
+	 "APPROX POSITION XYZ");
+   fprintf(out_f, "%14.4f%14.4f%14.4f%18s%-20s\n", ctx->antenna.h, ctx->antenna.e, ctx->antenna.n, "",
+	 "ANTENNA: DELTA H/E/N");
+   fprintf(out_f, "%1s  %3u%-54s%-20s\n", "G", ctx->rnx3.nobs, obs_list,
+	 "SYS / # / OBS TYPES");
+   fprintf(out_f, "%1s  %3u%-54s%-20s\n", "S", ctx->rnx3.nobs, obs_list,
+	 "SYS / # / OBS TYPES");
+   fprintf(out_f, "%6d%6d%6d%6d%6d%13.7f%5s%3s%9s%-20s\n", ctx->time_of_first_obs.year,
+	 ctx->time_of_first_obs.month, ctx->time_of_first_obs.day,
+	 ctx->time_of_first_obs.hour, ctx->time_of_first_obs.min,
+	 ctx->time_of_first_obs.sec, "", "GPS", "",
+	 "TIME OF FIRST OBS");
+   for (i=0; i < ctx->rnx3.nobs; i++) {
+      if (ctx->rnx3.obs[i] == RNX3_OBS_L1C) {
+	 fprintf(out_f, "%1s %3s %8.5f%-46s%-20s\n", "G", "L1C", 0.0, "",
+	       "SYS / PHASE SHIFT");
+	 fprintf(out_f, "%1s %3s %8.5f%-46s%-20s\n", "S", "L1C", 0.0, "",
+	       "SYS / PHASE SHIFT");
+      }
+   }
+   fprintf(out_f, "%-60s%-20s\n", "",
+	 "END OF HEADER");
+
+   return 1;
+}
 
-   tm = gmtime(&tt);
+/* Parse comma or space separated list of observation types, i.e.
+ * "C1C,L1C,D1C,S1C"  */
+static int rnx3_parse_obs_types(struct rnx3_tmpl_t *tmpl, const char *obs_types)
+{
+   unsigned i, j;
+   const char *p;
 
-   res->sec = tm->tm_sec + fractpart;
-   assert(res->sec<60.0);
-   res->min = tm->tm_min;
-   res->hour = tm->tm_hour;
-   res->day = tm->tm_mday;
-   res->yday = tm->tm_yday + 1;
-   res->month = tm->tm_mon + 1;
-   res->year = tm->tm_year + 1900;
+   assert(tmpl);
+   assert(obs_types);
 
-   return 1;
+   tmpl->nobs = 0;
+   p = obs_types;
+   while (*p != '\0') {
+      if (*p == ',' || *p == ' ') {
+	 p++;
+	 continue;
+      }
+
+      for (i=0; i < RNX3_OBS_MAX; i++) {
+	 if (strncmp(p, rnx3_obs_names[i], 3) == 0
+	       && (p[3] == '\0' || p[3] == ',' || p[3] == ' '))
+	    break;
+      }
+      if (i == RNX3_OBS_MAX) {
+	 fprintf(stderr, "Unsupported observation type: %.3s. Supported: %s\n",
+	       p, RNX3_DEFAULT_OBS_TYPES);
+	 return -1;
+      }
+      for (j=0; j < tmpl->nobs; j++) {
+	 if (tmpl->obs[j] == (enum rnx3_obs_type_t)i) {
+	    fprintf(stderr, "Duplicate observation type: %s\n", rnx3_obs_names[i]);
+	    return -1;
+	 }
+      }
+      tmpl->obs[tmpl->nobs++] = (enum rnx3_obs_type_t)i;
+      p += 3;
+   }
+
+   if (tmpl->nobs == 0) {
+      fputs("Empty list of observation types\n", stderr);
+      return -1;
+   }
+
+   rnx3_build_template(tmpl);
+
+   return 0;
+}
+
+static void rnx3_build_template(struct rnx3_tmpl_t *tmpl)
+{
+   assert(tmpl);
+   assert(tmpl->nobs > 0 && tmpl->nobs <= RNX3_OBS_MAX);
+
+   tmpl->rec_len = RNX3_REC_LEN(tmpl->nobs);
+   memset(tmpl->rec, ' ', tmpl->rec_len);
+   tmpl->rec[0] = 'G';
+   tmpl->rec[tmpl->rec_len-1] = '\n';
 }
 
 static void epoch_clear (struct epoch_t *e)
@@ -387,6 +683,53 @@ static void epoch_clear (struct epoch_t *e)
    e->epoch_time=0;
 }
 
+/* Drop channels of satellites below the elevation mask. Satellites
+ * without ephemeris are kept  */
+static void epoch_apply_elev_mask(struct rinex_ctx_t *ctx)
+{
+   unsigned chan_id;
+   int idx;
+   double t, el;
+   double rcv[3];
+   struct epoch_t *e;
+
+   if (ctx->navdata == NULL)
+      return;
+
+   /* no position yet  */
+   if ((ctx->approx_pos.x == 0)
+	 && (ctx->approx_pos.y == 0)
+	 && (ctx->approx_pos.z == 0))
+      return;
+
+   e = &ctx->epoch;
+   t = e->gps_week * 604800.0 + e->gps_tow;
+   if (ctx->orbit_is_stale
+	 || (fabs(t - ctx->orbit_time) > ELEV_MASK_RELOAD_INTERVAL)) {
+      orbit_load(ctx->orbit, ctx->navdata, e->gps_week, e->gps_tow);
+      ctx->orbit_time = t;
+      ctx->orbit_is_stale = 0;
+   }
+   if (ctx->orbit->cnt == 0)
+      return;
+
+   orbit_compute(ctx->orbit, e->gps_tow);
+
+   rcv[0] = ctx->approx_pos.x;
+   rcv[1] = ctx->approx_pos.y;
+   rcv[2] = ctx->approx_pos.z;
+   for (chan_id=0; chan_id < SIRF_NUM_CHANNELS; chan_id++) {
+      if (!e->ch[chan_id].valid)
+	 continue;
+      idx = orbit_find(ctx->orbit, e->ch[chan_id].sat_id);
+      if (idx < 0)
+	 continue;
+      orbit_azel(ctx->orbit, (unsigned)idx, rcv, NULL, &el);
+      if (el < ctx->elev_mask)
+	 e->ch[chan_id].valid = 0;
+   }
+}
+
 static int is_sat_in_epoch(const struct epoch_t *e, unsigned chan_id)
 {
    return ( fabs(e->gps_tow + ((double)e->clock_bias / 1.0e9) - e->ch[chan_id].gps_soft_time) < 0.1);
@@ -428,7 +771,7 @@ static void epoch_close(struct epoch_t *e)
 
 }
 
-static int epoch_printf(FILE *out_f, struct epoch_t *e)
+static int epoch_printf(FILE *out_f, struct epoch_t *e, struct gpstime_cache_t *tm_cache)
 {
    const char itoa[] = {'0','1','2','3','4','5','6','7','8','9'};
    struct gps_tm gps_tm0;
@@ -441,7 +784,7 @@ static int epoch_printf(FILE *out_f, struct epoch_t *e)
    if (e->valid_channels == 0)
       return -1;
 
-   gpstime2tm0(e->gps_week, e->epoch_time, &gps_tm0);
+   gpstime2tm(tm_cache, e->gps_week, e->epoch_time, &gps_tm0);
 
    epoch_flag=0;
 
@@ -489,80 +832,203 @@ static int epoch_printf(FILE *out_f, struct epoch_t *e)
 
    /* observations */
    for (chan_id=0; chan_id < SIRF_NUM_CHANNELS; chan_id++) {
-      double c1;
-      double l1;
-      double d1;
-      double s1;
-      unsigned char l1_loss_of_lock, loss_of_lock;
-      unsigned char sig_strength;
+      struct ch_obs_t obs;
 
       if (!e->ch[chan_id].valid)
 	 continue;
 
-      /* Pseudorange C/A on L1, meters */
-      c1 = e->ch[chan_id].pseudorange - (SPEED_OF_LIGHT * (e->clock_bias / 1.0e9));
+      epoch_ch_obs(e, chan_id, &obs);
 
-      /* Phase on L1, cycles */
-      if (e->ch[chan_id].carrier_phase)
-	 l1 = L1_CARRIER_FREQ * (e->ch[chan_id].carrier_phase / SPEED_OF_LIGHT - (e->clock_bias / 1.0e9));
-      else
-	 l1 = 0;
-
-      /* Doppler freq on L1, Hz */
-      d1 = -1 * (e->ch[chan_id].carrier_freq * L1_CARRIER_FREQ / SPEED_OF_LIGHT - e->clock_drift);
-
-      /* Snr */
-      s1 = e->ch[chan_id].min_cno;
-
-      /* 0x01 - acq/re-acq completed  */
-      /* 0x02 - integrated carrier phase is valid */
-      /* 0x04 - subframe sync completed  */
-      /* 0x08 - carrier pullin completed  */
-      /* 0x10 - code locked  */
-      /* 0x40 - ephemeris data available  */
-      if (!(e->ch[chan_id].sync_flags & 0x02))
-	 l1_loss_of_lock = '1';
-      else
-	 l1_loss_of_lock = ' ';
+      written = fprintf(out_f, "%14.3f%c%c%14.3f%c%c%14.3f%c%c%14.3f\n",
+	    obs.l1, obs.l1_lli, ' ',
+	    obs.c1, ' ', obs.ssi,
+	    obs.d1, ' ', ' ',
+	    obs.s1);
+      if (written < 0)
+	 return -1;
 
-      if ( (e->ch[chan_id].phase_err_cnt > 0) && (l1_loss_of_lock != '1')) {
-	    fprintf(stderr, "%.5f sync_flags %x phase_err_cnt: %u\n",
-		  e->gps_tow,
-		  e->ch[chan_id].sync_flags,
-		  e->ch[chan_id].phase_err_cnt);
-      }
+   } /* for */
 
-      sig_strength = itoa [ snr_project_to_1x9(s1) ];
+   return 0;
+}
 
-      if ((l1 > 9999999999.999) || (l1 < -999999999.999))
-	 l1 = 0;
-      else if (e->ch[chan_id].phase_err_cnt == 50)
-	 l1 = 0;
+/* Print F14.3 value right-aligned into a 14-characters slot.
+ * Caller guarantees -999999999.999 <= v <= 9999999999.999  */
+static void rnx3_put_f14_3(char *dst, double v)
+{
+   uint64_t n;
+   unsigned neg;
+   int p;
+
+   neg = v < 0;
+   if (neg)
+      v = -v;
+   n = (uint64_t)(v * 1000.0 + 0.5);
+   if (n == 0)
+      neg = 0;
+
+   p = 13;
+   dst[p--] = '0' + n % 10; n /= 10;
+   dst[p--] = '0' + n % 10; n /= 10;
+   dst[p--] = '0' + n % 10; n /= 10;
+   dst[p--] = '.';
+   do {
+      dst[p--] = '0' + n % 10;
+      n /= 10;
+   } while (n && p >= 0);
+   if (neg && p >= 0)
+      dst[p--] = '-';
+   while (p >= 0)
+      dst[p--] = ' ';
+}
 
-      if ((d1 > 9999999999.999) || (d1 < -999999999.999))
-	 d1 = 0;
+static int epoch_printf_rnx3(FILE *out_f, struct epoch_t *e, struct rnx3_tmpl_t *tmpl,
+      struct gpstime_cache_t *tm_cache)
+{
+   struct gps_tm gps_tm0;
+   unsigned chan_id;
+   unsigned i;
+   unsigned pos;
+   int written;
 
-      if ((c1 > 9999999999.999) || (c1 < -999999999.999)) {
-	 c1 = 0;
-	 sig_strength=' ';
-      }
+   assert(tmpl);
 
-      if (l1 == 0)
-	 l1_loss_of_lock = ' ';
+   if (e->valid_channels == 0)
+      return -1;
 
-      loss_of_lock = ' ';
+   gpstime2tm(tm_cache, e->gps_week, e->epoch_time, &gps_tm0);
 
-      written = fprintf(out_f, "%14.3f%c%c%14.3f%c%c%14.3f%c%c%14.3f\n",
-	    l1, l1_loss_of_lock, ' ',
-	    c1, loss_of_lock, sig_strength,
-	    d1, loss_of_lock, ' ',
-	    s1);
-      if (written < 0)
-	 return -1;
+   /* Epoch record  */
+   written = snprintf(tmpl->buf, sizeof(tmpl->buf), "> %4u %02u %02u %02u %02u%11.7f  %1u%3u\n",
+	 gps_tm0.year,
+	 gps_tm0.month,
+	 gps_tm0.day,
+	 gps_tm0.hour,
+	 gps_tm0.min,
+	 (double)gps_tm0.sec,
+	 0,
+	 e->valid_channels % 1000
+	 );
+   assert(written == RNX3_EPOCH_LINE_LEN);
+   pos = written;
+
+   /* Observation records  */
+   for (chan_id=0; chan_id < SIRF_NUM_CHANNELS; chan_id++) {
+      struct ch_obs_t obs;
+      char *rec;
+
+      if (!e->ch[chan_id].valid)
+	 continue;
 
+      assert(pos + tmpl->rec_len <= sizeof(tmpl->buf));
+      rec = &tmpl->buf[pos];
+      memcpy(rec, tmpl->rec, tmpl->rec_len);
+      pos += tmpl->rec_len;
+
+      epoch_ch_obs(e, chan_id, &obs);
+
+      /* sat_id: 'Gnn', SBAS: 'Snn' (PRN - 100) */
+      if (e->ch[chan_id].sat_id >= 100) {
+	 rec[0] = 'S';
+	 rec[1] = '0' + ((e->ch[chan_id].sat_id - 100) / 10) % 10;
+	 rec[2] = '0' + (e->ch[chan_id].sat_id - 100) % 10;
+      }else {
+	 rec[1] = '0' + (e->ch[chan_id].sat_id / 10) % 10;
+	 rec[2] = '0' + e->ch[chan_id].sat_id % 10;
+      }
+
+      for (i=0, rec += 3; i < tmpl->nobs; i++, rec += 16) {
+	 switch (tmpl->obs[i]) {
+	    case RNX3_OBS_C1C:
+	       if (obs.c1 != 0) {
+		  rnx3_put_f14_3(rec, obs.c1);
+		  rec[15] = obs.ssi;
+	       }
+	       break;
+	    case RNX3_OBS_L1C:
+	       if (obs.l1 != 0) {
+		  rnx3_put_f14_3(rec, obs.l1);
+		  rec[14] = obs.l1_lli;
+	       }
+	       break;
+	    case RNX3_OBS_D1C:
+	       if (obs.d1 != 0)
+		  rnx3_put_f14_3(rec, obs.d1);
+	       break;
+	    case RNX3_OBS_S1C:
+	       rnx3_put_f14_3(rec, obs.s1);
+	       break;
+	    default:
+	       assert(0);
+	       break;
+	 }
+      }
    } /* for */
 
+   if (fwrite(tmpl->buf, 1, pos, out_f) < pos)
+      return -1;
+
    return 0;
 }
 
+static void epoch_ch_obs(const struct epoch_t *e, unsigned chan_id, struct ch_obs_t *obs)
+{
+   unsigned char l1_lli;
+
+   assert(e);
+   assert(obs);
+
+   /* Pseudorange C/A on L1, meters */
+   obs->c1 = e->ch[chan_id].pseudorange - (SPEED_OF_LIGHT * (e->clock_bias / 1.0e9));
+
+   /* Phase on L1, cycles */
+   if (e->ch[chan_id].carrier_phase)
+      obs->l1 = L1_CARRIER_FREQ * (e->ch[chan_id].carrier_phase / SPEED_OF_LIGHT - (e->clock_bias / 1.0e9));
+   else
+      obs->l1 = 0;
+
+   /* Doppler freq on L1, Hz */
+   obs->d1 = -1 * (e->ch[chan_id].carrier_freq * L1_CARRIER_FREQ / SPEED_OF_LIGHT - e->clock_drift);
+
+   /* Snr */
+   obs->s1 = e->ch[chan_id].min_cno;
+
+   /* 0x01 - acq/re-acq completed  */
+   /* 0x02 - integrated carrier phase is valid */
+   /* 0x04 - subframe sync completed  */
+   /* 0x08 - carrier pullin completed  */
+   /* 0x10 - code locked  */
+   /* 0x40 - ephemeris data available  */
+   if (!(e->ch[chan_id].sync_flags & 0x02))
+      l1_lli = '1';
+   else
+      l1_lli = ' ';
+
+   if ( (e->ch[chan_id].phase_err_cnt > 0) && (l1_lli != '1')) {
+	 fprintf(stderr, "%.5f sync_flags %x phase_err_cnt: %u\n",
+	       e->gps_tow,
+	       e->ch[chan_id].sync_flags,
+	       e->ch[chan_id].phase_err_cnt);
+   }
+
+   obs->ssi = '0' + snr_project_to_1x9(obs->s1);
+
+   if ((obs->l1 > 9999999999.999) || (obs->l1 < -999999999.999))
+      obs->l1 = 0;
+   else if (e->ch[chan_id].phase_err_cnt == 50)
+      obs->l1 = 0;
+
+   if ((obs->d1 > 9999999999.999) || (obs->d1 < -999999999.999))
+      obs->d1 = 0;
+
+   if ((obs->c1 > 9999999999.999) || (obs->c1 < -999999999.999)) {
+      obs->c1 = 0;
+      obs->ssi = ' ';
+   }
+
+   if (obs->l1 == 0)
+      l1_lli = ' ';
+
+   obs->l1_lli = l1_lli;
+}
 
@@ -8,12 +8,28 @@
 
 #include "gpsd/gps.h"
 #include "sirfdump.h"
+#include "stats.h"
 #include "sirf_msg.h"
 #include "sirf_codec_ssb.h"
 #include "nav.h"
 
 extern const char const *MonthName[];
 
+/* Records are held back until ION ALPHA / BETA is known or
+ * NAV_STREAM_TIMEOUT seconds of GPS time pass (subframe 4 page 18
+ * is broadcast every 12.5 minutes)  */
+#define NAV_STREAM_TIMEOUT (13 * 60)
+/* In-memory limit of held back records, the rest goes to tmpfile()  */
+#define NAV_STREAM_MEM_LIMIT (64 * 1024)
+
+struct nav_stream_t {
+   char *buf;
+   size_t len;
+   FILE *spill;
+   double start_time;
+   int start_time_valid;
+};
+
 struct rinex_nav_ctx_t {
 
    struct {
@@ -22,24 +38,44 @@ struct rinex_nav_ctx_t {
       char date[21];
    } file;
 
-   fpos_t opt_header_pos;
-   int opt_header_pos_valid;
    int header_printed;
    int opt_header_printed;
    unsigned gps_week;
+   double gps_tow;
+   /* --navcache file, NULL: no cache  */
+   const char *nav_cache;
+   FILE *out_f;
+   struct nav_stream_t stream;
    struct nav_data_t navdata;
 };
 
+/* Snapshot: GPS time, navigation data, followed by held back records  */
+struct rinex_nav_state_t {
+   unsigned gps_week;
+   double gps_tow;
+   int header_printed;
+   double start_time;
+   int start_time_valid;
+   size_t held;
+   struct nav_data_t navdata;
+};
 
-static int print_nav_header(FILE *out_f, struct rinex_nav_ctx_t *ctx, const struct nav_sat_data_t *nav_data);
-static int print_nav_optional_header(FILE *out_f, struct rinex_nav_ctx_t *ctx, const struct nav_sat_data_t *sat);
-static int print_nav_data(FILE *out_f, struct rinex_nav_ctx_t *ctx, const struct nav_sat_data_t *nav_data);
+static int print_nav_header(FILE *out_f, struct rinex_nav_ctx_t *ctx);
+static int print_nav_optional_header(char *dst, size_t size, struct rinex_nav_ctx_t *ctx);
+static int print_nav_data(FILE *out_f, struct rinex_nav_ctx_t *ctx,
+      unsigned prn, const struct nav_eph_rec_t *rec);
+static int nav_stream_write(FILE *out_f, struct rinex_nav_ctx_t *ctx, const char *data, size_t len);
+static int nav_stream_flush(FILE *out_f, struct rinex_nav_ctx_t *ctx);
+static int nav_stream_is_held(const struct nav_stream_t *s);
+static int nav_stream_time(const struct rinex_nav_ctx_t *ctx, double *now);
+static void nav_stream_check_timeout(FILE *out_f, struct rinex_nav_ctx_t *ctx);
+static void print_cached_nav_data(FILE *out_f, struct rinex_nav_ctx_t *ctx);
 static int handle_mid8_msg(struct rinex_nav_ctx_t *ctx,
       const tSIRF_MSG_SSB_50BPS_DATA *msg,
       FILE *out_f);
 static double ura2meters(unsigned ura);
 
-void *new_rinex_nav_ctx(int argc, char **argv)
+void *new_rinex_nav_ctx(int argc, char **argv, const char *nav_cache)
 {
    struct rinex_nav_ctx_t *ctx;
    struct tm *tm;
@@ -60,12 +96,22 @@ void *new_rinex_nav_ctx(int argc, char **argv)
 	 tm->tm_mday, MonthName[tm->tm_mon], tm->tm_year % 100,
 	 tm->tm_hour, tm->tm_min);
 
-   ctx->opt_header_pos_valid = 0;
    ctx->header_printed = ctx->opt_header_printed = 0;
    ctx->gps_week = 1024;
+   ctx->gps_tow = 0;
+   ctx->out_f = NULL;
+
+   ctx->stream.buf = NULL;
+   ctx->stream.len = 0;
+   ctx->stream.spill = NULL;
+   ctx->stream.start_time_valid = 0;
 
    init_nav_data(&ctx->navdata);
 
+   ctx->nav_cache = nav_cache;
+   if (nav_cache)
+      nav_cache_load(&ctx->navdata, nav_cache);
+
    return ctx;
 }
 
@@ -73,6 +119,17 @@ void free_rinex_nav_ctx(void *ctx)
 {
    struct rinex_nav_ctx_t *c;
    c = (struct rinex_nav_ctx_t *)ctx;
+
+   /* end of input: write held back records without ION ALPHA / BETA  */
+   if (c->out_f && !c->header_printed && nav_stream_is_held(&c->stream))
+      nav_stream_flush(c->out_f, c);
+
+   if (c->nav_cache)
+      nav_cache_save(&c->navdata, c->nav_cache);
+
+   free(c->stream.buf);
+   if (c->stream.spill)
+      fclose(c->stream.spill);
    free(c);
 }
 
@@ -97,31 +154,146 @@ int output_rinex_nav(struct transport_msg_t *msg, FILE *out_f, void *user_ctx)
    ctx = (struct rinex_nav_ctx_t *)user_ctx;
 
    options = 0;
+   STATS_DECODE_BEGIN();
    err = SIRF_CODEC_SSB_Decode(msg->payload,
 	 msg->payload_length,
 	 &msg_id,
 	 m.u8,
 	 &msg_length,
          &options);
+   STATS_DECODE_END(err);
 
    if (err)
       return err;
 
+   ctx->out_f = out_f;
+
    if (msg_id ==  SIRF_MSG_SSB_50BPS_DATA)
       handle_mid8_msg(ctx, &m.data_50bps, out_f);
-   else if (msg_id == SIRF_MSG_SSB_CLOCK_STATUS)
+   else if (msg_id == SIRF_MSG_SSB_CLOCK_STATUS) {
       ctx->gps_week = m.data_clock.gps_week;
+      ctx->gps_tow = m.data_clock.gps_tow / 100.0;
+      if (nav_data_set_time(&ctx->navdata, ctx->gps_week, ctx->gps_tow) > 0)
+	 print_cached_nav_data(out_f, ctx);
+      nav_stream_check_timeout(out_f, ctx);
+   }
 
    return err;
 }
 
+/* Known ephemerides are repeated in the new file, so that each file can
+ * be used alone  */
+int rinex_nav_new_file(FILE *out_f, void *user_ctx)
+{
+   unsigned i;
+   struct rinex_nav_ctx_t *ctx;
+
+   assert(user_ctx);
+   assert(out_f);
+
+   ctx = (struct rinex_nav_ctx_t *)user_ctx;
+
+   /* previous file: held back records without ION ALPHA / BETA  */
+   if (ctx->out_f && !ctx->header_printed && nav_stream_is_held(&ctx->stream))
+      nav_stream_flush(ctx->out_f, ctx);
+
+   ctx->header_printed = ctx->opt_header_printed = 0;
+   ctx->stream.start_time_valid = 0;
+   ctx->out_f = out_f;
+
+   for (i=1; i <= MAX_GPS_PRN; i++)
+      print_nav_data(out_f, ctx, i, nav_eph_current(&ctx->navdata, i));
+
+   if (ctx->navdata.sub4_18.is_active)
+      return nav_stream_flush(out_f, ctx);
+
+   return 0;
+}
+
+size_t rinex_nav_get_state(void *user_ctx, void *buf, size_t size)
+{
+   struct rinex_nav_ctx_t *ctx;
+   struct rinex_nav_state_t *st;
+   size_t held, spill_len;
+   long l;
+
+   assert(user_ctx);
+
+   ctx = (struct rinex_nav_ctx_t *)user_ctx;
+
+   spill_len = 0;
+   if (ctx->stream.spill) {
+      l = ftell(ctx->stream.spill);
+      spill_len = l > 0 ? (size_t)l : 0;
+   }
+   held = ctx->stream.len + spill_len;
+
+   if (size < sizeof(*st) + held)
+      return sizeof(*st) + held;
+
+   st = (struct rinex_nav_state_t *)buf;
+   st->gps_week = ctx->gps_week;
+   st->gps_tow = ctx->gps_tow;
+   st->header_printed = ctx->header_printed;
+   st->start_time = ctx->stream.start_time;
+   st->start_time_valid = ctx->stream.start_time_valid;
+   st->held = held;
+   st->navdata = ctx->navdata;
+
+   if (ctx->stream.len)
+      memcpy(&st[1], ctx->stream.buf, ctx->stream.len);
+   if (spill_len) {
+      rewind(ctx->stream.spill);
+      if (fread((char *)&st[1] + ctx->stream.len, 1, spill_len,
+	       ctx->stream.spill) != spill_len)
+	 st->held = ctx->stream.len;
+      fseek(ctx->stream.spill, 0, SEEK_END);
+   }
+
+   return sizeof(*st) + held;
+}
+
+/* Ephemerides restored for a new file are written on the first MID 7, as
+ * the cached ones. Records held back in the previous run are written to
+ * its file at exit, in the same file they are held back again  */
+int rinex_nav_set_state(void *user_ctx, const void *buf, size_t size,
+      unsigned new_file)
+{
+   struct rinex_nav_ctx_t *ctx;
+   const struct rinex_nav_state_t *st;
+
+   assert(user_ctx);
+
+   st = (const struct rinex_nav_state_t *)buf;
+   if (size < sizeof(*st) || (size != sizeof(*st) + st->held))
+      return -1;
+
+   ctx = (struct rinex_nav_ctx_t *)user_ctx;
+   ctx->gps_week = st->gps_week;
+   ctx->gps_tow = st->gps_tow;
+   ctx->navdata = st->navdata;
+
+   if (new_file) {
+      nav_data_restored(&ctx->navdata);
+      return 0;
+   }
+
+   ctx->header_printed = st->header_printed;
+   if (!ctx->header_printed) {
+      ctx->stream.start_time = st->start_time;
+      ctx->stream.start_time_valid = st->start_time_valid;
+      if (st->held && (nav_stream_write(NULL, ctx, (const char *)&st[1], st->held) < 0))
+	 return -1;
+   }
+
+   return 0;
+}
 
 static int handle_mid8_msg(struct rinex_nav_ctx_t *ctx,
       const tSIRF_MSG_SSB_50BPS_DATA *msg,
       FILE *out_f)
 {
    int data_changed;
-   struct nav_sat_data_t *dst;
 
    assert(ctx);
    assert(msg);
@@ -132,86 +304,80 @@ static int handle_mid8_msg(struct rinex_nav_ctx_t *ctx,
    if (data_changed <= 0)
       return data_changed;
 
-   dst = get_navdata_p(&ctx->navdata, msg->svid);
-   if (!dst)
+   if (!get_navdata_p(&ctx->navdata, msg->svid))
       return -1;
 
-   if (!ctx->header_printed)
-      ctx->header_printed = print_nav_header(out_f, ctx, dst);
-   else if (!ctx->opt_header_printed && (data_changed & 0x02))
-      ctx->opt_header_printed = print_nav_optional_header(out_f, ctx, dst);
-   else if (0 && (data_changed & 0x02)) /* iono data changed  */
-      print_nav_optional_header(out_f, ctx, dst);
-
    if (data_changed & 0x01)
-      print_nav_data(out_f, ctx, dst);
+      print_nav_data(out_f, ctx, msg->svid,
+	    nav_eph_current(&ctx->navdata, msg->svid));
+
+   /* iono data arrived: write header and held back records  */
+   if (!ctx->header_printed && (data_changed & 0x02))
+      nav_stream_flush(out_f, ctx);
 
    return 0;
 }
 
-static int print_nav_header(FILE *out_f, struct rinex_nav_ctx_t *ctx, const struct nav_sat_data_t *sat)
+static int print_nav_header(FILE *out_f, struct rinex_nav_ctx_t *ctx)
 {
+   int len;
+   char hdr[81*7+1];
 
    assert(ctx);
    assert(out_f);
-   assert(sat);
 
-   fprintf(out_f, "%9.2f%-11s%c%-19s%-20s%-20s\n",
+   len = snprintf(hdr, sizeof(hdr),
+	 "%9.2f%-11s%c%-19s%-20s%-20s\n"
+	 "%-20s%-20s%-20s%-20s\n",
 	 2.10,
 	 "",
 	 'N',
 	 ": GPS NAV DATA",
 	 "",
-	 "RINEX VERSION / TYPE");
-   fprintf(out_f, "%-20s%-20s%-20s%-20s\n", ctx->file.pgm, ctx->file.run_by, ctx->file.date,
+	 "RINEX VERSION / TYPE",
+	 ctx->file.pgm, ctx->file.run_by, ctx->file.date,
 	 "PGM / RUN BY / DATE");
 
-   if ((ctx->opt_header_printed = print_nav_optional_header(out_f, ctx, sat)) == 0) {
-      ctx->opt_header_pos_valid = !fgetpos(out_f, &ctx->opt_header_pos);
-      fprintf(out_f,
-	    "%-60s%-20s\n"
-	    "%-60s%-20s\n"
-	    "%-60s%-20s\n"
-	    "%-60s%-20s\n",
-	    "", "COMMENT",
-	    "", "COMMENT",
-	    "", "COMMENT",
-	    "", "COMMENT");
-   }else
-      ctx->opt_header_printed = 1;
-
-   fprintf(out_f, "%-60s%-20s\n", "",
+   ctx->opt_header_printed = print_nav_optional_header(&hdr[len],
+	 sizeof(hdr)-len, ctx);
+   len += strlen(&hdr[len]);
+
+   len += snprintf(&hdr[len], sizeof(hdr)-len, "%-60s%-20s\n", "",
 	 "END OF HEADER");
+   assert((size_t)len < sizeof(hdr));
+
+   if (fwrite(hdr, 1, len, out_f) < (size_t)len)
+      return 0;
 
    return 1;
 }
 
-static int print_nav_optional_header(FILE *out_f, struct rinex_nav_ctx_t *ctx, const struct nav_sat_data_t *sat)
+static int print_nav_optional_header(char *dst, size_t size, struct rinex_nav_ctx_t *ctx)
 {
-   unsigned wn;
-   unsigned seek_to_header;
+   unsigned i;
+   unsigned wn, wn_hi;
+   const struct nav_sat_data_t *sat;
+
+   dst[0] = '\0';
 
    if (ctx->navdata.sub4_18.is_active == 0)
       return 0;
-   if (sat->is_sub1_active == 0)
-      return 0;
-
-   seek_to_header = ctx->header_printed
-      && (!ctx->opt_header_printed)
-      && (ctx->opt_header_pos_valid);
 
-   if (seek_to_header) {
-      if (fsetpos(out_f, &ctx->opt_header_pos) != 0)
-	 seek_to_header = 0; /*  not a seekable stream  */
+   /* XXX: WN bits 8-9 from any received subframe 1  */
+   wn_hi = ctx->gps_week & 0x300;
+   for (i=1; i <= MAX_GPS_PRN; i++) {
+      sat = get_navdata_p(&ctx->navdata, i);
+      if (sat && sat->is_sub1_active) {
+	 wn_hi = sat->wn & 0x300;
+	 break;
+      }
    }
 
-
-   /* XXX */
    wn = (ctx->gps_week & 0xfc00)
-      | (sat->sub1.sub1.WN & 0x300)
+      | wn_hi
       | (ctx->navdata.sub4_18.WNt & 0xff);
 
-   fprintf(out_f,
+   snprintf(dst, size,
 	 "  %12.4E%12.4E%12.4E%12.4E%-10s%-20s\n"
 	 "  %12.4E%12.4E%12.4E%12.4E%-10s%-20s\n"
 	 "   %19.12E%19.12E%9u%9u %-20s\n"
@@ -241,32 +407,28 @@ static int print_nav_optional_header(FILE *out_f, struct rinex_nav_ctx_t *ctx, c
 	 "LEAP SECONDS"
 	 );
 
-   if (seek_to_header)
-      fseek(out_f, 0L, SEEK_END);
-
    return 1;
 }
 
-static int print_nav_data(FILE *out_f, struct rinex_nav_ctx_t *ctx, const struct nav_sat_data_t *nav_data)
+static int print_nav_data(FILE *out_f, struct rinex_nav_ctx_t *ctx,
+      unsigned prn, const struct nav_eph_rec_t *rec)
 {
    unsigned wn;
+   int len;
    struct gps_tm toc_tm;
+   struct nav_eph_t eph;
+   const struct nav_eph_t *nav_data;
+   char buf[81*8+1];
 
-   assert(nav_data);
-
-   if (!nav_data->is_sub1_active
-	 || !nav_data->is_sub2_active
-	 || !nav_data->is_sub3_active)
+   if ((rec == NULL) || (nav_eph_decode(rec, prn, &eph) != 0))
       return 0;
-
-   assert((nav_data->sub1.sub1.IODC & 0xff) == nav_data->sub2.sub2.IODE);
-   assert((nav_data->sub1.sub1.IODC & 0xff) == nav_data->sub3.sub3.IODE);
+   nav_data = &eph;
 
    /* XXX */
    wn = (ctx->gps_week & 0xfc00) | (nav_data->sub1.sub1.WN & 0x3ff);
    gpstime2tm0(wn, nav_data->sub1.sub1.l_toc, &toc_tm);
 
-   fprintf(out_f,
+   len = snprintf(buf, sizeof(buf),
 	 "%2u%3u%3u%3u%3u%3u%5.1f%19.12E%19.12E%19.12E\n",
 	 nav_data->sub1.tSVID,
 	 toc_tm.year % 100,
@@ -279,7 +441,7 @@ static int print_nav_data(FILE *out_f, struct rinex_nav_ctx_t *ctx, const struct
 	 nav_data->sub1.sub1.d_af1,
 	 nav_data->sub1.sub1.d_af2);
 
-   fprintf(out_f,
+   len += snprintf(&buf[len], sizeof(buf)-len,
 	 "   %19.12E%19.12E%19.12E%19.12E\n"
 	 "   %19.12E%19.12E%19.12E%19.12E\n"
 	 "   %19.12E%19.12E%19.12E%19.12E\n"
@@ -320,10 +482,138 @@ static int print_nav_data(FILE *out_f, struct rinex_nav_ctx_t *ctx, const struct
 	 /* XXX  */
 	 (double)nav_data->sub1.l_TOW17
 	 );
+   assert((size_t)len < sizeof(buf));
+
+   if (nav_stream_write(out_f, ctx, buf, len) < 0)
+      return -1;
+
+   return 1;
+}
+
+/* Write record or hold it back until the header is written  */
+static int nav_stream_write(FILE *out_f, struct rinex_nav_ctx_t *ctx, const char *data, size_t len)
+{
+   struct nav_stream_t *s;
+
+   if (ctx->header_printed)
+      return fwrite(data, 1, len, out_f) < len ? -1 : 0;
+
+   s = &ctx->stream;
+
+   if (!s->start_time_valid)
+      s->start_time_valid = nav_stream_time(ctx, &s->start_time);
+
+   if ((s->spill == NULL) && (s->len + len > NAV_STREAM_MEM_LIMIT)) {
+      s->spill = tmpfile();
+      if (s->spill == NULL) {
+	 perror("tmpfile()");
+	 return -1;
+      }
+   }
+
+   if (s->spill)
+      return fwrite(data, 1, len, s->spill) < len ? -1 : 0;
+
+   if (s->buf == NULL) {
+      s->buf = malloc(NAV_STREAM_MEM_LIMIT);
+      if (s->buf == NULL) {
+	 perror(NULL);
+	 return -1;
+      }
+   }
+
+   memcpy(&s->buf[s->len], data, len);
+   s->len += len;
+
+   return 0;
+}
+
+/* Write header followed by held back records  */
+static int nav_stream_flush(FILE *out_f, struct rinex_nav_ctx_t *ctx)
+{
+   size_t l;
+   struct nav_stream_t *s;
+   char tmp[4096];
+
+   assert(!ctx->header_printed);
+
+   if (!print_nav_header(out_f, ctx))
+      return -1;
+   ctx->header_printed = 1;
+
+   s = &ctx->stream;
+
+   if (s->len && (fwrite(s->buf, 1, s->len, out_f) < s->len))
+      return -1;
+   free(s->buf);
+   s->buf = NULL;
+   s->len = 0;
+
+   if (s->spill) {
+      rewind(s->spill);
+      while ((l = fread(tmp, 1, sizeof(tmp), s->spill)) > 0) {
+	 if (fwrite(tmp, 1, l, out_f) < l)
+	    break;
+      }
+      fclose(s->spill);
+      s->spill = NULL;
+   }
+
+   return 0;
+}
+
+static int nav_stream_is_held(const struct nav_stream_t *s)
+{
+   return (s->len != 0) || (s->spill != NULL);
+}
+
+/* GPS time of the last MID 7. 0 before the first one: gps_week and
+ * gps_tow hold defaults, time of the navigation cache is not current  */
+static int nav_stream_time(const struct rinex_nav_ctx_t *ctx, double *now)
+{
+   if (!ctx->navdata.time.is_valid || ctx->navdata.is_cache_loaded)
+      return 0;
 
+   *now = ctx->gps_week * 604800.0 + ctx->gps_tow;
    return 1;
 }
 
+static void nav_stream_check_timeout(FILE *out_f, struct rinex_nav_ctx_t *ctx)
+{
+   double now;
+
+   if (ctx->header_printed || !nav_stream_time(ctx, &now))
+      return;
+
+   /* records held back before the time was known  */
+   if (!ctx->stream.start_time_valid) {
+      if (nav_stream_is_held(&ctx->stream)) {
+	 ctx->stream.start_time = now;
+	 ctx->stream.start_time_valid = 1;
+      }
+      return;
+   }
+
+   if (now - ctx->stream.start_time >= NAV_STREAM_TIMEOUT)
+      nav_stream_flush(out_f, ctx);
+}
+
+/* Print ephemerides loaded from the navigation cache  */
+static void print_cached_nav_data(FILE *out_f, struct rinex_nav_ctx_t *ctx)
+{
+   unsigned i;
+   struct nav_sat_data_t *sat;
+
+   for (i=1; i <= MAX_GPS_PRN; i++) {
+      sat = get_navdata_p(&ctx->navdata, i);
+      if (sat && sat->is_cached)
+	 print_nav_data(out_f, ctx, i, nav_eph_current(&ctx->navdata, i));
+   }
+
+   if (!ctx->header_printed && ctx->navdata.sub4_18.is_active)
+      nav_stream_flush(out_f, ctx);
+}
+
 static double ura2meters(unsigned ura)
 {
 
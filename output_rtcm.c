@@ -8,6 +8,7 @@
 #include "gpsd/gps.h"
 #include "gpsd/crc24q.h"
 #include "sirfdump.h"
+#include "stats.h"
 #include "sirf_codec.h"
 #include "sirf_codec_ssb.h"
 #include "sirf_msg.h"
@@ -45,6 +46,14 @@ struct rtcm_ctx_t {
    struct epoch_t epoch;
    struct nav_data_t navdata;
    unsigned sirf_flags;
+   /* --navcache file, NULL: no cache  */
+   const char *nav_cache;
+};
+
+/* Snapshot: epoch in progress and navigation data  */
+struct rtcm_state_t {
+   struct epoch_t epoch;
+   struct nav_data_t navdata;
 };
 
 static int handle_nl_meas_data_msg(struct rtcm_ctx_t *ctx,
@@ -56,6 +65,8 @@ static int handle_clock_status_msg(struct rtcm_ctx_t *ctx,
 static int handle_mid8_msg(struct rtcm_ctx_t *ctx,
       const tSIRF_MSG_SSB_50BPS_DATA *msg, FILE *out_f);
 
+static int print_msg1019(FILE *out_f, unsigned svid, const struct nav_eph_rec_t *rec);
+
 static void epoch_clear (struct epoch_t *e);
 static void epoch_close(struct epoch_t *e);
 static int epoch_printf(FILE *out_f, struct epoch_t *e);
@@ -64,7 +75,8 @@ static int rtcm_transport_write(FILE *out_f, void *data, unsigned size);
 static unsigned set_ubits(uint8_t *buf, unsigned pos, int len, unsigned val);
 static unsigned set_sbits(uint8_t *buf, unsigned pos, unsigned len, int val);
 
-void *new_rtcm_ctx(int argc, char **argv, unsigned gsw230_byte_order)
+void *new_rtcm_ctx(int argc, char **argv, unsigned gsw230_byte_order,
+      const char *nav_cache)
 {
    struct rtcm_ctx_t *ctx;
 
@@ -78,13 +90,21 @@ void *new_rtcm_ctx(int argc, char **argv, unsigned gsw230_byte_order)
    epoch_clear(&ctx->epoch);
    init_nav_data(&ctx->navdata);
    ctx->sirf_flags = gsw230_byte_order ? SIRF_CODEC_FLAGS_GSW230_BYTE_ORDER : 0;
+   ctx->nav_cache = nav_cache;
+   if (nav_cache)
+      nav_cache_load(&ctx->navdata, nav_cache);
 
    return ctx;
 }
 
 void free_rtcm_ctx(void *ctx)
 {
-   free(ctx);
+   struct rtcm_ctx_t *c;
+   c = (struct rtcm_ctx_t *)ctx;
+
+   if (c->nav_cache)
+      nav_cache_save(&c->navdata, c->nav_cache);
+   free(c);
 }
 
 int output_rtcm(struct transport_msg_t *msg, FILE *out_f, void *user_ctx)
@@ -109,12 +129,14 @@ int output_rtcm(struct transport_msg_t *msg, FILE *out_f, void *user_ctx)
    ctx = (struct rtcm_ctx_t *)user_ctx;
 
    options = ctx->sirf_flags;
+   STATS_DECODE_BEGIN();
    err = SIRF_CODEC_SSB_Decode(msg->payload,
 	 msg->payload_length,
 	 &msg_id,
 	 m.u8,
 	 &msg_length,
          &options);
+   STATS_DECODE_END(err);
 
    if (err)
       return err;
@@ -139,6 +161,65 @@ int output_rtcm(struct transport_msg_t *msg, FILE *out_f, void *user_ctx)
    return err;
 }
 
+/* Known ephemerides are repeated in the new file, so that each file can
+ * be decoded alone  */
+int rtcm_new_file(FILE *out_f, void *user_ctx)
+{
+   unsigned i;
+   struct rtcm_ctx_t *ctx;
+
+   assert(user_ctx);
+   assert(out_f);
+
+   ctx = (struct rtcm_ctx_t *)user_ctx;
+
+   for (i=1; i <= MAX_GPS_PRN; i++)
+      print_msg1019(out_f, i, nav_eph_current(&ctx->navdata, i));
+
+   return 0;
+}
+
+size_t rtcm_get_state(void *user_ctx, void *buf, size_t size)
+{
+   struct rtcm_ctx_t *ctx;
+   struct rtcm_state_t *st;
+
+   assert(user_ctx);
+
+   ctx = (struct rtcm_ctx_t *)user_ctx;
+   if (size < sizeof(*st))
+      return sizeof(*st);
+
+   st = (struct rtcm_state_t *)buf;
+   st->epoch = ctx->epoch;
+   st->navdata = ctx->navdata;
+
+   return sizeof(*st);
+}
+
+/* Ephemerides restored for a new file are sent on the first MID 7, as
+ * the cached ones  */
+int rtcm_set_state(void *user_ctx, const void *buf, size_t size,
+      unsigned new_file)
+{
+   struct rtcm_ctx_t *ctx;
+   const struct rtcm_state_t *st;
+
+   assert(user_ctx);
+
+   if (size != sizeof(*st))
+      return -1;
+
+   ctx = (struct rtcm_ctx_t *)user_ctx;
+   st = (const struct rtcm_state_t *)buf;
+   ctx->epoch = st->epoch;
+   ctx->navdata = st->navdata;
+   if (new_file)
+      nav_data_restored(&ctx->navdata);
+
+   return 0;
+}
+
 static int handle_nl_meas_data_msg(struct rtcm_ctx_t *ctx,
       tSIRF_MSG_SSB_NL_MEAS_DATA *msg)
 {
@@ -225,6 +306,17 @@ static int handle_clock_status_msg(struct rtcm_ctx_t *ctx,
    ctx->epoch.clock_bias = msg->clk_bias;
    ctx->epoch.clock_drift = msg->clk_offset;
 
+   if (nav_data_set_time(&ctx->navdata, msg->gps_week, msg->gps_tow / 100.0) > 0) {
+      unsigned i;
+      struct nav_sat_data_t *sat;
+      /* ephemerides loaded from the navigation cache  */
+      for (i=1; i <= MAX_GPS_PRN; i++) {
+	 sat = get_navdata_p(&ctx->navdata, i);
+	 if (sat && sat->is_cached)
+	    print_msg1019(out_f, i, nav_eph_current(&ctx->navdata, i));
+      }
+   }
+
    epoch_close(&ctx->epoch);
    epoch_printf(out_f, &ctx->epoch);
    epoch_clear(&ctx->epoch);
@@ -236,10 +328,7 @@ static int handle_mid8_msg(struct rtcm_ctx_t *ctx,
       const tSIRF_MSG_SSB_50BPS_DATA *msg,
       FILE *out_f)
 {
-   unsigned pos;
    int data_changed;
-   struct nav_sat_data_t *sat;
-   uint8_t msg1019[62];
 
    assert(ctx);
    assert(msg);
@@ -250,21 +339,28 @@ static int handle_mid8_msg(struct rtcm_ctx_t *ctx,
    if (data_changed < 0)
       return data_changed;
 
-   sat = get_navdata_p(&ctx->navdata, msg->svid);
-   if (!sat)
+   if (!get_navdata_p(&ctx->navdata, msg->svid))
       return -1;
 
-   if (!sat->is_sub1_active
-	 || !sat->is_sub2_active
-	 || !sat->is_sub3_active)
+   return print_msg1019(out_f, msg->svid,
+	 nav_eph_current(&ctx->navdata, msg->svid));
+}
+
+static int print_msg1019(FILE *out_f, unsigned svid, const struct nav_eph_rec_t *rec)
+{
+   unsigned pos;
+   struct nav_eph_t eph;
+   const struct nav_eph_t *sat;
+   uint8_t msg1019[62];
+
+   if ((rec == NULL) || (nav_eph_decode(rec, svid, &eph) != 0))
       return 0;
-   assert((sat->sub1.sub1.IODC & 0xff) == sat->sub2.sub2.IODE);
-   assert((sat->sub1.sub1.IODC & 0xff) == sat->sub3.sub3.IODE);
+   sat = &eph;
 
    /* MSG1019 */
    pos = 0;
    pos += set_ubits(msg1019, pos, 12, 1019);
-   pos += set_ubits(msg1019, pos, 6, msg->svid);
+   pos += set_ubits(msg1019, pos, 6, svid);
    pos += set_ubits(msg1019, pos, 10, sat->sub1.sub1.WN);
    pos += set_ubits(msg1019, pos, 4, sat->sub1.sub1.ura);
    pos += set_ubits(msg1019, pos, 2, sat->sub1.sub1.l2);
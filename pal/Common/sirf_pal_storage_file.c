@@ -38,6 +38,8 @@
 #include "string_sif.h"
 
 FILE *store_id[SIRF_PAL_STORAGE_MAX];
+/* file names set by SIRF_PAL_STORAGE_SetFileName()  */
+static const char *store_name[SIRF_PAL_STORAGE_MAX];
 
 /* ----------------------------------------------------------------------------
  *    Functions
@@ -55,7 +57,8 @@ FILE *store_id[SIRF_PAL_STORAGE_MAX];
 tSIRF_RESULT SIRF_PAL_STORAGE_Open( tSIRF_UINT32 storage_id )
 {
    tSIRF_RESULT result = SIRF_SUCCESS;
-   char filename[18];
+   char default_name[18];
+   const char *filename;
    FILE *fh;
 
    /* return if the ID is beyond the max possible */
@@ -67,10 +70,11 @@ tSIRF_RESULT SIRF_PAL_STORAGE_Open( tSIRF_UINT32 storage_id )
    if (SIRF_SUCCESS == result)
    {
 #ifdef OS_ANDROID
-      snprintf(filename,sizeof(filename),"/data/NVM%d",(int)storage_id);
+      snprintf(default_name,sizeof(default_name),"/data/NVM%d",(int)storage_id);
 #else
-      snprintf(filename,sizeof(filename),"NVM%d",(int)storage_id);
+      snprintf(default_name,sizeof(default_name),"NVM%d",(int)storage_id);
 #endif
+      filename = store_name[storage_id] ? store_name[storage_id] : default_name;
 
       /* check if file already exists */
       fh = fopen(filename,"r+b");
@@ -95,6 +99,27 @@ tSIRF_RESULT SIRF_PAL_STORAGE_Open( tSIRF_UINT32 storage_id )
 } /* SIRF_PAL_STORAGE_Open() */
 
 
+/**
+ * @brief Set the file used by SIRF_PAL_STORAGE_Open() for a storage ID.
+ *        The string is not copied and must stay valid.
+ * @param[in] storage_id               Storage ID.
+ * @param[in] filename                 File name, NULL for the default NVM<id>.
+ * @return                             Result code.
+ */
+tSIRF_RESULT SIRF_PAL_STORAGE_SetFileName( tSIRF_UINT32 storage_id, const char *filename )
+{
+   if (storage_id >= SIRF_PAL_STORAGE_MAX)
+   {
+      return SIRF_FAILURE;
+   }
+
+   store_name[storage_id] = filename;
+
+   return SIRF_SUCCESS;
+
+} /* SIRF_PAL_STORAGE_SetFileName() */
+
+
 /**
  * @brief Close the storage device for a given storage ID.
  *        The storage ID is derived from sirf_pal_storage.h
@@ -108,6 +108,8 @@ tSIRF_RESULT SIRF_PAL_STORAGE_Close( tSIRF_UINT32 storage_id );
 
 tSIRF_RESULT SIRF_PAL_STORAGE_Write( tSIRF_UINT32 storage_id, tSIRF_UINT32 offset, tSIRF_UINT8 *data, tSIRF_UINT32 length );
 tSIRF_RESULT SIRF_PAL_STORAGE_Read(  tSIRF_UINT32 storage_id, tSIRF_UINT32 offset, tSIRF_UINT8 *data, tSIRF_UINT32 length );
+/* File backend: file of the storage ID, NULL for the default NVM<id>  */
+tSIRF_RESULT SIRF_PAL_STORAGE_SetFileName( tSIRF_UINT32 storage_id, const char *filename );
 /* Leave C naming convention */
 #ifdef __cplusplus
 }
@@ -0,0 +1,644 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sirf_types.h"
+#include "sirf_msg.h"
+#include "sirf_proto_parse.h"
+#include "sirf_proto_common.h"
+
+const char *progname = "parsebench";
+const char *revision = "$Revision: 0.1 $";
+
+/* Parser instances of the interleaved check  */
+#define PARSERS_CNT 16
+/* Largest chunk of the chunked checks, bytes  */
+#define CHUNK_MAX 4800
+/* Read size of the benchmark, bytes  */
+#define BENCH_CHUNK 4096
+
+/* Parsed message: type, length and FNV-1a hash of the contents  */
+struct frame_t {
+   uint32_t hash;
+   uint32_t len;
+   uint32_t type;
+};
+
+struct frames_t {
+   struct frame_t *f;
+   size_t cnt;
+   size_t size;
+};
+
+struct bench_ctx_t {
+   unsigned runs;
+   unsigned size_mb;
+   unsigned seed;
+   unsigned errors;
+};
+
+static void usage(void)
+{
+ fprintf(stdout, "\nUsage:\n    %s [-h] [options] [file.srf]\n"
+       ,progname);
+ return;
+}
+
+static void version(void)
+{
+ fprintf(stdout,"%s %s\n",progname,revision);
+}
+
+static void help(void)
+{
+
+ printf("%s - SiRF protocol parser check and benchmark\t\t%s\n",
+       progname, revision);
+ usage();
+ printf(
+   "\nOptions:\n"
+   "    -n, --runs                  Runs per test, best is reported, default: 3\n"
+   "    -s, --size                  Generated stream size, MB, default: 16\n"
+   "    -S, --seed                  Random seed, default: 1\n"
+   "    -h, --help                  Help\n"
+   "    -v, --version               Show version\n"
+   "\n"
+   "Generated streams of SSB frames, $PSRF sentences and garbage, a second\n"
+   "one also with headers of bogus length, and file.srf when given, are\n"
+   "parsed by the former single stream parser and by\n"
+   "SIRF_PROTO_Parser_Parse(). Check: results of random chunks of 1 to\n"
+   "4800 bytes and of 16 instances fed interleaved are the same as of one\n"
+   "call; messages of the former parser are the same, in order, with the\n"
+   "messages it lost after a bogus length added. Exits with 1 on error.\n"
+   "Benchmark: MB/s and messages/s, 4096 byte reads.\n"
+   "\n"
+ );
+ return;
+}
+
+static uint64_t clock_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static unsigned rnd(unsigned n)
+{
+   return n ? (unsigned)(random() % n) : 0;
+}
+
+static int frames_add(struct frames_t *fr, const tSIRF_UINT8 *buf,
+      tSIRF_UINT32 len, tSIRF_ParserType type)
+{
+   tSIRF_UINT32 i;
+   uint32_t h;
+
+   if (fr->cnt == fr->size) {
+      struct frame_t *f;
+      size_t size;
+
+      size = fr->size ? fr->size * 2 : 1024;
+      f = realloc(fr->f, size * sizeof(fr->f[0]));
+      if (f == NULL) {
+	 perror(NULL);
+	 exit(1);
+      }
+      fr->f = f;
+      fr->size = size;
+   }
+
+   h = 2166136261u;
+   for (i=0; i < len; i++)
+      h = (h ^ buf[i]) * 16777619u;
+
+   fr->f[fr->cnt].hash = h;
+   fr->f[fr->cnt].len = len;
+   fr->f[fr->cnt].type = type;
+   fr->cnt++;
+
+   return 0;
+}
+
+/*
+ * SIRF_PROTO_Parse() before the reentrant parser: one byte at a time,
+ * state in file globals, no check of the packet length. PktBuf is
+ * enlarged to the largest length and $PSRF sentences are cut at its
+ * end, so the former buffer overrun can not happen here.
+ */
+#define LEGACY_BUFFER_SIZE 0x10000
+
+static Protocol_State_Machine_States legacy_state = stA0;
+static tSIRF_INT32 legacy_index;
+static tSIRF_INT32 legacy_len;
+static tSIRF_INT32 legacy_chksum;
+static tSIRF_UINT8 legacy_buf[LEGACY_BUFFER_SIZE];
+static struct frames_t *legacy_frames;
+
+static Protocol_State_Machine_States legacy_initial_byte(tSIRF_UINT8 Byte)
+{
+   Protocol_State_Machine_States newState = stA0;
+
+   if (SIRF_MSG_HEAD0 == Byte)
+      newState = stA1;
+   else if ('$' == Byte) {
+      legacy_index = 0;
+      legacy_buf[legacy_index++] = Byte;
+      newState = n_stP;
+   }
+   return newState;
+}
+
+static void legacy_parse(const tSIRF_UINT8 *Buf, tSIRF_UINT32 BytesRead)
+{
+   tSIRF_UINT8 Byte;
+   tSIRF_UINT32 i;
+
+   for (i = 0; i < BytesRead; i++) {
+      Byte = Buf[i];
+
+      switch(legacy_state) {
+	 case stA0:
+	    legacy_state = legacy_initial_byte(Byte);
+	    break;
+	 case stA1:
+	    if (SIRF_MSG_HEAD1 == Byte)
+	       legacy_state = stLen1;
+	    else
+	       legacy_state = legacy_initial_byte(Byte);
+	    break;
+	 case stLen1:
+	    legacy_len = Byte;
+	    legacy_state = stLen2;
+	    break;
+	 case stLen2:
+	    legacy_len = (legacy_len << 0x08) | Byte;
+	    legacy_index = -1;
+	    legacy_state = stPacket;
+	    break;
+	 case stPacket:
+	    legacy_index++;
+	    legacy_buf[legacy_index] = Byte;
+	    if ((legacy_index + 1) < legacy_len)
+	       break;
+	    legacy_state = stChkSm1;
+	    break;
+	 case stChkSm1:
+	    legacy_chksum = Byte;
+	    legacy_state = stChkSm2;
+	    break;
+	 case stChkSm2:
+	    legacy_chksum = ((legacy_chksum << 0x08) | Byte) & 0x7FFF;
+	    if (SIRF_PROTO_ComputeChksum(legacy_buf, legacy_len) == legacy_chksum)
+	       legacy_state = stB0;
+	    else
+	       legacy_state = legacy_initial_byte(Byte);
+	    break;
+	 case stB0:
+	    if (SIRF_MSG_TAIL0 == Byte)
+	       legacy_state = stB3;
+	    else
+	       legacy_state = legacy_initial_byte(Byte);
+	    break;
+	 case stB3:
+	    if (SIRF_MSG_TAIL1 == Byte)
+	       frames_add(legacy_frames, legacy_buf, legacy_len, PARSER_SSB);
+	    legacy_state = stA0;
+	    break;
+	 case n_stDollar:
+	    legacy_state = legacy_initial_byte(Byte);
+	    break;
+	 case n_stP:
+	 case n_stS:
+	 case n_stR:
+	 case n_stF:
+	    if (Byte == "PSRF"[legacy_state - n_stP]) {
+	       legacy_state = legacy_state + 1;
+	       legacy_buf[legacy_index++] = Byte;
+	    }else
+	       legacy_state = legacy_initial_byte(Byte);
+	    break;
+	 case n_stCR:
+	    if (0x0D == Byte)
+	       legacy_state = n_stLF;
+	    legacy_buf[legacy_index++] = Byte;
+	    if (legacy_index >= LEGACY_BUFFER_SIZE)
+	       legacy_state = stA0;
+	    break;
+	 case n_stLF:
+	    if ((0x0A == Byte) && (legacy_index >= 0)) {
+	       legacy_buf[legacy_index] = Byte;
+	       frames_add(legacy_frames, legacy_buf, legacy_index + 1, PARSER_NMEA);
+	    }
+	    legacy_state = n_stDollar;
+	    break;
+	 default:
+	    legacy_state = legacy_initial_byte(Byte);
+	    break;
+      }
+   }
+}
+
+static void legacy_reset(struct frames_t *fr)
+{
+   legacy_state = stA0;
+   legacy_index = legacy_len = legacy_chksum = 0;
+   legacy_frames = fr;
+}
+
+static tSIRF_RESULT parser_cb(tSIRF_UINT8 *buf, tSIRF_UINT32 len,
+      tSIRF_ParserType type, tSIRF_VOID *user_ctx)
+{
+   frames_add((struct frames_t *)user_ctx, buf, len, type);
+   return SIRF_SUCCESS;
+}
+
+/* SSB frames of 1 to 1000 (rarely up to 5999) bytes, $PSRF sentences,
+ * garbage; bogus: also headers with length 0 or above 6000  */
+static size_t gen_stream(uint8_t *buf, size_t size, unsigned bogus)
+{
+   size_t p;
+   unsigned i, len, r;
+   tSIRF_UINT16 chksum;
+
+   p = 0;
+   while (p + SIRF_PROTO_PARSE_MAX_BUFFER_SIZE + 16 < size) {
+      r = rnd(100);
+      if (r < 70) {
+	 len = rnd(100) ? 1 + rnd(1000) : 1 + rnd(SIRF_PROTO_PARSE_MAX_BUFFER_SIZE - 1);
+	 buf[p++] = SIRF_MSG_HEAD0;
+	 buf[p++] = SIRF_MSG_HEAD1;
+	 buf[p++] = (uint8_t)(len >> 8);
+	 buf[p++] = (uint8_t)len;
+	 for (i=0; i < len; i++)
+	    buf[p + i] = (uint8_t)random();
+	 chksum = SIRF_PROTO_ComputeChksum(&buf[p], len);
+	 p += len;
+	 buf[p++] = (uint8_t)(chksum >> 8);
+	 buf[p++] = (uint8_t)chksum;
+	 buf[p++] = SIRF_MSG_TAIL0;
+	 buf[p++] = SIRF_MSG_TAIL1;
+      }else if (r < 85) {
+	 memcpy(&buf[p], "$PSRF", 5);
+	 p += 5;
+	 len = 5 + rnd(80);
+	 for (i=0; i < len; i++)
+	    buf[p++] = (uint8_t)(' ' + rnd('~' - ' ' + 1));
+	 buf[p++] = 0x0D;
+	 buf[p++] = 0x0A;
+      }else if ((r < 98) || !bogus) {
+	 /* without bogus lengths no A0 A2 header is made up  */
+	 len = 1 + rnd(64);
+	 for (i=0; i < len; i++) {
+	    buf[p] = (uint8_t)random();
+	    if (!bogus && (buf[p] == SIRF_MSG_HEAD0))
+	       buf[p] = 0;
+	    p++;
+	 }
+      }else {
+	 len = rnd(4) ? SIRF_PROTO_PARSE_MAX_BUFFER_SIZE + 1 + rnd(0x10000 - SIRF_PROTO_PARSE_MAX_BUFFER_SIZE - 1) : 0;
+	 buf[p++] = SIRF_MSG_HEAD0;
+	 buf[p++] = SIRF_MSG_HEAD1;
+	 buf[p++] = (uint8_t)(len >> 8);
+	 buf[p++] = (uint8_t)len;
+      }
+   }
+
+   return p;
+}
+
+static int load_log(const char *fname, uint8_t **res, size_t *res_size)
+{
+   int fd;
+   uint8_t *data;
+   size_t size, i;
+   struct stat st;
+   ssize_t l;
+
+   fd = open(fname, O_RDONLY);
+   if (fd < 0 || (fstat(fd, &st) < 0)) {
+      perror(fname);
+      if (fd >= 0)
+	 close(fd);
+      return -1;
+   }
+   size = st.st_size;
+
+   data = malloc(size ? size : 1);
+   if (data == NULL) {
+      perror(NULL);
+      close(fd);
+      return -1;
+   }
+   for (i=0; i < size; i += l) {
+      l = read(fd, &data[i], size - i);
+      if (l <= 0) {
+	 perror(fname);
+	 free(data);
+	 close(fd);
+	 return -1;
+      }
+   }
+   close(fd);
+
+   *res = data;
+   *res_size = size;
+   return 0;
+}
+
+static int frames_equal(const struct frames_t *a, const struct frames_t *b)
+{
+   return (a->cnt == b->cnt)
+      && (a->cnt == 0 || memcmp(a->f, b->f, a->cnt * sizeof(a->f[0])) == 0);
+}
+
+/* Returns number of frames of b not in a, -1 if a is not a subsequence of b  */
+static long frames_subsequence(const struct frames_t *a, const struct frames_t *b)
+{
+   size_t i, j;
+
+   j = 0;
+   for (i=0; i < a->cnt; i++) {
+      while ((j < b->cnt) && memcmp(&a->f[i], &b->f[j], sizeof(a->f[i])) != 0)
+	 j++;
+      if (j == b->cnt)
+	 return -1;
+      j++;
+   }
+
+   return (long)(b->cnt - a->cnt);
+}
+
+static void parse_whole(const uint8_t *data, size_t size, struct frames_t *fr)
+{
+   tSIRF_PROTO_PARSER *p;
+
+   p = malloc(sizeof(*p));
+   if (p == NULL) {
+      perror(NULL);
+      exit(1);
+   }
+   SIRF_PROTO_Parser_Init(p, parser_cb, fr);
+   SIRF_PROTO_Parser_Parse(p, data, (tSIRF_UINT32)size);
+   free(p);
+}
+
+static void check_stream(struct bench_ctx_t *ctx, const char *name,
+      const uint8_t *data, size_t size, unsigned exact)
+{
+   unsigned k, done;
+   size_t pos, n, seg[PARSERS_CNT + 1];
+   long extra;
+   tSIRF_PROTO_PARSER *p;
+   struct frames_t whole, chunked, legacy;
+   struct frames_t part_whole[PARSERS_CNT], part[PARSERS_CNT];
+   size_t part_pos[PARSERS_CNT];
+
+   memset(&whole, 0, sizeof(whole));
+   memset(&chunked, 0, sizeof(chunked));
+   memset(&legacy, 0, sizeof(legacy));
+   memset(part_whole, 0, sizeof(part_whole));
+   memset(part, 0, sizeof(part));
+
+   parse_whole(data, size, &whole);
+
+   /* random chunks  */
+   p = malloc(PARSERS_CNT * sizeof(*p));
+   if (p == NULL) {
+      perror(NULL);
+      exit(1);
+   }
+   SIRF_PROTO_Parser_Init(&p[0], parser_cb, &chunked);
+   for (pos=0; pos < size; pos += n) {
+      n = 1 + rnd(CHUNK_MAX);
+      if (n > size - pos)
+	 n = size - pos;
+      SIRF_PROTO_Parser_Parse(&p[0], &data[pos], (tSIRF_UINT32)n);
+   }
+   if (!frames_equal(&whole, &chunked)) {
+      printf("%s: %lu messages in one call, %lu in chunks\n", name,
+	    (unsigned long)whole.cnt, (unsigned long)chunked.cnt);
+      ctx->errors++;
+   }
+
+   /* instances on parts of the stream, interleaved chunks  */
+   for (k=0; k <= PARSERS_CNT; k++)
+      seg[k] = size / PARSERS_CNT * k;
+   seg[PARSERS_CNT] = size;
+   for (k=0; k < PARSERS_CNT; k++) {
+      parse_whole(&data[seg[k]], seg[k+1] - seg[k], &part_whole[k]);
+      SIRF_PROTO_Parser_Init(&p[k], parser_cb, &part[k]);
+      part_pos[k] = seg[k];
+   }
+   do {
+      done = 1;
+      for (k=0; k < PARSERS_CNT; k++) {
+	 if (part_pos[k] == seg[k+1])
+	    continue;
+	 n = 1 + rnd(CHUNK_MAX);
+	 if (n > seg[k+1] - part_pos[k])
+	    n = seg[k+1] - part_pos[k];
+	 SIRF_PROTO_Parser_Parse(&p[k], &data[part_pos[k]], (tSIRF_UINT32)n);
+	 part_pos[k] += n;
+	 done = 0;
+      }
+   } while (!done);
+   for (k=0; k < PARSERS_CNT; k++) {
+      if (!frames_equal(&part_whole[k], &part[k])) {
+	 printf("%s: parser %u of %u: %lu messages alone, %lu interleaved\n",
+	       name, k, PARSERS_CNT, (unsigned long)part_whole[k].cnt,
+	       (unsigned long)part[k].cnt);
+	 ctx->errors++;
+      }
+      free(part_whole[k].f);
+      free(part[k].f);
+   }
+   free(p);
+
+   /* former parser  */
+   legacy_reset(&legacy);
+   legacy_parse(data, (tSIRF_UINT32)size);
+   extra = frames_subsequence(&legacy, &whole);
+   if (extra < 0) {
+      printf("%s: messages of the former parser missing\n", name);
+      ctx->errors++;
+   }else if (exact && (extra != 0)) {
+      printf("%s: %ld messages more than the former parser\n", name, extra);
+      ctx->errors++;
+   }else
+      printf("%-20s %10lu messages, %8lu more than the former parser\n",
+	    name, (unsigned long)whole.cnt, (unsigned long)extra);
+
+   free(whole.f);
+   free(chunked.f);
+   free(legacy.f);
+}
+
+static uint64_t run_legacy(const uint8_t *data, size_t size, size_t *cnt)
+{
+   size_t pos, n;
+   uint64_t t;
+   struct frames_t fr;
+
+   memset(&fr, 0, sizeof(fr));
+   legacy_reset(&fr);
+   t = clock_ns();
+   for (pos=0; pos < size; pos += n) {
+      n = size - pos < BENCH_CHUNK ? size - pos : BENCH_CHUNK;
+      legacy_parse(&data[pos], (tSIRF_UINT32)n);
+   }
+   t = clock_ns() - t;
+   *cnt = fr.cnt;
+   free(fr.f);
+   return t;
+}
+
+static uint64_t run_parser(const uint8_t *data, size_t size, size_t *cnt)
+{
+   size_t pos, n;
+   uint64_t t;
+   struct frames_t fr;
+   tSIRF_PROTO_PARSER *p;
+
+   p = malloc(sizeof(*p));
+   if (p == NULL) {
+      perror(NULL);
+      exit(1);
+   }
+   memset(&fr, 0, sizeof(fr));
+   SIRF_PROTO_Parser_Init(p, parser_cb, &fr);
+   t = clock_ns();
+   for (pos=0; pos < size; pos += n) {
+      n = size - pos < BENCH_CHUNK ? size - pos : BENCH_CHUNK;
+      SIRF_PROTO_Parser_Parse(p, &data[pos], (tSIRF_UINT32)n);
+   }
+   t = clock_ns() - t;
+   *cnt = fr.cnt;
+   free(fr.f);
+   free(p);
+   return t;
+}
+
+static void bench(const struct bench_ctx_t *ctx, const char *name,
+      const uint8_t *data, size_t size)
+{
+   unsigned i, k;
+   uint64_t ns, best[2];
+   size_t cnt[2];
+
+   best[0] = best[1] = UINT64_MAX;
+   cnt[0] = cnt[1] = 0;
+   for (i=0; i < ctx->runs; i++) {
+      for (k=0; k<2; k++) {
+	 ns = k ? run_parser(data, size, &cnt[k]) : run_legacy(data, size, &cnt[k]);
+	 if (ns < best[k])
+	    best[k] = ns;
+      }
+   }
+
+   for (k=0; k<2; k++) {
+      printf("%-20s %-8s %9.3f %10.1f %12.0f\n", name, k ? "parser" : "legacy",
+	    best[k] / 1e9, size / (best[k] / 1e9) / 1e6,
+	    cnt[k] / (best[k] / 1e9));
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   signed char c;
+   size_t size, len[2], log_size;
+   uint8_t *data[2], *log_data;
+   struct bench_ctx_t ctx;
+
+   static struct option longopts[] = {
+      {"version",     no_argument,       0, 'v'},
+      {"help",        no_argument,       0, 'h'},
+      {"runs",        required_argument, 0, 'n'},
+      {"size",        required_argument, 0, 's'},
+      {"seed",        required_argument, 0, 'S'},
+      {0, 0, 0, 0}
+   };
+
+   memset(&ctx, 0, sizeof(ctx));
+   ctx.runs = 3;
+   ctx.size_mb = 16;
+   ctx.seed = 1;
+
+   while ((c = getopt_long(argc, argv, "vh?n:s:S:",longopts,NULL)) != -1) {
+      switch (c) {
+	 case 'n':
+	    ctx.runs = strtoul(optarg, NULL, 10);
+	    break;
+	 case 's':
+	    ctx.size_mb = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'S':
+	    ctx.seed = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'v':
+	    version();
+	    exit(0);
+	    break;
+	 default:
+	    help();
+	    exit(0);
+	    break;
+      }
+   }
+   argc -= optind;
+   argv += optind;
+
+   if ((argc > 1) || (ctx.runs == 0) || (ctx.size_mb == 0)) {
+      help();
+      return 1;
+   }
+
+   srandom(ctx.seed);
+
+   size = (size_t)ctx.size_mb << 20;
+   data[0] = malloc(size);
+   data[1] = malloc(size);
+   if ((data[0] == NULL) || (data[1] == NULL)) {
+      perror(NULL);
+      return 1;
+   }
+   len[0] = gen_stream(data[0], size, 0);
+   len[1] = gen_stream(data[1], size, 1);
+
+   log_data = NULL;
+   log_size = 0;
+   if ((argc == 1) && (load_log(argv[0], &log_data, &log_size) < 0))
+      return 1;
+
+   check_stream(&ctx, "generated", data[0], len[0], 1);
+   check_stream(&ctx, "bogus lengths", data[1], len[1], 0);
+   if (log_data)
+      check_stream(&ctx, "log", log_data, log_size, 0);
+   if (ctx.errors) {
+      printf("check: %u errors\n", ctx.errors);
+      return 1;
+   }
+   printf("check: chunks, %u interleaved parsers, former parser: ok\n",
+	 PARSERS_CNT);
+
+   printf("%-20s %-8s %9s %10s %12s\n", "input", "test", "time,s", "MB/s",
+	 "messages/s");
+   bench(&ctx, "generated", data[0], len[0]);
+   if (log_data)
+      bench(&ctx, "log", log_data, log_size);
+
+   free(data[0]);
+   free(data[1]);
+   free(log_data);
+   return 0;
+}
@@ -0,0 +1,116 @@
+#include <sys/types.h>
+#include <sys/ioctl.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <termios.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
+#include "serial.h"
+
+static const struct {
+   unsigned baud;
+   speed_t speed;
+} speeds[] = {
+   {4800, B4800},
+   {9600, B9600},
+   {19200, B19200},
+   {38400, B38400},
+   {57600, B57600},
+   {115200, B115200},
+#ifdef B230400
+   {230400, B230400},
+#endif
+#ifdef B460800
+   {460800, B460800},
+#endif
+#ifdef B921600
+   {921600, B921600},
+#endif
+};
+
+static void set_low_latency(int fd);
+
+/*
+ * Same line settings as SIRF_PAL_COM_UART_Open(). Reads return as soon
+ * as any data is available (VMIN 1, VTIME 0): read_data() asks for the
+ * whole free buffer, so backlog is read in one call.
+ */
+int serial_open(const char *device, unsigned baud)
+{
+   int fd;
+   unsigned i;
+   struct termios t;
+
+   assert(device);
+
+   for (i=0; i < sizeof(speeds)/sizeof(speeds[0]); i++) {
+      if (speeds[i].baud == baud)
+	 break;
+   }
+   if (i == sizeof(speeds)/sizeof(speeds[0])) {
+      fprintf(stderr, "Unsupported baud rate %u\n", baud);
+      return -1;
+   }
+
+   /* O_NONBLOCK: do not wait for carrier  */
+   fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+   if (fd < 0) {
+      perror(device);
+      return -1;
+   }
+
+   if (tcgetattr(fd, &t) != 0) {
+      perror(device);
+      close(fd);
+      return -1;
+   }
+
+   t.c_cflag = CLOCAL | CREAD | CS8;
+   t.c_iflag = IGNPAR;
+   t.c_oflag = 0;
+   t.c_lflag = 0;
+   t.c_cc[VMIN] = 1;
+   t.c_cc[VTIME] = 0;
+   if (cfsetispeed(&t, speeds[i].speed) != 0
+	 || (cfsetospeed(&t, speeds[i].speed) != 0)
+	 || (tcsetattr(fd, TCSANOW, &t) != 0)) {
+      perror(device);
+      close(fd);
+      return -1;
+   }
+   tcflush(fd, TCIFLUSH);
+
+   if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK) != 0) {
+      perror(device);
+      close(fd);
+      return -1;
+   }
+
+   set_low_latency(fd);
+
+   return fd;
+}
+
+/* Disable receive FIFO delay of 8250 and some USB serial drivers  */
+static void set_low_latency(int fd)
+{
+#if defined(TIOCGSERIAL) && defined(ASYNC_LOW_LATENCY)
+   struct serial_struct ss;
+
+   if (ioctl(fd, TIOCGSERIAL, &ss) != 0)
+      return;
+   if (ss.flags & ASYNC_LOW_LATENCY)
+      return;
+   ss.flags |= ASYNC_LOW_LATENCY;
+   ioctl(fd, TIOCSSERIAL, &ss);
+#else
+   (void)fd;
+#endif
+}
@@ -0,0 +1,10 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#define SERIAL_DEFAULT_BAUD 115200
+
+/* Open tty in raw 8N1 mode, no flow control, with low latency reads.
+ * Returns file descriptor, -1 on error  */
+int serial_open(const char *device, unsigned baud);
+
+#endif /* SERIAL_H */
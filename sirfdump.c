@@ -1,5 +1,6 @@
 
 #define _GNU_SOURCE
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #include <assert.h>
@@ -11,8 +12,13 @@
 
 #ifdef _MSC_VER
 #include <io.h>
+#include <direct.h>
 #include "ultragetopt.h"
 #define STDIN_FILENO 0
+#define mkdir(_path, _mode) _mkdir(_path)
+#define ftruncate(_fd, _size) _chsize(_fd, _size)
+#define ftello(_f) _ftelli64(_f)
+#define S_ISREG(_mode) (((_mode) & _S_IFMT) == _S_IFREG)
 #define ssize_t int
 #else
 #include <getopt.h>
@@ -21,10 +27,67 @@
 
 #include "sirfdump.h"
 #include "sirf_msg.h"
+#include "stats.h"
+#include "arrival.h"
+#include "framer.h"
+#include "nmea_batch.h"
+#include "gpstime.h"
+#include "gpsd/crc24q.h"
+#ifdef HAVE_PTHREAD
+#include "srfz.h"
+#endif
+#ifdef HAVE_EPOLL
+#include "tcpsrv.h"
+#include "ntrip.h"
+#endif
+#ifdef HAVE_SENDMMSG
+#include "udpout.h"
+#endif
+#ifdef HAVE_TERMIOS
+#include "serial.h"
+#endif
 
 const char *progname = "sirfdump";
 const char *revision = "$Revision: 0.4 $";
 
+#define DEFAULT_DST_DIR "."
+#define DEFAULT_STATION_NAME "sirf"
+#define DEFAULT_NAV_CACHE "NVM0"
+#define PARTITION_DAILY (24 * 60)
+
+#define STATE_MAGIC 0x53445354 /* SDST */
+#define STATE_VERSION 2
+
+#define CHECKPOINT_MAGIC 0x53444350 /* SDCP */
+#define CHECKPOINT_VERSION 1
+#define DEFAULT_CHECKPOINT_INTERVAL 60
+
+/* --state-out file: header, sink snapshot. Host byte order  */
+struct state_hdr_t {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t output_type;
+   uint32_t size;
+   uint32_t crc;
+};
+
+/* --checkpoint file: header, state file  */
+struct checkpoint_hdr_t {
+   uint32_t magic;
+   uint32_t version;
+   /* consumed input: size, FNV-1a hash  */
+   uint64_t in_offset;
+   uint64_t in_hash;
+   /* --partition number of the open file  */
+   uint64_t part;
+   /* output file sizes, -1: not a file  */
+   int64_t out_size;
+   int64_t nmea_size;
+   int64_t garbage_size;
+   /* CRC-24Q of the header with crc 0  */
+   uint32_t crc;
+};
+
 struct opts_t {
    char *infile;
    char *outfile;
@@ -32,17 +95,42 @@ struct opts_t {
       OUTPUT_DUMP,
       OUTPUT_NMEA,
       OUTPUT_RINEX,
+      OUTPUT_RINEX3,
       OUTPUT_RINEX_NAV,
       OUTPUT_RTCM,
    } output_type;
    unsigned gsw230_byte_order;
-};
-
-struct input_stream_t {
-   int fd;
-   uint8_t buf[1024];
-   unsigned head, tail;
-   int last_errno;
+   /* ephemeris cache file, NULL: no cache  */
+   char *nav_cache;
+   char *obs_types;
+   /* degrees, < 0: off  */
+   double elev_mask;
+   unsigned stats;
+   char *stats_json;
+   unsigned stats_interval;
+   char *listen_addr;
+   char *ntrip_mount;
+   char *udp_addrs;
+   char *device;
+   unsigned baud;
+   unsigned timestamps;
+   unsigned nmea_sentences;
+   char *nmea_passthrough;
+   char *garbage_file;
+   /* archive time window, GPS ms, 0: no limit  */
+   uint64_t from;
+   uint64_t to;
+   unsigned threads;
+   /* partition length, minutes, 0: single output file  */
+   unsigned partition;
+   char *dst_dir;
+   char station_name[5];
+   char *state_in;
+   char *state_out;
+   char *checkpoint;
+   unsigned checkpoint_interval;
+   unsigned resume;
+   unsigned append;
 };
 
 struct ctx_t {
@@ -50,11 +138,39 @@ struct ctx_t {
    struct input_stream_t in;
    FILE *outfh;
    dumpf_t *dump_f;
+   newfilef_t *new_file_f;
+   getstatef_t *get_state_f;
+   setstatef_t *set_state_f;
    void *user_ctx;
+   /* --partition: number of the open partition since GPS epoch  */
+   uint64_t part;
+   /* output before the first partition is known  */
+   FILE *pending_f;
+   /* stats_clock() of the next checkpoint  */
+   uint64_t next_checkpoint;
+   /* --resume: checkpoint, its file at the state part  */
+   struct checkpoint_hdr_t resume;
+   FILE *resume_f;
+#ifdef HAVE_EPOLL
+   struct tcpsrv_t *srv;
+   struct ntrip_caster_t *caster;
+#endif
+#ifdef HAVE_SENDMMSG
+   struct udpout_t *udp;
+   /* MID completing the epoch, datagram is sent after it  */
+   unsigned udp_epoch_mid;
+#endif
+#ifdef HAVE_PTHREAD
+   /* archive input, in.fd is its pipe  */
+   struct srfz_feed_t *feed;
+#endif
 };
 
 
 unsigned output_dump_use_gsw230_byte_order = 0;
+unsigned output_dump_arrival_time = 0;
+unsigned output_nmea_sentences = NMEA_ALL;
+int64_t output_dump_realtime_offset = 0;
 
 
 static void usage(void)
@@ -79,8 +195,43 @@ static void help(void)
    "\nOptions:\n"
    "    -f, --infile                Input file, default: - (stdin)\n"
    "    -F, --outfile               Output file, default: - (stdout)\n"
-   "    -o, --outtype               Output type: dump / nmea / rinex / rinex-nav / rtcm. default: nmea\n"
+   "    -o, --outtype               Output type: dump / nmea / rinex / rinex3 / rinex-nav / rtcm. default: nmea\n"
    "    -2, --gsw230                Use alternate byte order that is used on GSW 2.3.0 - 2.9.9 firmwares\n"
+   "    -S, --sentences             NMEA sentences, default: GGA,RMC,GLL,GSA,VTG,GSV\n"
+   "    -t, --obstypes              RINEX 3 observation types, default: C1C,L1C,D1C,S1C\n"
+   "    -m, --elev-mask             Drop observations of satellites below N degrees elevation, from MID 8 ephemerides (rinex / rinex3)\n"
+   "    -N, --navcache[=FILE]       Load ephemerides from FILE (default: " DEFAULT_NAV_CACHE ") at start, merge and save at exit (rinex-nav / rtcm)\n"
+   "    -s, --stats                 Print per-message statistics and stage timings to stderr at exit\n"
+   "    -J, --stats-json            Write statistics as JSON to file at exit\n"
+   "    -I, --stats-interval        Also report statistics every N seconds while reading\n"
+#ifdef HAVE_EPOLL
+   "    -L, --listen                Serve output to TCP clients on [host:]port instead of outfile\n"
+   "    -M, --ntrip-mount           Act as NTRIP caster with given mountpoint (rtcm, with --listen)\n"
+#endif
+   "    -P, --nmea-passthrough      Write NMEA sentences found between SSB frames to file, - for stdout\n"
+   "    -G, --garbage               Write bytes that are neither SSB nor NMEA to file\n"
+#ifdef HAVE_TERMIOS
+   "    -D, --device                Read from serial port instead of infile\n"
+   "    -B, --baud                  Serial port baud rate, default: 115200\n"
+#endif
+   "    -T, --timestamps            Prefix dump output with frame arrival time, UNIX time\n"
+   "    -p, --partition             Split output into hourly / daily / Nmin files YYYY/DDD/ssssDDDh.ext\n"
+   "    -d, --dst-dir               Destination directory of partitions, default: " DEFAULT_DST_DIR "\n"
+   "    -n, --station               Station name of partitions, default: " DEFAULT_STATION_NAME "\n"
+   "    -i, --state-in              Restore sink state saved by --state-out at start (rinex / rinex3 / rinex-nav / rtcm)\n"
+   "    -O, --state-out             Save sink state to file at exit: GPS week, ephemerides, epoch in progress\n"
+   "    -c, --checkpoint            Write checkpoints to file: input offset, output sizes, sink state\n"
+   "    -k, --checkpoint-interval   Seconds between checkpoints, default: 60\n"
+   "    -R, --resume                Continue from the checkpoint, outputs are cut to its sizes\n"
+   "    -a, --append                Convert only input added since the last run, checkpoint: outfile.ck\n"
+#ifdef HAVE_PTHREAD
+   "    -b, --from                  Archive input: start at GPS time YYYY-MM-DD HH:MM[:SS]\n"
+   "    -e, --to                    Archive input: stop at GPS time YYYY-MM-DD HH:MM[:SS]\n"
+   "    -j, --threads               Archive input: decompressing threads, default: CPU count\n"
+#endif
+#ifdef HAVE_SENDMMSG
+   "    -U, --udp                   Send output to UDP host:port[,host:port...] instead of outfile, one datagram per epoch\n"
+#endif
    "    -h, --help                  Help\n"
    "    -v, --version               Show version\n"
    "\n"
@@ -101,11 +252,55 @@ static struct ctx_t *init_ctx()
    ctx->opts.infile = ctx->opts.outfile = NULL;
    ctx->opts.output_type = OUTPUT_NMEA;
    ctx->opts.gsw230_byte_order = 0;
-   ctx->in.fd = -1;
-   ctx->in.head = ctx->in.tail = 0;
-   ctx->in.last_errno = 0;
+   ctx->opts.nav_cache = NULL;
+   ctx->opts.obs_types = NULL;
+   ctx->opts.elev_mask = -1;
+   ctx->opts.stats = 0;
+   ctx->opts.stats_json = NULL;
+   ctx->opts.stats_interval = 0;
+   ctx->opts.listen_addr = NULL;
+   ctx->opts.ntrip_mount = NULL;
+   ctx->opts.udp_addrs = NULL;
+   ctx->opts.device = NULL;
+   ctx->opts.baud = 0;
+   ctx->opts.timestamps = 0;
+   ctx->opts.nmea_sentences = NMEA_ALL;
+   ctx->opts.nmea_passthrough = NULL;
+   ctx->opts.garbage_file = NULL;
+   ctx->opts.from = ctx->opts.to = 0;
+   ctx->opts.threads = 0;
+   ctx->opts.partition = 0;
+   ctx->opts.dst_dir = NULL;
+   strncpy(ctx->opts.station_name, DEFAULT_STATION_NAME, sizeof(ctx->opts.station_name));
+   ctx->opts.station_name[sizeof(ctx->opts.station_name)-1] = '\0';
+   ctx->opts.state_in = ctx->opts.state_out = NULL;
+   ctx->opts.checkpoint = NULL;
+   ctx->opts.checkpoint_interval = DEFAULT_CHECKPOINT_INTERVAL;
+   ctx->opts.resume = 0;
+   ctx->opts.append = 0;
+   input_stream_init(&ctx->in);
    ctx->outfh = NULL;
+   ctx->new_file_f = NULL;
+   ctx->get_state_f = NULL;
+   ctx->set_state_f = NULL;
    ctx->user_ctx = NULL;
+   ctx->part = 0;
+   ctx->pending_f = NULL;
+   ctx->next_checkpoint = 0;
+   memset(&ctx->resume, 0, sizeof(ctx->resume));
+   ctx->resume.out_size = ctx->resume.nmea_size = ctx->resume.garbage_size = -1;
+   ctx->resume_f = NULL;
+#ifdef HAVE_EPOLL
+   ctx->srv = NULL;
+   ctx->caster = NULL;
+#endif
+#ifdef HAVE_SENDMMSG
+   ctx->udp = NULL;
+   ctx->udp_epoch_mid = SIRF_GET_MID(SIRF_MSG_SSB_CLOCK_STATUS);
+#endif
+#ifdef HAVE_PTHREAD
+   ctx->feed = NULL;
+#endif
 
    return ctx;
 }
@@ -116,10 +311,44 @@ static void free_ctx(struct ctx_t *ctx)
       return;
    free(ctx->opts.infile);
    free(ctx->opts.outfile);
+   free(ctx->opts.obs_types);
+   free(ctx->opts.nav_cache);
+   free(ctx->opts.stats_json);
+   free(ctx->opts.listen_addr);
+   free(ctx->opts.ntrip_mount);
+   free(ctx->opts.udp_addrs);
+   free(ctx->opts.device);
+   free(ctx->opts.nmea_passthrough);
+   free(ctx->opts.garbage_file);
+   free(ctx->opts.dst_dir);
+   free(ctx->opts.state_in);
+   free(ctx->opts.state_out);
+   free(ctx->opts.checkpoint);
+   if (ctx->resume_f)
+      fclose(ctx->resume_f);
+#ifdef HAVE_PTHREAD
+   if (ctx->feed) {
+      free_srfz_feed(ctx->feed);
+      ctx->in.fd = -1;
+   }
+#endif
    if (ctx->in.fd > 0 && (ctx->in.fd != STDIN_FILENO))
       close(ctx->in.fd);
    if (ctx->outfh && (ctx->outfh != stdout))
       fclose(ctx->outfh);
+   if (ctx->pending_f && (ctx->pending_f != ctx->outfh))
+      fclose(ctx->pending_f);
+   if (ctx->in.nmea_f && (ctx->in.nmea_f != stdout))
+      fclose(ctx->in.nmea_f);
+   if (ctx->in.garbage_f && (ctx->in.garbage_f != stdout))
+      fclose(ctx->in.garbage_f);
+#ifdef HAVE_EPOLL
+   free_ntrip_caster(ctx->caster);
+   free_tcpsrv(ctx->srv);
+#endif
+#ifdef HAVE_SENDMMSG
+   free_udpout(ctx->udp);
+#endif
    free(ctx);
 }
 
@@ -143,114 +372,626 @@ static int set_file(char **dst, const char *optarg)
    return 0;
 }
 
-static int read_data(struct input_stream_t *stream)
+#ifdef HAVE_PTHREAD
+/* "YYYY-MM-DD HH:MM[:SS]", GPS time scale, to ms since GPS epoch  */
+static int parse_gps_time(const char *str, uint64_t *res)
 {
-   ssize_t l;
-   assert(
-      !(stream->tail == sizeof(stream->buf)
-	 && (stream->head == sizeof(stream->buf)))
-      );
+   struct gps_tm tm;
+   unsigned week;
+   double tow;
+
+   memset(&tm, 0, sizeof(tm));
+   if (sscanf(str, "%u-%u-%u%*[ T]%u:%u:%lf", &tm.year, &tm.month, &tm.day,
+	    &tm.hour, &tm.min, &tm.sec) < 5
+	 || (tm2gpstime(&tm, &week, &tow) < 0)) {
+      fprintf(stderr, "Wrong time: %s\n", str);
+      return -1;
+   }
+   *res = (uint64_t)week * 604800000 + (uint64_t)(tow * 1000.0 + 0.5);
+
+   return 0;
+}
+#endif
+
+/* "hourly", "daily" or "Nmin", N divides a day. Minutes  */
+static int parse_partition(const char *str, unsigned *res)
+{
+   unsigned n;
+   int len;
+   char unit[4];
+
+   if (strcmp(str, "hourly") == 0) {
+      *res = 60;
+      return 0;
+   }
+   if (strcmp(str, "daily") == 0) {
+      *res = PARTITION_DAILY;
+      return 0;
+   }
+   /* nothing after the unit: "15minutes" is wrong  */
+   len = 0;
+   if (sscanf(str, "%u%3s%n", &n, unit, &len) == 2
+	 && (str[len] == '\0')
+	 && (strcmp(unit, "min") == 0)
+	 && (n > 0)
+	 && (PARTITION_DAILY % n == 0)) {
+      *res = n;
+      return 0;
+   }
+
+   fprintf(stderr, "Wrong partition: %s\n", str);
+   return -1;
+}
+
+static const char *partition_ext(const struct ctx_t *ctx, unsigned year,
+      char *buf, size_t size)
+{
+   switch (ctx->opts.output_type) {
+      case OUTPUT_RINEX:
+      case OUTPUT_RINEX3:
+	 snprintf(buf, size, "%02uo", year % 100);
+	 break;
+      case OUTPUT_RINEX_NAV:
+	 snprintf(buf, size, "%02un", year % 100);
+	 break;
+      case OUTPUT_RTCM:
+	 return "rtcm";
+      case OUTPUT_DUMP:
+	 return "txt";
+      case OUTPUT_NMEA:
+      default:
+	 return "nmea";
+   }
+   return buf;
+}
+
+/* New file, or existing one cut to size (--resume) if size >= 0  */
+static FILE *open_output(const char *fname, int64_t size)
+{
+   FILE *f;
+
+   if (size < 0) {
+      f = fopen(fname,
+#ifdef WIN32
+	"wb"
+#else
+	"w"
+#endif
+	);
+      if (f == NULL)
+	 perror(fname);
+      return f;
+   }
 
-   if (stream->tail == sizeof(stream->buf)) {
-      memmove(stream->buf, &stream->buf[stream->head],
-	    stream->tail - stream->head);
-      stream->tail = stream->tail - stream->head;
-      stream->head=0;
+   f = fopen(fname, "r+b");
+   if (f == NULL) {
+      perror(fname);
+      return NULL;
+   }
+   if (ftruncate(fileno(f), (off_t)size) < 0
+	 || (fseek(f, 0, SEEK_END) < 0)) {
+      perror(fname);
+      fclose(f);
+      return NULL;
    }
 
-   l = read(stream->fd, &stream->buf[stream->tail], sizeof(stream->buf) - stream->tail);
-   if (l<0)
-      stream->last_errno = errno;
+   return f;
+}
+
+/*
+ * Partition file dst_dir/YYYY/DDD/ssssDDDh.ext, sirfsplitter layout.
+ * h: hour 'a'-'x', '0' for daily files, followed by minutes for
+ * partitions shorter than an hour
+ */
+static FILE *open_partition(struct ctx_t *ctx, uint64_t part, int64_t size)
+{
+   int pos;
+   FILE *f;
+   struct gps_tm tm;
+   uint64_t ms;
+   char ext[4];
+   char fname[1024];
+
+   ms = part * ctx->opts.partition * 60000;
+   gpstime2tm0((unsigned)(ms / 604800000), (ms % 604800000) / 1000.0, &tm);
+
+   pos = snprintf(fname, sizeof(fname), "%s/%04u",
+	 ctx->opts.dst_dir ? ctx->opts.dst_dir : DEFAULT_DST_DIR, tm.year);
+   if ((mkdir(fname, 0777) < 0) && (errno != EEXIST)) {
+      perror(fname);
+      return NULL;
+   }
+   pos += snprintf(&fname[pos], sizeof(fname) - pos, "/%03u", tm.yday);
+   if ((mkdir(fname, 0777) < 0) && (errno != EEXIST)) {
+      perror(fname);
+      return NULL;
+   }
+   pos += snprintf(&fname[pos], sizeof(fname) - pos, "/%.4s%03u",
+	 ctx->opts.station_name, tm.yday);
+   if (ctx->opts.partition == PARTITION_DAILY)
+      pos += snprintf(&fname[pos], sizeof(fname) - pos, "0");
+   else if (ctx->opts.partition % 60 == 0)
+      pos += snprintf(&fname[pos], sizeof(fname) - pos, "%c", 'a' + tm.hour);
    else
-      stream->tail = stream->tail+l;
+      pos += snprintf(&fname[pos], sizeof(fname) - pos, "%c%02u",
+	    'a' + tm.hour, tm.min);
+   snprintf(&fname[pos], sizeof(fname) - pos, ".%s",
+	 partition_ext(ctx, tm.year, ext, sizeof(ext)));
+
+   f = open_output(fname, size);
+   if (f == NULL)
+      return NULL;
 
-   return l;
+   fprintf(stderr, "%s\n", fname);
+
+   return f;
 }
 
-void *readpkt(struct input_stream_t *stream, struct transport_msg_t *res_msg)
+/*
+ * --partition: switch output to the next file when MID 7 time crosses a
+ * partition boundary. The switch is done before the frame is handled, so
+ * the boundary epoch opens the new file. Sink state (nav data, epoch in
+ * progress) is kept. Partitions only move forward in time.
+ */
+static int check_partition(struct ctx_t *ctx, const struct transport_msg_t *msg)
 {
-   unsigned start_seq_found;
-   unsigned payload_length;
-   unsigned checksum;
-   unsigned garbage_bytes;
-   unsigned p0;
+   const uint8_t *p;
+   unsigned week;
+   uint32_t tow;
+   uint64_t part;
+   FILE *f;
    size_t l;
-   uint8_t *res;
+   char buf[4096];
 
-   garbage_bytes = 0;
-   start_seq_found=0;
-   payload_length=0;
+   p = msg->payload;
+   if (msg->payload_length < 7
+	 || (p[0] != SIRF_GET_MID(SIRF_MSG_SSB_CLOCK_STATUS)))
+      return 0;
 
-   for (;;) {
-      while (stream->tail - stream->head < 8) {
-	 l = read_data(stream);
-	 if (l <= 0)
-	    return NULL;
-      }
+   week = ((unsigned)p[1] << 8) | p[2];
+   tow = ((uint32_t)p[3] << 24) | ((uint32_t)p[4] << 16)
+      | ((uint32_t)p[5] << 8) | p[6];
+   /* no time yet  */
+   if (week == 0)
+      return 0;
 
-      /* search for start sequence  */
-      while (stream->head < stream->tail-1) {
-	 if ((stream->buf[stream->head] == 0xa0)
-	       && (stream->buf[stream->head+1] == 0xa2)) {
-	    start_seq_found=1;
+   part = ((uint64_t)week * 604800000 + (uint64_t)tow * 10)
+      / ((uint64_t)ctx->opts.partition * 60000);
+   if (ctx->pending_f == NULL && (part <= ctx->part))
+      return 0;
+
+   f = open_partition(ctx, part, -1);
+   if (f == NULL)
+      return -1;
+
+   if (ctx->pending_f) {
+      /* first file starts with the output written so far  */
+      rewind(ctx->pending_f);
+      while ((l = fread(buf, 1, sizeof(buf), ctx->pending_f)) > 0) {
+	 if (fwrite(buf, 1, l, f) < l)
 	    break;
-	 }else {
-	    garbage_bytes++;
-	    stream->head++;
-	 }
       }
-      if (!start_seq_found)
-	 continue;
+      fclose(ctx->pending_f);
+      ctx->pending_f = NULL;
+   }else {
+      if (ctx->new_file_f)
+	 ctx->new_file_f(f, ctx->user_ctx);
+      fclose(ctx->outfh);
+   }
+
+   ctx->outfh = f;
+   ctx->part = part;
+
+   return 1;
+}
+
+/* rinex and rinex3 sinks share the snapshot  */
+static unsigned state_output_type(const struct ctx_t *ctx)
+{
+   if (ctx->opts.output_type == OUTPUT_RINEX3)
+      return OUTPUT_RINEX;
+   return ctx->opts.output_type;
+}
+
+/* State file part at the current position of f  */
+static int read_state(struct ctx_t *ctx, FILE *f, const char *fname,
+      unsigned new_file)
+{
+   int res;
+   struct state_hdr_t hdr;
+   void *buf;
+
+   if (fread(&hdr, sizeof(hdr), 1, f) != 1
+	 || (hdr.magic != STATE_MAGIC)
+	 || (hdr.version != STATE_VERSION)) {
+      fprintf(stderr, "%s: not a sirfdump state file\n", fname);
+      return -1;
+   }
+   if (hdr.output_type != state_output_type(ctx)) {
+      fprintf(stderr, "%s: state of other output type\n", fname);
+      return -1;
+   }
+   /* nmea, dump: no sink state  */
+   if (ctx->set_state_f == NULL)
+      return hdr.size == 0 ? 0 : -1;
+
+   buf = malloc(hdr.size ? hdr.size : 1);
+   if (buf == NULL) {
+      perror(NULL);
+      return -1;
+   }
+   if (fread(buf, 1, hdr.size, f) != hdr.size
+	 || (crc24q_hash(buf, hdr.size) != hdr.crc)) {
+      fprintf(stderr, "%s: checksum error\n", fname);
+      free(buf);
+      return -1;
+   }
+
+   res = ctx->set_state_f(ctx->user_ctx, buf, hdr.size, new_file);
+   if (res < 0)
+      fprintf(stderr, "%s: wrong state\n", fname);
+   free(buf);
+
+   return res;
+}
+
+static int load_state(struct ctx_t *ctx, const char *fname)
+{
+   FILE *f;
+   int res;
+
+   f = fopen(fname, "rb");
+   if (f == NULL) {
+      perror(fname);
+      return -1;
+   }
+   res = read_state(ctx, f, fname, 1);
+   fclose(f);
+
+   return res;
+}
+
+/* Sink snapshot with its header, malloc()ed  */
+static void *make_state(struct ctx_t *ctx, struct state_hdr_t *hdr)
+{
+   size_t size;
+   void *buf;
+
+   size = ctx->get_state_f ? ctx->get_state_f(ctx->user_ctx, NULL, 0) : 0;
+   buf = malloc(size ? size : 1);
+   if (buf == NULL) {
+      perror(NULL);
+      return NULL;
+   }
+   if (size)
+      ctx->get_state_f(ctx->user_ctx, buf, size);
+
+   hdr->magic = STATE_MAGIC;
+   hdr->version = STATE_VERSION;
+   hdr->output_type = state_output_type(ctx);
+   hdr->size = size;
+   hdr->crc = crc24q_hash(buf, size);
+
+   return buf;
+}
+
+/* Written to fname.tmp and renamed, old file is kept on error  */
+static int write_file(const char *fname, const struct crc24_iovec *iov,
+      int iovcnt)
+{
+   FILE *f;
+   int i, res;
+   char tmp_fname[1024];
 
-      while (stream->tail - stream->head < 6) {
-	 l = read_data(stream);
-	 if (l <= 0)
-	    return NULL;
+   snprintf(tmp_fname, sizeof(tmp_fname), "%s.tmp", fname);
+   f = fopen(tmp_fname, "wb");
+   if (f == NULL) {
+      perror(tmp_fname);
+      return -1;
+   }
+
+   res = 0;
+   for (i=0; i < iovcnt; i++) {
+      if (fwrite(iov[i].iov_base, 1, iov[i].iov_len, f) != iov[i].iov_len) {
+	 perror(tmp_fname);
+	 res = -1;
+	 break;
       }
+   }
+   if (fclose(f) != 0) {
+      perror(tmp_fname);
+      res = -1;
+   }
 
-      /* get payload length  */
-      payload_length = (0xff00 & (stream->buf[stream->head+2] << 8))
-	 | (0xff & stream->buf[stream->head+3]);
-      if (payload_length >= 1023) {
-	 stream->head++;
-	 continue;
+   if (res == 0 && (rename(tmp_fname, fname) < 0)) {
+      perror(fname);
+      res = -1;
+   }
+   if (res < 0)
+      remove(tmp_fname);
+
+   return res;
+}
+
+static int save_state(struct ctx_t *ctx, const char *fname)
+{
+   int res;
+   struct state_hdr_t hdr;
+   struct crc24_iovec iov[2];
+
+   iov[1].iov_base = make_state(ctx, &hdr);
+   if (iov[1].iov_base == NULL)
+      return -1;
+   iov[1].iov_len = hdr.size;
+   iov[0].iov_base = &hdr;
+   iov[0].iov_len = sizeof(hdr);
+
+   res = write_file(fname, iov, 2);
+   free(iov[1].iov_base);
+
+   return res;
+}
+
+/* Size of output file, -1 for stdout, sockets and pipes  */
+static int64_t output_size(FILE *f)
+{
+   struct stat st;
+
+   if (f == NULL || (f == stdout))
+      return -1;
+   fflush(f);
+   if (fileno(f) < 0
+	 || (fstat(fileno(f), &st) < 0)
+	 || !S_ISREG(st.st_mode))
+      return -1;
+
+   return (int64_t)ftello(f);
+}
+
+/*
+ * Checkpoint: consumed input, output sizes and sink state, taken after
+ * the frame completing an epoch. Not taken before the first partition
+ * is opened.
+ */
+static int write_checkpoint(struct ctx_t *ctx)
+{
+   int res;
+   struct checkpoint_hdr_t hdr;
+   struct state_hdr_t state_hdr;
+   struct crc24_iovec iov[3];
+
+   if (ctx->pending_f)
+      return 0;
+
+   input_hash_update(&ctx->in);
+
+   memset(&hdr, 0, sizeof(hdr));
+   hdr.magic = CHECKPOINT_MAGIC;
+   hdr.version = CHECKPOINT_VERSION;
+   hdr.in_offset = input_offset(&ctx->in);
+   hdr.in_hash = ctx->in.hash;
+   hdr.part = ctx->opts.partition ? ctx->part : 0;
+   hdr.out_size = output_size(ctx->outfh);
+   hdr.nmea_size = output_size(ctx->in.nmea_f);
+   hdr.garbage_size = output_size(ctx->in.garbage_f);
+   hdr.crc = crc24q_hash((unsigned char *)&hdr, sizeof(hdr));
+
+   iov[2].iov_base = make_state(ctx, &state_hdr);
+   if (iov[2].iov_base == NULL)
+      return -1;
+   iov[2].iov_len = state_hdr.size;
+   iov[1].iov_base = &state_hdr;
+   iov[1].iov_len = sizeof(state_hdr);
+   iov[0].iov_base = &hdr;
+   iov[0].iov_len = sizeof(hdr);
+
+   res = write_file(ctx->opts.checkpoint, iov, 3);
+   free(iov[2].iov_base);
+
+   return res;
+}
+
+/* Periodic checkpoint after MID 7  */
+static void check_checkpoint(struct ctx_t *ctx, const struct transport_msg_t *msg)
+{
+   uint64_t now;
+
+   if (msg->payload_length < 1
+	 || (msg->payload[0] != SIRF_GET_MID(SIRF_MSG_SSB_CLOCK_STATUS)))
+      return;
+
+   now = stats_clock();
+   if (now < ctx->next_checkpoint)
+      return;
+
+   write_checkpoint(ctx);
+   ctx->next_checkpoint = now
+      + (uint64_t)ctx->opts.checkpoint_interval * 1000000000;
+}
+
+/* Checkpoint header, file is left at the state part  */
+static FILE *read_checkpoint(const char *fname, struct checkpoint_hdr_t *hdr)
+{
+   FILE *f;
+   unsigned crc;
+
+   f = fopen(fname, "rb");
+   if (f == NULL) {
+      perror(fname);
+      return NULL;
+   }
+
+   if (fread(hdr, sizeof(*hdr), 1, f) == 1) {
+      crc = hdr->crc;
+      hdr->crc = 0;
+      if (hdr->magic == CHECKPOINT_MAGIC
+	    && (hdr->version == CHECKPOINT_VERSION)
+	    && (crc24q_hash((unsigned char *)hdr, sizeof(*hdr)) == crc)) {
+	 hdr->crc = crc;
+	 return f;
       }
+   }
+
+   fprintf(stderr, "%s: not a sirfdump checkpoint\n", fname);
+   fclose(f);
+   return NULL;
+}
+
+/* --append: checkpoint does not fit, outputs are written from the start  */
+static void append_restart(struct ctx_t *ctx, const char *reason)
+{
+   fprintf(stderr, "%s: %s, converting from the start\n",
+	 ctx->opts.checkpoint, reason);
+   if (ctx->resume_f) {
+      fclose(ctx->resume_f);
+      ctx->resume_f = NULL;
+   }
+   memset(&ctx->resume, 0, sizeof(ctx->resume));
+   ctx->resume.out_size = ctx->resume.nmea_size = ctx->resume.garbage_size = -1;
+   ctx->opts.resume = 0;
+}
+
+/*
+ * --append: resume from the checkpoint (outfile.ck by default) when it
+ * exists and the output still holds the checkpointed part, start a new
+ * output otherwise
+ */
+static int init_append(struct ctx_t *ctx)
+{
+   struct stat st;
+   size_t len;
 
-      /* load payload data */
-      p0 = 2+2+payload_length;
-      while (stream->tail - stream->head < p0+2+2) {
-	 l = read_data(stream);
-	 if (l <= 0)
-	    return NULL;
+   if (ctx->opts.checkpoint == NULL) {
+      len = strlen(ctx->opts.outfile);
+      ctx->opts.checkpoint = malloc(len + sizeof(".ck"));
+      if (ctx->opts.checkpoint == NULL) {
+	 perror(NULL);
+	 return -1;
       }
+      memcpy(ctx->opts.checkpoint, ctx->opts.outfile, len);
+      memcpy(ctx->opts.checkpoint + len, ".ck", sizeof(".ck"));
+   }
+
+   /* first run  */
+   if (stat(ctx->opts.checkpoint, &st) < 0 && (errno == ENOENT))
+      return 0;
+
+   ctx->resume_f = read_checkpoint(ctx->opts.checkpoint, &ctx->resume);
+   if (ctx->resume_f == NULL) {
+      append_restart(ctx, "unusable checkpoint");
+      return 0;
+   }
+   ctx->opts.resume = 1;
 
-      /* checksum  */
-      checksum = (0xff00 & (stream->buf[stream->head+p0] << 8))
-	 | (0xff & stream->buf[stream->head+p0+1]);
+   /* output removed or cut: new file with its own header  */
+   if (ctx->opts.outfile != NULL && !ctx->opts.partition
+	 && (ctx->resume.out_size >= 0)
+	 && (stat(ctx->opts.outfile, &st) < 0
+	    || ((int64_t)st.st_size < ctx->resume.out_size))) {
+      append_restart(ctx, "output is new");
+      return 0;
+   }
 
-      /* end sequence  */
-      if (stream->buf[stream->head+p0+2] != 0xb0
-	    || (stream->buf[stream->head+p0+3] != 0xb3)) {
-	 stream->head++;
+   return 0;
+}
+
+/* Input must start with the checkpointed prefix, fd is left after it  */
+static int resume_input(struct input_stream_t *stream,
+      const struct checkpoint_hdr_t *hdr)
+{
+   uint64_t pos, hash;
+   ssize_t l;
+   size_t n;
+
+   hash = FNV1A_INIT;
+   for (pos = 0; pos < hdr->in_offset; pos += l) {
+      n = sizeof(stream->buf);
+      if (hdr->in_offset - pos < n)
+	 n = hdr->in_offset - pos;
+      l = read(stream->fd, stream->buf, n);
+      if (l < 0 && (errno == EINTR)) {
+	 l = 0;
 	 continue;
       }
-      break;
-   } /* for(;;)  */
+      if (l <= 0)
+	 break;
+      hash = fnv1a(hash, stream->buf, l);
+   }
 
-   res = &stream->buf[stream->head];
-   stream->head = stream->head + 2+2+payload_length+2+2;
-   if (stream->head == stream->tail) {
-      stream->head = stream->tail = 0;
+   if (pos != hdr->in_offset || (hash != hdr->in_hash)) {
+      fputs("Input does not match the checkpoint\n", stderr);
+      return -1;
    }
 
-   if (res_msg) {
-      res_msg->payload = &res[4];
-      res_msg->payload_length = payload_length;
-      res_msg->checksum = checksum;
-      res_msg->skipped_bytes = garbage_bytes;
+   stream->base = hdr->in_offset;
+   stream->hash = hash;
+
+   return 0;
+}
+
+static FILE *open_side_file(const char *fname, int64_t size)
+{
+   if (fname[0] == '-' && (fname[1] == '\0'))
+      return stdout;
+
+   return open_output(fname, size);
+}
+
+static void report_stats(struct ctx_t *ctx)
+{
+   if (ctx->opts.stats)
+      stats_print(stderr, stats_ctx);
+   if (ctx->opts.stats_json)
+      stats_write_json(ctx->opts.stats_json, stats_ctx);
+}
+
+static int process_with_stats(struct ctx_t *ctx)
+{
+   uint8_t *pkt;
+   struct transport_msg_t msg;
+   uint64_t t0, t1, interval, next_report;
+
+   interval = (uint64_t)ctx->opts.stats_interval * 1000000000;
+   next_report = stats_clock() + interval;
+
+   for (;;) {
+      stats_ctx->io_ns = 0;
+      t0 = stats_clock();
+      pkt = readpkt(&ctx->in, &msg);
+      t1 = stats_clock();
+      if (pkt == NULL)
+	 break;
+      stats_frame(stats_ctx, &msg, t1 - t0 - stats_ctx->io_ns);
+
+      if (ctx->opts.partition && (check_partition(ctx, &msg) < 0))
+	 return -1;
+      ctx->dump_f(&msg, ctx->outfh, ctx->user_ctx);
+      if (ctx->opts.checkpoint)
+	 check_checkpoint(ctx, &msg);
+      t0 = stats_clock();
+      stats_sink_done(stats_ctx, t0 - t1);
+#ifdef HAVE_EPOLL
+      if (ctx->srv && tcpsrv_flush(ctx->srv)) {
+	 t0 = stats_clock();
+	 stats_send_done(stats_ctx, t0 - msg.last_byte_ns);
+      }
+#endif
+#ifdef HAVE_SENDMMSG
+      if (ctx->udp && msg.payload_length
+	    && (msg.payload[0] == ctx->udp_epoch_mid)
+	    && udpout_flush(ctx->udp)) {
+	 t0 = stats_clock();
+	 stats_send_done(stats_ctx, t0 - msg.last_byte_ns);
+      }
+#endif
+
+      if (interval && (t0 >= next_report)) {
+	 report_stats(ctx);
+	 next_report = t0 + interval;
+      }
    }
 
-   return res;
+   return ctx->in.last_errno;
 }
 
 int process(struct ctx_t *ctx)
@@ -258,8 +999,24 @@ int process(struct ctx_t *ctx)
    uint8_t *pkt;
    struct transport_msg_t msg;
 
+   if (stats_ctx)
+      return process_with_stats(ctx);
+
    while ( (pkt = readpkt(&ctx->in, &msg)) != NULL ) {
+      if (ctx->opts.partition && (check_partition(ctx, &msg) < 0))
+	 return -1;
       ctx->dump_f(&msg, ctx->outfh, ctx->user_ctx);
+      if (ctx->opts.checkpoint)
+	 check_checkpoint(ctx, &msg);
+#ifdef HAVE_EPOLL
+      if (ctx->srv)
+	 tcpsrv_flush(ctx->srv);
+#endif
+#ifdef HAVE_SENDMMSG
+      if (ctx->udp && msg.payload_length
+	    && (msg.payload[0] == ctx->udp_epoch_mid))
+	 udpout_flush(ctx->udp);
+#endif
    }
 
    return ctx->in.last_errno;
@@ -268,6 +1025,7 @@ int process(struct ctx_t *ctx)
 int main(int argc, char *argv[])
 {
    signed char c;
+   int res;
    struct ctx_t *ctx;
 
    static struct option longopts[] = {
@@ -277,6 +1035,41 @@ int main(int argc, char *argv[])
       {"outfile",     required_argument, 0, 'F'},
       {"outtype",     required_argument, 0, 'o'},
       {"gsw230",      no_argument,       0, '2'},
+      {"sentences",   required_argument, 0, 'S'},
+      {"nmea-passthrough", required_argument, 0, 'P'},
+      {"garbage",     required_argument, 0, 'G'},
+      {"obstypes",    required_argument, 0, 't'},
+      {"elev-mask",   required_argument, 0, 'm'},
+      {"navcache",    optional_argument, 0, 'N'},
+      {"stats",       no_argument,       0, 's'},
+      {"stats-json",  required_argument, 0, 'J'},
+      {"stats-interval", required_argument, 0, 'I'},
+#ifdef HAVE_EPOLL
+      {"listen",      required_argument, 0, 'L'},
+      {"ntrip-mount", required_argument, 0, 'M'},
+#endif
+#ifdef HAVE_TERMIOS
+      {"device",      required_argument, 0, 'D'},
+      {"baud",        required_argument, 0, 'B'},
+#endif
+      {"timestamps",  no_argument,       0, 'T'},
+      {"partition",   required_argument, 0, 'p'},
+      {"dst-dir",     required_argument, 0, 'd'},
+      {"station",     required_argument, 0, 'n'},
+      {"state-in",    required_argument, 0, 'i'},
+      {"state-out",   required_argument, 0, 'O'},
+      {"checkpoint",  required_argument, 0, 'c'},
+      {"checkpoint-interval", required_argument, 0, 'k'},
+      {"resume",      no_argument,       0, 'R'},
+      {"append",      no_argument,       0, 'a'},
+#ifdef HAVE_PTHREAD
+      {"from",        required_argument, 0, 'b'},
+      {"to",          required_argument, 0, 'e'},
+      {"threads",     required_argument, 0, 'j'},
+#endif
+#ifdef HAVE_SENDMMSG
+      {"udp",         required_argument, 0, 'U'},
+#endif
       {0, 0, 0, 0}
    };
 
@@ -292,7 +1085,7 @@ int main(int argc, char *argv[])
 #endif
 #endif
 
-   while ((c = getopt_long(argc, argv, "vh?f:F:o:2",longopts,NULL)) != -1) {
+   while ((c = getopt_long(argc, argv, "vh?f:F:o:2S:P:G:t:m:N::sJ:I:L:M:U:D:B:Tp:d:n:i:O:c:k:Rab:e:j:",longopts,NULL)) != -1) {
       switch (c) {
 	 case 'f':
 	    if (set_file(&ctx->opts.infile, optarg) != 0) {
@@ -313,6 +1106,8 @@ int main(int argc, char *argv[])
 	       ctx->opts.output_type = OUTPUT_DUMP;
 	    }else if (strcmp(optarg, "rinex") == 0) {
 	       ctx->opts.output_type = OUTPUT_RINEX;
+	    }else if (strcmp(optarg, "rinex3") == 0) {
+	       ctx->opts.output_type = OUTPUT_RINEX3;
 	    }else if (strcmp(optarg, "rinex-nav") == 0) {
 	       ctx->opts.output_type = OUTPUT_RINEX_NAV;
 	    }else if (strcmp(optarg, "rtcm") == 0) {
@@ -325,6 +1120,168 @@ int main(int argc, char *argv[])
 	 case '2':
 	    ctx->opts.gsw230_byte_order = 1;
 	    break;
+	 case 'P':
+	    free(ctx->opts.nmea_passthrough);
+	    ctx->opts.nmea_passthrough = strdup(optarg);
+	    break;
+	 case 'G':
+	    free(ctx->opts.garbage_file);
+	    ctx->opts.garbage_file = strdup(optarg);
+	    break;
+	 case 'S':
+	    if (nmea_batch_parse_mask(optarg, &ctx->opts.nmea_sentences) != 0) {
+	       fputs("Wrong NMEA sentence list\n", stderr);
+	       free_ctx(ctx);
+	       return 1;
+	    }
+	    break;
+	 case 'm':
+	    ctx->opts.elev_mask = strtod(optarg, NULL);
+	    if ((ctx->opts.elev_mask < 0) || (ctx->opts.elev_mask > 90)) {
+	       fputs("Wrong elevation mask\n", stderr);
+	       free_ctx(ctx);
+	       return 1;
+	    }
+	    break;
+	 case 'N':
+	    if (set_file(&ctx->opts.nav_cache,
+		     optarg ? optarg : DEFAULT_NAV_CACHE) != 0) {
+	       free_ctx(ctx);
+	       return 1;
+	    }
+	    break;
+	 case 's':
+	    ctx->opts.stats = 1;
+	    break;
+	 case 'J':
+	    free(ctx->opts.stats_json);
+	    ctx->opts.stats_json = strdup(optarg);
+	    if (ctx->opts.stats_json == NULL) {
+	       perror(NULL);
+	       free_ctx(ctx);
+	       return 1;
+	    }
+	    break;
+	 case 'I':
+	    ctx->opts.stats_interval = (unsigned)strtoul(optarg, NULL, 10);
+	    break;
+#ifdef HAVE_EPOLL
+	 case 'L':
+	    free(ctx->opts.listen_addr);
+	    ctx->opts.listen_addr = strdup(optarg);
+	    if (ctx->opts.listen_addr == NULL) {
+	       perror(NULL);
+	       free_ctx(ctx);
+	       return 1;
+	    }
+	    break;
+	 case 'M':
+	    free(ctx->opts.ntrip_mount);
+	    ctx->opts.ntrip_mount = strdup(optarg);
+	    if (ctx->opts.ntrip_mount == NULL) {
+	       perror(NULL);
+	       free_ctx(ctx);
+	       return 1;
+	    }
+	    break;
+#endif
+#ifdef HAVE_TERMIOS
+	 case 'D':
+	    free(ctx->opts.device);
+	    ctx->opts.device = strdup(optarg);
+	    if (ctx->opts.device == NULL) {
+	       perror(NULL);
+	       free_ctx(ctx);
+	       return 1;
+	    }
+	    break;
+	 case 'B':
+	    ctx->opts.baud = (unsigned)strtoul(optarg, NULL, 10);
+	    break;
+#endif
+	 case 'T':
+	    ctx->opts.timestamps = 1;
+	    break;
+	 case 'p':
+	    if (parse_partition(optarg, &ctx->opts.partition) < 0) {
+	       free_ctx(ctx);
+	       return 1;
+	    }
+	    break;
+	 case 'd':
+	    if (set_file(&ctx->opts.dst_dir, optarg) != 0) {
+	       free_ctx(ctx);
+	       return 1;
+	    }
+	    break;
+	 case 'n':
+	    strncpy(ctx->opts.station_name, optarg, sizeof(ctx->opts.station_name));
+	    ctx->opts.station_name[sizeof(ctx->opts.station_name)-1]='\0';
+	    break;
+	 case 'i':
+	    if (set_file(&ctx->opts.state_in, optarg) != 0) {
+	       free_ctx(ctx);
+	       return 1;
+	    }
+	    break;
+	 case 'O':
+	    if (set_file(&ctx->opts.state_out, optarg) != 0) {
+	       free_ctx(ctx);
+	       return 1;
+	    }
+	    break;
+	 case 'c':
+	    if (set_file(&ctx->opts.checkpoint, optarg) != 0) {
+	       free_ctx(ctx);
+	       return 1;
+	    }
+	    break;
+	 case 'k':
+	    ctx->opts.checkpoint_interval = (unsigned)strtoul(optarg, NULL, 10);
+	    break;
+	 case 'R':
+	    ctx->opts.resume = 1;
+	    break;
+	 case 'a':
+	    ctx->opts.append = 1;
+	    break;
+#ifdef HAVE_PTHREAD
+	 case 'b':
+	    if (parse_gps_time(optarg, &ctx->opts.from) < 0) {
+	       free_ctx(ctx);
+	       return 1;
+	    }
+	    break;
+	 case 'e':
+	    if (parse_gps_time(optarg, &ctx->opts.to) < 0) {
+	       free_ctx(ctx);
+	       return 1;
+	    }
+	    break;
+	 case 'j':
+	    ctx->opts.threads = (unsigned)strtoul(optarg, NULL, 10);
+	    break;
+#endif
+#ifdef HAVE_SENDMMSG
+	 case 'U':
+	    free(ctx->opts.udp_addrs);
+	    ctx->opts.udp_addrs = strdup(optarg);
+	    if (ctx->opts.udp_addrs == NULL) {
+	       perror(NULL);
+	       free_ctx(ctx);
+	       return 1;
+	    }
+	    break;
+#endif
+	 case 't':
+	    free(ctx->opts.obs_types);
+	    ctx->opts.obs_types = strdup(optarg);
+	    if (ctx->opts.obs_types == NULL) {
+	       perror(NULL);
+	       free_ctx(ctx);
+	       return 1;
+	    }
+	    break;
 	 case 'v':
 	    version();
 	    free_ctx(ctx);
@@ -340,7 +1297,55 @@ int main(int argc, char *argv[])
    argc -= optind;
    argv += optind;
 
+   /* incremental conversion: checkpoint of the last run, if usable  */
+   if (ctx->opts.append) {
+      if (ctx->opts.resume
+	    || (ctx->opts.infile == NULL)
+	    || (ctx->opts.device != NULL)
+	    || (ctx->opts.state_in != NULL)
+	    || (ctx->opts.checkpoint == NULL && (ctx->opts.outfile == NULL))) {
+	 fputs("--append requires --infile and --outfile or --checkpoint, can not be used with --resume or --state-in\n", stderr);
+	 free_ctx(ctx);
+	 return 1;
+      }
+      if (init_append(ctx) < 0) {
+	 free_ctx(ctx);
+	 return 1;
+      }
+   }else
+   /* checkpoint to continue from  */
+   if (ctx->opts.resume) {
+      if (ctx->opts.checkpoint == NULL
+	    || (ctx->opts.infile == NULL)
+	    || (ctx->opts.device != NULL)
+	    || (ctx->opts.state_in != NULL)) {
+	 fputs("--resume requires --checkpoint and --infile, can not be used with --state-in\n", stderr);
+	 free_ctx(ctx);
+	 return 1;
+      }
+      ctx->resume_f = read_checkpoint(ctx->opts.checkpoint, &ctx->resume);
+      if (ctx->resume_f == NULL) {
+	 free_ctx(ctx);
+	 return 1;
+      }
+   }
+
    /* infile  */
+#ifdef HAVE_TERMIOS
+   if (ctx->opts.device != NULL) {
+      if (ctx->opts.infile != NULL) {
+	 fputs("--device and --infile can not be used together\n", stderr);
+	 free_ctx(ctx);
+	 return 1;
+      }
+      ctx->in.fd = serial_open(ctx->opts.device,
+	    ctx->opts.baud ? ctx->opts.baud : SERIAL_DEFAULT_BAUD);
+      if (ctx->in.fd < 0) {
+	 free_ctx(ctx);
+	 return 1;
+      }
+   }else
+#endif
    if (ctx->opts.infile != NULL) {
       ctx->in.fd = open(ctx->opts.infile, O_RDONLY
 #ifdef O_BINARY
@@ -352,21 +1357,156 @@ int main(int argc, char *argv[])
 	 free_ctx(ctx);
 	 return 1;
       }
+#ifdef HAVE_PTHREAD
+      /* compressed archive, decompressed by threads to a pipe  */
+      if (srfz_is_archive(ctx->in.fd)) {
+	 if (ctx->opts.threads == 0) {
+	    long n;
+
+	    n = sysconf(_SC_NPROCESSORS_ONLN);
+	    ctx->opts.threads = n > 0 ? (unsigned)n : 1;
+	 }
+	 ctx->feed = new_srfz_feed(ctx->in.fd, ctx->opts.from, ctx->opts.to,
+	       ctx->opts.threads);
+	 if (ctx->feed == NULL) {
+	    ctx->in.fd = -1;
+	    free_ctx(ctx);
+	    return 1;
+	 }
+	 ctx->in.fd = srfz_feed_fd(ctx->feed);
+      }
+#endif
    }else
       ctx->in.fd = STDIN_FILENO;
+#ifdef HAVE_PTHREAD
+   if ((ctx->opts.from || ctx->opts.to) && (ctx->feed == NULL)) {
+      fputs("--from and --to require archive input\n", stderr);
+      free_ctx(ctx);
+      return 1;
+   }
+#endif
+   if (ctx->opts.resume) {
+#ifdef HAVE_PTHREAD
+      if (ctx->feed != NULL) {
+	 fputs("--resume can not be used with archive input\n", stderr);
+	 free_ctx(ctx);
+	 return 1;
+      }
+#endif
+      if (resume_input(&ctx->in, &ctx->resume) < 0) {
+	 if (!ctx->opts.append
+	       || (lseek(ctx->in.fd, 0, SEEK_SET) < 0)) {
+	    free_ctx(ctx);
+	    return 1;
+	 }
+	 append_restart(ctx, "input changed");
+      }
+   }
+   ctx->in.hashing = ctx->opts.checkpoint != NULL;
+   arrival_init(&ctx->in.arrival, ctx->in.fd);
+
+   /* demultiplexed input  */
+   if (ctx->opts.nmea_passthrough != NULL) {
+      ctx->in.nmea_f = open_side_file(ctx->opts.nmea_passthrough,
+	    ctx->resume.nmea_size);
+      if (ctx->in.nmea_f == NULL) {
+	 free_ctx(ctx);
+	 return 1;
+      }
+   }
+   if (ctx->opts.garbage_file != NULL) {
+      ctx->in.garbage_f = open_side_file(ctx->opts.garbage_file,
+	    ctx->resume.garbage_size);
+      if (ctx->in.garbage_f == NULL) {
+	 free_ctx(ctx);
+	 return 1;
+      }
+   }
 
    /* outfile  */
-   if (ctx->opts.outfile != NULL) {
-      ctx->outfh = fopen(ctx->opts.outfile,
-#ifdef WIN32
-	"wb"
-#else
-	"w"
+   if (ctx->opts.listen_addr != NULL && (ctx->opts.udp_addrs != NULL)) {
+      fputs("--listen and --udp can not be used together\n", stderr);
+      free_ctx(ctx);
+      return 1;
+   }
+   if (ctx->opts.partition
+	 && (ctx->opts.outfile != NULL
+	    || (ctx->opts.listen_addr != NULL)
+	    || (ctx->opts.udp_addrs != NULL))) {
+      fputs("--partition can not be used with --outfile, --listen or --udp\n", stderr);
+      free_ctx(ctx);
+      return 1;
+   }
+#ifdef HAVE_EPOLL
+   if (ctx->opts.ntrip_mount != NULL
+	 && (ctx->opts.listen_addr == NULL
+	    || (ctx->opts.output_type != OUTPUT_RTCM))) {
+      fputs("NTRIP caster requires --listen and rtcm output\n", stderr);
+      free_ctx(ctx);
+      return 1;
+   }
 #endif
-	);
-
+   if (ctx->opts.partition && ctx->resume.part) {
+      ctx->outfh = open_partition(ctx, ctx->resume.part, ctx->resume.out_size);
+      if (ctx->outfh == NULL) {
+	 free_ctx(ctx);
+	 return 1;
+      }
+      ctx->part = ctx->resume.part;
+   }else if (ctx->opts.partition) {
+      ctx->pending_f = tmpfile();
+      if (ctx->pending_f == NULL) {
+	 perror("tmpfile()");
+	 free_ctx(ctx);
+	 return 1;
+      }
+      ctx->outfh = ctx->pending_f;
+   }else
+#ifdef HAVE_EPOLL
+   if (ctx->opts.listen_addr != NULL) {
+      ctx->srv = new_tcpsrv(ctx->opts.listen_addr);
+      if (ctx->srv == NULL) {
+	 free_ctx(ctx);
+	 return 1;
+      }
+      if (ctx->opts.ntrip_mount != NULL) {
+	 ctx->caster = new_ntrip_caster(ctx->srv, ctx->opts.ntrip_mount);
+	 if (ctx->caster == NULL) {
+	    free_ctx(ctx);
+	    return 1;
+	 }
+      }
+      ctx->outfh = tcpsrv_fopen(ctx->srv);
+      if (ctx->outfh == NULL) {
+	 free_ctx(ctx);
+	 return 1;
+      }
+      setvbuf(ctx->outfh, NULL, _IONBF, 0);
+      ctx->in.srv = ctx->srv;
+   }else
+#endif
+#ifdef HAVE_SENDMMSG
+   if (ctx->opts.udp_addrs != NULL) {
+      ctx->udp = new_udpout(ctx->opts.udp_addrs);
+      if (ctx->udp == NULL) {
+	 free_ctx(ctx);
+	 return 1;
+      }
+      ctx->outfh = udpout_fopen(ctx->udp);
+      if (ctx->outfh == NULL) {
+	 free_ctx(ctx);
+	 return 1;
+      }
+      setvbuf(ctx->outfh, NULL, _IONBF, 0);
+      ctx->in.udp = ctx->udp;
+      /* GGA and RMC are made from MID 41  */
+      if (ctx->opts.output_type == OUTPUT_NMEA)
+	 ctx->udp_epoch_mid = SIRF_GET_MID(SIRF_MSG_SSB_GEODETIC_NAVIGATION);
+   }else
+#endif
+   if (ctx->opts.outfile != NULL) {
+      ctx->outfh = open_output(ctx->opts.outfile, ctx->resume.out_size);
       if (ctx->outfh == NULL) {
-	 perror(NULL);
 	 free_ctx(ctx);
 	 return 1;
       }
@@ -377,10 +1517,28 @@ int main(int argc, char *argv[])
    switch (ctx->opts.output_type) {
       case OUTPUT_NMEA:
 	 ctx->dump_f = &output_nmea;
+	 output_nmea_sentences = ctx->opts.nmea_sentences;
 	 break;
       case OUTPUT_RINEX:
 	 ctx->dump_f = &output_rinex;
-	 ctx->user_ctx = new_rinex_ctx(argc, argv, ctx->opts.gsw230_byte_order);
+	 ctx->new_file_f = &rinex_new_file;
+	 ctx->get_state_f = &rinex_get_state;
+	 ctx->set_state_f = &rinex_set_state;
+	 ctx->user_ctx = new_rinex_ctx(argc, argv, ctx->opts.gsw230_byte_order,
+	       ctx->opts.elev_mask);
+	 if (ctx->user_ctx == NULL) {
+	    perror(NULL);
+	    free_ctx(ctx);
+	    return 1;
+	 }
+	 break;
+      case OUTPUT_RINEX3:
+	 ctx->dump_f = &output_rinex;
+	 ctx->new_file_f = &rinex_new_file;
+	 ctx->get_state_f = &rinex_get_state;
+	 ctx->set_state_f = &rinex_set_state;
+	 ctx->user_ctx = new_rinex3_ctx(argc, argv, ctx->opts.gsw230_byte_order,
+	       ctx->opts.obs_types, ctx->opts.elev_mask);
 	 if (ctx->user_ctx == NULL) {
 	    perror(NULL);
 	    free_ctx(ctx);
@@ -389,7 +1547,10 @@ int main(int argc, char *argv[])
 	 break;
       case OUTPUT_RINEX_NAV:
 	 ctx->dump_f = &output_rinex_nav;
-	 ctx->user_ctx = new_rinex_nav_ctx(argc, argv);
+	 ctx->new_file_f = &rinex_nav_new_file;
+	 ctx->get_state_f = &rinex_nav_get_state;
+	 ctx->set_state_f = &rinex_nav_set_state;
+	 ctx->user_ctx = new_rinex_nav_ctx(argc, argv, ctx->opts.nav_cache);
 	 if (ctx->user_ctx == NULL) {
 	    perror(NULL);
 	    free_ctx(ctx);
@@ -398,7 +1559,11 @@ int main(int argc, char *argv[])
 	 break;
       case OUTPUT_RTCM:
 	 ctx->dump_f = &output_rtcm;
-	 ctx->user_ctx = new_rtcm_ctx(argc, argv, ctx->opts.gsw230_byte_order);
+	 ctx->new_file_f = &rtcm_new_file;
+	 ctx->get_state_f = &rtcm_get_state;
+	 ctx->set_state_f = &rtcm_set_state;
+	 ctx->user_ctx = new_rtcm_ctx(argc, argv, ctx->opts.gsw230_byte_order,
+	       ctx->opts.nav_cache);
 	 setvbuf(ctx->outfh, NULL, _IONBF, 0);
 	 if (ctx->user_ctx == NULL) {
 	    perror(NULL);
@@ -409,14 +1574,54 @@ int main(int argc, char *argv[])
       case OUTPUT_DUMP:
       default:
 	 output_dump_use_gsw230_byte_order = ctx->opts.gsw230_byte_order;
+	 output_dump_arrival_time = ctx->opts.timestamps;
+	 output_dump_realtime_offset = stats_realtime_offset();
 	 ctx->dump_f = &output_dump;
 	 break;
    }
 
+   /* sink state of the previous run  */
+   if ((ctx->opts.state_in || ctx->opts.state_out) && (ctx->get_state_f == NULL)) {
+      fputs("--state-in and --state-out require rinex, rinex3, rinex-nav or rtcm output\n", stderr);
+      free_ctx(ctx);
+      return 1;
+   }
+   if (ctx->opts.state_in && (load_state(ctx, ctx->opts.state_in) < 0)) {
+      free_ctx(ctx);
+      return 1;
+   }
+   if (ctx->resume_f) {
+      if (read_state(ctx, ctx->resume_f, ctx->opts.checkpoint, 0) < 0) {
+	 free_ctx(ctx);
+	 return 1;
+      }
+      fclose(ctx->resume_f);
+      ctx->resume_f = NULL;
+   }
+   ctx->next_checkpoint = stats_clock()
+      + (uint64_t)ctx->opts.checkpoint_interval * 1000000000;
+
+   if (ctx->opts.stats || ctx->opts.stats_json) {
+      stats_ctx = new_stats();
+      if (stats_ctx == NULL) {
+	 perror(NULL);
+	 free_ctx(ctx);
+	 return 1;
+      }
+   }
+
    process(ctx);
 
+   res = 0;
+   if (ctx->opts.state_out && (save_state(ctx, ctx->opts.state_out) < 0))
+      res = 1;
+   /* end of input  */
+   if (ctx->opts.checkpoint && (write_checkpoint(ctx) < 0))
+      res = 1;
+
    switch (ctx->opts.output_type) {
       case OUTPUT_RINEX:
+      case OUTPUT_RINEX3:
 	 free_rinex_ctx(ctx->user_ctx);
 	 break;
       case OUTPUT_RINEX_NAV:
@@ -429,7 +1634,26 @@ int main(int argc, char *argv[])
 	 break;
    }
 
+#ifdef HAVE_EPOLL
+   if (ctx->srv) {
+      fflush(ctx->outfh);
+      tcpsrv_drain(ctx->srv, 1000);
+   }
+#endif
+#ifdef HAVE_SENDMMSG
+   if (ctx->udp) {
+      fflush(ctx->outfh);
+      udpout_flush(ctx->udp);
+   }
+#endif
+
+   if (stats_ctx) {
+      report_stats(ctx);
+      free_stats(stats_ctx);
+      stats_ctx = NULL;
+   }
+
    free_ctx(ctx);
-   return 0;
+   return res;
 }
 
@@ -15,6 +15,10 @@ struct transport_msg_t {
    unsigned payload_length;
    unsigned checksum;
    unsigned skipped_bytes;
+   /* Arrival of the first and the last byte of the frame,
+    * stats_clock() ns. See arrival.h  */
+   uint64_t first_byte_ns;
+   uint64_t last_byte_ns;
 };
 
 struct gps_tm {
@@ -24,21 +28,49 @@ struct gps_tm {
 };
 
 typedef int (dumpf_t)(struct transport_msg_t *msg, FILE *out_f, void *user_ctx);
+/* Output continues in a new file (sirfdump --partition): out_f gets its
+ * own header, previous file is still open  */
+typedef int (newfilef_t)(FILE *out_f, void *user_ctx);
+/* Sink state carried to the next run (sirfdump --state-out / --state-in,
+ * checkpoints). get: returns snapshot size, snapshot is copied to buf if
+ * it fits. set: new_file - output continues in a new file, otherwise in
+ * the same one cut at the snapshot. Returns -1 on wrong snapshot  */
+typedef size_t (getstatef_t)(void *user_ctx, void *buf, size_t size);
+typedef int (setstatef_t)(void *user_ctx, const void *buf, size_t size,
+      unsigned new_file);
 
 int output_dump(struct transport_msg_t *msg, FILE *out_f, void *user_ctx);
 int output_nmea(struct transport_msg_t *msg, FILE *out_f, void *user_ctx);
 
-void *new_rinex_ctx(int argc, char **argv, unsigned gsw230_byte_order);
+/* elev_mask: degrees, < 0: off  */
+void *new_rinex_ctx(int argc, char **argv, unsigned gsw230_byte_order,
+      double elev_mask);
 void free_rinex_ctx(void *ctx);
 int output_rinex(struct transport_msg_t *msg, FILE *out_f, void *user_ctx);
+int rinex_new_file(FILE *out_f, void *user_ctx);
+size_t rinex_get_state(void *user_ctx, void *buf, size_t size);
+int rinex_set_state(void *user_ctx, const void *buf, size_t size,
+      unsigned new_file);
+void *new_rinex3_ctx(int argc, char **argv, unsigned gsw230_byte_order,
+      const char *obs_types, double elev_mask);
 
-void *new_rinex_nav_ctx(int argc, char **argv);
+/* nav_cache: ephemeris cache file, NULL: no cache  */
+void *new_rinex_nav_ctx(int argc, char **argv, const char *nav_cache);
 void free_rinex_nav_ctx(void *ctx);
 int output_rinex_nav(struct transport_msg_t *msg, FILE *out_f, void *user_ctx);
+int rinex_nav_new_file(FILE *out_f, void *user_ctx);
+size_t rinex_nav_get_state(void *user_ctx, void *buf, size_t size);
+int rinex_nav_set_state(void *user_ctx, const void *buf, size_t size,
+      unsigned new_file);
 
-void *new_rtcm_ctx(int argc, char **argv, unsigned gsw230_byte_order);
+void *new_rtcm_ctx(int argc, char **argv, unsigned gsw230_byte_order,
+      const char *nav_cache);
 void free_rtcm_ctx(void *ctx);
 int output_rtcm(struct transport_msg_t *msg, FILE *out_f, void *user_ctx);
+int rtcm_new_file(FILE *out_f, void *user_ctx);
+size_t rtcm_get_state(void *user_ctx, void *buf, size_t size);
+int rtcm_set_state(void *user_ctx, const void *buf, size_t size,
+      unsigned new_file);
 
 
 int gpstime2tm0(unsigned gps_week, double gps_tow, struct gps_tm *res);
@@ -0,0 +1,985 @@
+#define _GNU_SOURCE
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sirfdump.h"
+#include "sirf_msg.h"
+#include "arrival.h"
+#include "framer.h"
+#include "nmea_batch.h"
+#include "sirf_codec.h"
+#include "sirf_codec_ssb.h"
+#include "sirf_codec_ascii.h"
+
+#if defined(__SANITIZE_ADDRESS__)
+#define HAVE_SANITIZER
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define HAVE_SANITIZER
+#endif
+#endif
+
+#ifdef HAVE_SANITIZER
+#include <sanitizer/common_interface_defs.h>
+#endif
+
+const char *progname = "sirffuzz";
+const char *revision = "$Revision: 0.1 $";
+
+/* Options of the dump and nmea sinks, set by the ascii and nmea targets  */
+unsigned output_dump_use_gsw230_byte_order = 0;
+unsigned output_dump_arrival_time = 0;
+unsigned output_nmea_sentences = NMEA_ALL;
+int64_t output_dump_realtime_offset = 0;
+
+/* Largest input, bytes  */
+#define FUZZ_MAX_LEN 65536
+/* Largest payload of the payload targets: the framer limit  */
+#define FUZZ_MAX_PAYLOAD 1022
+/* -s: inputs of a MID, stream pieces  */
+#define SEED_PER_MID 8
+#define SEED_PIECES 64
+/* Largest log read by -s, bytes  */
+#define SEED_MAX_LOG (64 * 1024 * 1024)
+/* Mutations stacked on one input: 1 to 2^FUZZ_MAX_STACK  */
+#define FUZZ_MAX_STACK 4
+/* Progress line every ns  */
+#define FUZZ_REPORT_NS 10000000000ull
+
+struct fuzz_sink_t {
+   void *(*new_ctx)(unsigned gsw230_byte_order);
+   void (*free_ctx)(void *ctx);
+   dumpf_t *dump_f;
+   getstatef_t *get_state_f;
+   setstatef_t *set_state_f;
+   /* 2: run with both byte orders  */
+   unsigned orders;
+};
+
+struct fuzz_target_t {
+   const char *name;
+   int (*run)(const struct fuzz_target_t *t, const uint8_t *data, size_t size);
+   const struct fuzz_sink_t *sink;
+   /* -s: one input per payload, otherwise pieces of the log  */
+   unsigned payload_seeds;
+};
+
+struct fuzz_input_t {
+   uint8_t *data;
+   size_t size;
+   /* file of a corpus input  */
+   char *fname;
+};
+
+struct fuzz_ctx_t {
+   const struct fuzz_target_t *target;
+   size_t max_len;
+   FILE *null_f;
+   /* framer input  */
+   int in_fd;
+   struct input_stream_t in;
+   /* input of the running exec: saved on crash, or its file name is
+    * printed if replayed  */
+   const uint8_t *cur;
+   size_t cur_size;
+   const char *cur_fname;
+   unsigned save_crash;
+   char crash_fname[64];
+   /* -q: stderr of the harness and of the sanitizer  */
+   FILE *err_f;
+};
+
+static struct fuzz_ctx_t fuzz;
+
+static void usage(void)
+{
+ fprintf(stdout, "\nUsage:\n    %s [-h] -t target [options] [file|dir ...]\n"
+       ,progname);
+ return;
+}
+
+static void version(void)
+{
+ fprintf(stdout,"%s %s\n",progname,revision);
+}
+
+static void help(void)
+{
+
+ printf("%s - Fuzz harness of the SSB framer, codecs and output sinks\t%s\n",
+       progname, revision);
+ usage();
+ printf(
+   "\nOptions:\n"
+   "    -t, --target                framer, ssb, ascii, nmea, rinex, rinex3,\n"
+   "                                rinex-nav or rtcm\n"
+   "    -d, --duration              Seconds of mutation, default: 0 (replay only)\n"
+   "    -m, --max-len               Largest input, bytes, default: 65536\n"
+   "    -s, --seeds                 Write seed corpus of the target from the SSB log\n"
+   "                                on stdin to dir\n"
+   "    -S, --seed                  Random seed, default: 1\n"
+   "    -q, --quiet                 Messages of the code under test to /dev/null\n"
+   "    -h, --help                  Help\n"
+   "    -v, --version               Show version\n"
+   "\n"
+   "Targets: framer - readpkt() with and without NMEA pass-through, frames\n"
+   "are checked against the input; ssb - SIRF_CODEC_SSB_Decode() of a\n"
+   "payload in both byte orders; ascii, nmea - output_dump()\n"
+   "(SIRF_CODEC_ASCII_Encode()) and output_nmea() of a payload; rinex,\n"
+   "rinex3 (10 degree elevation mask), rinex-nav, rtcm - framer and sink,\n"
+   "then the sink state is restored in a new sink and the input is run\n"
+   "again.\n"
+   "Files and directories are run once each, stdin if none is given (AFL).\n"
+   "With -d they are the corpus of random byte level mutations; execs/s is\n"
+   "reported. An input failing a check or a sanitizer is written to\n"
+   "crash-<target>.\n"
+   "\n"
+ );
+}
+
+static uint64_t clock_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static unsigned rnd(unsigned n)
+{
+   return (unsigned)random() % n;
+}
+
+static void save_crash(void)
+{
+   int fd;
+   size_t pos;
+   ssize_t l;
+   char msg[4096+16];
+
+   if (!fuzz.save_crash)
+      return;
+   fuzz.save_crash = 0;
+
+   if (fuzz.cur_fname) {
+      fd = fuzz.err_f ? fileno(fuzz.err_f) : STDERR_FILENO;
+      snprintf(msg, sizeof(msg), "input: %s\n", fuzz.cur_fname);
+      l = write(fd, msg, strlen(msg));
+      return;
+   }
+
+   fd = open(fuzz.crash_fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0)
+      return;
+   for (pos = 0; pos < fuzz.cur_size; pos += l) {
+      l = write(fd, fuzz.cur + pos, fuzz.cur_size - pos);
+      if (l <= 0)
+	 break;
+   }
+   close(fd);
+}
+
+static void crash_signal(int sig)
+{
+   save_crash();
+   signal(sig, SIG_DFL);
+   raise(sig);
+}
+
+static void fuzz_fail(const char *what, size_t pos)
+{
+   fprintf(fuzz.err_f ? fuzz.err_f : stderr, "%s: %s at %lu\n",
+	 fuzz.target->name, what, (unsigned long)pos);
+   abort();
+}
+
+static void fuzz_init(void)
+{
+   FILE *f;
+
+   fuzz.null_f = fopen("/dev/null", "w");
+   f = tmpfile();
+   if (fuzz.null_f == NULL || (f == NULL)) {
+      perror(NULL);
+      exit(1);
+   }
+   fuzz.in_fd = fileno(f);
+}
+
+/* Framer on data, nmea_f: NMEA pass-through  */
+static void stream_open(const uint8_t *data, size_t size, FILE *nmea_f)
+{
+   size_t pos;
+   ssize_t l;
+
+   if (ftruncate(fuzz.in_fd, 0) < 0 || (lseek(fuzz.in_fd, 0, SEEK_SET) < 0)) {
+      perror(NULL);
+      exit(1);
+   }
+   for (pos = 0; pos < size; pos += l) {
+      l = write(fuzz.in_fd, data + pos, size - pos);
+      if (l <= 0) {
+	 perror(NULL);
+	 exit(1);
+      }
+   }
+   lseek(fuzz.in_fd, 0, SEEK_SET);
+
+   input_stream_init(&fuzz.in);
+   fuzz.in.fd = fuzz.in_fd;
+   fuzz.in.nmea_f = nmea_f;
+   fuzz.in.garbage_f = fuzz.null_f;
+   arrival_init(&fuzz.in.arrival, fuzz.in.fd);
+}
+
+static void check_frame(const uint8_t *pkt, const struct transport_msg_t *msg,
+      size_t pos)
+{
+   unsigned len;
+
+   len = msg->payload_length;
+   if (len >= 1023)
+      fuzz_fail("payload length", pos);
+   if (pkt[0] != 0xa0 || (pkt[1] != 0xa2) || (msg->payload != pkt + 4)
+	 || (pkt[2+2+len+2] != 0xb0) || (pkt[2+2+len+3] != 0xb3))
+      fuzz_fail("frame", pos);
+   if ((unsigned)((pkt[2] << 8) | pkt[3]) != len
+	 || ((unsigned)((pkt[4+len] << 8) | pkt[4+len+1]) != msg->checksum))
+      fuzz_fail("frame header", pos);
+   if (msg->first_byte_ns > msg->last_byte_ns)
+      fuzz_fail("arrival time", pos);
+}
+
+static int run_framer(const struct fuzz_target_t *t, const uint8_t *data,
+      size_t size)
+{
+   uint8_t *pkt;
+   struct transport_msg_t msg;
+   size_t pos, len;
+   unsigned cnt;
+
+   (void)t;
+
+   /* every byte is a frame or garbage  */
+   stream_open(data, size, NULL);
+   pos = cnt = 0;
+   while ((pkt = readpkt(&fuzz.in, &msg)) != NULL) {
+      pos += msg.skipped_bytes;
+      len = 2+2+msg.payload_length+2+2;
+      if (pos + len > size || memcmp(&data[pos], pkt, len) != 0)
+	 fuzz_fail("frame does not match the input", pos);
+      check_frame(pkt, &msg, pos);
+      pos += len;
+      cnt++;
+   }
+
+   stream_open(data, size, fuzz.null_f);
+   while ((pkt = readpkt(&fuzz.in, &msg)) != NULL) {
+      check_frame(pkt, &msg, 0);
+      if (cnt-- == 0)
+	 fuzz_fail("more frames with NMEA pass-through", size);
+   }
+
+   return 0;
+}
+
+/* Payload of the payload targets, framer limit  */
+static size_t payload_copy(uint8_t *dst, const uint8_t *data, size_t size)
+{
+   if (size > FUZZ_MAX_PAYLOAD)
+      size = FUZZ_MAX_PAYLOAD;
+   memcpy(dst, data, size);
+   return size;
+}
+
+static int run_ssb(const struct fuzz_target_t *t, const uint8_t *data,
+      size_t size)
+{
+   unsigned i;
+   tSIRF_UINT32 msg_id, msg_length, options;
+   uint8_t payload[FUZZ_MAX_PAYLOAD];
+   uint8_t msg_structure[SIRF_MSG_SSB_MAX_MESSAGE_LEN];
+
+   (void)t;
+
+   size = payload_copy(payload, data, size);
+   for (i=0; i < 2; i++) {
+      options = i ? SIRF_CODEC_FLAGS_GSW230_BYTE_ORDER : 0;
+      msg_length = 0;
+      if (SIRF_CODEC_SSB_Decode(payload, size, &msg_id, msg_structure,
+	       &msg_length, &options) == 0
+	    && (msg_length > sizeof(msg_structure)))
+	 fuzz_fail("message length", msg_length);
+   }
+
+   return 0;
+}
+
+static int run_ascii(const struct fuzz_target_t *t, const uint8_t *data,
+      size_t size)
+{
+   unsigned i;
+   struct transport_msg_t msg;
+   uint8_t payload[FUZZ_MAX_PAYLOAD];
+
+   memset(&msg, 0, sizeof(msg));
+   msg.payload = payload;
+   msg.payload_length = payload_copy(payload, data, size);
+   for (i=0; i < 2; i++) {
+      output_dump_use_gsw230_byte_order = i;
+      output_dump_arrival_time = i;
+      if (strcmp(t->name, "nmea") == 0)
+	 output_nmea(&msg, fuzz.null_f, NULL);
+      else
+	 output_dump(&msg, fuzz.null_f, NULL);
+   }
+
+   return 0;
+}
+
+static void *new_rinex(unsigned gsw230_byte_order)
+{
+   return new_rinex_ctx(0, NULL, gsw230_byte_order, -1);
+}
+
+static void *new_rinex3(unsigned gsw230_byte_order)
+{
+   return new_rinex3_ctx(0, NULL, gsw230_byte_order, NULL, 10.0);
+}
+
+static void *new_rinex_nav(unsigned gsw230_byte_order)
+{
+   (void)gsw230_byte_order;
+   return new_rinex_nav_ctx(0, NULL, NULL);
+}
+
+static void *new_rtcm(unsigned gsw230_byte_order)
+{
+   return new_rtcm_ctx(0, NULL, gsw230_byte_order, NULL);
+}
+
+static void sink_feed(const struct fuzz_sink_t *sink, void *ctx,
+      const uint8_t *data, size_t size)
+{
+   struct transport_msg_t msg;
+
+   stream_open(data, size, NULL);
+   while (readpkt(&fuzz.in, &msg) != NULL)
+      sink->dump_f(&msg, fuzz.null_f, ctx);
+}
+
+static int run_sink(const struct fuzz_target_t *t, const uint8_t *data,
+      size_t size)
+{
+   unsigned i;
+   size_t state_size;
+   void *ctx, *ctx2, *state;
+   const struct fuzz_sink_t *sink;
+
+   sink = t->sink;
+   for (i=0; i < sink->orders; i++) {
+      ctx = sink->new_ctx(i);
+      if (ctx == NULL) {
+	 perror(NULL);
+	 exit(1);
+      }
+      sink_feed(sink, ctx, data, size);
+
+      /* --state-out, --state-in of the same file  */
+      state_size = sink->get_state_f(ctx, NULL, 0);
+      state = malloc(state_size);
+      ctx2 = sink->new_ctx(i);
+      if (state == NULL || (ctx2 == NULL)) {
+	 perror(NULL);
+	 exit(1);
+      }
+      if (sink->get_state_f(ctx, state, state_size) != state_size)
+	 fuzz_fail("state size", state_size);
+      if (sink->set_state_f(ctx2, state, state_size, 0) != 0)
+	 fuzz_fail("state not restored", state_size);
+      sink_feed(sink, ctx2, data, size);
+
+      free(state);
+      sink->free_ctx(ctx2);
+      sink->free_ctx(ctx);
+   }
+
+   return 0;
+}
+
+static const struct fuzz_sink_t sink_rinex = {
+   new_rinex, free_rinex_ctx, output_rinex, rinex_get_state, rinex_set_state, 2
+};
+static const struct fuzz_sink_t sink_rinex3 = {
+   new_rinex3, free_rinex_ctx, output_rinex, rinex_get_state, rinex_set_state, 2
+};
+static const struct fuzz_sink_t sink_rinex_nav = {
+   new_rinex_nav, free_rinex_nav_ctx, output_rinex_nav, rinex_nav_get_state,
+   rinex_nav_set_state, 1
+};
+static const struct fuzz_sink_t sink_rtcm = {
+   new_rtcm, free_rtcm_ctx, output_rtcm, rtcm_get_state, rtcm_set_state, 2
+};
+
+static const struct fuzz_target_t targets[] = {
+   {"framer",    run_framer, NULL,            0},
+   {"ssb",       run_ssb,    NULL,            1},
+   {"ascii",     run_ascii,  NULL,            1},
+   {"nmea",      run_ascii,  NULL,            1},
+   {"rinex",     run_sink,   &sink_rinex,     0},
+   {"rinex3",    run_sink,   &sink_rinex3,    0},
+   {"rinex-nav", run_sink,   &sink_rinex_nav, 0},
+   {"rtcm",      run_sink,   &sink_rtcm,      0},
+   {NULL,        NULL,       NULL,            0}
+};
+
+static const struct fuzz_target_t *find_target(const char *name)
+{
+   const struct fuzz_target_t *t;
+
+   for (t = targets; t->name; t++) {
+      if (strcmp(t->name, name) == 0)
+	 return t;
+   }
+   return NULL;
+}
+
+static void set_target(const struct fuzz_target_t *t)
+{
+   fuzz.target = t;
+   snprintf(fuzz.crash_fname, sizeof(fuzz.crash_fname), "crash-%s", t->name);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+   if (size > fuzz.max_len)
+      return 0;
+   fuzz.cur = data;
+   fuzz.cur_size = size;
+   return fuzz.target->run(fuzz.target, data, size);
+}
+
+#ifdef LIBFUZZER
+
+/* Target from SIRFFUZZ_TARGET environment variable, default: framer  */
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+   const char *name;
+   const struct fuzz_target_t *t;
+
+   (void)argc;
+   (void)argv;
+
+   name = getenv("SIRFFUZZ_TARGET");
+   t = find_target(name ? name : "framer");
+   if (t == NULL) {
+      fprintf(stderr, "Unknown SIRFFUZZ_TARGET %s\n", name);
+      exit(1);
+   }
+   set_target(t);
+   fuzz.max_len = FUZZ_MAX_LEN;
+   fuzz_init();
+
+   return 0;
+}
+
+#else /* LIBFUZZER  */
+
+/* stderr to /dev/null, failed checks and sanitizer reports to the
+ * former stderr  */
+static int quiet_stderr(void)
+{
+   int fd;
+
+   fd = dup(STDERR_FILENO);
+   if (fd < 0)
+      return -1;
+   fuzz.err_f = fdopen(fd, "w");
+   if (fuzz.err_f == NULL)
+      return -1;
+   setvbuf(fuzz.err_f, NULL, _IONBF, 0);
+#ifdef HAVE_SANITIZER
+   __sanitizer_set_report_fd((void *)(intptr_t)fd);
+#endif
+   fflush(stderr);
+   if (dup2(fileno(fuzz.null_f), STDERR_FILENO) < 0)
+      return -1;
+
+   return 0;
+}
+
+static int read_input(int fd, size_t max_len, struct fuzz_input_t *res)
+{
+   ssize_t l;
+   uint8_t *p;
+
+   res->size = 0;
+   res->fname = NULL;
+   res->data = malloc(max_len ? max_len : 1);
+   if (res->data == NULL)
+      return -1;
+
+   while (res->size < max_len) {
+      l = read(fd, res->data + res->size, max_len - res->size);
+      if (l < 0 && (errno == EINTR))
+	 continue;
+      if (l < 0) {
+	 free(res->data);
+	 return -1;
+      }
+      if (l == 0)
+	 break;
+      res->size += l;
+   }
+
+   p = realloc(res->data, res->size ? res->size : 1);
+   if (p)
+      res->data = p;
+
+   return 0;
+}
+
+static int corpus_add(struct fuzz_input_t **corpus, size_t *cnt,
+      const char *fname, size_t max_len)
+{
+   int fd;
+   int err;
+   struct fuzz_input_t *p;
+
+   p = realloc(*corpus, (*cnt + 1) * sizeof(**corpus));
+   if (p == NULL) {
+      perror(NULL);
+      return -1;
+   }
+   *corpus = p;
+
+   fd = open(fname, O_RDONLY);
+   if (fd < 0) {
+      perror(fname);
+      return -1;
+   }
+   err = read_input(fd, max_len, &p[*cnt]);
+   close(fd);
+   if (err == 0) {
+      p[*cnt].fname = strdup(fname);
+      if (p[*cnt].fname == NULL) {
+	 free(p[*cnt].data);
+	 err = -1;
+      }
+   }
+   if (err) {
+      perror(fname);
+      return -1;
+   }
+   *cnt += 1;
+
+   return 0;
+}
+
+/* Files of a directory, one level  */
+static int corpus_load(struct fuzz_input_t **corpus, size_t *cnt,
+      const char *path, size_t max_len)
+{
+   DIR *d;
+   struct dirent *e;
+   struct stat st;
+   char fname[4096];
+   int err;
+
+   if (stat(path, &st) < 0) {
+      perror(path);
+      return -1;
+   }
+   if (!S_ISDIR(st.st_mode))
+      return corpus_add(corpus, cnt, path, max_len);
+
+   d = opendir(path);
+   if (d == NULL) {
+      perror(path);
+      return -1;
+   }
+   err = 0;
+   while (err == 0 && ((e = readdir(d)) != NULL)) {
+      snprintf(fname, sizeof(fname), "%s/%s", path, e->d_name);
+      if (stat(fname, &st) < 0 || !S_ISREG(st.st_mode))
+	 continue;
+      err = corpus_add(corpus, cnt, fname, max_len);
+   }
+   closedir(d);
+
+   return err;
+}
+
+static int write_seed(const char *dir, const char *name, unsigned n,
+      const uint8_t *data, size_t size)
+{
+   FILE *f;
+   char fname[4096];
+
+   /* seeds of another log are kept  */
+   for (;; n++) {
+      snprintf(fname, sizeof(fname), "%s/%s-%u", dir, name, n);
+      if (access(fname, F_OK) != 0)
+	 break;
+   }
+   f = fopen(fname, "wb");
+   if (f == NULL) {
+      perror(fname);
+      return -1;
+   }
+   if (fwrite(data, 1, size, f) != size) {
+      perror(fname);
+      fclose(f);
+      return -1;
+   }
+   fclose(f);
+
+   return 0;
+}
+
+/* Seed corpus: payloads, SEED_PER_MID of every MID; or SEED_PIECES pieces
+ * of the log cut at frame starts, garbage and NMEA included  */
+static int write_seeds(const char *dir, size_t max_len)
+{
+   struct fuzz_input_t log;
+   struct transport_msg_t msg;
+   unsigned mid_cnt[256];
+   char name[16];
+   size_t pos, end, piece;
+   unsigned n;
+
+   if (read_input(STDIN_FILENO, SEED_MAX_LOG, &log) < 0) {
+      perror(NULL);
+      return -1;
+   }
+
+   n = 0;
+   if (fuzz.target->payload_seeds) {
+      memset(mid_cnt, 0, sizeof(mid_cnt));
+      stream_open(log.data, log.size, NULL);
+      while (readpkt(&fuzz.in, &msg) != NULL) {
+	 if (msg.payload_length == 0
+	       || (mid_cnt[msg.payload[0]] >= SEED_PER_MID))
+	    continue;
+	 snprintf(name, sizeof(name), "mid%u", msg.payload[0]);
+	 if (write_seed(dir, name, mid_cnt[msg.payload[0]]++, msg.payload,
+		  msg.payload_length) < 0)
+	    break;
+	 n++;
+      }
+   }else {
+      piece = max_len / 4;
+      for (pos = 0; pos < log.size && (n < SEED_PIECES); pos = end) {
+	 end = pos + piece;
+	 while (end + 1 < log.size
+	       && !(log.data[end] == 0xa0 && (log.data[end+1] == 0xa2)))
+	    end++;
+	 if (end + 1 >= log.size)
+	    end = log.size;
+	 if (end - pos > max_len)
+	    end = pos + max_len;
+	 if (write_seed(dir, "log", n++, &log.data[pos], end - pos) < 0)
+	    break;
+      }
+   }
+   free(log.data);
+
+   printf("%s: %u seeds\n", fuzz.target->name, n);
+
+   return 0;
+}
+
+static const uint8_t interesting8[] = {
+   0x00, 0x01, 0x7f, 0x80, 0xff, 0xa0, 0xa2, 0xb0, 0xb3, '$', '\r', '\n'
+};
+
+static const uint32_t interesting32[] = {
+   0, 1, 0x7f, 0x80, 0xff, 0x100, 0x3ff, 0x400, 0x7fff, 0x8000, 0xffff,
+   0x10000, 0x7fffffff, 0x80000000, 0xffffffff
+};
+
+/* Random byte level mutation of buf[*size], max_len capacity. Fields are
+ * big endian as in SSB  */
+static void mutate(uint8_t *buf, size_t *size, size_t max_len,
+      const struct fuzz_input_t *corpus, size_t corpus_cnt)
+{
+   size_t pos, len, src;
+   unsigned i, n, op;
+   uint32_t v;
+   const struct fuzz_input_t *other;
+
+   n = 1u << rnd(FUZZ_MAX_STACK + 1);
+   for (i=0; i < n; i++) {
+      op = rnd(*size ? 9 : 1);
+      pos = *size ? rnd(*size) : 0;
+      switch (op) {
+	 case 0:
+	    /* insert random bytes  */
+	    len = 1 + rnd(16);
+	    if (*size + len > max_len)
+	       break;
+	    memmove(&buf[pos+len], &buf[pos], *size - pos);
+	    for (src=0; src < len; src++)
+	       buf[pos+src] = rnd(256);
+	    *size += len;
+	    break;
+	 case 1:
+	    buf[pos] ^= 1u << rnd(8);
+	    break;
+	 case 2:
+	    buf[pos] = rnd(256);
+	    break;
+	 case 3:
+	    buf[pos] = interesting8[rnd(sizeof(interesting8))];
+	    break;
+	 case 4:
+	    /* 16 or 32-bit field  */
+	    v = interesting32[rnd(sizeof(interesting32) / sizeof(interesting32[0]))];
+	    len = rnd(2) ? 4 : 2;
+	    if (pos + len > *size)
+	       break;
+	    for (src=0; src < len; src++)
+	       buf[pos+src] = v >> (8 * (len - 1 - src));
+	    break;
+	 case 5:
+	    /* erase  */
+	    len = 1 + rnd(*size - pos < 64 ? *size - pos : 64);
+	    memmove(&buf[pos], &buf[pos+len], *size - pos - len);
+	    *size -= len;
+	    break;
+	 case 6:
+	    /* duplicate a range  */
+	    src = rnd(*size);
+	    len = 1 + rnd(*size - src < 256 ? *size - src : 256);
+	    if (*size + len > max_len)
+	       break;
+	    memmove(&buf[pos+len], &buf[pos], *size - pos);
+	    memmove(&buf[pos], &buf[src < pos ? src : src + len], len);
+	    *size += len;
+	    break;
+	 case 7:
+	    /* truncate  */
+	    *size = pos;
+	    break;
+	 default:
+	    /* splice another input  */
+	    other = &corpus[rnd(corpus_cnt)];
+	    if (other->size == 0)
+	       break;
+	    src = rnd(other->size);
+	    len = other->size - src;
+	    if (pos + len > max_len)
+	       len = max_len - pos;
+	    memcpy(&buf[pos], &other->data[src], len);
+	    if (pos + len > *size)
+	       *size = pos + len;
+	    break;
+      }
+   }
+}
+
+static void run_mutations(const struct fuzz_input_t *corpus, size_t corpus_cnt,
+      unsigned duration)
+{
+   uint8_t *buf;
+   size_t size;
+   const struct fuzz_input_t *in;
+   struct fuzz_input_t empty;
+   unsigned long execs;
+   uint64_t t0, t, end, next_report;
+
+   empty.data = NULL;
+   empty.size = 0;
+   if (corpus_cnt == 0) {
+      corpus = &empty;
+      corpus_cnt = 1;
+   }
+
+   buf = malloc(fuzz.max_len);
+   if (buf == NULL) {
+      perror(NULL);
+      exit(1);
+   }
+
+   execs = 0;
+   t0 = t = clock_ns();
+   end = t0 + (uint64_t)duration * 1000000000;
+   next_report = t0 + FUZZ_REPORT_NS;
+   while (t < end) {
+      in = &corpus[rnd(corpus_cnt)];
+      size = in->size;
+      if (size)
+	 memcpy(buf, in->data, size);
+      mutate(buf, &size, fuzz.max_len, corpus, corpus_cnt);
+
+      fuzz.save_crash = 1;
+      LLVMFuzzerTestOneInput(buf, size);
+      fuzz.save_crash = 0;
+
+      if ((++execs & 0xff) == 0) {
+	 t = clock_ns();
+	 if (t >= next_report) {
+	    printf("%-10s %12lu execs %10.0f execs/s\n", fuzz.target->name,
+		  execs, execs / ((t - t0) / 1e9));
+	    fflush(stdout);
+	    next_report += FUZZ_REPORT_NS;
+	 }
+      }
+   }
+   t = clock_ns();
+
+   printf("%-10s %12lu execs %7.1f s %10.0f execs/s\n", fuzz.target->name,
+	 execs, (t - t0) / 1e9, execs / ((t - t0) / 1e9));
+   free(buf);
+}
+
+int main(int argc, char *argv[])
+{
+   signed char c;
+   int i;
+   unsigned duration, seed, quiet;
+   const char *target, *seed_dir;
+   struct fuzz_input_t *corpus;
+   size_t corpus_cnt, n;
+   uint64_t t0, t1;
+
+   static struct option longopts[] = {
+      {"version",     no_argument,       0, 'v'},
+      {"help",        no_argument,       0, 'h'},
+      {"target",      required_argument, 0, 't'},
+      {"duration",    required_argument, 0, 'd'},
+      {"max-len",     required_argument, 0, 'm'},
+      {"seeds",       required_argument, 0, 's'},
+      {"seed",        required_argument, 0, 'S'},
+      {"quiet",       no_argument,       0, 'q'},
+      {0, 0, 0, 0}
+   };
+
+   target = seed_dir = NULL;
+   duration = 0;
+   seed = 1;
+   quiet = 0;
+   fuzz.max_len = FUZZ_MAX_LEN;
+
+   while ((c = getopt_long(argc, argv, "vh?t:d:m:s:S:q",longopts,NULL)) != -1) {
+      switch (c) {
+	 case 't':
+	    target = optarg;
+	    break;
+	 case 'd':
+	    duration = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'm':
+	    fuzz.max_len = strtoul(optarg, NULL, 10);
+	    break;
+	 case 's':
+	    seed_dir = optarg;
+	    break;
+	 case 'S':
+	    seed = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'q':
+	    quiet = 1;
+	    break;
+	 case 'v':
+	    version();
+	    exit(0);
+	    break;
+	 default:
+	    help();
+	    exit(0);
+	    break;
+      }
+   }
+   argc -= optind;
+   argv += optind;
+
+   if (target == NULL || (fuzz.max_len == 0)) {
+      help();
+      return 1;
+   }
+   if (find_target(target) == NULL) {
+      fprintf(stderr, "Unknown target %s\n", target);
+      return 1;
+   }
+   set_target(find_target(target));
+   fuzz_init();
+   srandom(seed);
+
+   if (seed_dir) {
+      if (argc != 0) {
+	 help();
+	 return 1;
+      }
+      return write_seeds(seed_dir, fuzz.max_len) < 0 ? 1 : 0;
+   }
+
+   /* sanitizer reports a SIGSEGV on its own  */
+   signal(SIGABRT, crash_signal);
+#ifdef HAVE_SANITIZER
+   __sanitizer_set_death_callback(save_crash);
+#else
+   signal(SIGSEGV, crash_signal);
+   signal(SIGBUS, crash_signal);
+   signal(SIGFPE, crash_signal);
+#endif
+   if (quiet && (quiet_stderr() < 0)) {
+      perror(NULL);
+      return 1;
+   }
+
+   corpus = NULL;
+   corpus_cnt = 0;
+   if (argc == 0 && (duration == 0)) {
+      corpus = malloc(sizeof(*corpus));
+      if (corpus == NULL || (read_input(STDIN_FILENO, fuzz.max_len, corpus) < 0)) {
+	 perror(NULL);
+	 return 1;
+      }
+      corpus_cnt = 1;
+   }
+   for (i=0; i < argc; i++) {
+      if (corpus_load(&corpus, &corpus_cnt, argv[i], fuzz.max_len) < 0)
+	 return 1;
+   }
+
+   /* corpus replay  */
+   t0 = clock_ns();
+   for (n=0; n < corpus_cnt; n++) {
+      fuzz.cur_fname = corpus[n].fname;
+      fuzz.save_crash = corpus[n].fname != NULL;
+      LLVMFuzzerTestOneInput(corpus[n].data, corpus[n].size);
+   }
+   fuzz.cur_fname = NULL;
+   fuzz.save_crash = 0;
+   t1 = clock_ns();
+   if (argc || duration)
+      printf("%-10s %12lu inputs %7.1f s\n", fuzz.target->name,
+	    (unsigned long)corpus_cnt, (t1 - t0) / 1e9);
+
+   if (duration)
+      run_mutations(corpus, corpus_cnt, duration);
+
+   for (n=0; n < corpus_cnt; n++) {
+      free(corpus[n].data);
+      free(corpus[n].fname);
+   }
+   free(corpus);
+   fclose(fuzz.null_f);
+
+   return 0;
+}
+
+#endif /* LIBFUZZER  */
@@ -0,0 +1,531 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sirfdump.h"
+#include "sirf_msg.h"
+#include "sirf_codec.h"
+#include "sirf_codec_ssb.h"
+#include "sirf_proto_common.h"
+#include "gpsd/gps.h"
+
+const char *progname = "sirfgen";
+const char *revision = "$Revision: 0.1 $";
+
+#define DEFAULT_GPS_WEEK 1745
+#define DEFAULT_GPS_TOW 216000.0
+
+struct opts_t {
+   unsigned rate;
+   unsigned channels;
+   unsigned duration;
+   double garbage_ratio;
+   unsigned gsw230_byte_order;
+   unsigned gps_week;
+   double gps_tow;
+   unsigned seed;
+};
+
+struct sat_t {
+   unsigned prn;
+   double range0;
+   double range_rate;
+   unsigned iode;
+   unsigned subframe_n;
+   uint32_t prev_parity;
+};
+
+struct gen_ctx_t {
+   struct opts_t opts;
+   struct sat_t sat[SIRF_NUM_CHANNELS];
+   unsigned gps_week;
+   double gps_tow;
+   uint32_t clk_bias;
+   uint32_t clk_drift;
+   unsigned long packets;
+   unsigned long bytes;
+};
+
+
+static void usage(void)
+{
+ fprintf(stdout, "\nUsage:\n    %s [-h] [options]\n"
+       ,progname);
+ return;
+}
+
+static void version(void)
+{
+ fprintf(stdout,"%s %s\n",progname,revision);
+}
+
+static void help(void)
+{
+
+ printf("%s - Synthetic Sirf binary log generator\t\t%s\n",
+       progname, revision);
+ usage();
+ printf(
+   "\nOptions:\n"
+   "    -r, --rate                  Measurement rate, Hz, default: 1\n"
+   "    -c, --channels              Number of tracked channels (1-12), default: 8\n"
+   "    -d, --duration              Duration of the log, seconds, default: 3600\n"
+   "    -g, --garbage               Ratio of garbage bytes to packet bytes, default: 0\n"
+   "    -w, --week                  Starting GPS week, default: %u\n"
+   "    -t, --tow                   Starting GPS time of week, seconds, default: %.0f\n"
+   "    -S, --seed                  Random seed, default: 1\n"
+   "    -2, --gsw230                Use alternate byte order that is used on GSW 2.3.0 - 2.9.9 firmwares\n"
+   "    -h, --help                  Help\n"
+   "    -v, --version               Show version\n"
+   "\n", DEFAULT_GPS_WEEK, DEFAULT_GPS_TOW
+ );
+ return;
+}
+
+static int write_garbage(struct gen_ctx_t *ctx, unsigned pkt_size)
+{
+   unsigned i, n;
+   double r;
+   uint8_t buf[2048];
+
+   if (ctx->opts.garbage_ratio <= 0)
+      return 0;
+
+   r = ctx->opts.garbage_ratio * pkt_size * 2.0 * (rand() / (RAND_MAX + 1.0));
+   n = (unsigned)r;
+   if (n > sizeof(buf))
+      n = sizeof(buf);
+
+   for (i=0; i<n; i++) {
+      buf[i] = (uint8_t)rand();
+      /* do not emit start sequence  */
+      if (i > 0 && buf[i-1] == 0xa0 && buf[i] == 0xa2)
+	 buf[i] = 0;
+   }
+   if (n > 0 && buf[n-1] == 0xa0)
+      buf[n-1] = 0;
+
+   if (n && fwrite(buf, 1, n, stdout) < n)
+      return -1;
+   ctx->bytes += n;
+
+   return 0;
+}
+
+/* GSW 2.3.0 - 2.9.9 firmwares use plain big endian doubles  */
+static void swap_double_gsw230(uint8_t *p)
+{
+   unsigned i;
+   uint8_t t;
+
+   for (i=0; i<4; i++) {
+      t = p[i];
+      p[i] = p[i+4];
+      p[i+4] = t;
+   }
+}
+
+static int write_msg(struct gen_ctx_t *ctx, tSIRF_UINT32 msg_id, void *msg, unsigned msg_size)
+{
+   tSIRF_UINT32 options;
+   tSIRF_UINT32 payload_length, pkt_length;
+   uint8_t payload[SIRF_MSG_SSB_MAX_MESSAGE_LEN];
+   uint8_t pkt[SIRF_MSG_SSB_MAX_MESSAGE_LEN+8];
+
+   options = 0;
+   payload_length = sizeof(payload);
+   if (SIRF_CODEC_SSB_Encode(msg_id, msg, msg_size, payload,
+	    &payload_length, &options) != SIRF_SUCCESS) {
+      fprintf(stderr, "SIRF_CODEC_SSB_Encode() error. Msg %04x\n", (unsigned)msg_id);
+      return -1;
+   }
+
+   if (ctx->opts.gsw230_byte_order && (msg_id == SIRF_MSG_SSB_NL_MEAS_DATA)) {
+      swap_double_gsw230(&payload[7]);
+      swap_double_gsw230(&payload[15]);
+      swap_double_gsw230(&payload[27]);
+   }
+
+   if (SIRF_PROTO_Wrapper(payload, payload_length, pkt, &pkt_length) != SIRF_SUCCESS)
+      return -1;
+
+   if (write_garbage(ctx, pkt_length) < 0)
+      return -1;
+
+   if (fwrite(pkt, 1, pkt_length, stdout) < pkt_length)
+      return -1;
+
+   ctx->packets++;
+   ctx->bytes += pkt_length;
+
+   return 0;
+}
+
+static uint32_t put_bits(uint32_t word, unsigned hi_bit, unsigned len, int32_t val)
+{
+   uint32_t mask;
+
+   mask = (len >= 32) ? 0xffffffff : ((1u << len) - 1);
+   return word | (((uint32_t)val & mask) << (hi_bit + 1 - len));
+}
+
+/* Build raw 30-bit words with parity from 24-bit subframe data  */
+static void subframe_to_raw(struct sat_t *sat, const uint32_t data[10], uint32_t raw[10])
+{
+   unsigned i;
+   uint32_t w, parity;
+
+   for (i=0; i<10; i++) {
+      w = ((sat->prev_parity & 0x03) << 30) | ((data[i] & 0xffffff) << 6);
+      parity = isgps_parity(w);
+      if (w & 0x40000000)
+	 w ^= 0x3fffffc0;
+      raw[i] = w | parity;
+      sat->prev_parity = parity;
+   }
+}
+
+static void fill_subframe(const struct gen_ctx_t *ctx, const struct sat_t *sat,
+      unsigned subframe_n, uint32_t w[10])
+{
+   unsigned tow17;
+   unsigned toe;
+   unsigned iode;
+
+   memset(w, 0, 10*sizeof(w[0]));
+
+   tow17 = ((unsigned)(ctx->gps_tow / 6.0) + 1) % 100800;
+   toe = ((unsigned)ctx->gps_tow / 7200) * 7200 / 16;
+   /* new ephemeris set every 2 hours  */
+   iode = (sat->iode + (unsigned)ctx->gps_tow / 7200) & 0xff;
+
+   w[0] = put_bits(0, 23, 8, 0x74);
+   w[1] = put_bits(0, 23, 17, tow17);
+   w[1] = put_bits(w[1], 4, 3, subframe_n);
+
+   switch (subframe_n) {
+      case 1:
+	 w[2] = put_bits(0, 23, 10, ctx->gps_week & 0x3ff);
+	 w[2] = put_bits(w[2], 13, 2, 1);
+	 w[2] = put_bits(w[2], 11, 4, 0);
+	 w[2] = put_bits(w[2], 1, 2, 0);
+	 w[6] = put_bits(0, 7, 8, -11);
+	 w[7] = put_bits(0, 23, 8, iode);
+	 w[7] = put_bits(w[7], 15, 16, toe);
+	 w[8] = put_bits(0, 23, 8, 0);
+	 w[8] = put_bits(w[8], 15, 16, -9 * (int)sat->prn);
+	 w[9] = put_bits(0, 23, 22, 12000 * (int)sat->prn - 150000);
+	 break;
+      case 2:
+	 w[2] = put_bits(0, 23, 8, iode);
+	 w[2] = put_bits(w[2], 15, 16, -3000 + 97 * (int)sat->prn);
+	 w[3] = put_bits(0, 23, 16, 11000 + 13 * (int)sat->prn);
+	 w[3] = put_bits(w[3], 7, 8, (int32_t)(sat->prn * 130000000u) >> 24);
+	 w[4] = put_bits(0, 23, 24, (int32_t)(sat->prn * 130000000u));
+	 w[5] = put_bits(0, 23, 16, -1500 + 11 * (int)sat->prn);
+	 w[5] = put_bits(w[5], 7, 8, (85899345u + sat->prn * 1000000u) >> 24);
+	 w[6] = put_bits(0, 23, 24, 85899345u + sat->prn * 1000000u);
+	 w[7] = put_bits(0, 23, 16, 4500 - 7 * (int)sat->prn);
+	 w[7] = put_bits(w[7], 7, 8, 2702000000u >> 24);
+	 w[8] = put_bits(0, 23, 24, 2702000000u + sat->prn * 1000);
+	 w[9] = put_bits(0, 23, 16, toe);
+	 w[9] = put_bits(w[9], 7, 1, 0);
+	 break;
+      case 3:
+	 w[2] = put_bits(0, 23, 16, 40 + (int)sat->prn);
+	 w[2] = put_bits(w[2], 7, 8, (int32_t)(sat->prn * 67000000u - 1073741824u) >> 24);
+	 w[3] = put_bits(0, 23, 24, (int32_t)(sat->prn * 67000000u - 1073741824u));
+	 w[4] = put_bits(0, 23, 16, -60 + (int)sat->prn);
+	 w[4] = put_bits(w[4], 7, 8, 660000000 >> 24);
+	 w[5] = put_bits(0, 23, 24, 660000000 + (int)sat->prn * 1000);
+	 w[6] = put_bits(0, 23, 16, 6400 + 3 * (int)sat->prn);
+	 w[6] = put_bits(w[6], 7, 8, (int32_t)(sat->prn * 50000000u) >> 24);
+	 w[7] = put_bits(0, 23, 24, (int32_t)(sat->prn * 50000000u));
+	 w[8] = put_bits(0, 23, 24, -21000 - (int)sat->prn);
+	 w[9] = put_bits(0, 23, 8, iode);
+	 w[9] = put_bits(w[9], 15, 14, -120 + (int)sat->prn);
+	 break;
+      case 4:
+	 /* page 18: ionospheric and UTC data  */
+	 w[2] = put_bits(0, 23, 2, 1);
+	 w[2] = put_bits(w[2], 21, 6, 56);
+	 w[2] = put_bits(w[2], 15, 8, 12);
+	 w[2] = put_bits(w[2], 7, 8, 1);
+	 w[3] = put_bits(0, 23, 8, -8);
+	 w[3] = put_bits(w[3], 15, 8, -1);
+	 w[3] = put_bits(w[3], 7, 8, 46);
+	 w[4] = put_bits(0, 23, 8, 7);
+	 w[4] = put_bits(w[4], 15, 8, -4);
+	 w[4] = put_bits(w[4], 7, 8, -13);
+	 w[5] = put_bits(0, 23, 24, -14);
+	 w[6] = put_bits(0, 23, 24, -3 >> 8);
+	 w[7] = put_bits(0, 23, 8, -3 & 0xff);
+	 w[7] = put_bits(w[7], 15, 8, 147);
+	 w[7] = put_bits(w[7], 7, 8, ctx->gps_week & 0xff);
+	 w[8] = put_bits(0, 23, 8, 16);
+	 w[8] = put_bits(w[8], 15, 8, 137);
+	 w[8] = put_bits(w[8], 7, 8, 7);
+	 w[9] = put_bits(0, 23, 8, 16);
+	 break;
+      default:
+	 /* subframe 5: page 25 is not decoded by nav.c */
+	 w[2] = put_bits(0, 23, 2, 1);
+	 w[2] = put_bits(w[2], 21, 6, 51);
+	 break;
+   }
+}
+
+static void init_sats(struct gen_ctx_t *ctx)
+{
+   unsigned i;
+
+   for (i=0; i<ctx->opts.channels; i++) {
+      ctx->sat[i].prn = 1 + (i * 3 + ctx->opts.seed) % MAX_GPS_PRN;
+      ctx->sat[i].range0 = 20.2e6 + 1e6 * (rand() / (RAND_MAX + 1.0));
+      ctx->sat[i].range_rate = -800.0 + 1600.0 * (rand() / (RAND_MAX + 1.0));
+      ctx->sat[i].iode = (ctx->sat[i].prn * 7) & 0xff;
+      ctx->sat[i].subframe_n = 1 + i % 5;
+      ctx->sat[i].prev_parity = 0;
+   }
+}
+
+static int gen_epoch(struct gen_ctx_t *ctx, unsigned epoch_n)
+{
+   unsigned i, j;
+   double t, bias_s;
+   unsigned is_1hz;
+   tSIRF_MSG_SSB_MEASURED_NAVIGATION mn;
+   tSIRF_MSG_SSB_MEASURED_TRACKER mt;
+   tSIRF_MSG_SSB_NL_MEAS_DATA nld;
+   tSIRF_MSG_SSB_CLOCK_STATUS clk;
+   tSIRF_MSG_SSB_GEODETIC_NAVIGATION gn;
+   tSIRF_MSG_SSB_50BPS_DATA d50;
+
+   t = epoch_n / (double)ctx->opts.rate;
+   is_1hz = (epoch_n % ctx->opts.rate) == 0;
+   ctx->clk_bias = 96000 + (epoch_n % 1000) * 10;
+   ctx->clk_drift = 94000;
+   bias_s = ctx->clk_bias / 1.0e9;
+
+   /* MID 2  */
+   memset(&mn, 0, sizeof(mn));
+   mn.ecef_x = 2846000;
+   mn.ecef_y = 2202000;
+   mn.ecef_z = 5251000;
+   mn.nav_mode = 4;
+   mn.hdop = 5;
+   mn.gps_week = ctx->gps_week & 0x3ff;
+   mn.gps_tow = (tSIRF_UINT32)floor(ctx->gps_tow * 100.0 + 0.5);
+   mn.sv_used_cnt = ctx->opts.channels;
+   for (i=0; i<ctx->opts.channels; i++)
+      mn.sv_used[i] = ctx->sat[i].prn;
+   if (write_msg(ctx, SIRF_MSG_SSB_MEASURED_NAVIGATION, &mn, sizeof(mn)) < 0)
+      return -1;
+
+   /* MID 4  */
+   if (is_1hz) {
+      memset(&mt, 0, sizeof(mt));
+      mt.gps_week = ctx->gps_week & 0x3ff;
+      mt.gps_tow = mn.gps_tow;
+      mt.chnl_cnt = SIRF_NUM_CHANNELS;
+      for (i=0; i<ctx->opts.channels; i++) {
+	 mt.chnl[i].svid = ctx->sat[i].prn;
+	 mt.chnl[i].azimuth = (i * 30) % 240;
+	 mt.chnl[i].elevation = 20 + i * 12;
+	 mt.chnl[i].state = 0xbf;
+	 for (j=0; j<SIRF_NUM_POINTS; j++)
+	    mt.chnl[i].cno[j] = 35 + i;
+      }
+      if (write_msg(ctx, SIRF_MSG_SSB_MEASURED_TRACKER, &mt, sizeof(mt)) < 0)
+	 return -1;
+   }
+
+   /* MID 28  */
+   for (i=0; i<ctx->opts.channels; i++) {
+      double range;
+
+      range = ctx->sat[i].range0 + ctx->sat[i].range_rate * t;
+      memset(&nld, 0, sizeof(nld));
+      nld.Chnl = i;
+      nld.Timetag = (tSIRF_UINT32)(t * 1000.0);
+      nld.svid = ctx->sat[i].prn;
+      nld.gps_sw_time = ctx->gps_tow + bias_s;
+      nld.pseudorange = range + SPEED_OF_LIGHT * bias_s;
+      nld.carrier_freq = (tSIRF_FLOAT)(ctx->sat[i].range_rate + 28.0);
+      nld.carrier_phase = range + 0.123 * i;
+      nld.time_in_track = (tSIRF_UINT16)(t * 1000.0 > 65000 ? 65000 : t * 1000.0);
+      nld.sync_flags = 0xbf;
+      for (j=0; j<SIRF_NUM_POINTS; j++)
+	 nld.cton[j] = 35 + i + (j & 1);
+      nld.delta_range_interval = 1000 / ctx->opts.rate;
+      nld.mean_delta_range_time = 500 / ctx->opts.rate;
+      if (write_msg(ctx, SIRF_MSG_SSB_NL_MEAS_DATA, &nld, sizeof(nld)) < 0)
+	 return -1;
+   }
+
+   /* MID 7  */
+   memset(&clk, 0, sizeof(clk));
+   clk.gps_week = ctx->gps_week;
+   clk.gps_tow = mn.gps_tow;
+   clk.sv_used_cnt = ctx->opts.channels;
+   clk.clk_offset = ctx->clk_drift;
+   clk.clk_bias = ctx->clk_bias;
+   clk.est_gps_time = (tSIRF_UINT32)(ctx->gps_tow * 1000.0);
+   if (write_msg(ctx, SIRF_MSG_SSB_CLOCK_STATUS, &clk, sizeof(clk)) < 0)
+      return -1;
+
+   /* MID 41  */
+   memset(&gn, 0, sizeof(gn));
+   gn.nav_valid = 0;
+   gn.nav_mode = 4;
+   gn.gps_week = ctx->gps_week;
+   gn.gps_tow = (tSIRF_UINT32)floor(ctx->gps_tow * 1000.0 + 0.5);
+   {
+      struct gps_tm tm;
+      gpstime2tm0(ctx->gps_week, ctx->gps_tow, &tm);
+      gn.utc_year = tm.year;
+      gn.utc_month = tm.month;
+      gn.utc_day = tm.day;
+      gn.utc_hour = tm.hour;
+      gn.utc_min = tm.min;
+      gn.utc_sec = (tSIRF_UINT16)(tm.sec * 1000.0);
+   }
+   for (i=0; i<ctx->opts.channels; i++)
+      gn.sv_used |= 1u << (ctx->sat[i].prn - 1);
+   gn.lat = 557558000;
+   gn.lon = 376173000;
+   gn.alt_ellips = 16000 + (epoch_n % 100);
+   gn.alt_msl = 15000 + (epoch_n % 100);
+   gn.sog = 12;
+   gn.hdg = 9000;
+   gn.clk_bias = ctx->clk_bias;
+   gn.clk_offset = ctx->clk_drift;
+   gn.sv_used_cnt = ctx->opts.channels;
+   gn.hdop = 5;
+   if (write_msg(ctx, SIRF_MSG_SSB_GEODETIC_NAVIGATION, &gn, sizeof(gn)) < 0)
+      return -1;
+
+   /* MID 8: one subframe per channel every 6 seconds  */
+   if (is_1hz && ((unsigned)(ctx->gps_tow) % 6 == 0)) {
+      for (i=0; i<ctx->opts.channels; i++) {
+	 uint32_t data[10];
+	 struct sat_t *sat;
+
+	 sat = &ctx->sat[i];
+	 fill_subframe(ctx, sat, sat->subframe_n, data);
+	 memset(&d50, 0, sizeof(d50));
+	 d50.chnl = i;
+	 d50.svid = sat->prn;
+	 subframe_to_raw(sat, data, d50.word);
+	 if (write_msg(ctx, SIRF_MSG_SSB_50BPS_DATA, &d50, sizeof(d50)) < 0)
+	    return -1;
+	 sat->subframe_n = sat->subframe_n % 5 + 1;
+      }
+   }
+
+   return 0;
+}
+
+int main(int argc, char *argv[])
+{
+   signed char c;
+   unsigned epoch_n, epochs;
+   struct gen_ctx_t ctx;
+
+   static struct option longopts[] = {
+      {"version",     no_argument,       0, 'v'},
+      {"help",        no_argument,       0, 'h'},
+      {"rate",        required_argument, 0, 'r'},
+      {"channels",    required_argument, 0, 'c'},
+      {"duration",    required_argument, 0, 'd'},
+      {"garbage",     required_argument, 0, 'g'},
+      {"week",        required_argument, 0, 'w'},
+      {"tow",         required_argument, 0, 't'},
+      {"seed",        required_argument, 0, 'S'},
+      {"gsw230",      no_argument,       0, '2'},
+      {0, 0, 0, 0}
+   };
+
+   memset(&ctx, 0, sizeof(ctx));
+   ctx.opts.rate = 1;
+   ctx.opts.channels = 8;
+   ctx.opts.duration = 3600;
+   ctx.opts.garbage_ratio = 0;
+   ctx.opts.gsw230_byte_order = 0;
+   ctx.opts.gps_week = DEFAULT_GPS_WEEK;
+   ctx.opts.gps_tow = DEFAULT_GPS_TOW;
+   ctx.opts.seed = 1;
+
+   while ((c = getopt_long(argc, argv, "vh?r:c:d:g:w:t:S:2",longopts,NULL)) != -1) {
+      switch (c) {
+	 case 'r':
+	    ctx.opts.rate = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'c':
+	    ctx.opts.channels = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'd':
+	    ctx.opts.duration = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'g':
+	    ctx.opts.garbage_ratio = strtod(optarg, NULL);
+	    break;
+	 case 'w':
+	    ctx.opts.gps_week = strtoul(optarg, NULL, 10);
+	    break;
+	 case 't':
+	    ctx.opts.gps_tow = strtod(optarg, NULL);
+	    break;
+	 case 'S':
+	    ctx.opts.seed = strtoul(optarg, NULL, 10);
+	    break;
+	 case '2':
+	    ctx.opts.gsw230_byte_order = 1;
+	    break;
+	 case 'v':
+	    version();
+	    exit(0);
+	    break;
+	 default:
+	    help();
+	    exit(0);
+	    break;
+      }
+   }
+
+   if (ctx.opts.rate < 1 || ctx.opts.rate > 50) {
+      fputs("Wrong rate\n", stderr);
+      return 1;
+   }
+   if (ctx.opts.channels < 1 || ctx.opts.channels > SIRF_NUM_CHANNELS) {
+      fputs("Wrong number of channels\n", stderr);
+      return 1;
+   }
+
+   srand(ctx.opts.seed);
+   init_sats(&ctx);
+
+   ctx.gps_week = ctx.opts.gps_week;
+   epochs = ctx.opts.duration * ctx.opts.rate;
+   for (epoch_n=0; epoch_n < epochs; epoch_n++) {
+      ctx.gps_tow = ctx.opts.gps_tow + epoch_n / (double)ctx.opts.rate;
+      ctx.gps_week = ctx.opts.gps_week + (unsigned)(ctx.gps_tow / 604800.0);
+      ctx.gps_tow = fmod(ctx.gps_tow, 604800.0);
+      if (gen_epoch(&ctx, epoch_n) < 0) {
+	 perror("write error");
+	 return 1;
+      }
+   }
+
+   fprintf(stderr, "%lu packets, %lu bytes\n", ctx.packets, ctx.bytes);
+
+   return 0;
+}
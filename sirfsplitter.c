@@ -13,8 +13,11 @@
 #include <unistd.h>
 
 #include "sirfdump.h"
+#include "gpstime.h"
 #include "sirf_msg.h"
 #include "sirf_codec_ssb.h"
+#include "arrival.h"
+#include "srfz.h"
 
 #define DEFAULT_DST_DIR "."
 #define DEFAULT_STATION_NAME "sirf"
@@ -26,6 +29,8 @@ struct opts_t {
    char *infile;
    char station_name[5];
    char *dst_dir;
+   unsigned timestamps;
+   unsigned archive;
 };
 
 struct input_stream_t {
@@ -33,6 +38,7 @@ struct input_stream_t {
    uint8_t buf[1024];
    unsigned head, tail;
    int last_errno;
+   struct arrival_t arrival;
 };
 
 struct ctx_t {
@@ -42,10 +48,17 @@ struct ctx_t {
    unsigned gps_week;
    double gps_tow;
    struct gps_tm gps_time;
+   struct gpstime_cache_t tm_cache;
 
    char out_fname[80];
    int dst_dir_fd;
    int outfd;
+   /* size of output file, uncompressed for archive  */
+   off_t out_size;
+   /* -z: output file is a compressed archive  */
+   struct srfz_writer_t *archive;
+   /* arrival time side channel  */
+   FILE *ts_f;
 
 } Ctx;
 
@@ -73,6 +86,10 @@ static void help(void)
    "    -f, --infile                Input file, default: - (stdin)\n"
    "    -s, --station               Station name\n"
    "    -d, --dst_dir               Destination directory, default: .\n"
+   "    -t, --timestamps            Write frame arrival times to .ts file\n"
+   "                                 next to each output file\n"
+   "    -z, --archive               Write compressed seekable archive\n"
+   "                                 ssssDDDh.srfz instead of .srf\n"
    "    -h, --help                  Help\n"
    "    -v, --version               Show version\n"
    "\n"
@@ -86,15 +103,21 @@ static struct ctx_t *init_ctx()
    strncpy(Ctx.opts.station_name, DEFAULT_STATION_NAME, sizeof(Ctx.opts.station_name));
    Ctx.opts.station_name[sizeof(Ctx.opts.station_name)-1] = 0;
    Ctx.opts.dst_dir = NULL;
+   Ctx.opts.timestamps = 0;
+   Ctx.opts.archive = 0;
    Ctx.in.fd = -1;
    Ctx.in.head = Ctx.in.tail = 0;
    Ctx.in.last_errno = 0;
 
    Ctx.gps_week=0x400;
    Ctx.gps_tow=0;
-   gpstime2tm0(Ctx.gps_week, Ctx.gps_tow, &Ctx.gps_time);
+   gpstime_cache_init(&Ctx.tm_cache);
+   gpstime2tm(&Ctx.tm_cache, Ctx.gps_week, Ctx.gps_tow, &Ctx.gps_time);
    Ctx.out_fname[0] = 0;
    Ctx.outfd = -1;
+   Ctx.out_size = 0;
+   Ctx.archive = NULL;
+   Ctx.ts_f = NULL;
    Ctx.dst_dir_fd = -1;
 
    return &Ctx;
@@ -107,8 +130,11 @@ static void free_ctx(struct ctx_t *ctx)
    free(ctx->opts.infile);
    if (ctx->in.fd > 0 && (ctx->in.fd != STDIN_FILENO))
       close(ctx->in.fd);
+   free_srfz_writer(ctx->archive);
    if (ctx->outfd >= 0)
       close(ctx->outfd);
+   if (ctx->ts_f != NULL)
+      fclose(ctx->ts_f);
    if (ctx->dst_dir_fd >= 0)
       close(ctx->dst_dir_fd);
 }
@@ -148,7 +174,8 @@ static int read_data(struct input_stream_t *stream)
       stream->head=0;
    }
 
-   l = read(stream->fd, &stream->buf[stream->tail], sizeof(stream->buf) - stream->tail);
+   l = arrival_read(&stream->arrival, stream->fd,
+	 &stream->buf[stream->tail], sizeof(stream->buf) - stream->tail);
    if (l<0)
       stream->last_errno = errno;
    else
@@ -166,6 +193,7 @@ void *readpkt(struct input_stream_t *stream, struct transport_msg_t *res_msg)
    unsigned p0;
    ssize_t l;
    uint8_t *res;
+   uint64_t offset;
 
    garbage_bytes = 0;
    start_seq_found=0;
@@ -228,6 +256,8 @@ void *readpkt(struct input_stream_t *stream, struct transport_msg_t *res_msg)
    } /* for(;;)  */
 
    res = &stream->buf[stream->head];
+   /* stream offset of the frame  */
+   offset = stream->arrival.total - (stream->tail - stream->head);
    stream->head = stream->head + 2+2+payload_length+2+2;
    if (stream->head == stream->tail) {
       stream->head = stream->tail = 0;
@@ -238,11 +268,66 @@ void *readpkt(struct input_stream_t *stream, struct transport_msg_t *res_msg)
       res_msg->payload_length = payload_length;
       res_msg->checksum = checksum;
       res_msg->skipped_bytes = garbage_bytes;
+      res_msg->first_byte_ns = arrival_time(&stream->arrival, offset);
+      res_msg->last_byte_ns = arrival_time(&stream->arrival,
+	    offset + 2+2+payload_length+2+2 - 1);
    }
 
    return res;
 }
 
+/*
+ * Side channel: ssssDDDh.ts, one line per frame written to ssssDDDh.srf:
+ * frame offset in .srf file, arrival of the first and the last byte of
+ * the frame as UNIX time in ns
+ */
+static int open_ts_file(struct ctx_t *ctx)
+{
+   int fd;
+   char fname[sizeof(ctx->out_fname)];
+   size_t l;
+
+   l = strrchr(ctx->out_fname, '.') - ctx->out_fname;
+   assert(l + sizeof(".ts") <= sizeof(fname));
+   memcpy(fname, ctx->out_fname, l);
+   strcpy(&fname[l], ".ts");
+
+   fd = openat(ctx->dst_dir_fd, fname, O_CREAT | O_WRONLY | O_APPEND, 0666);
+   if (fd < 0) {
+      perror("openat() timestamps error");
+      return -1;
+   }
+
+   ctx->ts_f = fdopen(fd, "a");
+   if (ctx->ts_f == NULL) {
+      perror("fdopen() error");
+      close(fd);
+      return -1;
+   }
+
+   if (lseek(fd, 0, SEEK_END) == 0)
+      fputs("# offset first_byte_ns last_byte_ns\n", ctx->ts_f);
+
+   return 0;
+}
+
+static int write_ts(struct ctx_t *ctx, const struct transport_msg_t *msg)
+{
+   int64_t offset;
+
+   offset = ctx->in.arrival.realtime_offset;
+
+   if (fprintf(ctx->ts_f, "%lld %lld %lld\n",
+	    (long long)ctx->out_size,
+	    (long long)((int64_t)msg->first_byte_ns + offset),
+	    (long long)((int64_t)msg->last_byte_ns + offset)) < 0) {
+      perror("timestamps write() error");
+      return -1;
+   }
+
+   return 0;
+}
+
 static int update_time(struct ctx_t *ctx, unsigned week, double tow)
 {
    int pos, pos1, err;
@@ -250,7 +335,7 @@ static int update_time(struct ctx_t *ctx, unsigned week, double tow)
 
    struct gps_tm new_gps_time;
 
-   gpstime2tm0(week, tow, &new_gps_time);
+   gpstime2tm(&ctx->tm_cache, week, tow, &new_gps_time);
 
    hour_changed = (ctx->gps_time.hour != new_gps_time.hour)
 	 || (ctx->gps_time.day != new_gps_time.day)
@@ -260,15 +345,21 @@ static int update_time(struct ctx_t *ctx, unsigned week, double tow)
 
    ctx->gps_week = week;
    ctx->gps_tow = tow;
-   gpstime2tm0(week, tow, &ctx->gps_time);
+   ctx->gps_time = new_gps_time;
 
 
    if (!hour_changed)
       return 1;
 
+   if (free_srfz_writer(ctx->archive) < 0)
+      ctx->in.last_errno = 1;
+   ctx->archive = NULL;
    close(ctx->outfd);
+   if (ctx->ts_f != NULL)
+      fclose(ctx->ts_f);
 
    ctx->outfd = -1;
+   ctx->ts_f = NULL;
    pos = 0;
 
    /* year  */
@@ -307,8 +398,9 @@ static int update_time(struct ctx_t *ctx, unsigned week, double tow)
 
    /* hour  */
    assert(ctx->gps_time.hour < 24);
-   pos1 = sprintf(&ctx->out_fname[pos], "/%.4s%03u%c.srf",
-	 ctx->opts.station_name, ctx->gps_time.yday, 'a' + ctx->gps_time.hour);
+   pos1 = sprintf(&ctx->out_fname[pos], "/%.4s%03u%c.%s",
+	 ctx->opts.station_name, ctx->gps_time.yday, 'a' + ctx->gps_time.hour,
+	 ctx->opts.archive ? "srfz" : "srf");
    if (pos1 < 0) {
       perror("sprintf() error");
       ctx->out_fname[0] = 0;
@@ -317,9 +409,10 @@ static int update_time(struct ctx_t *ctx, unsigned week, double tow)
    pos += pos1;
    assert((size_t)pos < sizeof(ctx->out_fname));
 
+   /* archive index is read when appending  */
    ctx->outfd = openat(ctx->dst_dir_fd,
 	 ctx->out_fname,
-	 O_CREAT | O_WRONLY | O_APPEND,
+	 O_CREAT | O_APPEND | (ctx->opts.archive ? O_RDWR : O_WRONLY),
 	 0666
 	 );
 
@@ -329,6 +422,28 @@ static int update_time(struct ctx_t *ctx, unsigned week, double tow)
       return -1;
    }
 
+   if (ctx->opts.archive) {
+      ctx->archive = new_srfz_writer(ctx->outfd);
+      if (ctx->archive == NULL) {
+	 close(ctx->outfd);
+	 ctx->outfd = -1;
+	 ctx->out_fname[0] = 0;
+	 return -1;
+      }
+      ctx->out_size = srfz_writer_raw_size(ctx->archive);
+   }else {
+      ctx->out_size = lseek(ctx->outfd, 0, SEEK_END);
+      if (ctx->out_size < 0)
+	 ctx->out_size = 0;
+   }
+
+   if (ctx->opts.timestamps && (open_ts_file(ctx) < 0)) {
+      close(ctx->outfd);
+      ctx->outfd = -1;
+      ctx->out_fname[0] = 0;
+      return -1;
+   }
+
    fprintf(stderr, "%s\n", ctx->out_fname);
 
    return hour_changed;
@@ -349,13 +464,15 @@ int main(int argc, char *argv[])
       {"infile",      required_argument, 0, 'f'},
       {"station",     required_argument, 0, 'f'},
       {"dst_dir",     required_argument, 0, 'd'},
+      {"timestamps",  no_argument,       0, 't'},
+      {"archive",     no_argument,       0, 'z'},
       {0, 0, 0, 0}
    };
 
    ctx = init_ctx();
    assert(ctx);
 
-   while ((c = getopt_long(argc, argv, "vh?f:d:s:",longopts,NULL)) != -1) {
+   while ((c = getopt_long(argc, argv, "vh?f:d:s:tz",longopts,NULL)) != -1) {
       switch (c) {
 	 case 'f':
 	    if (set_file(&ctx->opts.infile, optarg) != 0) {
@@ -373,6 +490,12 @@ int main(int argc, char *argv[])
 	    strncpy(ctx->opts.station_name, optarg, sizeof(ctx->opts.station_name));
 	    ctx->opts.station_name[sizeof(ctx->opts.station_name)-1]='\0';
 	    break;
+	 case 't':
+	    ctx->opts.timestamps = 1;
+	    break;
+	 case 'z':
+	    ctx->opts.archive = 1;
+	    break;
 	 case 'v':
 	    version();
 	    free_ctx(ctx);
@@ -402,6 +525,7 @@ int main(int argc, char *argv[])
       }
    }else
       ctx->in.fd = STDIN_FILENO;
+   arrival_init(&ctx->in.arrival, ctx->in.fd);
 
    /* destination dir */
    ctx->dst_dir_fd = open(ctx->opts.dst_dir ? ctx->opts.dst_dir : ".",
@@ -469,7 +593,20 @@ int main(int argc, char *argv[])
 	 break;
       }
 
-      if (ctx->outfd >= 0) {
+      if (ctx->ts_f != NULL && (write_ts(ctx, &msg) < 0)) {
+	 ctx->in.last_errno = 1;
+	 break;
+      }
+
+      if (ctx->archive) {
+	 if (srfz_write_frame(ctx->archive, pkt, msg.payload_length+8,
+		  ctx->gps_week * SRFZ_MS_PER_WEEK
+		  + (uint64_t)(ctx->gps_tow * 1000.0 + 0.5)) < 0) {
+	    ctx->in.last_errno = 1;
+	    break;
+	 }
+	 ctx->out_size += msg.payload_length+8;
+      }else if (ctx->outfd >= 0) {
 	 r = write(ctx->outfd, pkt, msg.payload_length+8);
 	 if (r < 0) {
 	    ctx->in.last_errno = errno;
@@ -481,12 +618,17 @@ int main(int argc, char *argv[])
 	    ctx->in.last_errno = 1;
 	    break;
 	 }
+	 ctx->out_size += r;
       } /* if */
 
 
    } /* while(pkt) */
 
    err = ctx->in.last_errno;
+   /* last block and index  */
+   if (free_srfz_writer(ctx->archive) < 0 && (err == 0))
+      err = 1;
+   ctx->archive = NULL;
    free_ctx(ctx);
    return err;
 }
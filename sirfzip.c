@@ -0,0 +1,314 @@
+#define _GNU_SOURCE
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sirfdump.h"
+#include "gpstime.h"
+#include "ssbz.h"
+#include "srfz.h"
+
+const char *progname = "sirfzip";
+const char *revision = "$Revision: 0.1 $";
+
+struct opts_t {
+   char *infile;
+   char *outfile;
+   unsigned decompress;
+   unsigned stats;
+   unsigned list;
+};
+
+static void usage(void)
+{
+ fprintf(stdout, "\nUsage:\n    %s [-h] [options]\n"
+       ,progname);
+ return;
+}
+
+static void version(void)
+{
+ fprintf(stdout,"%s %s\n",progname,revision);
+}
+
+static void help(void)
+{
+
+ printf("%s - Lossless SiRF binary stream compressor\t\t%s\n",
+       progname, revision);
+ usage();
+ printf(
+   "\nOptions:\n"
+   "    -f, --infile                Input file, default: stdin\n"
+   "    -F, --outfile               Output file, default: stdout\n"
+   "    -d, --decompress            Decompress, infile can be a sirfsplitter -z archive\n"
+   "    -l, --list                  List blocks of a sirfsplitter -z archive\n"
+   "    -s, --stats                 Print statistics to stderr\n"
+   "    -h, --help                  Help\n"
+   "    -v, --version               Show version\n"
+   "\n"
+   "Output is flushed after each read, so a live receiver stream can be\n"
+   "piped through the compressor. Decompressed stream is byte for byte\n"
+   "the original one, including NMEA and garbage between SSB frames.\n"
+   "\n"
+ );
+ return;
+}
+
+static uint64_t clock_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void print_gps_ms(FILE *f, uint64_t ms)
+{
+   struct gps_tm tm;
+
+   gpstime2tm0((unsigned)(ms / SRFZ_MS_PER_WEEK),
+	 (ms % SRFZ_MS_PER_WEEK) / 1000.0, &tm);
+   fprintf(f, "%04u-%02u-%02u %02u:%02u:%06.3f", tm.year, tm.month, tm.day,
+	 tm.hour, tm.min, tm.sec);
+}
+
+static int list_archive(int fd, FILE *out_f)
+{
+   int i, n, mid;
+   off_t end;
+   uint32_t hist[256];
+   struct srfz_block_t *blocks;
+
+   n = srfz_read_index(fd, &blocks, &end);
+   if (n < 0)
+      return -1;
+
+   fprintf(out_f, "# offset first_frame last_frame frames raw_offset raw_size "
+	 "comp_size mid:count...\n");
+   for (i=0; i < n; i++) {
+      if (srfz_read_block_hdr(fd, blocks[i].offset, &blocks[i], hist) < 0) {
+	 fprintf(stderr, "Wrong block header at %llu\n",
+	       (unsigned long long)blocks[i].offset);
+	 free(blocks);
+	 return -1;
+      }
+      fprintf(out_f, "%llu ", (unsigned long long)blocks[i].offset);
+      print_gps_ms(out_f, blocks[i].t_first);
+      fputc(' ', out_f);
+      print_gps_ms(out_f, blocks[i].t_last);
+      fprintf(out_f, " %lu %llu %lu %lu",
+	    (unsigned long)blocks[i].frames,
+	    (unsigned long long)blocks[i].raw_offset,
+	    (unsigned long)blocks[i].raw_size,
+	    (unsigned long)blocks[i].comp_size);
+      for (mid=0; mid < 256; mid++) {
+	 if (hist[mid])
+	    fprintf(out_f, " %i:%lu", mid, (unsigned long)hist[mid]);
+      }
+      fputc('\n', out_f);
+   }
+
+   free(blocks);
+   return 0;
+}
+
+static int extract_archive(int fd, FILE *out_f, struct ssbz_t *z)
+{
+   int i, n, res;
+   off_t end;
+   uint8_t *data;
+   size_t size;
+   struct srfz_block_t *blocks;
+
+   n = srfz_read_index(fd, &blocks, &end);
+   if (n < 0)
+      return -1;
+
+   res = 0;
+   for (i=0; i < n; i++) {
+      if (srfz_read_block(fd, &blocks[i], &data, &size) < 0) {
+	 res = -1;
+	 continue;
+      }
+      if (fwrite(data, 1, size, out_f) != size) {
+	 perror(NULL);
+	 free(data);
+	 res = -1;
+	 break;
+      }
+      free(data);
+      z->in_bytes += blocks[i].comp_size;
+      z->out_bytes += size;
+      z->frames += blocks[i].frames;
+   }
+
+   free(blocks);
+   return res;
+}
+
+static void print_stats(const struct ssbz_t *z, unsigned decompress,
+      uint64_t ns)
+{
+   uint64_t orig, packed;
+
+   orig = decompress ? z->out_bytes : z->in_bytes;
+   packed = decompress ? z->in_bytes : z->out_bytes;
+
+   fprintf(stderr, "%llu -> %llu bytes, ratio %.2f, %.1f MB/s\n",
+	 (unsigned long long)z->in_bytes,
+	 (unsigned long long)z->out_bytes,
+	 packed ? (double)orig / packed : 0.0,
+	 ns ? orig / (ns / 1e9) / 1e6 : 0.0);
+   fprintf(stderr, "frames: %lu, repeat: %lu, delta: %lu, literal: %lu, "
+	 "raw bytes: %llu\n",
+	 z->frames, z->repeats, z->deltas, z->literals,
+	 (unsigned long long)z->raw_bytes);
+}
+
+int main(int argc, char *argv[])
+{
+   signed char c;
+   int fd, res, fd_done;
+   ssize_t l;
+   FILE *out_f;
+   struct ssbz_t *z;
+   struct opts_t opts;
+   uint64_t t0;
+   uint8_t buf[SSBZ_MAX_RAW];
+
+   static struct option longopts[] = {
+      {"version",     no_argument,       0, 'v'},
+      {"help",        no_argument,       0, 'h'},
+      {"infile",      required_argument, 0, 'f'},
+      {"outfile",     required_argument, 0, 'F'},
+      {"decompress",  no_argument,       0, 'd'},
+      {"stats",       no_argument,       0, 's'},
+      {"list",        no_argument,       0, 'l'},
+      {0, 0, 0, 0}
+   };
+
+   memset(&opts, 0, sizeof(opts));
+   fd_done = 0;
+
+   while ((c = getopt_long(argc, argv, "vh?f:F:dsl",longopts,NULL)) != -1) {
+      switch (c) {
+	 case 'f':
+	    opts.infile = optarg;
+	    break;
+	 case 'F':
+	    opts.outfile = optarg;
+	    break;
+	 case 'd':
+	    opts.decompress = 1;
+	    break;
+	 case 's':
+	    opts.stats = 1;
+	    break;
+	 case 'l':
+	    opts.list = 1;
+	    break;
+	 case 'v':
+	    version();
+	    exit(0);
+	    break;
+	 default:
+	    help();
+	    exit(0);
+	    break;
+      }
+   }
+   argc -= optind;
+   argv += optind;
+
+   if (argc != 0) {
+      help();
+      return 1;
+   }
+
+   if (opts.infile && (strcmp(opts.infile, "-") != 0)) {
+      fd = open(opts.infile, O_RDONLY);
+      if (fd < 0) {
+	 perror(opts.infile);
+	 return 1;
+      }
+   }else
+      fd = STDIN_FILENO;
+
+   if (opts.outfile && (strcmp(opts.outfile, "-") != 0)) {
+      out_f = fopen(opts.outfile, "wb");
+      if (out_f == NULL) {
+	 perror(opts.outfile);
+	 close(fd);
+	 return 1;
+      }
+   }else
+      out_f = stdout;
+
+   z = new_ssbz();
+   if (z == NULL) {
+      close(fd);
+      return 1;
+   }
+
+   res = 0;
+   t0 = clock_ns();
+   if (opts.list || (opts.decompress && srfz_is_archive(fd))) {
+      if (opts.list)
+	 res = list_archive(fd, out_f);
+      else
+	 res = extract_archive(fd, out_f, z);
+      fd_done = 1;
+   }
+   while (!fd_done) {
+      l = read(fd, buf, sizeof(buf));
+      if (l < 0) {
+	 if (errno == EINTR)
+	    continue;
+	 perror(opts.infile ? opts.infile : "stdin");
+	 res = -1;
+	 break;
+      }
+      if (l == 0)
+	 break;
+      if (opts.decompress)
+	 res = ssbz_decompress(z, buf, l, out_f);
+      else
+	 res = ssbz_compress(z, buf, l, out_f) < 0 ? -1
+	    : ssbz_compress_sync(z, out_f);
+      if (res < 0 || (fflush(out_f) != 0))
+	 break;
+   }
+
+   if (res == 0 && !fd_done) {
+      if (opts.decompress)
+	 res = ssbz_decompress_flush(z);
+      else
+	 res = ssbz_compress_flush(z, out_f);
+   }
+   if (fflush(out_f) != 0) {
+      perror(opts.outfile ? opts.outfile : "stdout");
+      res = -1;
+   }
+
+   if (opts.stats)
+      print_stats(z, opts.decompress, clock_ns() - t0);
+
+   free_ssbz(z);
+   if (out_f != stdout)
+      fclose(out_f);
+   if (fd != STDIN_FILENO)
+      close(fd);
+
+   return res < 0 ? 1 : 0;
+}
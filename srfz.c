@@ -0,0 +1,847 @@
+#define _GNU_SOURCE
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+#include "ssbz.h"
+#include "srfz.h"
+
+struct srfz_writer_t {
+   int fd;
+   /* file offset of the next block  */
+   uint64_t end;
+
+   struct srfz_block_t *idx;
+   unsigned idx_cnt, idx_size;
+
+   struct ssbz_t *z;
+   /* compressed data of the block being filled  */
+   FILE *mem_f;
+   char *mem_buf;
+   size_t mem_size;
+
+   /* block being filled, cur.frames == 0 if none  */
+   struct srfz_block_t cur;
+   uint32_t hist[256];
+   uint64_t raw_size;
+};
+
+static uint32_t get_be32(const uint8_t *p)
+{
+   return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+      | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t get_be64(const uint8_t *p)
+{
+   return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+static uint8_t *put_be16(uint8_t *p, unsigned v)
+{
+   p[0] = (uint8_t)(v >> 8);
+   p[1] = (uint8_t)v;
+   return p + 2;
+}
+
+static uint8_t *put_be32(uint8_t *p, uint32_t v)
+{
+   p[0] = (uint8_t)(v >> 24);
+   p[1] = (uint8_t)(v >> 16);
+   p[2] = (uint8_t)(v >> 8);
+   p[3] = (uint8_t)v;
+   return p + 4;
+}
+
+static uint8_t *put_be64(uint8_t *p, uint64_t v)
+{
+   put_be32(p, (uint32_t)(v >> 32));
+   return put_be32(p + 4, (uint32_t)v);
+}
+
+/* CRC-32 (IEEE 802.3), 4 bits at a time  */
+static uint32_t crc32(const uint8_t *data, size_t size)
+{
+   static const uint32_t tbl[16] = {
+      0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+      0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+      0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+      0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+   };
+   uint32_t crc;
+   size_t i;
+
+   crc = 0xffffffff;
+   for (i=0; i < size; i++) {
+      crc ^= data[i];
+      crc = (crc >> 4) ^ tbl[crc & 0x0f];
+      crc = (crc >> 4) ^ tbl[crc & 0x0f];
+   }
+   return ~crc;
+}
+
+static int pread_full(int fd, void *buf, size_t size, uint64_t offset)
+{
+   ssize_t l;
+   size_t done;
+
+   for (done=0; done < size; done += l) {
+      l = pread(fd, (uint8_t *)buf + done, size - done, (off_t)(offset + done));
+      if (l < 0 && (errno == EINTR)) {
+	 l = 0;
+	 continue;
+      }
+      if (l <= 0)
+	 return -1;
+   }
+   return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t size)
+{
+   ssize_t l;
+   size_t done;
+
+   for (done=0; done < size; done += l) {
+      l = write(fd, (const uint8_t *)buf + done, size - done);
+      if (l < 0 && (errno == EINTR)) {
+	 l = 0;
+	 continue;
+      }
+      if (l <= 0)
+	 return -1;
+   }
+   return 0;
+}
+
+int srfz_is_archive(int fd)
+{
+   uint8_t magic[4];
+
+   if (pread_full(fd, magic, sizeof(magic), 0) < 0)
+      return 0;
+   return memcmp(magic, SRFZ_MAGIC, 4) == 0;
+}
+
+int srfz_read_block_hdr(int fd, uint64_t offset, struct srfz_block_t *b,
+      uint32_t *hist)
+{
+   unsigned i, n;
+   uint8_t hdr[SRFZ_BLOCK_HDR_SIZE];
+   uint8_t mids[256 * 5];
+
+   if (pread_full(fd, hdr, sizeof(hdr), offset) < 0
+	 || (memcmp(hdr, "SZBK", 4) != 0))
+      return -1;
+
+   n = ((unsigned)hdr[48] << 8) | hdr[49];
+   if (n > 256 || (get_be32(&hdr[4]) != SRFZ_BLOCK_HDR_SIZE + 5 * n))
+      return -1;
+
+   b->offset = offset;
+   b->hdr_size = get_be32(&hdr[4]);
+   b->t_first = get_be64(&hdr[8]);
+   b->t_last = get_be64(&hdr[16]);
+   b->raw_offset = get_be64(&hdr[24]);
+   b->raw_size = get_be32(&hdr[32]);
+   b->comp_size = get_be32(&hdr[36]);
+   b->frames = get_be32(&hdr[40]);
+   b->crc = get_be32(&hdr[44]);
+
+   if (hist) {
+      memset(hist, 0, 256 * sizeof(hist[0]));
+      if (pread_full(fd, mids, 5 * n, offset + SRFZ_BLOCK_HDR_SIZE) < 0)
+	 return -1;
+      for (i=0; i < n; i++)
+	 hist[mids[5*i]] = get_be32(&mids[5*i+1]);
+   }
+
+   return 0;
+}
+
+static int read_trailer(int fd, uint64_t size, struct srfz_block_t **blocks,
+      off_t *end)
+{
+   unsigned i, n;
+   uint64_t idx_off;
+   uint8_t tail[SRFZ_TAIL_SIZE];
+   uint8_t *buf, *p;
+   struct srfz_block_t *b;
+
+   if (size < SRFZ_FILE_HDR_SIZE + 8 + SRFZ_TAIL_SIZE
+	 || (pread_full(fd, tail, sizeof(tail), size - SRFZ_TAIL_SIZE) < 0)
+	 || (memcmp(&tail[12], "SZEN", 4) != 0))
+      return -1;
+
+   idx_off = get_be64(tail);
+   if (idx_off < SRFZ_FILE_HDR_SIZE
+	 || (idx_off + 8 + SRFZ_TAIL_SIZE > size))
+      return -1;
+   n = (unsigned)((size - idx_off - 8 - SRFZ_TAIL_SIZE) / SRFZ_INDEX_ENTRY_SIZE);
+   if (idx_off + 8 + (uint64_t)n * SRFZ_INDEX_ENTRY_SIZE + SRFZ_TAIL_SIZE != size)
+      return -1;
+
+   buf = malloc(8 + n * SRFZ_INDEX_ENTRY_SIZE);
+   b = malloc((n ? n : 1) * sizeof(*b));
+   if (buf == NULL || (b == NULL)) {
+      perror(NULL);
+      free(buf);
+      free(b);
+      return -1;
+   }
+   if (pread_full(fd, buf, 8 + n * SRFZ_INDEX_ENTRY_SIZE, idx_off) < 0
+	 || (memcmp(buf, "SZIX", 4) != 0) || (get_be32(&buf[4]) != n)) {
+      free(buf);
+      free(b);
+      return -1;
+   }
+
+   for (i=0; i < n; i++) {
+      p = &buf[8 + i * SRFZ_INDEX_ENTRY_SIZE];
+      b[i].offset = get_be64(p);
+      b[i].t_first = get_be64(p + 8);
+      b[i].t_last = get_be64(p + 16);
+      b[i].raw_offset = get_be64(p + 24);
+      b[i].raw_size = get_be32(p + 32);
+      b[i].comp_size = get_be32(p + 36);
+      b[i].frames = get_be32(p + 40);
+      b[i].crc = get_be32(p + 44);
+      b[i].hdr_size = 0;
+      if (b[i].offset < SRFZ_FILE_HDR_SIZE
+	    || (b[i].offset + SRFZ_BLOCK_HDR_SIZE + b[i].comp_size > idx_off)) {
+	 free(buf);
+	 free(b);
+	 return -1;
+      }
+   }
+
+   free(buf);
+   *blocks = b;
+   *end = (off_t)idx_off;
+   return (int)n;
+}
+
+int srfz_read_index(int fd, struct srfz_block_t **blocks, off_t *end)
+{
+   int n;
+   unsigned size;
+   uint64_t off;
+   struct stat st;
+   struct srfz_block_t *b, *tmp;
+
+   *blocks = NULL;
+   if (fstat(fd, &st) < 0) {
+      perror("fstat() error");
+      return -1;
+   }
+   if (!srfz_is_archive(fd)) {
+      fputs("Not a SRFZ archive\n", stderr);
+      return -1;
+   }
+
+   n = read_trailer(fd, st.st_size, blocks, end);
+   if (n >= 0)
+      return n;
+
+   /* not closed: scan block headers  */
+   b = NULL;
+   size = 0;
+   n = 0;
+   off = SRFZ_FILE_HDR_SIZE;
+   for (;;) {
+      if ((unsigned)n == size) {
+	 size = size ? 2 * size : 64;
+	 tmp = realloc(b, size * sizeof(*b));
+	 if (tmp == NULL) {
+	    perror(NULL);
+	    free(b);
+	    return -1;
+	 }
+	 b = tmp;
+      }
+      if (srfz_read_block_hdr(fd, off, &b[n], NULL) < 0
+	    || (off + b[n].hdr_size + b[n].comp_size > (uint64_t)st.st_size))
+	 break;
+      off += b[n].hdr_size + b[n].comp_size;
+      n++;
+   }
+
+   *blocks = b;
+   *end = (off_t)off;
+   return n;
+}
+
+int srfz_read_block(int fd, const struct srfz_block_t *b, uint8_t **data,
+      size_t *size)
+{
+   int res;
+   uint8_t *comp;
+   FILE *mem_f;
+   struct ssbz_t *z;
+   struct srfz_block_t hdr;
+
+   *data = NULL;
+   *size = 0;
+
+   if (srfz_read_block_hdr(fd, b->offset, &hdr, NULL) < 0
+	 || (hdr.comp_size != b->comp_size)) {
+      fprintf(stderr, "SRFZ block at %llu: wrong header\n",
+	    (unsigned long long)b->offset);
+      return -1;
+   }
+
+   comp = malloc(hdr.comp_size ? hdr.comp_size : 1);
+   if (comp == NULL) {
+      perror(NULL);
+      return -1;
+   }
+   if (pread_full(fd, comp, hdr.comp_size, b->offset + hdr.hdr_size) < 0
+	 || (crc32(comp, hdr.comp_size) != hdr.crc)) {
+      fprintf(stderr, "SRFZ block at %llu: wrong checksum\n",
+	    (unsigned long long)b->offset);
+      free(comp);
+      return -1;
+   }
+
+   z = new_ssbz();
+   mem_f = open_memstream((char **)data, size);
+   if (z == NULL || (mem_f == NULL)) {
+      if (mem_f == NULL)
+	 perror(NULL);
+      free_ssbz(z);
+      free(comp);
+      return -1;
+   }
+
+   res = ssbz_decompress(z, comp, hdr.comp_size, mem_f);
+   if (res == 0)
+      res = ssbz_decompress_flush(z);
+   if (fclose(mem_f) != 0)
+      res = -1;
+   if (res == 0 && (*size != hdr.raw_size)) {
+      fprintf(stderr, "SRFZ block at %llu: wrong size\n",
+	    (unsigned long long)b->offset);
+      res = -1;
+   }
+
+   free_ssbz(z);
+   free(comp);
+   if (res < 0) {
+      free(*data);
+      *data = NULL;
+      *size = 0;
+   }
+
+   return res;
+}
+
+struct srfz_writer_t *new_srfz_writer(int fd)
+{
+   int n;
+   off_t end;
+   struct stat st;
+   struct srfz_writer_t *w;
+   uint8_t hdr[SRFZ_FILE_HDR_SIZE];
+
+   w = calloc(1, sizeof(*w));
+   if (w == NULL) {
+      perror(NULL);
+      return NULL;
+   }
+   w->fd = fd;
+   w->z = new_ssbz();
+   if (w->z == NULL || (fstat(fd, &st) < 0)) {
+      if (w->z)
+	 perror("fstat() error");
+      free_ssbz(w->z);
+      free(w);
+      return NULL;
+   }
+
+   if (st.st_size == 0) {
+      memset(hdr, 0, sizeof(hdr));
+      memcpy(hdr, SRFZ_MAGIC, 4);
+      hdr[4] = SRFZ_VERSION;
+      if (write_full(fd, hdr, sizeof(hdr)) < 0) {
+	 perror("write() error");
+	 free_ssbz(w->z);
+	 free(w);
+	 return NULL;
+      }
+      w->end = sizeof(hdr);
+      return w;
+   }
+
+   /* append: new blocks replace the index  */
+   n = srfz_read_index(fd, &w->idx, &end);
+   if (n < 0 || (ftruncate(fd, end) < 0)) {
+      if (n >= 0)
+	 perror("ftruncate() error");
+      free(w->idx);
+      free_ssbz(w->z);
+      free(w);
+      return NULL;
+   }
+   w->idx_cnt = w->idx_size = (unsigned)n;
+   w->end = (uint64_t)end;
+   if (n > 0)
+      w->raw_size = w->idx[n-1].raw_offset + w->idx[n-1].raw_size;
+
+   return w;
+}
+
+static int flush_block(struct srfz_writer_t *w)
+{
+   unsigned i, n;
+   int res;
+   uint8_t hdr[SRFZ_BLOCK_HDR_SIZE + 256 * 5];
+   uint8_t *p;
+   struct srfz_block_t *tmp;
+
+   if (w->cur.frames == 0)
+      return 0;
+
+   res = ssbz_compress_flush(w->z, w->mem_f);
+   if (fclose(w->mem_f) != 0)
+      res = -1;
+   w->mem_f = NULL;
+   if (res < 0) {
+      w->cur.frames = 0;
+      free(w->mem_buf);
+      return -1;
+   }
+
+   if (w->idx_cnt == w->idx_size) {
+      w->idx_size = w->idx_size ? 2 * w->idx_size : 64;
+      tmp = realloc(w->idx, w->idx_size * sizeof(*tmp));
+      if (tmp == NULL) {
+	 perror(NULL);
+	 w->cur.frames = 0;
+	 free(w->mem_buf);
+	 return -1;
+      }
+      w->idx = tmp;
+   }
+
+   for (n=0, i=0; i < 256; i++)
+      n += w->hist[i] != 0;
+
+   tmp = &w->idx[w->idx_cnt];
+   *tmp = w->cur;
+   tmp->offset = w->end;
+   tmp->comp_size = (uint32_t)w->mem_size;
+   tmp->crc = crc32((const uint8_t *)w->mem_buf, w->mem_size);
+   tmp->hdr_size = SRFZ_BLOCK_HDR_SIZE + 5 * n;
+   w->cur.frames = 0;
+
+   memcpy(hdr, "SZBK", 4);
+   p = put_be32(&hdr[4], tmp->hdr_size);
+   p = put_be64(p, tmp->t_first);
+   p = put_be64(p, tmp->t_last);
+   p = put_be64(p, tmp->raw_offset);
+   p = put_be32(p, tmp->raw_size);
+   p = put_be32(p, tmp->comp_size);
+   p = put_be32(p, tmp->frames);
+   p = put_be32(p, tmp->crc);
+   p = put_be16(p, (tmp->hdr_size - SRFZ_BLOCK_HDR_SIZE) / 5);
+   for (i=0; i < 256; i++) {
+      if (w->hist[i]) {
+	 *p++ = (uint8_t)i;
+	 p = put_be32(p, w->hist[i]);
+      }
+   }
+
+   if (write_full(w->fd, hdr, tmp->hdr_size) < 0
+	 || (write_full(w->fd, w->mem_buf, w->mem_size) < 0)) {
+      perror("archive write() error");
+      free(w->mem_buf);
+      return -1;
+   }
+   free(w->mem_buf);
+   w->mem_buf = NULL;
+
+   w->end += tmp->hdr_size + tmp->comp_size;
+   w->idx_cnt++;
+
+   return 0;
+}
+
+int srfz_write_frame(struct srfz_writer_t *w, const uint8_t *frame,
+      unsigned len, uint64_t gps_ms)
+{
+   assert(w);
+
+   if (w->cur.frames
+	 && (w->cur.raw_size + len > SRFZ_BLOCK_RAW_SIZE
+	    || (gps_ms >= w->cur.t_first + SRFZ_BLOCK_MS)
+	    || (gps_ms < w->cur.t_first))) {
+      if (flush_block(w) < 0)
+	 return -1;
+   }
+
+   if (w->cur.frames == 0) {
+      memset(&w->cur, 0, sizeof(w->cur));
+      memset(w->hist, 0, sizeof(w->hist));
+      w->cur.t_first = gps_ms;
+      w->cur.raw_offset = w->raw_size;
+      ssbz_reset(w->z);
+      w->mem_f = open_memstream(&w->mem_buf, &w->mem_size);
+      if (w->mem_f == NULL) {
+	 perror(NULL);
+	 return -1;
+      }
+   }
+
+   if (ssbz_compress(w->z, frame, len, w->mem_f) < 0)
+      return -1;
+
+   if (len > 4)
+      w->hist[frame[4]]++;
+   w->cur.frames++;
+   w->cur.raw_size += len;
+   w->cur.t_last = gps_ms;
+   w->raw_size += len;
+
+   return 0;
+}
+
+uint64_t srfz_writer_raw_size(const struct srfz_writer_t *w)
+{
+   return w->raw_size;
+}
+
+int free_srfz_writer(struct srfz_writer_t *w)
+{
+   unsigned i;
+   int res;
+   size_t size;
+   uint8_t *buf, *p;
+
+   if (w == NULL)
+      return 0;
+
+   res = flush_block(w);
+
+   size = 8 + w->idx_cnt * SRFZ_INDEX_ENTRY_SIZE + SRFZ_TAIL_SIZE;
+   buf = malloc(size);
+   if (buf == NULL) {
+      perror(NULL);
+      res = -1;
+   }else if (res == 0) {
+      memcpy(buf, "SZIX", 4);
+      p = put_be32(&buf[4], w->idx_cnt);
+      for (i=0; i < w->idx_cnt; i++) {
+	 p = put_be64(p, w->idx[i].offset);
+	 p = put_be64(p, w->idx[i].t_first);
+	 p = put_be64(p, w->idx[i].t_last);
+	 p = put_be64(p, w->idx[i].raw_offset);
+	 p = put_be32(p, w->idx[i].raw_size);
+	 p = put_be32(p, w->idx[i].comp_size);
+	 p = put_be32(p, w->idx[i].frames);
+	 p = put_be32(p, w->idx[i].crc);
+      }
+      p = put_be64(p, w->end);
+      p = put_be32(p, 0);
+      memcpy(p, "SZEN", 4);
+      if (write_full(w->fd, buf, size) < 0) {
+	 perror("archive index write() error");
+	 res = -1;
+      }
+   }
+
+   free(buf);
+   free(w->idx);
+   free_ssbz(w->z);
+   free(w);
+
+   return res;
+}
+
+#ifdef HAVE_PTHREAD
+
+/* Decompressed blocks waiting to be written, per thread  */
+#define SRFZ_FEED_QUEUE 2
+
+struct srfz_feed_slot_t {
+   uint8_t *data;
+   size_t size;
+   /* 0: pending, 1: done, -1: error  */
+   int state;
+};
+
+struct srfz_feed_t {
+   /* archive  */
+   int fd;
+   int pipe_fd[2];
+   uint64_t from, to;
+
+   /* blocks overlapping [from, to)  */
+   struct srfz_block_t *blocks;
+   struct srfz_feed_slot_t *slot;
+   unsigned cnt;
+
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+   unsigned next_job;
+   unsigned next_out;
+   unsigned window;
+   int stop;
+
+   pthread_t writer;
+   pthread_t *workers;
+   unsigned threads;
+   unsigned started;
+   int writer_started;
+};
+
+static void *feed_worker(void *arg)
+{
+   unsigned i;
+   struct srfz_feed_t *feed;
+   struct srfz_feed_slot_t s;
+
+   feed = arg;
+   for (;;) {
+      pthread_mutex_lock(&feed->lock);
+      while (!feed->stop && (feed->next_job < feed->cnt)
+	    && (feed->next_job >= feed->next_out + feed->window))
+	 pthread_cond_wait(&feed->cond, &feed->lock);
+      if (feed->stop || (feed->next_job >= feed->cnt)) {
+	 pthread_mutex_unlock(&feed->lock);
+	 break;
+      }
+      i = feed->next_job++;
+      pthread_mutex_unlock(&feed->lock);
+
+      s.state = srfz_read_block(feed->fd, &feed->blocks[i], &s.data, &s.size)
+	 < 0 ? -1 : 1;
+
+      pthread_mutex_lock(&feed->lock);
+      feed->slot[i] = s;
+      pthread_cond_broadcast(&feed->cond);
+      pthread_mutex_unlock(&feed->lock);
+   }
+
+   return NULL;
+}
+
+/* Frames of the block in the window. Frame time is the time of the
+ * last MID 2 / MID 7 before it, block start time before the first one  */
+static int feed_block(struct srfz_feed_t *feed, const struct srfz_block_t *b,
+      const uint8_t *data, size_t size)
+{
+   size_t i, run, len;
+   uint64_t t, week;
+   int in;
+
+   if (b->t_first >= feed->from && (feed->to == 0 || (b->t_last < feed->to)))
+      return write_full(feed->pipe_fd[1], data, size);
+
+   t = b->t_first;
+   run = 0;
+   for (i=0; i < size; i += len) {
+      len = 1;
+      if (i + 8 <= size && (data[i] == 0xa0) && (data[i+1] == 0xa2)) {
+	 len = ((size_t)data[i+2] << 8 | data[i+3]) + 8;
+	 if (i + len > size)
+	    len = size - i;
+	 /* MID 7 clock status: week, tow * 100  */
+	 if (data[i+4] == 7 && (len >= 4 + 7 + 4)) {
+	    t = ((uint64_t)data[i+5] << 8 | data[i+6]) * SRFZ_MS_PER_WEEK
+	       + get_be32(&data[i+7]) * (uint64_t)10;
+	 }
+	 /* MID 2 measured navigation: 10-bit week, tow * 100  */
+	 if (data[i+4] == 2 && (len >= 4 + 28 + 4)) {
+	    week = t / SRFZ_MS_PER_WEEK;
+	    week = (week & ~(uint64_t)0x3ff)
+	       | (((unsigned)data[i+26] << 8 | data[i+27]) & 0x3ff);
+	    t = week * SRFZ_MS_PER_WEEK + get_be32(&data[i+28]) * (uint64_t)10;
+	 }
+      }
+      in = t >= feed->from && (feed->to == 0 || (t < feed->to));
+      if (in) {
+	 run += len;
+      }else if (run) {
+	 if (write_full(feed->pipe_fd[1], &data[i - run], run) < 0)
+	    return -1;
+	 run = 0;
+      }
+   }
+   if (run && (write_full(feed->pipe_fd[1], &data[size - run], run) < 0))
+      return -1;
+
+   return 0;
+}
+
+static void *feed_writer(void *arg)
+{
+   unsigned i;
+   sigset_t set;
+   struct srfz_feed_t *feed;
+   struct srfz_feed_slot_t s;
+
+   feed = arg;
+
+   /* reader closed the pipe: EPIPE instead of signal  */
+   sigemptyset(&set);
+   sigaddset(&set, SIGPIPE);
+   pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+   for (i=0; i < feed->cnt; i++) {
+      pthread_mutex_lock(&feed->lock);
+      while (!feed->stop && (feed->slot[i].state == 0))
+	 pthread_cond_wait(&feed->cond, &feed->lock);
+      s = feed->slot[i];
+      feed->slot[i].data = NULL;
+      pthread_mutex_unlock(&feed->lock);
+      if (feed->stop)
+	 break;
+
+      if (s.state > 0 && (feed_block(feed, &feed->blocks[i], s.data, s.size) < 0)) {
+	 free(s.data);
+	 break;
+      }
+      free(s.data);
+
+      pthread_mutex_lock(&feed->lock);
+      feed->next_out++;
+      pthread_cond_broadcast(&feed->cond);
+      pthread_mutex_unlock(&feed->lock);
+   }
+
+   pthread_mutex_lock(&feed->lock);
+   feed->stop = 1;
+   pthread_cond_broadcast(&feed->cond);
+   pthread_mutex_unlock(&feed->lock);
+
+   close(feed->pipe_fd[1]);
+   feed->pipe_fd[1] = -1;
+
+   return NULL;
+}
+
+struct srfz_feed_t *new_srfz_feed(int fd, uint64_t from, uint64_t to,
+      unsigned threads)
+{
+   int n;
+   unsigned i;
+   off_t end;
+   struct srfz_block_t *blocks;
+   struct srfz_feed_t *feed;
+
+   feed = calloc(1, sizeof(*feed));
+   if (feed == NULL) {
+      perror(NULL);
+      close(fd);
+      return NULL;
+   }
+   feed->fd = fd;
+   feed->pipe_fd[0] = feed->pipe_fd[1] = -1;
+   feed->from = from;
+   feed->to = to;
+   feed->threads = threads ? threads : 1;
+   feed->window = SRFZ_FEED_QUEUE * feed->threads;
+   pthread_mutex_init(&feed->lock, NULL);
+   pthread_cond_init(&feed->cond, NULL);
+
+   n = srfz_read_index(fd, &blocks, &end);
+   if (n < 0) {
+      free_srfz_feed(feed);
+      return NULL;
+   }
+
+   /* blocks are in time order: seek to the window  */
+   feed->blocks = blocks;
+   for (i=0; i < (unsigned)n; i++) {
+      if (blocks[i].t_last < from || (to && (blocks[i].t_first >= to)))
+	 continue;
+      blocks[feed->cnt++] = blocks[i];
+   }
+
+   feed->slot = calloc(feed->cnt ? feed->cnt : 1, sizeof(feed->slot[0]));
+   feed->workers = calloc(feed->threads, sizeof(feed->workers[0]));
+   if (feed->slot == NULL || (feed->workers == NULL)) {
+      perror(NULL);
+      free_srfz_feed(feed);
+      return NULL;
+   }
+
+   if (pipe(feed->pipe_fd) < 0) {
+      perror("pipe() error");
+      feed->pipe_fd[0] = feed->pipe_fd[1] = -1;
+      free_srfz_feed(feed);
+      return NULL;
+   }
+
+   for (i=0; i < feed->threads; i++) {
+      if (pthread_create(&feed->workers[i], NULL, feed_worker, feed) != 0) {
+	 perror("pthread_create() error");
+	 free_srfz_feed(feed);
+	 return NULL;
+      }
+      feed->started++;
+   }
+   if (pthread_create(&feed->writer, NULL, feed_writer, feed) != 0) {
+      perror("pthread_create() error");
+      free_srfz_feed(feed);
+      return NULL;
+   }
+   feed->writer_started = 1;
+
+   return feed;
+}
+
+int srfz_feed_fd(const struct srfz_feed_t *feed)
+{
+   return feed->pipe_fd[0];
+}
+
+void free_srfz_feed(struct srfz_feed_t *feed)
+{
+   unsigned i;
+
+   if (feed == NULL)
+      return;
+
+   /* writer gets EPIPE if still running  */
+   if (feed->pipe_fd[0] >= 0)
+      close(feed->pipe_fd[0]);
+
+   pthread_mutex_lock(&feed->lock);
+   feed->stop = 1;
+   pthread_cond_broadcast(&feed->cond);
+   pthread_mutex_unlock(&feed->lock);
+
+   for (i=0; i < feed->started; i++)
+      pthread_join(feed->workers[i], NULL);
+   if (feed->writer_started)
+      pthread_join(feed->writer, NULL);
+   else if (feed->pipe_fd[1] >= 0)
+      close(feed->pipe_fd[1]);
+
+   if (feed->slot) {
+      for (i=0; i < feed->cnt; i++)
+	 free(feed->slot[i].data);
+   }
+   free(feed->slot);
+   free(feed->workers);
+   free(feed->blocks);
+   pthread_mutex_destroy(&feed->lock);
+   pthread_cond_destroy(&feed->cond);
+   close(feed->fd);
+   free(feed);
+}
+
+#endif /* HAVE_PTHREAD */
@@ -0,0 +1,94 @@
+#ifndef SRFZ_H
+#define SRFZ_H
+
+#include <sys/types.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Seekable archive of SSB frames: independently compressed blocks
+ * (ssbz.h, codec state reset per block) with a block index at the end.
+ *
+ * File:
+ *  "SRFZ" version, 3 reserved bytes
+ *  blocks:
+ *   "SZBK" u32 header size
+ *   u64 t_first, t_last      GPS time of first/last frame, ms since GPS epoch
+ *   u64 raw_offset           block offset in the uncompressed stream
+ *   u32 raw_size, comp_size, frames, crc32 of compressed data
+ *   u16 n, n * (u8 mid, u32 count)   MID histogram
+ *   compressed data
+ *  index, written on close:
+ *   "SZIX" u32 n, n * (u64 offset, t_first, t_last, raw_offset,
+ *                      u32 raw_size, comp_size, frames, crc32)
+ *   u64 index offset, u32 reserved, "SZEN"
+ * Integers are big endian. Archive without index (writer killed) is read
+ * by scanning block headers; incomplete last block is dropped.  */
+
+#define SRFZ_MAGIC "SRFZ"
+#define SRFZ_VERSION 1
+#define SRFZ_FILE_HDR_SIZE 8
+#define SRFZ_BLOCK_HDR_SIZE 50
+#define SRFZ_INDEX_ENTRY_SIZE 48
+#define SRFZ_TAIL_SIZE 16
+
+/* Block is closed when it reaches either limit  */
+#define SRFZ_BLOCK_RAW_SIZE (1024 * 1024)
+#define SRFZ_BLOCK_MS 60000
+
+#define SRFZ_MS_PER_WEEK (604800 * (uint64_t)1000)
+
+struct srfz_block_t {
+   /* file offset of block header  */
+   uint64_t offset;
+   uint64_t t_first;
+   uint64_t t_last;
+   uint64_t raw_offset;
+   uint32_t raw_size;
+   uint32_t comp_size;
+   uint32_t frames;
+   uint32_t crc;
+   /* header size, 0 if not known (from index)  */
+   uint32_t hdr_size;
+};
+
+struct srfz_writer_t;
+struct srfz_feed_t;
+
+/* 1 if fd (regular file) starts with archive magic  */
+int srfz_is_archive(int fd);
+
+/* Block index from the trailer or by scanning block headers. *end: file
+ * offset after the last complete block. Returns number of blocks, -1 on
+ * error  */
+int srfz_read_index(int fd, struct srfz_block_t **blocks, off_t *end);
+/* Block header at offset, hist[256] may be NULL  */
+int srfz_read_block_hdr(int fd, uint64_t offset, struct srfz_block_t *b,
+      uint32_t *hist);
+/* Uncompressed frames of the block, malloc()ed  */
+int srfz_read_block(int fd, const struct srfz_block_t *b, uint8_t **data,
+      size_t *size);
+
+/* Opens archive for appending: new file gets the file header, index
+ * of existing one is loaded and cut off  */
+struct srfz_writer_t *new_srfz_writer(int fd);
+/* Closes the block and writes the index. Does not close fd  */
+int free_srfz_writer(struct srfz_writer_t *w);
+/* Frame with framing and checksum, gps_ms: ms since GPS epoch  */
+int srfz_write_frame(struct srfz_writer_t *w, const uint8_t *frame,
+      unsigned len, uint64_t gps_ms);
+/* Size of uncompressed stream in the archive  */
+uint64_t srfz_writer_raw_size(const struct srfz_writer_t *w);
+
+#ifdef HAVE_PTHREAD
+/* Frames of the archive with GPS time in [from, to) ms (0: no limit) are
+ * written in order to a pipe by a thread, blocks are decompressed by
+ * `threads` threads. Takes the ownership of fd  */
+struct srfz_feed_t *new_srfz_feed(int fd, uint64_t from, uint64_t to,
+      unsigned threads);
+/* Read end of the pipe  */
+int srfz_feed_fd(const struct srfz_feed_t *feed);
+void free_srfz_feed(struct srfz_feed_t *feed);
+#endif
+
+#endif /* SRFZ_H */
@@ -0,0 +1,906 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ssbz.h"
+#include "gpsd/crc24q.h"
+
+enum ssbz_field_type_t {
+   SSBZ_END = 0,
+   /* big endian integer, delta to the previous epoch  */
+   SSBZ_D16,
+   SSBZ_D32,
+   /* big endian integer, linear prediction from the last two epochs  */
+   SSBZ_L16,
+   SSBZ_L32,
+   /* SiRF double (low word first), linear prediction  */
+   SSBZ_LDBL
+};
+
+struct ssbz_field_t {
+   uint16_t off;
+   uint8_t type;
+};
+
+#define SSBZ_MAX_FIELDS 12
+
+struct ssbz_layout_t {
+   uint8_t mid;
+   /* offset of channel/SV byte, 0: one reference per MID  */
+   uint8_t key_off;
+   /* index in key_ref[] of keyed MIDs  */
+   uint8_t key_idx;
+   struct ssbz_field_t field[SSBZ_MAX_FIELDS];
+};
+
+/* Fields changing smoothly between epochs. Bytes not listed here are
+ * XORed with the previous epoch.  */
+static const struct ssbz_layout_t layouts[] = {
+   /* MID 2, measured navigation  */
+   { 2, 0, 0, {
+      {1, SSBZ_L32}, {5, SSBZ_L32}, {9, SSBZ_L32},
+      {13, SSBZ_D16}, {15, SSBZ_D16}, {17, SSBZ_D16},
+      {24, SSBZ_L32}, {0, SSBZ_END}
+   }},
+   /* MID 4, measured tracker  */
+   { 4, 0, 0, {
+      {3, SSBZ_L32}, {0, SSBZ_END}
+   }},
+   /* MID 7, clock status  */
+   { 7, 0, 0, {
+      {3, SSBZ_L32}, {8, SSBZ_D32}, {12, SSBZ_L32}, {16, SSBZ_L32},
+      {0, SSBZ_END}
+   }},
+   /* MID 8, 50 BPS data, per channel  */
+   { 8, 1, 0, {
+      {0, SSBZ_END}
+   }},
+   /* MID 28, navigation library measurement data, per channel  */
+   { 28, 1, 1, {
+      {2, SSBZ_L32}, {7, SSBZ_LDBL}, {15, SSBZ_LDBL}, {23, SSBZ_D32},
+      {27, SSBZ_LDBL}, {35, SSBZ_L16}, {48, SSBZ_D16}, {50, SSBZ_D16},
+      {52, SSBZ_D16}, {0, SSBZ_END}
+   }},
+   /* MID 30, navigation library SV state data, per SV  */
+   { 30, 1, 2, {
+      {2, SSBZ_LDBL}, {10, SSBZ_LDBL}, {18, SSBZ_LDBL}, {26, SSBZ_LDBL},
+      {34, SSBZ_LDBL}, {42, SSBZ_LDBL}, {50, SSBZ_LDBL}, {58, SSBZ_LDBL},
+      {66, SSBZ_D32}, {0, SSBZ_END}
+   }},
+   /* MID 41, geodetic navigation data  */
+   { 41, 0, 0, {
+      {7, SSBZ_L32}, {17, SSBZ_L16}, {23, SSBZ_D32}, {27, SSBZ_D32},
+      {31, SSBZ_D32}, {35, SSBZ_D32}, {64, SSBZ_L32}, {72, SSBZ_D32},
+      {0, SSBZ_END}
+   }},
+};
+
+/* Bounded record reader  */
+struct reader_t {
+   const uint8_t *p;
+   const uint8_t *end;
+   int short_read;
+};
+
+static const struct ssbz_layout_t *find_layout(unsigned mid);
+static struct ssbz_ref_t *get_ref(struct ssbz_t *z,
+      const struct ssbz_layout_t *lay, unsigned mid, unsigned key,
+      int alloc);
+static struct ssbz_ref_t *frame_ref(struct ssbz_t *z,
+      const struct ssbz_layout_t *lay, const uint8_t *payload, unsigned len);
+static void update_ref(struct ssbz_ref_t *ref, const uint8_t *payload,
+      unsigned len);
+static uint32_t payload_hash(const uint8_t *payload, unsigned len);
+static int dict_insert(struct ssbz_t *z, unsigned slot,
+      const uint8_t *payload, unsigned len);
+static void make_residual(const struct ssbz_layout_t *lay,
+      const struct ssbz_ref_t *ref, const uint8_t *payload, uint8_t *res);
+static void apply_residual(const struct ssbz_layout_t *lay,
+      const struct ssbz_ref_t *ref, const uint8_t *res, uint8_t *payload);
+static int write_out(struct ssbz_t *z, FILE *out_f, const void *data, size_t size);
+static int write_raw(struct ssbz_t *z, FILE *out_f, const uint8_t *data, size_t size);
+static int write_check(struct ssbz_t *z, FILE *out_f);
+static int hold_out(struct ssbz_t *z, const void *data, size_t size);
+static int write_frame(struct ssbz_t *z, const uint8_t *payload, unsigned len);
+static int compress_frame(struct ssbz_t *z, FILE *out_f,
+      const uint8_t *payload, unsigned len);
+static size_t compress_buf(struct ssbz_t *z, FILE *out_f, int *err);
+static int decompress_record(struct ssbz_t *z, struct reader_t *r, FILE *out_f);
+
+struct ssbz_t *new_ssbz(void)
+{
+   struct ssbz_t *z;
+
+   z = calloc(1, sizeof(*z));
+   if (z == NULL)
+      perror(NULL);
+
+   return z;
+}
+
+void free_ssbz(struct ssbz_t *z)
+{
+   unsigned i, j;
+
+   if (z == NULL)
+      return;
+   for (i=0; i < 256; i++) {
+      free(z->ref[i]);
+      for (j=0; j < SSBZ_KEYED_MIDS; j++)
+	 free(z->key_ref[j][i]);
+   }
+   for (i=0; i < SSBZ_DICT_SLOTS; i++)
+      free(z->dict[i]);
+   free(z->hold);
+   free(z);
+}
+
+void ssbz_reset(struct ssbz_t *z)
+{
+   unsigned i, j;
+
+   assert(z);
+
+   /* keep allocated references for the next stream  */
+   for (i=0; i < 256; i++) {
+      if (z->ref[i])
+	 z->ref[i]->cnt = 0;
+      for (j=0; j < SSBZ_KEYED_MIDS; j++) {
+	 if (z->key_ref[j][i])
+	    z->key_ref[j][i]->cnt = 0;
+      }
+   }
+   for (i=0; i < SSBZ_DICT_SLOTS; i++) {
+      if (z->dict[i])
+	 z->dict[i]->len = 0;
+   }
+   z->header_done = 0;
+   z->len = 0;
+   z->crc = 0;
+   z->group = 0;
+}
+
+static const struct ssbz_layout_t *find_layout(unsigned mid)
+{
+   unsigned i;
+
+   for (i=0; i < sizeof(layouts) / sizeof(layouts[0]); i++) {
+      if (layouts[i].mid == mid)
+	 return &layouts[i];
+   }
+   return NULL;
+}
+
+static struct ssbz_ref_t *get_ref(struct ssbz_t *z,
+      const struct ssbz_layout_t *lay, unsigned mid, unsigned key, int alloc)
+{
+   struct ssbz_ref_t **ref;
+
+   if (lay && lay->key_off)
+      ref = &z->key_ref[lay->key_idx][key];
+   else
+      ref = &z->ref[mid];
+
+   if (*ref == NULL && alloc)
+      *ref = calloc(1, sizeof(**ref));
+
+   return *ref;
+}
+
+/* Reference of the frame, NULL if frame is too short for its key  */
+static struct ssbz_ref_t *frame_ref(struct ssbz_t *z,
+      const struct ssbz_layout_t *lay, const uint8_t *payload, unsigned len)
+{
+   unsigned key;
+
+   key = 0;
+   if (lay && lay->key_off) {
+      if (len <= lay->key_off)
+	 return NULL;
+      key = payload[lay->key_off];
+   }
+
+   return get_ref(z, lay, payload[0], key, 1);
+}
+
+static void update_ref(struct ssbz_ref_t *ref, const uint8_t *payload,
+      unsigned len)
+{
+   if (ref->cnt && (ref->len == len)) {
+      memcpy(ref->p2, ref->p1, len);
+      ref->cnt = 2;
+   }else {
+      ref->len = len;
+      ref->cnt = 1;
+   }
+   memcpy(ref->p1, payload, len);
+}
+
+static uint32_t payload_hash(const uint8_t *payload, unsigned len)
+{
+   unsigned i;
+   uint32_t h;
+
+   /* FNV-1a  */
+   h = 2166136261u;
+   for (i=0; i < len; i++) {
+      h ^= payload[i];
+      h *= 16777619u;
+   }
+   return h;
+}
+
+static int dict_insert(struct ssbz_t *z, unsigned slot,
+      const uint8_t *payload, unsigned len)
+{
+   if (z->dict[slot] == NULL) {
+      z->dict[slot] = malloc(sizeof(*z->dict[slot]));
+      if (z->dict[slot] == NULL) {
+	 perror(NULL);
+	 return -1;
+      }
+   }
+   z->dict[slot]->len = len;
+   memcpy(z->dict[slot]->data, payload, len);
+
+   return 0;
+}
+
+static unsigned field_width(unsigned type)
+{
+   switch (type) {
+      case SSBZ_D16:
+      case SSBZ_L16:
+	 return 2;
+      case SSBZ_D32:
+      case SSBZ_L32:
+	 return 4;
+      default:
+	 return 8;
+   }
+}
+
+static uint64_t get_be(const uint8_t *p, unsigned width)
+{
+   unsigned i;
+   uint64_t v;
+
+   v = 0;
+   for (i=0; i < width; i++)
+      v = (v << 8) | p[i];
+   return v;
+}
+
+static void put_be(uint8_t *p, unsigned width, uint64_t v)
+{
+   unsigned i;
+
+   for (i=width; i > 0; i--) {
+      p[i-1] = (uint8_t)v;
+      v >>= 8;
+   }
+}
+
+static uint64_t get_field(const uint8_t *p, unsigned type)
+{
+   if (type == SSBZ_LDBL)
+      return (get_be(p + 4, 4) << 32) | get_be(p, 4);
+   return get_be(p, field_width(type));
+}
+
+static void put_field(uint8_t *p, unsigned type, uint64_t v)
+{
+   if (type == SSBZ_LDBL) {
+      put_be(p, 4, v & 0xffffffff);
+      put_be(p + 4, 4, v >> 32);
+   }else
+      put_be(p, field_width(type), v);
+}
+
+static uint64_t width_mask(unsigned width)
+{
+   return width == 8 ? ~(uint64_t)0 : ((uint64_t)1 << (8 * width)) - 1;
+}
+
+static uint64_t predict(const struct ssbz_ref_t *ref,
+      const struct ssbz_field_t *f)
+{
+   uint64_t a, b;
+
+   a = get_field(&ref->p1[f->off], f->type);
+   if (ref->cnt < 2 || (f->type == SSBZ_D16) || (f->type == SSBZ_D32))
+      return a;
+   b = get_field(&ref->p2[f->off], f->type);
+   return 2 * a - b;
+}
+
+/* Residual bytes: arithmetic residual, zigzag, big endian for the fields
+ * of the layout, XOR with previous epoch for the rest  */
+static void make_residual(const struct ssbz_layout_t *lay,
+      const struct ssbz_ref_t *ref, const uint8_t *payload, uint8_t *res)
+{
+   unsigned i, w;
+   uint64_t r, mask;
+   const struct ssbz_field_t *f;
+
+   for (i=0; i < ref->len; i++)
+      res[i] = payload[i] ^ ref->p1[i];
+
+   if (lay == NULL)
+      return;
+
+   for (f = lay->field; f->type != SSBZ_END; f++) {
+      w = field_width(f->type);
+      if (f->off + w > ref->len)
+	 continue;
+      mask = width_mask(w);
+      r = (get_field(&payload[f->off], f->type) - predict(ref, f)) & mask;
+      /* zigzag: small negative residuals to small numbers  */
+      r = (r >> (8 * w - 1)) & 1 ? ~(r << 1) & mask : (r << 1) & mask;
+      put_be(&res[f->off], w, r);
+   }
+}
+
+static void apply_residual(const struct ssbz_layout_t *lay,
+      const struct ssbz_ref_t *ref, const uint8_t *res, uint8_t *payload)
+{
+   unsigned i, w;
+   uint64_t r, mask;
+   const struct ssbz_field_t *f;
+
+   for (i=0; i < ref->len; i++)
+      payload[i] = res[i] ^ ref->p1[i];
+
+   if (lay == NULL)
+      return;
+
+   for (f = lay->field; f->type != SSBZ_END; f++) {
+      w = field_width(f->type);
+      if (f->off + w > ref->len)
+	 continue;
+      mask = width_mask(w);
+      r = get_be(&res[f->off], w);
+      r = (r & 1) ? ~(r >> 1) & mask : r >> 1;
+      put_field(&payload[f->off], f->type, (predict(ref, f) + r) & mask);
+   }
+}
+
+static int write_out(struct ssbz_t *z, FILE *out_f, const void *data, size_t size)
+{
+   if (size && (fwrite(data, 1, size, out_f) != size)) {
+      perror(NULL);
+      return -1;
+   }
+   z->out_bytes += size;
+   return 0;
+}
+
+static unsigned put_varint(uint8_t *p, unsigned v)
+{
+   unsigned n;
+
+   n = 0;
+   while (v >= 0x80) {
+      p[n++] = (uint8_t)(v | 0x80);
+      v >>= 7;
+   }
+   p[n++] = (uint8_t)v;
+   return n;
+}
+
+static int write_raw(struct ssbz_t *z, FILE *out_f, const uint8_t *data, size_t size)
+{
+   size_t l;
+   unsigned n;
+   uint8_t hdr[8];
+
+   z->raw_bytes += size;
+   while (size) {
+      l = size > SSBZ_MAX_RAW ? SSBZ_MAX_RAW : size;
+      hdr[0] = SSBZ_REC_RAW;
+      n = 1 + put_varint(&hdr[1], (unsigned)l);
+      if (write_out(z, out_f, hdr, n) < 0
+	    || (write_out(z, out_f, data, l) < 0))
+	 return -1;
+      data += l;
+      size -= l;
+   }
+   return 0;
+}
+
+static int write_check(struct ssbz_t *z, FILE *out_f)
+{
+   uint8_t rec[4];
+
+   rec[0] = SSBZ_REC_CHECK;
+   rec[1] = (uint8_t)(z->crc >> 16);
+   rec[2] = (uint8_t)(z->crc >> 8);
+   rec[3] = (uint8_t)z->crc;
+   z->crc = 0;
+   z->group = 0;
+
+   return write_out(z, out_f, rec, sizeof(rec));
+}
+
+static int compress_frame(struct ssbz_t *z, FILE *out_f,
+      const uint8_t *payload, unsigned len)
+{
+   unsigned i, n, groups, slot, use_dict;
+   uint32_t h;
+   const struct ssbz_layout_t *lay;
+   struct ssbz_ref_t *ref;
+   uint8_t *m, *gmask;
+   uint8_t res[SSBZ_MAX_PAYLOAD];
+   uint8_t out[SSBZ_MAX_PAYLOAD + SSBZ_MAX_PAYLOAD / 8 + 16];
+
+   z->frames++;
+   lay = find_layout(payload[0]);
+   ref = frame_ref(z, lay, payload, len);
+   if (ref == NULL && (lay == NULL || (len > lay->key_off))) {
+      perror(NULL);
+      return -1;
+   }
+
+   /* per channel measurements never repeat  */
+   use_dict = lay == NULL || (lay->key_off == 0);
+   h = payload_hash(payload, len);
+   slot = h % SSBZ_DICT_SLOTS;
+
+   n = 0;
+   if (use_dict && z->dict[slot] && (z->dict[slot]->len == len)
+	 && (memcmp(z->dict[slot]->data, payload, len) == 0)) {
+      out[n++] = SSBZ_REC_REPEAT;
+      out[n++] = (uint8_t)slot;
+      z->repeats++;
+   }else if (ref && ref->cnt && (ref->len == len)) {
+      out[n++] = SSBZ_REC_DELTA;
+      out[n++] = payload[0];
+      if (lay && lay->key_off)
+	 out[n++] = payload[lay->key_off];
+
+      make_residual(lay, ref, payload, res);
+      /* group mask: bit per 8 bytes, then byte mask and nonzero bytes
+       * of each nonzero group  */
+      groups = (len + 7) / 8;
+      gmask = &out[n];
+      memset(gmask, 0, (groups + 7) / 8);
+      n += (groups + 7) / 8;
+      for (i=0; i < len; i += 8) {
+	 unsigned j, end;
+
+	 end = i + 8 > len ? len : i + 8;
+	 for (j=i; j < end && (res[j] == 0); j++);
+	 if (j == end)
+	    continue;
+	 gmask[i / 64] |= 1 << ((i / 8) & 7);
+	 m = &out[n++];
+	 *m = 0;
+	 for (j=i; j < end; j++) {
+	    if (res[j]) {
+	       *m |= 1 << (j - i);
+	       out[n++] = res[j];
+	    }
+	 }
+      }
+      /* literal is shorter  */
+      if (n > len + 3)
+	 n = 0;
+      else
+	 z->deltas++;
+   }
+
+   if (n == 0) {
+      out[n++] = SSBZ_REC_LITERAL;
+      n += put_varint(&out[n], len);
+      memcpy(&out[n], payload, len);
+      n += len;
+      z->literals++;
+   }
+
+   if (write_out(z, out_f, out, n) < 0)
+      return -1;
+
+   if (ref)
+      update_ref(ref, payload, len);
+   if (use_dict)
+      return dict_insert(z, slot, payload, len);
+   return 0;
+}
+
+/* Code complete frames of the buffer, returns number of bytes consumed  */
+static size_t compress_buf(struct ssbz_t *z, FILE *out_f, int *err)
+{
+   size_t i, raw, len;
+   unsigned plen, sum, j;
+   const uint8_t *b, *q;
+
+   *err = 0;
+   b = z->buf;
+   len = z->len;
+   raw = 0;
+   i = 0;
+   while (i < len) {
+      q = memchr(&b[i], 0xa0, len - i);
+      if (q == NULL) {
+	 i = len;
+	 break;
+      }
+      i = q - b;
+      if (i + 4 > len)
+	 break;
+      if (b[i+1] != 0xa2) {
+	 i++;
+	 continue;
+      }
+      plen = ((unsigned)b[i+2] << 8) | b[i+3];
+      if (plen == 0 || (plen > SSBZ_MAX_PAYLOAD)) {
+	 i++;
+	 continue;
+      }
+      if (i + plen + 8 > len)
+	 break;
+      for (sum = 0, j = 0; j < plen; j++)
+	 sum += b[i+4+j];
+      sum &= 0x7fff;
+      if (b[i+4+plen] != (sum >> 8) || (b[i+5+plen] != (sum & 0xff))
+	    || (b[i+6+plen] != 0xb0) || (b[i+7+plen] != 0xb3)) {
+	 i++;
+	 continue;
+      }
+      if (write_raw(z, out_f, &b[raw], i - raw) < 0
+	    || (compress_frame(z, out_f, &b[i+4], plen) < 0)) {
+	 *err = -1;
+	 return 0;
+      }
+      i += plen + 8;
+      raw = i;
+   }
+
+   /* bytes before a possible frame start are raw  */
+   if (write_raw(z, out_f, &b[raw], i - raw) < 0) {
+      *err = -1;
+      return 0;
+   }
+
+   return i;
+}
+
+int ssbz_compress(struct ssbz_t *z, const void *data, size_t size, FILE *out_f)
+{
+   size_t l, used;
+   int err;
+   const uint8_t *p;
+
+   assert(z);
+
+   if (!z->header_done) {
+      uint8_t hdr[SSBZ_HDR_SIZE];
+
+      memcpy(hdr, SSBZ_MAGIC, 4);
+      hdr[4] = SSBZ_VERSION;
+      if (write_out(z, out_f, hdr, sizeof(hdr)) < 0)
+	 return -1;
+      z->header_done = 1;
+   }
+
+   z->in_bytes += size;
+   p = (const uint8_t *)data;
+   while (size) {
+      l = sizeof(z->buf) - z->len;
+      if (l > size)
+	 l = size;
+      memcpy(&z->buf[z->len], p, l);
+      z->len += l;
+      p += l;
+      size -= l;
+
+      used = compress_buf(z, out_f, &err);
+      if (err)
+	 return -1;
+      z->crc = crc24q_update(z->crc, z->buf, (int)used);
+      z->group += used;
+      if (z->group >= SSBZ_MAX_GROUP && (write_check(z, out_f) < 0))
+	 return -1;
+      memmove(z->buf, &z->buf[used], z->len - used);
+      z->len -= used;
+   }
+
+   return 0;
+}
+
+int ssbz_compress_sync(struct ssbz_t *z, FILE *out_f)
+{
+   assert(z);
+
+   if (z->group == 0)
+      return 0;
+   return write_check(z, out_f);
+}
+
+int ssbz_compress_flush(struct ssbz_t *z, FILE *out_f)
+{
+   assert(z);
+
+   if (!z->header_done && (ssbz_compress(z, NULL, 0, out_f) < 0))
+      return -1;
+   if (write_raw(z, out_f, z->buf, z->len) < 0)
+      return -1;
+   z->crc = crc24q_update(z->crc, z->buf, (int)z->len);
+   z->group += z->len;
+   z->len = 0;
+
+   return write_check(z, out_f);
+}
+
+static int read_u8(struct reader_t *r)
+{
+   if (r->p >= r->end) {
+      r->short_read = 1;
+      return 0;
+   }
+   return *r->p++;
+}
+
+static unsigned read_varint(struct reader_t *r)
+{
+   unsigned v, shift;
+   int b;
+
+   v = 0;
+   for (shift = 0; shift < 28; shift += 7) {
+      b = read_u8(r);
+      v |= (unsigned)(b & 0x7f) << shift;
+      if (!(b & 0x80))
+	 break;
+   }
+   return v;
+}
+
+/* Decompressed data, written out by its check record  */
+static int hold_out(struct ssbz_t *z, const void *data, size_t size)
+{
+   uint8_t *p;
+   size_t n;
+
+   if (z->group + size > z->hold_size) {
+      /* compressor checks every SSBZ_MAX_GROUP bytes of its buffer  */
+      if (z->group + size > SSBZ_MAX_GROUP + SSBZ_BUF_SIZE)
+	 return -1;
+      n = z->hold_size ? 2 * z->hold_size : SSBZ_BUF_SIZE;
+      while (n < z->group + size)
+	 n *= 2;
+      p = realloc(z->hold, n);
+      if (p == NULL) {
+	 perror(NULL);
+	 return -1;
+      }
+      z->hold = p;
+      z->hold_size = n;
+   }
+   memcpy(&z->hold[z->group], data, size);
+   z->group += size;
+
+   return 0;
+}
+
+static int write_frame(struct ssbz_t *z, const uint8_t *payload, unsigned len)
+{
+   unsigned i, sum;
+   uint8_t hdr[4], tail[4];
+
+   for (sum = 0, i = 0; i < len; i++)
+      sum += payload[i];
+   sum &= 0x7fff;
+
+   hdr[0] = 0xa0;
+   hdr[1] = 0xa2;
+   hdr[2] = (uint8_t)(len >> 8);
+   hdr[3] = (uint8_t)len;
+   tail[0] = (uint8_t)(sum >> 8);
+   tail[1] = (uint8_t)sum;
+   tail[2] = 0xb0;
+   tail[3] = 0xb3;
+
+   z->frames++;
+   if (hold_out(z, hdr, 4) < 0
+	 || (hold_out(z, payload, len) < 0)
+	 || (hold_out(z, tail, 4) < 0))
+      return -1;
+   return 0;
+}
+
+/* Returns 1 if record was decoded, 0 if more data is needed, -1 on error  */
+static int decompress_record(struct ssbz_t *z, struct reader_t *r, FILE *out_f)
+{
+   unsigned i, len, slot, key, mid, groups, crc;
+   const struct ssbz_layout_t *lay;
+   struct ssbz_ref_t *ref;
+   const uint8_t *gmask;
+   uint8_t payload[SSBZ_MAX_PAYLOAD];
+   uint8_t res[SSBZ_MAX_PAYLOAD];
+
+   ref = NULL;
+   switch (read_u8(r)) {
+      case SSBZ_REC_RAW:
+	 len = read_varint(r);
+	 if (r->short_read)
+	    return 0;
+	 if (len > SSBZ_MAX_RAW)
+	    return -1;
+	 if ((size_t)(r->end - r->p) < len)
+	    return 0;
+	 z->raw_bytes += len;
+	 if (hold_out(z, r->p, len) < 0)
+	    return -1;
+	 r->p += len;
+	 return 1;
+
+      case SSBZ_REC_CHECK:
+	 if (r->end - r->p < 3)
+	    return 0;
+	 crc = ((unsigned)r->p[0] << 16) | ((unsigned)r->p[1] << 8) | r->p[2];
+	 r->p += 3;
+	 if (crc != crc24q_hash(z->hold, (int)z->group))
+	    return -1;
+	 if (write_out(z, out_f, z->hold, z->group) < 0)
+	    return -1;
+	 z->group = 0;
+	 return 1;
+
+      case SSBZ_REC_LITERAL:
+	 len = read_varint(r);
+	 if (r->short_read)
+	    return 0;
+	 if (len == 0 || (len > SSBZ_MAX_PAYLOAD))
+	    return -1;
+	 if ((size_t)(r->end - r->p) < len)
+	    return 0;
+	 memcpy(payload, r->p, len);
+	 r->p += len;
+	 z->literals++;
+	 break;
+
+      case SSBZ_REC_REPEAT:
+	 slot = read_u8(r);
+	 if (r->short_read)
+	    return 0;
+	 if (slot >= SSBZ_DICT_SLOTS || (z->dict[slot] == NULL)
+	       || (z->dict[slot]->len == 0))
+	    return -1;
+	 len = z->dict[slot]->len;
+	 memcpy(payload, z->dict[slot]->data, len);
+	 z->repeats++;
+	 break;
+
+      case SSBZ_REC_DELTA:
+	 mid = read_u8(r);
+	 lay = find_layout(mid);
+	 key = 0;
+	 if (lay && lay->key_off)
+	    key = read_u8(r);
+	 if (r->short_read)
+	    return 0;
+	 ref = get_ref(z, lay, mid, key, 0);
+	 if (ref == NULL || (ref->cnt == 0))
+	    return -1;
+	 len = ref->len;
+
+	 groups = (len + 7) / 8;
+	 gmask = r->p;
+	 if ((size_t)(r->end - r->p) < (groups + 7) / 8)
+	    return 0;
+	 r->p += (groups + 7) / 8;
+	 memset(res, 0, len);
+	 for (i=0; i < groups; i++) {
+	    unsigned j, m;
+
+	    if (!(gmask[i / 8] & (1 << (i & 7))))
+	       continue;
+	    m = read_u8(r);
+	    for (j=0; j < 8; j++) {
+	       if (m & (1 << j)) {
+		  if (i * 8 + j >= len)
+		     return -1;
+		  res[i * 8 + j] = read_u8(r);
+	       }
+	    }
+	 }
+	 if (r->short_read)
+	    return 0;
+	 apply_residual(lay, ref, res, payload);
+	 z->deltas++;
+	 break;
+
+      default:
+	 return r->short_read ? 0 : -1;
+   }
+
+   if (write_frame(z, payload, len) < 0)
+      return -1;
+
+   /* same reference and dictionary updates as the compressor  */
+   lay = find_layout(payload[0]);
+   if (ref == NULL)
+      ref = frame_ref(z, lay, payload, len);
+   if (ref)
+      update_ref(ref, payload, len);
+   if (lay == NULL || (lay->key_off == 0)) {
+      slot = payload_hash(payload, len) % SSBZ_DICT_SLOTS;
+      if (dict_insert(z, slot, payload, len) < 0)
+	 return -1;
+   }
+
+   return 1;
+}
+
+int ssbz_decompress(struct ssbz_t *z, const void *data, size_t size, FILE *out_f)
+{
+   size_t l;
+   int res;
+   const uint8_t *p;
+   struct reader_t r;
+
+   assert(z);
+
+   z->in_bytes += size;
+   p = (const uint8_t *)data;
+   while (size) {
+      l = sizeof(z->buf) - z->len;
+      if (l > size)
+	 l = size;
+      memcpy(&z->buf[z->len], p, l);
+      z->len += l;
+      p += l;
+      size -= l;
+
+      r.p = z->buf;
+      r.end = &z->buf[z->len];
+      if (!z->header_done) {
+	 if (z->len < SSBZ_HDR_SIZE)
+	    continue;
+	 if (memcmp(z->buf, SSBZ_MAGIC, 4) != 0
+	       || (z->buf[4] != SSBZ_VERSION)) {
+	    fputs("Not a SSBZ stream\n", stderr);
+	    return -1;
+	 }
+	 z->header_done = 1;
+	 r.p += SSBZ_HDR_SIZE;
+      }
+
+      for (;;) {
+	 const uint8_t *start;
+
+	 start = r.p;
+	 r.short_read = 0;
+	 if (r.p == r.end)
+	    break;
+	 res = decompress_record(z, &r, out_f);
+	 if (res < 0) {
+	    fputs("Corrupted SSBZ stream\n", stderr);
+	    return -1;
+	 }
+	 if (res == 0) {
+	    r.p = start;
+	    break;
+	 }
+      }
+      z->len = r.end - r.p;
+      memmove(z->buf, r.p, z->len);
+   }
+
+   return 0;
+}
+
+int ssbz_decompress_flush(struct ssbz_t *z)
+{
+   assert(z);
+
+   if (z->len || z->group) {
+      fputs("Truncated SSBZ stream\n", stderr);
+      z->len = 0;
+      z->group = 0;
+      return -1;
+   }
+   return 0;
+}
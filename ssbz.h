@@ -0,0 +1,112 @@
+#ifndef SSBZ_H
+#define SSBZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Lossless SSB stream codec.
+ *
+ * Valid SSB frames are coded by payload only, framing and checksum are
+ * rebuilt on decompression. Payload is coded as one of:
+ *  - repeat of a recent payload (dictionary hashed by content),
+ *  - residual against the previous payload of the same MID (MID 28, 30 and
+ *    8: of the same channel/SV): known integer and double fields are
+ *    predicted linearly from the last two epochs, other bytes are XORed
+ *    with the previous epoch. Zero bytes of the residual cost one bit.
+ *  - literal payload.
+ * Bytes outside valid frames (NMEA, garbage, bad checksum) are stored raw.
+ * Decompressed output is byte for byte the compressor input.
+ *
+ * Stream: "SSBZ" version, then records:
+ *  0x00 varint len, bytes           raw bytes
+ *  0x01 varint len, payload         literal frame
+ *  0x02 slot                        repeat of dictionary slot
+ *  0x03 mid [key] masks, bytes      residual frame
+ *  0x04 crc                         CRC-24Q of the decompressed bytes
+ *                                   since the previous check, big endian
+ * Decompressor writes output only when its check record matches.  */
+
+#define SSBZ_MAGIC "SSBZ"
+#define SSBZ_VERSION 2
+#define SSBZ_HDR_SIZE 5
+
+#define SSBZ_REC_RAW 0x00
+#define SSBZ_REC_LITERAL 0x01
+#define SSBZ_REC_REPEAT 0x02
+#define SSBZ_REC_DELTA 0x03
+#define SSBZ_REC_CHECK 0x04
+
+#define SSBZ_MAX_PAYLOAD 1023
+/* Raw runs are split into records of at most this size  */
+#define SSBZ_MAX_RAW 4096
+#define SSBZ_DICT_SLOTS 64
+/* MIDs with references per channel/SV: 8, 28, 30  */
+#define SSBZ_KEYED_MIDS 3
+/* Check record at least after this many decompressed bytes  */
+#define SSBZ_MAX_GROUP (256 * 1024)
+
+/* Input buffer: longest frame or record, plus one read  */
+#define SSBZ_BUF_SIZE (2 * SSBZ_MAX_RAW + 16)
+
+/* Reference epochs of one MID/key  */
+struct ssbz_ref_t {
+   uint16_t len;
+   /* epochs seen with this length, 2 is enough  */
+   unsigned cnt;
+   uint8_t p1[SSBZ_MAX_PAYLOAD];
+   uint8_t p2[SSBZ_MAX_PAYLOAD];
+};
+
+struct ssbz_dict_t {
+   uint16_t len;
+   uint8_t data[SSBZ_MAX_PAYLOAD];
+};
+
+struct ssbz_t {
+   /* allocated on first use  */
+   struct ssbz_ref_t *ref[256];
+   struct ssbz_ref_t *key_ref[SSBZ_KEYED_MIDS][256];
+   struct ssbz_dict_t *dict[SSBZ_DICT_SLOTS];
+
+   int header_done;
+   uint8_t buf[SSBZ_BUF_SIZE];
+   size_t len;
+
+   /* CRC-24Q and size of the data since the last check record  */
+   unsigned crc;
+   size_t group;
+   /* decompressed data waiting for its check record  */
+   uint8_t *hold;
+   size_t hold_size;
+
+   /* counters  */
+   uint64_t in_bytes;
+   uint64_t out_bytes;
+   unsigned long frames;
+   unsigned long repeats;
+   unsigned long deltas;
+   unsigned long literals;
+   uint64_t raw_bytes;
+};
+
+struct ssbz_t *new_ssbz(void);
+void free_ssbz(struct ssbz_t *z);
+/* Forget references and dictionary, next output starts with header  */
+void ssbz_reset(struct ssbz_t *z);
+
+/* Compress stream data. Complete frames are written at once, incomplete
+ * frame at the end of data waits for the next call.  */
+int ssbz_compress(struct ssbz_t *z, const void *data, size_t size, FILE *out_f);
+/* Write the check record of the data coded since the last one  */
+int ssbz_compress_sync(struct ssbz_t *z, FILE *out_f);
+/* Write the pending bytes as raw, then the check record  */
+int ssbz_compress_flush(struct ssbz_t *z, FILE *out_f);
+
+/* Decompress stream data, records are written when their check record
+ * matches. Returns -1 on format error or CRC mismatch  */
+int ssbz_decompress(struct ssbz_t *z, const void *data, size_t size, FILE *out_f);
+/* Returns -1 if data ends inside a record or before a check record  */
+int ssbz_decompress_flush(struct ssbz_t *z);
+
+#endif /* SSBZ_H */
@@ -0,0 +1,381 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "sirfdump.h"
+#include "stats.h"
+
+struct stats_t *stats_ctx = NULL;
+
+/* SSB MIDs followed by a sub ID byte  */
+static const unsigned char mids_with_sid[] = {
+   0x2b, 0x30, 0x33, 0x36, 0x38, 0x3f, 0x40, 0x41, 0x45, 0x46, 0x48, 0x49,
+   0x4b, 0x4d, 0x5a, 0x5c, 0x5d, 0xa1, 0xac, 0xb2, 0xcd, 0xd2, 0xd3, 0xd4,
+   0xd5, 0xd7, 0xd8, 0xda, 0xdc, 0xdd, 0xe8, 0xea
+};
+
+static const char *stage_names[STATS_STAGE_CNT] = {
+   "framing",
+   "decode",
+   "sink",
+   "send"
+};
+
+static void hist_add(struct stats_hist_t *h, uint64_t ns);
+static uint64_t hist_percentile(const struct stats_hist_t *h, unsigned pct);
+static void print_counter_json(FILE *f, const struct stats_counter_t *c);
+
+uint64_t stats_clock(void)
+{
+#ifdef WIN32
+   static LARGE_INTEGER freq;
+   LARGE_INTEGER cnt;
+
+   if (freq.QuadPart == 0)
+      QueryPerformanceFrequency(&freq);
+   QueryPerformanceCounter(&cnt);
+   return (uint64_t)(cnt.QuadPart / freq.QuadPart) * 1000000000
+      + (uint64_t)(cnt.QuadPart % freq.QuadPart) * 1000000000 / freq.QuadPart;
+#else
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+int64_t stats_realtime_offset(void)
+{
+#ifdef WIN32
+   FILETIME ft;
+   uint64_t t;
+
+   /* 100 ns intervals since 1601-01-01  */
+   GetSystemTimeAsFileTime(&ft);
+   t = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+   return (int64_t)((t - 116444736000000000ULL) * 100) - (int64_t)stats_clock();
+#else
+   struct timespec ts;
+
+   clock_gettime(CLOCK_REALTIME, &ts);
+   return (int64_t)((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec)
+      - (int64_t)stats_clock();
+#endif
+}
+
+struct stats_t *new_stats(void)
+{
+   unsigned i;
+   struct stats_t *s;
+
+   s = calloc(1, sizeof(*s));
+   if (s == NULL)
+      return NULL;
+
+   for (i=0; i < sizeof(mids_with_sid)/sizeof(mids_with_sid[0]); i++)
+      s->has_sid[mids_with_sid[i]] = 1;
+   s->start_ns = stats_clock();
+
+   return s;
+}
+
+void free_stats(struct stats_t *s)
+{
+   unsigned i;
+
+   if (s == NULL)
+      return;
+   for (i=0; i < 256; i++)
+      free(s->sid[i]);
+   free(s);
+}
+
+void stats_frame(struct stats_t *s, const struct transport_msg_t *msg,
+      uint64_t framing_ns)
+{
+   unsigned mid, sid, i, sum;
+   struct stats_counter_t *c[3];
+
+   assert(s);
+   assert(msg);
+
+   s->decode_ns = 0;
+   s->cur_mid = s->cur_sid = NULL;
+   hist_add(&s->stage[STATS_STAGE_FRAMING], framing_ns);
+
+   c[0] = &s->total;
+   c[1] = c[2] = NULL;
+   if (msg->payload_length > 0) {
+      mid = msg->payload[0];
+      c[1] = s->cur_mid = &s->mid[mid];
+      if (s->has_sid[mid] && msg->payload_length > 1) {
+	 if (s->sid[mid] == NULL)
+	    s->sid[mid] = calloc(256, sizeof(struct stats_counter_t));
+	 if (s->sid[mid] != NULL) {
+	    sid = msg->payload[1];
+	    c[2] = s->cur_sid = &s->sid[mid][sid];
+	 }
+      }
+   }
+
+   /* readpkt() does not verify checksum  */
+   sum = 0;
+   for (i=0; i < msg->payload_length; i++)
+      sum += msg->payload[i];
+   sum &= 0x7fff;
+
+   for (i=0; i < 3 && c[i]; i++) {
+      c[i]->frames++;
+      c[i]->bytes += msg->payload_length + 8;
+      c[i]->skipped_bytes += msg->skipped_bytes;
+      if (sum != msg->checksum)
+	 c[i]->checksum_errors++;
+   }
+}
+
+void stats_decode_done(struct stats_t *s, int err)
+{
+   assert(s);
+
+   s->decode_ns = stats_clock() - s->decode_start;
+   hist_add(&s->stage[STATS_STAGE_DECODE], s->decode_ns);
+
+   if (err) {
+      s->total.decode_errors++;
+      if (s->cur_mid)
+	 s->cur_mid->decode_errors++;
+      if (s->cur_sid)
+	 s->cur_sid->decode_errors++;
+   }
+}
+
+void stats_sink_done(struct stats_t *s, uint64_t dump_ns)
+{
+   assert(s);
+
+   if (dump_ns > s->decode_ns)
+      hist_add(&s->stage[STATS_STAGE_SINK], dump_ns - s->decode_ns);
+   else
+      hist_add(&s->stage[STATS_STAGE_SINK], 0);
+}
+
+void stats_send_done(struct stats_t *s, uint64_t send_ns)
+{
+   assert(s);
+   hist_add(&s->stage[STATS_STAGE_SEND], send_ns);
+}
+
+void stats_print(FILE *out_f, const struct stats_t *s)
+{
+   unsigned mid, sid, st;
+   const struct stats_counter_t *c;
+   const struct stats_hist_t *h;
+
+   assert(out_f);
+   assert(s);
+
+   fprintf(out_f, "%-4s %-4s %10s %12s %8s %8s %10s\n",
+	 "MID", "SID", "frames", "bytes", "dec_err", "crc_err", "skipped");
+   for (mid=0; mid < 256; mid++) {
+      c = &s->mid[mid];
+      if (c->frames == 0)
+	 continue;
+      fprintf(out_f, "%-4u %-4s %10llu %12llu %8llu %8llu %10llu\n",
+	    mid, "",
+	    (unsigned long long)c->frames,
+	    (unsigned long long)c->bytes,
+	    (unsigned long long)c->decode_errors,
+	    (unsigned long long)c->checksum_errors,
+	    (unsigned long long)c->skipped_bytes);
+      if (s->sid[mid] == NULL)
+	 continue;
+      for (sid=0; sid < 256; sid++) {
+	 c = &s->sid[mid][sid];
+	 if (c->frames == 0)
+	    continue;
+	 fprintf(out_f, "%-4s %-4u %10llu %12llu %8llu %8llu %10llu\n",
+	       "", sid,
+	       (unsigned long long)c->frames,
+	       (unsigned long long)c->bytes,
+	       (unsigned long long)c->decode_errors,
+	       (unsigned long long)c->checksum_errors,
+	       (unsigned long long)c->skipped_bytes);
+      }
+   }
+   c = &s->total;
+   fprintf(out_f, "%-9s %10llu %12llu %8llu %8llu %10llu\n",
+	 "total",
+	 (unsigned long long)c->frames,
+	 (unsigned long long)c->bytes,
+	 (unsigned long long)c->decode_errors,
+	 (unsigned long long)c->checksum_errors,
+	 (unsigned long long)c->skipped_bytes);
+
+   fprintf(out_f, "\n%-9s %10s %10s %10s %10s %10s\n",
+	 "stage", "count", "mean,ns", "p50,ns", "p99,ns", "max,ns");
+   for (st=0; st < STATS_STAGE_CNT; st++) {
+      h = &s->stage[st];
+      if (st == STATS_STAGE_SEND && (h->cnt == 0))
+	 continue;
+      fprintf(out_f, "%-9s %10llu %10llu %10llu %10llu %10llu\n",
+	    stage_names[st],
+	    (unsigned long long)h->cnt,
+	    (unsigned long long)(h->cnt ? h->sum_ns / h->cnt : 0),
+	    (unsigned long long)hist_percentile(h, 50),
+	    (unsigned long long)hist_percentile(h, 99),
+	    (unsigned long long)h->max_ns);
+   }
+}
+
+/*
+ * Written to fname.tmp and renamed, so a reader polling the file
+ * never sees partial output.
+ */
+int stats_write_json(const char *fname, const struct stats_t *s)
+{
+   unsigned mid, sid, st, b, first;
+   FILE *f;
+   char *tmpname;
+   const struct stats_hist_t *h;
+
+   assert(fname);
+   assert(s);
+
+   tmpname = malloc(strlen(fname) + 5);
+   if (tmpname == NULL) {
+      perror(NULL);
+      return -1;
+   }
+   strcpy(tmpname, fname);
+   strcat(tmpname, ".tmp");
+
+   f = fopen(tmpname, "w");
+   if (f == NULL) {
+      perror(tmpname);
+      free(tmpname);
+      return -1;
+   }
+
+   fprintf(f, "{\n  \"elapsed_ns\": %llu,\n  \"total\": {",
+	 (unsigned long long)(stats_clock() - s->start_ns));
+   print_counter_json(f, &s->total);
+   fputs("}", f);
+
+   fputs(",\n  \"messages\": [", f);
+   first = 1;
+   for (mid=0; mid < 256; mid++) {
+      if (s->mid[mid].frames == 0)
+	 continue;
+      fprintf(f, "%s\n    {\"mid\": %u, ", first ? "" : ",", mid);
+      print_counter_json(f, &s->mid[mid]);
+      first = 0;
+      if (s->sid[mid] == NULL) {
+	 fputs("}", f);
+	 continue;
+      }
+      fputs(", \"sid\": [", f);
+      for (sid=0, b=1; sid < 256; sid++) {
+	 if (s->sid[mid][sid].frames == 0)
+	    continue;
+	 fprintf(f, "%s\n      {\"sid\": %u, ", b ? "" : ",", sid);
+	 print_counter_json(f, &s->sid[mid][sid]);
+	 fputs("}", f);
+	 b = 0;
+      }
+      fputs("]}", f);
+   }
+
+   fputs("\n  ],\n  \"stages\": {", f);
+   for (st=0; st < STATS_STAGE_CNT; st++) {
+      h = &s->stage[st];
+      fprintf(f, "%s\n    \"%s\": {\"count\": %llu, \"sum_ns\": %llu, "
+	    "\"max_ns\": %llu, \"p50_ns\": %llu, \"p99_ns\": %llu, "
+	    "\"log2_ns_buckets\": [",
+	    st ? "," : "",
+	    stage_names[st],
+	    (unsigned long long)h->cnt,
+	    (unsigned long long)h->sum_ns,
+	    (unsigned long long)h->max_ns,
+	    (unsigned long long)hist_percentile(h, 50),
+	    (unsigned long long)hist_percentile(h, 99));
+      for (b=0; b < STATS_HIST_BUCKETS; b++)
+	 fprintf(f, "%s%llu", b ? ", " : "", (unsigned long long)h->bucket[b]);
+      fputs("]}", f);
+   }
+   fputs("\n  }\n}\n", f);
+
+   if (fclose(f) != 0) {
+      perror(tmpname);
+      free(tmpname);
+      return -1;
+   }
+
+#ifdef WIN32
+   remove(fname);
+#endif
+   if (rename(tmpname, fname) != 0) {
+      perror(fname);
+      free(tmpname);
+      return -1;
+   }
+
+   free(tmpname);
+   return 0;
+}
+
+static void print_counter_json(FILE *f, const struct stats_counter_t *c)
+{
+   fprintf(f, "\"frames\": %llu, \"bytes\": %llu, \"decode_errors\": %llu, "
+	 "\"checksum_errors\": %llu, \"skipped_bytes\": %llu",
+	 (unsigned long long)c->frames,
+	 (unsigned long long)c->bytes,
+	 (unsigned long long)c->decode_errors,
+	 (unsigned long long)c->checksum_errors,
+	 (unsigned long long)c->skipped_bytes);
+}
+
+static void hist_add(struct stats_hist_t *h, uint64_t ns)
+{
+   unsigned b;
+   uint64_t v;
+
+   h->cnt++;
+   h->sum_ns += ns;
+   if (ns > h->max_ns)
+      h->max_ns = ns;
+
+   b = 0;
+   for (v = ns >> 1; v && b < STATS_HIST_BUCKETS-1; v >>= 1)
+      b++;
+   h->bucket[b]++;
+}
+
+/* Upper bound of the bucket containing the percentile  */
+static uint64_t hist_percentile(const struct stats_hist_t *h, unsigned pct)
+{
+   unsigned b;
+   uint64_t acc, lim;
+
+   if (h->cnt == 0)
+      return 0;
+
+   lim = (h->cnt * pct + 99) / 100;
+   acc = 0;
+   for (b=0; b < STATS_HIST_BUCKETS; b++) {
+      acc += h->bucket[b];
+      if (acc >= lim)
+	 break;
+   }
+   if (b >= STATS_HIST_BUCKETS-1)
+      return h->max_ns;
+
+   lim = ((uint64_t)2 << b) - 1;
+   return lim < h->max_ns ? lim : h->max_ns;
+}
@@ -0,0 +1,87 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sirfdump.h"
+
+/* Per MID/SID counters and per-stage latency histograms.
+ * Disabled when stats_ctx is NULL: every hook is a single pointer test.  */
+
+enum stats_stage_t {
+   STATS_STAGE_FRAMING = 0,
+   STATS_STAGE_DECODE,
+   STATS_STAGE_SINK,
+   /* frame arrival to datagram sent, epoch closing frames only  */
+   STATS_STAGE_SEND,
+   STATS_STAGE_CNT
+};
+
+/* bucket i: [2^i, 2^(i+1)) ns  */
+#define STATS_HIST_BUCKETS 32
+
+struct stats_counter_t {
+   uint64_t frames;
+   uint64_t bytes;
+   uint64_t decode_errors;
+   uint64_t checksum_errors;
+   uint64_t skipped_bytes;
+};
+
+struct stats_hist_t {
+   uint64_t cnt;
+   uint64_t sum_ns;
+   uint64_t max_ns;
+   uint64_t bucket[STATS_HIST_BUCKETS];
+};
+
+struct stats_t {
+   struct stats_counter_t total;
+   struct stats_counter_t mid[256];
+   /* MIDs with sub IDs, 256 entries allocated on first use  */
+   struct stats_counter_t *sid[256];
+   unsigned char has_sid[256];
+   struct stats_hist_t stage[STATS_STAGE_CNT];
+
+   /* current frame  */
+   struct stats_counter_t *cur_mid;
+   struct stats_counter_t *cur_sid;
+   uint64_t io_ns;
+   uint64_t decode_start;
+   uint64_t decode_ns;
+
+   uint64_t start_ns;
+};
+
+extern struct stats_t *stats_ctx;
+
+#define STATS_DECODE_BEGIN() do { \
+   if (stats_ctx) stats_ctx->decode_start = stats_clock(); \
+} while (0)
+
+#define STATS_DECODE_END(err) do { \
+   if (stats_ctx) stats_decode_done(stats_ctx, (err)); \
+} while (0)
+
+/* Monotonic clock, ns  */
+uint64_t stats_clock(void);
+/* System time minus stats_clock(), ns  */
+int64_t stats_realtime_offset(void);
+
+struct stats_t *new_stats(void);
+void free_stats(struct stats_t *s);
+
+/* framing_ns: time spent in frame search, without read()  */
+void stats_frame(struct stats_t *s, const struct transport_msg_t *msg,
+      uint64_t framing_ns);
+void stats_decode_done(struct stats_t *s, int err);
+/* dump_ns: time of the whole output call, decode included  */
+void stats_sink_done(struct stats_t *s, uint64_t dump_ns);
+/* send_ns: time from frame arrival to output sent  */
+void stats_send_done(struct stats_t *s, uint64_t send_ns);
+
+void stats_print(FILE *out_f, const struct stats_t *s);
+int stats_write_json(const char *fname, const struct stats_t *s);
+
+#endif /* STATS_H */
@@ -0,0 +1,575 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gpsd/gps.h"
+
+const char *progname = "subframebench";
+const char *revision = "$Revision: 0.1 $";
+
+/* Subframes per pass of the benchmark  */
+#define BENCH_BATCH SUBFRAME_BATCH_MAX
+
+struct bench_ctx_t {
+   unsigned runs;
+   unsigned count;
+   unsigned check_cnt;
+   unsigned corrupt;
+   unsigned seed;
+   unsigned errors;
+};
+
+static void usage(void)
+{
+ fprintf(stdout, "\nUsage:\n    %s [-h] [options]\n"
+       ,progname);
+ return;
+}
+
+static void version(void)
+{
+ fprintf(stdout,"%s %s\n",progname,revision);
+}
+
+static void help(void)
+{
+
+ printf("%s - Subframe parity and decoder check and benchmark\t\t%s\n",
+       progname, revision);
+ usage();
+ printf(
+   "\nOptions:\n"
+   "    -n, --runs                  Runs per test, best is reported, default: 1\n"
+   "    -c, --count                 Subframes decoded per benchmark run, default: 1000000\n"
+   "    -C, --check                 Random subframes compared, default: 1000000\n"
+   "    -E, --corrupt               Corrupted subframes, per mille, default: 20\n"
+   "    -S, --seed                  Random seed, default: 1\n"
+   "    -h, --help                  Help\n"
+   "    -v, --version               Show version\n"
+   "\n"
+   "Check: isgps_parity() and isgps_parity_batch() against the former\n"
+   "bit mask parity on random words; gpsd_interpret_subframe_raw() against\n"
+   "the former word by word decoder and gpsd_interpret_subframes_raw()\n"
+   "against gpsd_interpret_subframe_raw() on random subframes 1-5, some of\n"
+   "them with a flipped bit. Exits with 1 on error.\n"
+   "Benchmark: parity per word, decoding per subframe.\n"
+   "\n"
+ );
+ return;
+}
+
+static uint64_t clock_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t rnd32(void)
+{
+   return ((uint32_t)random() << 16) ^ (uint32_t)random();
+}
+
+/* Former parity: bit masks of D25..D30, one table lookup per byte  */
+static const unsigned char legacy_parity_array[256] = {
+    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
+    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
+    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
+    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
+    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
+    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
+    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
+    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
+    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
+    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
+    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
+    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
+    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
+    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
+    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
+    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0
+};
+
+static const uint32_t legacy_parity_mask[6] = {
+   0xbb1f3480u, 0x5d8f9a40u, 0xaec7cd00u,
+   0x5763e680u, 0x6bb1f340u, 0x8b7a89c0u
+};
+
+static unsigned legacy_parity(uint32_t th)
+{
+   unsigned i, p;
+   uint32_t t;
+
+   p = 0;
+   for (i=0; i<6; i++) {
+      t = th & legacy_parity_mask[i];
+      p = (p << 1) | (legacy_parity_array[t & 0xff]
+	    ^ legacy_parity_array[(t >> 8) & 0xff]
+	    ^ legacy_parity_array[(t >> 16) & 0xff]
+	    ^ legacy_parity_array[(t >> 24) & 0xff]);
+   }
+   return p;
+}
+
+#define uint2int( u, bit) ( u & (1<<(bit-1)) ? u - (1<<bit) : u)
+
+/* Former gpsd_interpret_subframe_raw(): header and subframes 1-3 only  */
+static unsigned legacy_subframe_raw(struct subframe_t *subp,
+      unsigned tSVID, uint32_t words[])
+{
+   unsigned i;
+   uint8_t preamble;
+
+   preamble = (uint8_t)((words[0] >> 22) & 0xff);
+   if (preamble == 0x8b)
+      words[0] ^= 0x3fffffc0;
+   else if (preamble != 0x74)
+      return 0;
+   words[0] = (words[0] >> 6) & 0xffffff;
+
+   for (i=1; i<10; i++) {
+      if (words[i] & 0x40000000)
+	 words[i] ^= 0x3fffffc0;
+      if (legacy_parity(words[i]) != (words[i] & 0x3f))
+	 return 0;
+      words[i] = (words[i] >> 6) & 0xffffff;
+   }
+
+   subp->integrity = (bool)((words[0] >> 1) & 0x01);
+   subp->TOW17 = ((words[1] >> 7) & 0x01ffff);
+   subp->l_TOW17 = (long)(subp->TOW17 * 6);
+   subp->tSVID = (uint8_t)tSVID;
+   subp->subframe_num = ((words[1] >> 2) & 0x07);
+   subp->alert = (bool)((words[1] >> 6) & 0x01);
+   subp->antispoof = (bool)((words[1] >> 6) & 0x01);
+   subp->pageid  = (words[2] >> 16) & 0x00003f;
+   subp->data_id = (words[2] >> 22) & 0x3;
+   subp->is_almanac = 0;
+
+   switch (subp->subframe_num) {
+      case 1:
+	 subp->sub1.WN   = (uint16_t)((words[2] >> 14) & 0x03ff);
+	 subp->sub1.l2   = (uint8_t)((words[2] >> 12) & 0x000003);
+	 subp->sub1.ura  = (unsigned int)((words[2] >>  8) & 0x00000f);
+	 subp->sub1.hlth = (unsigned int)((words[2] >>  2) & 0x00003f);
+	 subp->sub1.IODC = (words[2] & 0x000003);
+	 subp->sub1.l2p  = ((words[3] >> 23) & 0x000001);
+	 subp->sub1.Tgd  = (int8_t)( words[6] & 0x0000ff);
+	 subp->sub1.d_Tgd  = pow(2.0, -31) * (int)subp->sub1.Tgd;
+	 subp->sub1.toc  = ( words[7] & 0x00ffff);
+	 subp->sub1.l_toc = (long)subp->sub1.toc  << 4;
+	 subp->sub1.af2  = (int8_t)((words[8] >> 16) & 0x0ff);
+	 subp->sub1.d_af2  = pow(2.0, -55) * (int)subp->sub1.af2;
+	 subp->sub1.af1  = (int16_t)( words[8] & 0x00ffff);
+	 subp->sub1.d_af1  = pow(2.0, -43) * subp->sub1.af1;
+	 subp->sub1.af0  = (int32_t)((words[9] >>  2) & 0x03fffff);
+	 subp->sub1.af0  = uint2int(subp->sub1.af0, 22);
+	 subp->sub1.d_af0  = pow(2.0, -31) * subp->sub1.af0;
+	 subp->sub1.IODC <<= 8;
+	 subp->sub1.IODC |= ((words[7] >> 16) & 0x00ff);
+	 break;
+      case 2:
+	 subp->sub2.IODE   = ((words[2] >> 16) & 0x00ff);
+	 subp->sub2.Crs    = (int16_t)( words[2] & 0x00ffff);
+	 subp->sub2.d_Crs  = pow(2.0,-5) * subp->sub2.Crs;
+	 subp->sub2.deltan = (int16_t)((words[3] >>  8) & 0x00ffff);
+	 subp->sub2.d_deltan  = pow(2.0,-43) * subp->sub2.deltan;
+	 subp->sub2.M0     = (int32_t)( words[3] & 0x0000ff);
+	 subp->sub2.M0   <<= 24;
+	 subp->sub2.M0    |= ( words[4] & 0x00ffffff);
+	 subp->sub2.d_M0   = pow(2.0,-31) * subp->sub2.M0 * GPS_PI;
+	 subp->sub2.Cuc    = (int16_t)((words[5] >>  8) & 0x00ffff);
+	 subp->sub2.d_Cuc  = pow(2.0,-29) * subp->sub2.Cuc;
+	 subp->sub2.e      = ( words[5] & 0x0000ff);
+	 subp->sub2.e    <<= 24;
+	 subp->sub2.e     |= ( words[6] & 0x00ffffff);
+	 subp->sub2.d_eccentricity  = pow(2.0,-33) * subp->sub2.e;
+	 subp->sub2.Cus    = (int16_t)((words[7] >>  8) & 0x00ffff);
+	 subp->sub2.d_Cus  = pow(2.0,-29) * subp->sub2.Cus;
+	 subp->sub2.sqrtA  = ( words[7] & 0x0000ff);
+	 subp->sub2.sqrtA <<= 24;
+	 subp->sub2.sqrtA |= ( words[8] & 0x00ffffff);
+	 subp->sub2.d_sqrtA = pow(2.0, -19) * subp->sub2.sqrtA;
+	 subp->sub2.toe    = ((words[9] >>  8) & 0x00ffff);
+	 subp->sub2.l_toe  = (long)(subp->sub2.toe << 4);
+	 subp->sub2.fit    = ((words[9] >>  7) & 0x000001);
+	 subp->sub2.AODO   = ((words[9] >>  2) & 0x00001f);
+	 subp->sub2.u_AODO   = subp->sub2.AODO * 900;
+	 break;
+      case 3:
+	 subp->sub3.Cic      = (int16_t)((words[2] >>  8) & 0x00ffff);
+	 subp->sub3.d_Cic    = pow(2.0, -29) * subp->sub3.Cic;
+	 subp->sub3.Omega0   = (int32_t)(words[2] & 0x0000ff);
+	 subp->sub3.Omega0 <<= 24;
+	 subp->sub3.Omega0  |= ( words[3] & 0x00ffffff);
+	 subp->sub3.d_Omega0 = pow(2.0, -31) * subp->sub3.Omega0;
+	 subp->sub3.Cis      = (int16_t)((words[4] >>  8) & 0x00ffff);
+	 subp->sub3.d_Cis    = pow(2.0, -29) * subp->sub3.Cis;
+	 subp->sub3.i0       = (int32_t)(words[4] & 0x0000ff);
+	 subp->sub3.i0     <<= 24;
+	 subp->sub3.i0      |= ( words[5] & 0x00ffffff);
+	 subp->sub3.d_i0     = pow(2.0, -31) * subp->sub3.i0;
+	 subp->sub3.Crc      = (int16_t)((words[6] >>  8) & 0x00ffff);
+	 subp->sub3.d_Crc    = pow(2.0, -5) * subp->sub3.Crc;
+	 subp->sub3.omega    = (int32_t)(words[6] & 0x0000ff);
+	 subp->sub3.omega  <<= 24;
+	 subp->sub3.omega   |= ( words[7] & 0x00ffffff);
+	 subp->sub3.d_omega  = pow(2.0, -31) * subp->sub3.omega;
+	 subp->sub3.Omegad   = (int32_t)(words[8] & 0x00ffffff);
+	 subp->sub3.Omegad   = uint2int(subp->sub3.Omegad, 24);
+	 subp->sub3.d_Omegad = pow(2.0, -43) * subp->sub3.Omegad;
+	 subp->sub3.IODE     = ((words[9] >> 16) & 0x0000ff);
+	 subp->sub3.IDOT     = (int16_t)((words[9] >>  2) & 0x003fff);
+	 subp->sub3.IDOT     = uint2int(subp->sub3.IDOT, 14);
+	 subp->sub3.d_IDOT   = pow(2.0, -43) * subp->sub3.IDOT;
+	 break;
+      default:
+	 break;
+   }
+
+   return subp->subframe_num;
+}
+
+/* Random subframe 1-5 with parity and D30* inversion as transmitted,
+ * corrupted one time out of 1000/corrupt  */
+static void subframe_random(const struct bench_ctx_t *ctx, uint32_t raw[10])
+{
+   unsigned i;
+   uint32_t w, parity, prev;
+
+   prev = rnd32() & 0x03;
+   for (i=0; i<10; i++) {
+      w = rnd32() & 0xffffff;
+      if (i == 0)
+	 w = (w & 0x00ffff) | (0x74 << 16);
+      else if (i == 1)
+	 w = (w & ~(0x07u << 2)) | ((1 + random() % 5) << 2);
+      w = (prev << 30) | (w << 6);
+      parity = legacy_parity(w);
+      if (w & 0x40000000)
+	 w ^= 0x3fffffc0;
+      raw[i] = w | parity;
+      prev = parity & 0x03;
+   }
+
+   if ((unsigned)(random() % 1000) < ctx->corrupt)
+      raw[random() % 10] ^= 1u << (random() % 32);
+}
+
+static void check_parity(struct bench_ctx_t *ctx)
+{
+   unsigned i, n;
+   isgps30bits_t th[256];
+   uint8_t p[256];
+
+   for (n=0; n < ctx->check_cnt; n += 256) {
+      for (i=0; i<256; i++)
+	 th[i] = rnd32();
+      isgps_parity_batch(th, p, 256);
+      for (i=0; i<256; i++) {
+	 unsigned ref = legacy_parity(th[i]);
+	 if ((isgps_parity(th[i]) != ref) || (p[i] != ref)) {
+	    if (ctx->errors++ < 10)
+	       printf("parity 0x%08x: %u single %u batch %u\n",
+		     (unsigned)th[i], ref, isgps_parity(th[i]), p[i]);
+	 }
+      }
+   }
+}
+
+static void check_decode(struct bench_ctx_t *ctx)
+{
+   unsigned i, n, k, res_legacy, res_single, res_batch;
+   unsigned svid[BENCH_BATCH];
+   uint32_t raw[BENCH_BATCH][10];
+   uint32_t words[BENCH_BATCH][10];
+   uint32_t w[10];
+   uint8_t valid;
+   struct subframe_t legacy, single[BENCH_BATCH], batch[BENCH_BATCH];
+
+   for (n=0; n < ctx->check_cnt; n += BENCH_BATCH) {
+      for (i=0; i < BENCH_BATCH; i++) {
+	 subframe_random(ctx, raw[i]);
+	 svid[i] = 1 + random() % 32;
+      }
+
+      memset(batch, 0, sizeof(batch));
+      memcpy(words, raw, sizeof(words));
+      res_batch = gpsd_interpret_subframes_raw(batch, svid, words, BENCH_BATCH);
+
+      k = 0;
+      for (i=0; i < BENCH_BATCH; i++) {
+	 memset(&legacy, 0, sizeof(legacy));
+	 memcpy(w, raw[i], sizeof(w));
+	 res_legacy = legacy_subframe_raw(&legacy, svid[i], w);
+
+	 memset(&single[i], 0, sizeof(single[i]));
+	 memcpy(w, raw[i], sizeof(w));
+	 res_single = gpsd_interpret_subframe_raw(&single[i], svid[i], w);
+	 if (res_single)
+	    k++;
+
+	 /* unknown pages of subframes 4, 5 are not decoded: compare parity
+	  * and preamble check only  */
+	 memcpy(w, raw[i], sizeof(w));
+	 gpsd_check_subframes_raw((uint32_t (*)[10])w, 1, &valid);
+	 if ((res_legacy != 0) != (valid != 0)
+	       || ((res_legacy != 0) && (res_legacy <= 3)
+		  && ((res_single == 0)
+		     || (single[i].subframe_num != res_legacy)))) {
+	    if (ctx->errors++ < 10)
+	       printf("subframe %u: legacy %u single %u\n", n + i,
+		     res_legacy, res_single);
+	    continue;
+	 }
+	 if (res_single && (legacy.subframe_num <= 3)
+	       && memcmp(&legacy, &single[i], sizeof(legacy)) != 0) {
+	    if (ctx->errors++ < 10)
+	       printf("subframe %u (%u): legacy and single decode differ\n",
+		     n + i, legacy.subframe_num);
+	    continue;
+	 }
+	 if (res_single && ((legacy.TOW17 != single[i].TOW17)
+		  || (legacy.pageid != single[i].pageid)
+		  || (legacy.data_id != single[i].data_id)
+		  || (legacy.tSVID != single[i].tSVID))) {
+	    if (ctx->errors++ < 10)
+	       printf("subframe %u (%u): legacy and single header differ\n",
+		     n + i, legacy.subframe_num);
+	    continue;
+	 }
+
+	 if (res_single == 0) {
+	    if (batch[i].subframe_num != 0) {
+	       if (ctx->errors++ < 10)
+		  printf("subframe %u: invalid, batch decoded %u\n", n + i,
+			batch[i].subframe_num);
+	    }
+	 }else if (memcmp(&single[i], &batch[i], sizeof(batch[i])) != 0) {
+	    if (ctx->errors++ < 10)
+	       printf("subframe %u (%u): single and batch decode differ\n",
+		     n + i, single[i].subframe_num);
+	 }
+      }
+      if (k != res_batch) {
+	 if (ctx->errors++ < 10)
+	    printf("subframes %u-%u: single %u batch %u decoded\n",
+		  n, n + BENCH_BATCH - 1, k, res_batch);
+      }
+   }
+}
+
+/* Test data: BENCH_BATCH subframes, decoded count/BENCH_BATCH times  */
+struct bench_data_t {
+   unsigned svid[BENCH_BATCH];
+   uint32_t raw[BENCH_BATCH][10];
+   uint32_t words[BENCH_BATCH][10];
+   struct subframe_t sub[BENCH_BATCH];
+};
+
+static uint64_t run_legacy(const struct bench_ctx_t *ctx,
+      struct bench_data_t *d, unsigned *sum)
+{
+   unsigned n, i;
+   uint64_t t;
+
+   t = clock_ns();
+   for (n=0; n < ctx->count; n += BENCH_BATCH) {
+      memcpy(d->words, d->raw, sizeof(d->words));
+      for (i=0; i < BENCH_BATCH; i++)
+	 *sum += legacy_subframe_raw(&d->sub[i], d->svid[i], d->words[i]);
+   }
+   return clock_ns() - t;
+}
+
+static uint64_t run_single(const struct bench_ctx_t *ctx,
+      struct bench_data_t *d, unsigned *sum)
+{
+   unsigned n, i;
+   uint64_t t;
+
+   t = clock_ns();
+   for (n=0; n < ctx->count; n += BENCH_BATCH) {
+      memcpy(d->words, d->raw, sizeof(d->words));
+      for (i=0; i < BENCH_BATCH; i++)
+	 *sum += gpsd_interpret_subframe_raw(&d->sub[i], d->svid[i], d->words[i]);
+   }
+   return clock_ns() - t;
+}
+
+static uint64_t run_batch(const struct bench_ctx_t *ctx,
+      struct bench_data_t *d, unsigned *sum)
+{
+   unsigned n;
+   uint64_t t;
+
+   t = clock_ns();
+   for (n=0; n < ctx->count; n += BENCH_BATCH) {
+      memcpy(d->words, d->raw, sizeof(d->words));
+      *sum += gpsd_interpret_subframes_raw(d->sub, d->svid, d->words, BENCH_BATCH);
+   }
+   return clock_ns() - t;
+}
+
+static uint64_t run_parity(const struct bench_ctx_t *ctx,
+      struct bench_data_t *d, unsigned mode, unsigned *sum)
+{
+   unsigned n, i;
+   uint64_t t;
+   const isgps30bits_t *th;
+   uint8_t p[BENCH_BATCH * 10];
+
+   th = &d->raw[0][0];
+   t = clock_ns();
+   for (n=0; n < ctx->count; n += BENCH_BATCH) {
+      switch (mode) {
+	 case 0:
+	    for (i=0; i < BENCH_BATCH * 10; i++)
+	       *sum += legacy_parity(th[i]);
+	    break;
+	 case 1:
+	    for (i=0; i < BENCH_BATCH * 10; i++)
+	       *sum += isgps_parity(th[i]);
+	    break;
+	 default:
+	    isgps_parity_batch(th, p, BENCH_BATCH * 10);
+	    *sum += p[n % (BENCH_BATCH * 10)];
+	    break;
+      }
+   }
+   return clock_ns() - t;
+}
+
+static void report(const char *name, uint64_t ns, unsigned long cnt,
+      const char *unit)
+{
+   printf("%-28s %9.3f %10.1f %s\n", name, ns / 1e9, ns / (double)cnt, unit);
+}
+
+int main(int argc, char *argv[])
+{
+   signed char c;
+   unsigned i, k, sum;
+   uint64_t ns, best[6];
+   unsigned long subframes;
+   struct bench_ctx_t ctx;
+   struct bench_data_t *d;
+
+   static struct option longopts[] = {
+      {"version",     no_argument,       0, 'v'},
+      {"help",        no_argument,       0, 'h'},
+      {"runs",        required_argument, 0, 'n'},
+      {"count",       required_argument, 0, 'c'},
+      {"check",       required_argument, 0, 'C'},
+      {"corrupt",     required_argument, 0, 'E'},
+      {"seed",        required_argument, 0, 'S'},
+      {0, 0, 0, 0}
+   };
+
+   memset(&ctx, 0, sizeof(ctx));
+   ctx.runs = 1;
+   ctx.count = 1000000;
+   ctx.check_cnt = 1000000;
+   ctx.corrupt = 20;
+   ctx.seed = 1;
+
+   while ((c = getopt_long(argc, argv, "vh?n:c:C:E:S:",longopts,NULL)) != -1) {
+      switch (c) {
+	 case 'n':
+	    ctx.runs = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'c':
+	    ctx.count = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'C':
+	    ctx.check_cnt = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'E':
+	    ctx.corrupt = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'S':
+	    ctx.seed = strtoul(optarg, NULL, 10);
+	    break;
+	 case 'v':
+	    version();
+	    exit(0);
+	    break;
+	 default:
+	    help();
+	    exit(0);
+	    break;
+      }
+   }
+   argc -= optind;
+   argv += optind;
+
+   if (argc != 0 || (ctx.runs == 0) || (ctx.count == 0)
+	 || (ctx.corrupt > 1000)) {
+      help();
+      return 1;
+   }
+
+   srandom(ctx.seed);
+
+   check_parity(&ctx);
+   check_decode(&ctx);
+   if (ctx.errors) {
+      printf("check: %u errors\n", ctx.errors);
+      return 1;
+   }
+   printf("check: parity, legacy / single / batch decode of %u subframes: ok\n",
+	 ctx.check_cnt);
+
+   d = malloc(sizeof(*d));
+   if (d == NULL) {
+      perror(NULL);
+      return 1;
+   }
+   memset(d, 0, sizeof(*d));
+   for (i=0; i < BENCH_BATCH; i++) {
+      subframe_random(&ctx, d->raw[i]);
+      d->svid[i] = 1 + i % 32;
+   }
+
+   sum = 0;
+   for (k=0; k<6; k++)
+      best[k] = UINT64_MAX;
+   for (i=0; i < ctx.runs; i++) {
+      for (k=0; k<6; k++) {
+	 switch (k) {
+	    case 0: ns = run_parity(&ctx, d, 0, &sum); break;
+	    case 1: ns = run_parity(&ctx, d, 1, &sum); break;
+	    case 2: ns = run_parity(&ctx, d, 2, &sum); break;
+	    case 3: ns = run_legacy(&ctx, d, &sum); break;
+	    case 4: ns = run_single(&ctx, d, &sum); break;
+	    default: ns = run_batch(&ctx, d, &sum); break;
+	 }
+	 if (ns < best[k])
+	    best[k] = ns;
+      }
+   }
+
+   subframes = (ctx.count + BENCH_BATCH - 1) / BENCH_BATCH * BENCH_BATCH;
+   printf("%lu subframes, %u corrupted per mille\n", subframes, ctx.corrupt);
+   printf("%-28s %9s %10s\n", "test", "time,s", "ns");
+   report("parity, legacy", best[0], subframes * 10, "/word");
+   report("isgps_parity", best[1], subframes * 10, "/word");
+   report("isgps_parity_batch", best[2], subframes * 10, "/word");
+   report("decode, legacy", best[3], subframes, "/subframe");
+   report("gpsd_interpret_subframe_raw", best[4], subframes, "/subframe");
+   report("gpsd_interpret_subframes_raw", best[5], subframes, "/subframe");
+   /* keeps the loops  */
+   if (sum == 1)
+      printf("\n");
+
+   free(d);
+   return 0;
+}
@@ -0,0 +1,611 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tcpsrv.h"
+
+#define TCPSRV_MAX_EVENTS 64
+#define TCPSRV_MAX_IOV 64
+
+static int listen_socket(const char *addr);
+static int set_nonblock(int fd);
+static void accept_clients(struct tcpsrv_t *srv);
+static void drop_client(struct tcpsrv_t *srv, struct tcpsrv_client_t *c);
+static int client_send(struct tcpsrv_t *srv, struct tcpsrv_client_t *c);
+static int client_enqueue(struct tcpsrv_client_t *c, struct tcpsrv_buf_t *b);
+static void client_read(struct tcpsrv_t *srv, struct tcpsrv_client_t *c);
+static int set_pollout(struct tcpsrv_t *srv, struct tcpsrv_client_t *c, unsigned on);
+static struct tcpsrv_buf_t *new_buf(const void *data, size_t size);
+static void buf_unref(struct tcpsrv_buf_t *b);
+static ssize_t cookie_write(void *cookie, const char *buf, size_t size);
+
+struct tcpsrv_t *new_tcpsrv(const char *addr)
+{
+   struct tcpsrv_t *srv;
+   struct epoll_event ev;
+
+   assert(addr);
+
+   srv = calloc(1, sizeof(*srv));
+   if (srv == NULL) {
+      perror(NULL);
+      return NULL;
+   }
+   srv->epoll_fd = srv->listen_fd = srv->input_fd = -1;
+
+   srv->listen_fd = listen_socket(addr);
+   if (srv->listen_fd < 0) {
+      free(srv);
+      return NULL;
+   }
+
+   srv->epoll_fd = epoll_create(TCPSRV_MAX_EVENTS);
+   if (srv->epoll_fd < 0) {
+      perror("epoll_create");
+      free_tcpsrv(srv);
+      return NULL;
+   }
+
+   memset(&ev, 0, sizeof(ev));
+   ev.events = EPOLLIN;
+   ev.data.ptr = srv;
+   if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, srv->listen_fd, &ev) < 0) {
+      perror("epoll_ctl");
+      free_tcpsrv(srv);
+      return NULL;
+   }
+
+   return srv;
+}
+
+void free_tcpsrv(struct tcpsrv_t *srv)
+{
+   if (srv == NULL)
+      return;
+
+   while (srv->clients)
+      drop_client(srv, srv->clients);
+   if (srv->listen_fd >= 0)
+      close(srv->listen_fd);
+   if (srv->epoll_fd >= 0)
+      close(srv->epoll_fd);
+   free(srv->pending);
+   free(srv);
+}
+
+int tcpsrv_write(struct tcpsrv_t *srv, const void *data, size_t size)
+{
+   size_t new_size;
+   uint8_t *p;
+
+   assert(srv);
+
+   if (srv->pending_len + size > srv->pending_size) {
+      new_size = srv->pending_size ? srv->pending_size : 4096;
+      while (new_size < srv->pending_len + size)
+	 new_size *= 2;
+      p = realloc(srv->pending, new_size);
+      if (p == NULL) {
+	 perror(NULL);
+	 return -1;
+      }
+      srv->pending = p;
+      srv->pending_size = new_size;
+   }
+
+   memcpy(&srv->pending[srv->pending_len], data, size);
+   srv->pending_len += size;
+
+   return 0;
+}
+
+/*
+ * Output is copied once into a shared buffer. Clients with empty queues
+ * get it sent directly; others hold a reference until it is sent.
+ */
+int tcpsrv_flush(struct tcpsrv_t *srv)
+{
+   struct tcpsrv_buf_t *b;
+   struct tcpsrv_client_t *c, *next;
+
+   assert(srv);
+
+   if (srv->pending_len == 0)
+      return 0;
+
+   if (srv->clients == NULL) {
+      srv->pending_len = 0;
+      return 0;
+   }
+
+   b = new_buf(srv->pending, srv->pending_len);
+   srv->pending_len = 0;
+   if (b == NULL)
+      return 0;
+
+   for (c = srv->clients; c; c = next) {
+      next = c->next;
+      if (!c->subscribed)
+	 continue;
+      if (client_enqueue(c, b) < 0) {
+	 srv->dropped++;
+	 drop_client(srv, c);
+	 continue;
+      }
+      if (!c->pollout && (client_send(srv, c) < 0))
+	 drop_client(srv, c);
+   }
+
+   buf_unref(b);
+
+   return 1;
+}
+
+int tcpsrv_poll(struct tcpsrv_t *srv, int timeout_ms)
+{
+   int i, n, input_ready;
+   struct epoll_event ev[TCPSRV_MAX_EVENTS];
+   struct tcpsrv_client_t *c;
+
+   assert(srv);
+
+   n = epoll_wait(srv->epoll_fd, ev, TCPSRV_MAX_EVENTS, timeout_ms);
+   if (n < 0) {
+      if (errno == EINTR)
+	 return 0;
+      perror("epoll_wait");
+      return -1;
+   }
+
+   input_ready = 0;
+   for (i=0; i < n; i++) {
+      if (ev[i].data.ptr == srv) {
+	 accept_clients(srv);
+	 continue;
+      }
+      if (ev[i].data.ptr == &srv->input_fd) {
+	 input_ready = 1;
+	 continue;
+      }
+
+      c = (struct tcpsrv_client_t *)ev[i].data.ptr;
+      if (ev[i].events & (EPOLLERR | EPOLLHUP)) {
+	 drop_client(srv, c);
+	 continue;
+      }
+      if (ev[i].events & EPOLLOUT) {
+	 if (client_send(srv, c) < 0) {
+	    drop_client(srv, c);
+	    continue;
+	 }
+      }
+      if (ev[i].events & EPOLLIN)
+	 client_read(srv, c);
+   }
+
+   return input_ready;
+}
+
+int tcpsrv_wait_input(struct tcpsrv_t *srv, int fd)
+{
+   int res;
+   struct epoll_event ev;
+
+   assert(srv);
+
+   if (srv->input_fd != fd) {
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN;
+      ev.data.ptr = &srv->input_fd;
+      if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0)
+	 srv->input_pollable = 1;
+      else if (errno == EPERM)
+	 /* regular files are always readable  */
+	 srv->input_pollable = 0;
+      else {
+	 perror("epoll_ctl");
+	 return -1;
+      }
+      srv->input_fd = fd;
+   }
+
+   if (!srv->input_pollable)
+      return tcpsrv_poll(srv, 0) < 0 ? -1 : 0;
+
+   do {
+      res = tcpsrv_poll(srv, -1);
+   } while (res == 0);
+
+   return res < 0 ? -1 : 0;
+}
+
+void tcpsrv_set_request_handler(struct tcpsrv_t *srv, tcpsrv_request_f *f,
+      void *arg)
+{
+   assert(srv);
+   srv->on_request = f;
+   srv->on_request_arg = arg;
+}
+
+int tcpsrv_reply(struct tcpsrv_client_t *c, const void *data, size_t size)
+{
+   int res;
+   struct tcpsrv_buf_t *b;
+
+   assert(c);
+
+   b = new_buf(data, size);
+   if (b == NULL)
+      return -1;
+   res = client_enqueue(c, b);
+   buf_unref(b);
+
+   return res;
+}
+
+void tcpsrv_drain(struct tcpsrv_t *srv, int timeout_ms)
+{
+   struct timespec t0, t;
+   struct tcpsrv_client_t *c;
+   int elapsed_ms, pending;
+
+   assert(srv);
+
+   tcpsrv_flush(srv);
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   for (;;) {
+      pending = 0;
+      for (c = srv->clients; c; c = c->next) {
+	 if (c->q_cnt)
+	    pending = 1;
+      }
+      if (!pending)
+	 break;
+      clock_gettime(CLOCK_MONOTONIC, &t);
+      elapsed_ms = (t.tv_sec - t0.tv_sec) * 1000 + (t.tv_nsec - t0.tv_nsec) / 1000000;
+      if (elapsed_ms >= timeout_ms)
+	 break;
+      if (tcpsrv_poll(srv, timeout_ms - elapsed_ms) < 0)
+	 break;
+   }
+}
+
+FILE *tcpsrv_fopen(struct tcpsrv_t *srv)
+{
+   FILE *f;
+   cookie_io_functions_t io;
+
+   memset(&io, 0, sizeof(io));
+   io.write = cookie_write;
+
+   f = fopencookie(srv, "w", io);
+   if (f == NULL)
+      perror(NULL);
+
+   return f;
+}
+
+static ssize_t cookie_write(void *cookie, const char *buf, size_t size)
+{
+   if (tcpsrv_write((struct tcpsrv_t *)cookie, buf, size) < 0)
+      return -1;
+   return size;
+}
+
+static int listen_socket(const char *addr)
+{
+   int fd, err, opt;
+   char *host, *port;
+   struct addrinfo hints, *res, *ai;
+
+   host = strdup(addr);
+   if (host == NULL) {
+      perror(NULL);
+      return -1;
+   }
+   port = strrchr(host, ':');
+   if (port) {
+      *port++ = '\0';
+   }else {
+      port = host;
+      host = NULL;
+   }
+
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+   hints.ai_flags = AI_PASSIVE;
+
+   err = getaddrinfo(host && host[0] ? host : NULL, port, &hints, &res);
+   free(host ? host : port);
+   if (err != 0) {
+      fprintf(stderr, "%s: %s\n", addr, gai_strerror(err));
+      return -1;
+   }
+
+   fd = -1;
+   for (ai = res; ai; ai = ai->ai_next) {
+      fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd < 0)
+	 continue;
+      opt = 1;
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+      if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0
+	    && (listen(fd, SOMAXCONN) == 0)
+	    && (set_nonblock(fd) == 0))
+	 break;
+      close(fd);
+      fd = -1;
+   }
+   if (fd < 0)
+      perror(addr);
+
+   freeaddrinfo(res);
+
+   return fd;
+}
+
+static int set_nonblock(int fd)
+{
+   int flags;
+
+   flags = fcntl(fd, F_GETFL);
+   if (flags < 0)
+      return -1;
+   return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static void accept_clients(struct tcpsrv_t *srv)
+{
+   int fd, opt;
+   struct tcpsrv_client_t *c;
+   struct epoll_event ev;
+
+   for (;;) {
+      fd = accept(srv->listen_fd, NULL, NULL);
+      if (fd < 0) {
+	 if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR
+	       && errno != ECONNABORTED)
+	    perror("accept");
+	 return;
+      }
+
+      if (srv->client_cnt >= TCPSRV_MAX_CLIENTS) {
+	 close(fd);
+	 continue;
+      }
+
+      c = calloc(1, sizeof(*c));
+      if (c == NULL || (set_nonblock(fd) < 0)) {
+	 perror(NULL);
+	 free(c);
+	 close(fd);
+	 continue;
+      }
+      opt = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+      c->fd = fd;
+      c->subscribed = srv->on_request == NULL;
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN;
+      ev.data.ptr = c;
+      if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+	 perror("epoll_ctl");
+	 free(c);
+	 close(fd);
+	 continue;
+      }
+
+      c->next = srv->clients;
+      if (srv->clients)
+	 srv->clients->prev = c;
+      srv->clients = c;
+      srv->client_cnt++;
+      srv->accepted++;
+   }
+}
+
+static void drop_client(struct tcpsrv_t *srv, struct tcpsrv_client_t *c)
+{
+   assert(srv);
+   assert(c);
+
+   epoll_ctl(srv->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+   close(c->fd);
+
+   while (c->q_cnt) {
+      buf_unref(c->q[c->q_head]);
+      c->q_head = (c->q_head + 1) % TCPSRV_CLIENT_QUEUE_LEN;
+      c->q_cnt--;
+   }
+   free(c->req);
+
+   if (c->prev)
+      c->prev->next = c->next;
+   else
+      srv->clients = c->next;
+   if (c->next)
+      c->next->prev = c->prev;
+   srv->client_cnt--;
+
+   free(c);
+}
+
+static int client_enqueue(struct tcpsrv_client_t *c, struct tcpsrv_buf_t *b)
+{
+   if (c->q_cnt == TCPSRV_CLIENT_QUEUE_LEN
+	 || (c->q_bytes + b->len > TCPSRV_CLIENT_MAX_QUEUED))
+      return -1;
+
+   c->q[(c->q_head + c->q_cnt) % TCPSRV_CLIENT_QUEUE_LEN] = b;
+   c->q_cnt++;
+   c->q_bytes += b->len;
+   b->refcnt++;
+
+   return 0;
+}
+
+static int client_send(struct tcpsrv_t *srv, struct tcpsrv_client_t *c)
+{
+   unsigned i, iovcnt;
+   ssize_t l;
+   struct iovec iov[TCPSRV_MAX_IOV];
+   struct tcpsrv_buf_t *b;
+   struct msghdr msg;
+
+   while (c->q_cnt) {
+      iovcnt = c->q_cnt < TCPSRV_MAX_IOV ? c->q_cnt : TCPSRV_MAX_IOV;
+      for (i=0; i < iovcnt; i++) {
+	 b = c->q[(c->q_head + i) % TCPSRV_CLIENT_QUEUE_LEN];
+	 iov[i].iov_base = b->data;
+	 iov[i].iov_len = b->len;
+      }
+      iov[0].iov_base = (uint8_t *)iov[0].iov_base + c->q_sent;
+      iov[0].iov_len -= c->q_sent;
+
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = iov;
+      msg.msg_iovlen = iovcnt;
+      l = sendmsg(c->fd, &msg, MSG_NOSIGNAL);
+      if (l < 0) {
+	 if (errno == EINTR)
+	    continue;
+	 if (errno == EAGAIN || errno == EWOULDBLOCK)
+	    break;
+	 return -1;
+      }
+
+      c->q_bytes -= l;
+      l += c->q_sent;
+      c->q_sent = 0;
+      while (c->q_cnt) {
+	 b = c->q[c->q_head];
+	 if ((size_t)l < b->len) {
+	    c->q_sent = l;
+	    break;
+	 }
+	 l -= b->len;
+	 buf_unref(b);
+	 c->q_head = (c->q_head + 1) % TCPSRV_CLIENT_QUEUE_LEN;
+	 c->q_cnt--;
+      }
+      if (c->q_sent)
+	 break;
+   }
+
+   if (c->q_cnt == 0 && c->close_when_sent)
+      return -1;
+
+   return set_pollout(srv, c, c->q_cnt != 0);
+}
+
+/*
+ * Data from unsubscribed clients is collected and passed to the request
+ * handler, anything else is ignored. EOF closes connection
+ */
+static void client_read(struct tcpsrv_t *srv, struct tcpsrv_client_t *c)
+{
+   int res;
+   ssize_t l;
+   char buf[512];
+
+   for (;;) {
+      l = recv(c->fd, buf, sizeof(buf), 0);
+      if (l < 0 && (errno == EINTR))
+	 continue;
+      if (l < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	 return;
+      if (l <= 0) {
+	 drop_client(srv, c);
+	 return;
+      }
+      if (c->subscribed || c->close_when_sent)
+	 continue;
+
+      if (c->req == NULL) {
+	 c->req = malloc(TCPSRV_REQ_MAX);
+	 if (c->req == NULL) {
+	    perror(NULL);
+	    drop_client(srv, c);
+	    return;
+	 }
+      }
+      if (c->req_len + l > TCPSRV_REQ_MAX) {
+	 drop_client(srv, c);
+	 return;
+      }
+      memcpy(&c->req[c->req_len], buf, l);
+      c->req_len += l;
+
+      res = srv->on_request(srv, c, c->req, c->req_len, srv->on_request_arg);
+      if (res == TCPSRV_REQ_MORE)
+	 continue;
+
+      free(c->req);
+      c->req = NULL;
+      c->req_len = 0;
+      if (res == TCPSRV_REQ_ACCEPT)
+	 c->subscribed = 1;
+      else
+	 c->close_when_sent = 1;
+      if (client_send(srv, c) < 0) {
+	 drop_client(srv, c);
+	 return;
+      }
+   }
+}
+
+static int set_pollout(struct tcpsrv_t *srv, struct tcpsrv_client_t *c, unsigned on)
+{
+   struct epoll_event ev;
+
+   if (c->pollout == on)
+      return 0;
+
+   memset(&ev, 0, sizeof(ev));
+   ev.events = EPOLLIN | (on ? EPOLLOUT : 0);
+   ev.data.ptr = c;
+   if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev) < 0)
+      return -1;
+   c->pollout = on;
+
+   return 0;
+}
+
+static struct tcpsrv_buf_t *new_buf(const void *data, size_t size)
+{
+   struct tcpsrv_buf_t *b;
+
+   b = malloc(offsetof(struct tcpsrv_buf_t, data) + size);
+   if (b == NULL) {
+      perror(NULL);
+      return NULL;
+   }
+   b->refcnt = 1;
+   b->len = size;
+   memcpy(b->data, data, size);
+
+   return b;
+}
+
+static void buf_unref(struct tcpsrv_buf_t *b)
+{
+   assert(b->refcnt > 0);
+   if (--b->refcnt == 0)
+      free(b);
+}
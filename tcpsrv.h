@@ -0,0 +1,104 @@
+#ifndef TCPSRV_H
+#define TCPSRV_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* TCP fan-out server. Single thread, epoll, non-blocking sockets.
+ * Output is collected into a buffer and published to all clients
+ * with tcpsrv_flush(). Published buffers are shared by all clients and
+ * freed when the last client has sent them.  */
+
+/* Max bytes queued to one client. Slower clients are dropped  */
+#define TCPSRV_CLIENT_MAX_QUEUED (256 * 1024)
+/* Max buffers queued to one client  */
+#define TCPSRV_CLIENT_QUEUE_LEN 256
+#define TCPSRV_MAX_CLIENTS 1024
+/* Max size of client request  */
+#define TCPSRV_REQ_MAX 4096
+
+/* Request handler results  */
+#define TCPSRV_REQ_MORE   0
+#define TCPSRV_REQ_ACCEPT 1
+#define TCPSRV_REQ_CLOSE  2
+
+struct tcpsrv_t;
+struct tcpsrv_client_t;
+
+/* Called with all data received from a client not yet subscribed to
+ * output. Replies are queued with tcpsrv_reply(). Returns
+ * TCPSRV_REQ_MORE to wait for more data, TCPSRV_REQ_ACCEPT to subscribe
+ * the client or TCPSRV_REQ_CLOSE to close it once replies are sent  */
+typedef int (tcpsrv_request_f)(struct tcpsrv_t *srv, struct tcpsrv_client_t *c,
+      const char *req, size_t len, void *arg);
+
+struct tcpsrv_buf_t {
+   unsigned refcnt;
+   size_t len;
+   uint8_t data[1];
+};
+
+struct tcpsrv_client_t {
+   int fd;
+   struct tcpsrv_buf_t *q[TCPSRV_CLIENT_QUEUE_LEN];
+   unsigned q_head;
+   unsigned q_cnt;
+   /* bytes of q[q_head] already sent  */
+   size_t q_sent;
+   size_t q_bytes;
+   unsigned pollout;
+   /* receives published output  */
+   unsigned subscribed;
+   unsigned close_when_sent;
+   char *req;
+   size_t req_len;
+   struct tcpsrv_client_t *prev, *next;
+};
+
+struct tcpsrv_t {
+   int listen_fd;
+   int epoll_fd;
+   int input_fd;
+   unsigned input_pollable;
+
+   /* Output collected since last tcpsrv_flush()  */
+   uint8_t *pending;
+   size_t pending_len;
+   size_t pending_size;
+
+   struct tcpsrv_client_t *clients;
+   unsigned client_cnt;
+
+   /* NULL: clients are subscribed on connect  */
+   tcpsrv_request_f *on_request;
+   void *on_request_arg;
+
+   unsigned long accepted;
+   unsigned long dropped;
+};
+
+/* addr: [host:]port  */
+struct tcpsrv_t *new_tcpsrv(const char *addr);
+void free_tcpsrv(struct tcpsrv_t *srv);
+
+int tcpsrv_write(struct tcpsrv_t *srv, const void *data, size_t size);
+/* Publish collected output to all clients. Returns 1 if output was
+ * published, 0 if nothing to publish or no clients  */
+int tcpsrv_flush(struct tcpsrv_t *srv);
+/* Serve clients. timeout_ms as in epoll_wait(). Returns 1 if input_fd
+ * is readable, 0 on timeout, -1 on error  */
+int tcpsrv_poll(struct tcpsrv_t *srv, int timeout_ms);
+/* Serve clients until fd is readable. Returns 0, -1 on error  */
+int tcpsrv_wait_input(struct tcpsrv_t *srv, int fd);
+void tcpsrv_set_request_handler(struct tcpsrv_t *srv, tcpsrv_request_f *f,
+      void *arg);
+/* Queue data to one client  */
+int tcpsrv_reply(struct tcpsrv_client_t *c, const void *data, size_t size);
+/* Try to send queued data to clients for up to timeout_ms  */
+void tcpsrv_drain(struct tcpsrv_t *srv, int timeout_ms);
+
+/* Stream writing to tcpsrv_write()  */
+FILE *tcpsrv_fopen(struct tcpsrv_t *srv);
+
+#endif /* TCPSRV_H */
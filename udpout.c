@@ -0,0 +1,272 @@
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "udpout.h"
+
+static int add_sink(struct udpout_t *u, const char *addr);
+static int family_socket(struct udpout_t *u, int family);
+static ssize_t cookie_write(void *cookie, const char *buf, size_t size);
+
+struct udpout_t *new_udpout(const char *addrs)
+{
+   char *s, *p, *next;
+   struct udpout_t *u;
+
+   assert(addrs);
+
+   u = calloc(1, sizeof(*u));
+   if (u == NULL) {
+      perror(NULL);
+      return NULL;
+   }
+   u->fd4 = u->fd6 = -1;
+   u->len = UDPOUT_HDR_SIZE;
+
+   s = strdup(addrs);
+   if (s == NULL) {
+      perror(NULL);
+      free(u);
+      return NULL;
+   }
+
+   for (p = s; p; p = next) {
+      next = strchr(p, ',');
+      if (next)
+	 *next++ = '\0';
+      if (add_sink(u, p) < 0) {
+	 free(s);
+	 free_udpout(u);
+	 return NULL;
+      }
+   }
+   free(s);
+
+   return u;
+}
+
+void free_udpout(struct udpout_t *u)
+{
+   if (u == NULL)
+      return;
+   if (u->fd4 >= 0)
+      close(u->fd4);
+   if (u->fd6 >= 0)
+      close(u->fd6);
+   free(u);
+}
+
+int udpout_write(struct udpout_t *u, const void *data, size_t size)
+{
+   size_t l;
+   const uint8_t *p;
+
+   assert(u);
+
+   p = (const uint8_t *)data;
+   while (size) {
+      /* Keep writes in one datagram when possible  */
+      if (u->len + size > sizeof(u->buf) && (u->len > UDPOUT_HDR_SIZE))
+	 udpout_flush(u);
+      l = sizeof(u->buf) - u->len;
+      if (l > size)
+	 l = size;
+      memcpy(&u->buf[u->len], p, l);
+      u->len += l;
+      p += l;
+      size -= l;
+   }
+
+   return 0;
+}
+
+int udpout_flush(struct udpout_t *u)
+{
+   unsigned i, n, sent;
+   int fd, res;
+   struct iovec iov;
+   struct mmsghdr msg[UDPOUT_MAX_SINKS];
+
+   assert(u);
+
+   if (u->len == UDPOUT_HDR_SIZE)
+      return 0;
+
+   u->buf[0] = (u->seq >> 24) & 0xff;
+   u->buf[1] = (u->seq >> 16) & 0xff;
+   u->buf[2] = (u->seq >> 8) & 0xff;
+   u->buf[3] = u->seq & 0xff;
+   iov.iov_base = u->buf;
+   iov.iov_len = u->len;
+
+   for (fd = u->fd4; ; fd = u->fd6) {
+      n = 0;
+      for (i=0; i < u->sink_cnt; i++) {
+	 if (u->sink[i].fd != fd)
+	    continue;
+	 memset(&msg[n], 0, sizeof(msg[n]));
+	 msg[n].msg_hdr.msg_name = &u->sink[i].addr;
+	 msg[n].msg_hdr.msg_namelen = u->sink[i].addrlen;
+	 msg[n].msg_hdr.msg_iov = &iov;
+	 msg[n].msg_hdr.msg_iovlen = 1;
+	 n++;
+      }
+
+      for (sent = 0; sent < n; ) {
+	 res = sendmmsg(fd, &msg[sent], n - sent, 0);
+	 if (res < 0) {
+	    if (errno == EINTR)
+	       continue;
+	    /* Skip unreachable sink  */
+	    u->send_errors++;
+	    sent++;
+	    continue;
+	 }
+	 sent += res;
+      }
+
+      if (fd == u->fd6)
+	 break;
+   }
+
+   u->seq++;
+   u->datagrams++;
+   u->len = UDPOUT_HDR_SIZE;
+
+   return 1;
+}
+
+int udpout_flush_if_idle(struct udpout_t *u, int fd)
+{
+   struct pollfd pfd;
+
+   assert(u);
+
+   if (u->len == UDPOUT_HDR_SIZE)
+      return 0;
+
+   pfd.fd = fd;
+   pfd.events = POLLIN;
+   pfd.revents = 0;
+   if (poll(&pfd, 1, 0) == 1)
+      return 0;
+
+   return udpout_flush(u);
+}
+
+FILE *udpout_fopen(struct udpout_t *u)
+{
+   FILE *f;
+   cookie_io_functions_t io;
+
+   memset(&io, 0, sizeof(io));
+   io.write = cookie_write;
+
+   f = fopencookie(u, "w", io);
+   if (f == NULL)
+      perror(NULL);
+
+   return f;
+}
+
+static ssize_t cookie_write(void *cookie, const char *buf, size_t size)
+{
+   if (udpout_write((struct udpout_t *)cookie, buf, size) < 0)
+      return -1;
+   return size;
+}
+
+static int add_sink(struct udpout_t *u, const char *addr)
+{
+   int err, fd;
+   char *host, *port, *p;
+   struct addrinfo hints, *res;
+   struct udpout_sink_t *sink;
+
+   if (u->sink_cnt == UDPOUT_MAX_SINKS) {
+      fputs("Too many UDP destinations\n", stderr);
+      return -1;
+   }
+
+   host = strdup(addr);
+   if (host == NULL) {
+      perror(NULL);
+      return -1;
+   }
+   port = strrchr(host, ':');
+   if (port == NULL) {
+      fprintf(stderr, "%s: host:port expected\n", addr);
+      free(host);
+      return -1;
+   }
+   *port++ = '\0';
+   p = host;
+   if (p[0] == '[') {
+      p++;
+      if (p[0] && (p[strlen(p)-1] == ']'))
+	 p[strlen(p)-1] = '\0';
+   }
+
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_DGRAM;
+
+   err = getaddrinfo(p, port, &hints, &res);
+   free(host);
+   if (err != 0) {
+      fprintf(stderr, "%s: %s\n", addr, gai_strerror(err));
+      return -1;
+   }
+
+   fd = family_socket(u, res->ai_family);
+   if (fd < 0) {
+      freeaddrinfo(res);
+      return -1;
+   }
+
+   sink = &u->sink[u->sink_cnt++];
+   memcpy(&sink->addr, res->ai_addr, res->ai_addrlen);
+   sink->addrlen = res->ai_addrlen;
+   sink->fd = fd;
+
+   freeaddrinfo(res);
+
+   return 0;
+}
+
+/*
+ * One socket per address family serves unicast and multicast sinks.
+ * Multicast TTL is left at default 1: datagrams stay on the LAN.
+ */
+static int family_socket(struct udpout_t *u, int family)
+{
+   int *fd;
+
+   if (family == AF_INET)
+      fd = &u->fd4;
+   else if (family == AF_INET6)
+      fd = &u->fd6;
+   else {
+      fputs("Unsupported address family\n", stderr);
+      return -1;
+   }
+
+   if (*fd < 0) {
+      *fd = socket(family, SOCK_DGRAM, 0);
+      if (*fd < 0)
+	 perror("socket");
+   }
+
+   return *fd;
+}
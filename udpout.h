@@ -0,0 +1,53 @@
+#ifndef UDPOUT_H
+#define UDPOUT_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* UDP output. Output is collected into one datagram per epoch and sent
+ * to all sinks with a single sendmmsg() per address family.
+ * Datagram: 32-bit big endian sequence number followed by output data  */
+
+#define UDPOUT_MAX_SINKS 16
+/* Fits into ethernet MTU  */
+#define UDPOUT_MAX_DATAGRAM 1472
+#define UDPOUT_HDR_SIZE 4
+
+struct udpout_sink_t {
+   struct sockaddr_storage addr;
+   socklen_t addrlen;
+   int fd;
+};
+
+struct udpout_t {
+   int fd4, fd6;
+   struct udpout_sink_t sink[UDPOUT_MAX_SINKS];
+   unsigned sink_cnt;
+
+   uint32_t seq;
+   uint8_t buf[UDPOUT_MAX_DATAGRAM];
+   size_t len;
+
+   unsigned long datagrams;
+   unsigned long send_errors;
+};
+
+/* addrs: host:port[,host:port...]. IPv6 hosts in brackets  */
+struct udpout_t *new_udpout(const char *addrs);
+void free_udpout(struct udpout_t *u);
+
+int udpout_write(struct udpout_t *u, const void *data, size_t size);
+/* Send collected output. Returns 1 if datagram was sent, 0 if nothing
+ * to send  */
+int udpout_flush(struct udpout_t *u);
+/* Flush if fd has no data to read  */
+int udpout_flush_if_idle(struct udpout_t *u, int fd);
+
+/* Stream writing to udpout_write()  */
+FILE *udpout_fopen(struct udpout_t *u);
+
+#endif /* UDPOUT_H */
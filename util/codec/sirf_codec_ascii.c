@@ -53,6 +53,10 @@
  *   Macro Definitions
  ***************************************************************************/
 
+/* String table lookup with an untrusted index */
+#define ASCII_STR_AT(table, idx) \
+   ((unsigned)(idx) < sizeof(table)/sizeof((table)[0]) ? (table)[(idx)] : "unknown")
+
 /***************************************************************************
  * @brief:   Encode the error string for the specified error
  * @param:   pBuf - The buffer to write the data into
@@ -398,7 +402,7 @@ tSIRF_RESULT SIRF_CODEC_ASCII_Encode( tSIRF_UINT32 message_id,
             }
             else
             {
-               lp_duty_cycle = (float) (100 * RcvrParam->lp_on_time)
+               lp_duty_cycle = (float) (100.0 * RcvrParam->lp_on_time)
                             / (float) (RcvrParam->lp_interval);
             }
             if( RcvrParam->lp_push_to_fix )
@@ -435,20 +439,20 @@ tSIRF_RESULT SIRF_CODEC_ASCII_Encode( tSIRF_UINT32 message_id,
                      "DOPMaskMode: %s\nElevMask:%.1f deg\nPwrMask: %u dBHz\n"
                      "DGPSSrc: %s\nDGPSMode: %s\nDGPSTimeout: %u s\n"
                      "%s",
-                     strAltMode[RcvrParam->alt_mode],
-                     strAltSrc[RcvrParam->alt_src],
+                     ASCII_STR_AT(strAltMode, RcvrParam->alt_mode),
+                     ASCII_STR_AT(strAltSrc, RcvrParam->alt_src),
                      (int)RcvrParam->alt_input,
-                     strDegMode[RcvrParam->degraded_mode],
+                     ASCII_STR_AT(strDegMode, RcvrParam->degraded_mode),
                      (unsigned)RcvrParam->degraded_timeout,
                      (unsigned)RcvrParam->dr_timeout,
                      (unsigned)RcvrParam->trk_smooth,
-                     strEnabled[RcvrParam->static_nav_mode],
-                     strEnabled[RcvrParam->enable_3sv_lsq],
-                     strDOPMode[RcvrParam->dop_mask_mode],
+                     ASCII_STR_AT(strEnabled, RcvrParam->static_nav_mode),
+                     ASCII_STR_AT(strEnabled, RcvrParam->enable_3sv_lsq),
+                     ASCII_STR_AT(strDOPMode, RcvrParam->dop_mask_mode),
                      RcvrParam->nav_elev_mask / 10.0F,
                      (unsigned)RcvrParam->nav_pwr_mask,
-                     strDGPSSrc[RcvrParam->dgps_src],
-                     strDGPSMode[RcvrParam->dgps_mode],
+                     ASCII_STR_AT(strDGPSSrc, RcvrParam->dgps_src),
+                     ASCII_STR_AT(strDGPSMode, RcvrParam->dgps_mode),
                      (unsigned)RcvrParam->dgps_timeout,
                      lp_str );
             break;
@@ -1641,7 +1645,7 @@ tSIRF_RESULT SIRF_CODEC_ASCII_Encode( tSIRF_UINT32 message_id,
             {
                snprintf( szBuf, sizeof(szBuf), "%ld,%02X",
                   (unsigned long)SIRF_GET_MID(message_id), (unsigned)SIRF_GET_SUB_ID(message_id));
-               for ( i = 0; i <= message_length - 1; i++ )
+               for ( i = 0; i < message_length; i++ )
                {
                   snprintf( szFoo, sizeof(szFoo), ",%02X", (unsigned)(((tSIRF_UINT8*)message_structure)[i]) );
                   strlcat( szBuf, szFoo, sizeof(szBuf) );
@@ -1688,7 +1692,7 @@ tSIRF_RESULT SIRF_CODEC_ASCII_Encode( tSIRF_UINT32 message_id,
             {
                snprintf( szBuf, sizeof(szBuf), "%ld",
                   (unsigned long)SIRF_GET_MID(message_id));
-               for ( i = 0; i <= message_length - 1; i++ )
+               for ( i = 0; i < message_length; i++ )
                {
                   snprintf( szFoo, sizeof(szFoo), ",%02X", (unsigned)(((tSIRF_UINT8*)message_structure)[i]) );
                   strlcat( szBuf, szFoo, sizeof(szBuf) );
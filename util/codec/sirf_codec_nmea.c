@@ -763,7 +763,7 @@ static tSIRF_RESULT SIRF_CODEC_NMEA_Encode_GGA(
             (unsigned long)data->sv_used_cnt,
             (double)data->hdop * SIRF_MSG_SSB_DOP_LSB,
             data->alt_msl*1e-2,
-            (data->alt_ellips - data->alt_msl)*1e-2 );
+            ((double)data->alt_ellips - data->alt_msl)*1e-2 );
       }
       else
       {
@@ -1014,7 +1014,7 @@ static tSIRF_RESULT SIRF_CODEC_NMEA_Encode_GSA(
    /* put active chans svid */
    for ( i = 0; i < 32; i++ )
    {
-      if (data->sv_used & (1<<i))
+      if (data->sv_used & (1u<<i))
       {
          tSIRF_CHAR str1[128];
          snprintf(str1, sizeof(str1), "%02d,", i+1);
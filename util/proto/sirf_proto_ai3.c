@@ -43,6 +43,11 @@
 #include "sirf_codec_ai3.h"
 #include "sirf_proto_common.h"
 
+#if defined(__SSE2__) && defined(__GNUC__)
+#  include <emmintrin.h>
+#  define AI3_SIMD_SSE2
+#endif
+
 /******************************************************************************
  *  DEFINES
  ******************************************************************************/
@@ -72,6 +77,9 @@
 /* This is the bit to set in the MSByte of the header to signify 
  * to repeat the byte after the header for the length */
 #define RUN_LENGTH_COMPRESSION_BIT (0x80)
+/** Bytes compared at once by the run search. Also the largest token
+ * decompressed with a fixed size copy */
+#define AI3_SIMD_WIDTH (16)
 /******************************************************************************
  *  TYPEDEFS
  ******************************************************************************/
@@ -670,6 +678,9 @@ tSIRF_VOID SIRF_PROTO_AI3_SendEphAckNakMsg(tSIRF_UINT8 reason, tSIRF_UINT8 slcMs
  * @param output    location to store the decompressed data
  * @param maxOutLen length of output
  * 
+ * Short tokens are expanded with fixed size copies, so output bytes past
+ * the returned length may be overwritten.
+ *
  * @return Actual length written to output or 0 on error
  */
 tSIRF_UINT32 SIRF_PROTO_AI3_decompressAI3Msg( tSIRF_UINT8 *input,
@@ -699,7 +710,16 @@ tSIRF_UINT32 SIRF_PROTO_AI3_decompressAI3Msg( tSIRF_UINT8 *input,
 
       if( RUN_LENGTH_COMPRESSION_REPEAT_BYTE(header))
       {
-         memset((output + n), input[m], data_length);
+         if ((data_length <= AI3_SIMD_WIDTH) &&
+             ((n + AI3_SIMD_WIDTH) <= maxOutLen))
+         {
+            /* fixed size fill, the excess is overwritten by the next token */
+            memset((output + n), input[m], AI3_SIMD_WIDTH);
+         }
+         else
+         {
+            memset((output + n), input[m], data_length);
+         }
          n += data_length;
          m++;
       }
@@ -711,7 +731,17 @@ tSIRF_UINT32 SIRF_PROTO_AI3_decompressAI3Msg( tSIRF_UINT8 *input,
             return 0; /* input buffer is too short */
          }
 
-         memcpy(&output[n],&input[m],data_length);
+         if ((data_length <= AI3_SIMD_WIDTH) &&
+             ((m + AI3_SIMD_WIDTH) <= inputLen) &&
+             ((n + AI3_SIMD_WIDTH) <= maxOutLen))
+         {
+            /* fixed size copy, the excess is overwritten by the next token */
+            memcpy(&output[n],&input[m],AI3_SIMD_WIDTH);
+         }
+         else
+         {
+            memcpy(&output[n],&input[m],data_length);
+         }
          n += data_length;
          m += data_length;
       }
@@ -726,108 +756,161 @@ tSIRF_UINT32 SIRF_PROTO_AI3_decompressAI3Msg( tSIRF_UINT8 *input,
 }
 
 /******************************************************************************
- *  FUNCTION NAME: SIRF_PROTO_AI3_compressAI3Msg
+ *  FUNCTION NAME: SIRF_PROTO_AI3_findRun
  *
- *  Input:   input buffer, output  buffer, input length
+ *  Input:   input buffer, search start index, input length
  *
- *  Output:   NONE
+ *  Output:  index of the first byte of the next run, in_len if there is none
  *
- *  Description: compresses the input buffer and returns the length and compressed
- *               buffer
+ *  Description: finds the next run of more than RUN_LENGTH_COMPRESSION_MINIMUM
+ *               equal bytes. Equal neighbours are found 16 at a time by
+ *               comparing the input with itself shifted by one byte.
  *
  ******************************************************************************/
-
-tSIRF_UINT16 SIRF_PROTO_AI3_compressAI3Msg(tSIRF_UINT8 *in_buf,  tSIRF_UINT8 *out_buf, tSIRF_UINT16 in_len)
+static tSIRF_UINT16 SIRF_PROTO_AI3_findRun(const tSIRF_UINT8 *in_buf,
+                                           tSIRF_UINT16 start,
+                                           tSIRF_UINT16 in_len)
 {
-   tSIRF_UINT16 run_cnt,
-      non_run_cnt,
-      in_ind, out_ind,
-      cur_ind;
-   tSIRF_BOOL  ready_to_copy,match_end;
-
-   in_ind        = 0;
-   run_cnt       = 0;
-   non_run_cnt   = 0;
-   out_ind       = 0;
-   cur_ind       = 0;
-   ready_to_copy = SIRF_FALSE;
-   match_end     = SIRF_FALSE;
-
-   while(cur_ind < in_len - 1)
+   tSIRF_UINT32 i, eq_cnt;
+
+   i = start;
+#ifdef AI3_SIMD_SSE2
+   /* bit j of eq: in_buf[i+j] == in_buf[i+j+1]. A run starts at i+j when
+    * bits j..j+3 are set, which is known for j <= 12 only */
+   while ((i + AI3_SIMD_WIDTH + 1) <= in_len)
    {
-      if(in_buf[cur_ind] == in_buf[cur_ind +1])
+      __m128i a = _mm_loadu_si128((const __m128i *)&in_buf[i]);
+      __m128i b = _mm_loadu_si128((const __m128i *)&in_buf[i + 1]);
+      tSIRF_UINT32 eq = (tSIRF_UINT32)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+
+      eq &= (eq >> 1) & (eq >> 2) & (eq >> 3) & 0x1FFF;
+      if (eq)
       {
-         run_cnt++;
-         if( run_cnt < RUN_LENGTH_COMPRESSION_MINIMUM)
-         {
-            non_run_cnt++;
-         }
-         else
+         return (tSIRF_UINT16)(i + __builtin_ctz(eq));
+      }
+      i += AI3_SIMD_WIDTH - (RUN_LENGTH_COMPRESSION_MINIMUM - 1);
+   }
+#endif
+   eq_cnt = 0;
+   for (; (i + 1) < in_len; i++)
+   {
+      if (in_buf[i] == in_buf[i + 1])
+      {
+         if (++eq_cnt == RUN_LENGTH_COMPRESSION_MINIMUM)
          {
-            match_end = SIRF_TRUE;
-            if((non_run_cnt >= run_cnt) && (ready_to_copy))
-            {
-               /* copy non run length */
-               out_buf[out_ind++] = 0x00 | ((non_run_cnt - run_cnt + 1) >> 8);
-               out_buf[out_ind++] = (tSIRF_UINT8)(non_run_cnt - run_cnt + 1);
-               memcpy(&out_buf[out_ind],&in_buf[in_ind],(non_run_cnt - run_cnt + 1));
-               in_ind = in_ind + non_run_cnt - run_cnt + 1;
-               out_ind = out_ind + non_run_cnt - run_cnt + 1;
-               ready_to_copy = SIRF_FALSE;
-            }
-            non_run_cnt = 0;
+            return (tSIRF_UINT16)(i + 1 - RUN_LENGTH_COMPRESSION_MINIMUM);
          }
       }
       else
       {
-         if(match_end)
-         {
-            run_cnt++;
-            match_end = SIRF_FALSE;
-         }
-         else
-         {
-            non_run_cnt++;
-         }
-         if(run_cnt >= RUN_LENGTH_COMPRESSION_MINIMUM)
+         eq_cnt = 0;
+      }
+   }
+   return in_len;
+}
+
+/******************************************************************************
+ *  FUNCTION NAME: SIRF_PROTO_AI3_runEnd
+ *
+ *  Input:   input buffer, index of the run start, input length
+ *
+ *  Output:  index of the first byte after the run
+ *
+ ******************************************************************************/
+static tSIRF_UINT16 SIRF_PROTO_AI3_runEnd(const tSIRF_UINT8 *in_buf,
+                                          tSIRF_UINT16 start,
+                                          tSIRF_UINT16 in_len)
+{
+   tSIRF_UINT32 i;
+   tSIRF_UINT8 b = in_buf[start];
+
+   i = start + 1;
+#ifdef AI3_SIMD_SSE2
+   {
+      __m128i v = _mm_set1_epi8((char)b);
+
+      while ((i + AI3_SIMD_WIDTH) <= in_len)
+      {
+         tSIRF_UINT32 eq = (tSIRF_UINT32)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)&in_buf[i]), v));
+
+         if (eq != 0xFFFF)
          {
-            if((non_run_cnt >= run_cnt) && (ready_to_copy))
-            {
-               /* copy non run length. 
-                  Do not set the RUN_LENGTH_COMPRESSION_BIT */
-               out_buf[out_ind++] = ((non_run_cnt - run_cnt + 1) >> 8);
-               out_buf[out_ind++] = (tSIRF_UINT8)(non_run_cnt - run_cnt + 1);
-               memcpy(&out_buf[out_ind],&in_buf[in_ind],(non_run_cnt - run_cnt + 1));
-               in_ind = in_ind + non_run_cnt - run_cnt + 1;
-               out_ind = out_ind + non_run_cnt - run_cnt + 1;
-               ready_to_copy = SIRF_FALSE;
-            }
-            non_run_cnt = 0;
-            /* copy run length */
-            out_buf[out_ind++] = RUN_LENGTH_COMPRESSION_BIT | ((run_cnt) >> 8);
-            out_buf[out_ind++] = (tSIRF_UINT8)(run_cnt);
-            out_buf[out_ind++] = in_buf[in_ind];
-            in_ind = in_ind + run_cnt;
+            return (tSIRF_UINT16)(i + __builtin_ctz(~eq));
          }
-         run_cnt = 0;
-         ready_to_copy = SIRF_TRUE;
+         i += AI3_SIMD_WIDTH;
       }
-      cur_ind++;
    }
-   /* copy remaining run length and non run length */
-   if(run_cnt >= RUN_LENGTH_COMPRESSION_MINIMUM)
+#endif
+   while ((i < in_len) && (in_buf[i] == b))
+   {
+      i++;
+   }
+   return (tSIRF_UINT16)i;
+}
+
+/******************************************************************************
+ *  FUNCTION NAME: SIRF_PROTO_AI3_compressAI3Msg
+ *
+ *  Input:   input buffer, output  buffer, input length
+ *
+ *  Output:   NONE
+ *
+ *  Description: compresses the input buffer and returns the length and compressed
+ *               buffer. Runs of more than RUN_LENGTH_COMPRESSION_MINIMUM equal
+ *               bytes are stored as run length, the bytes between them are
+ *               copied. Output is the same as of the former byte at a time
+ *               state machine.
+ *
+ ******************************************************************************/
+
+tSIRF_UINT16 SIRF_PROTO_AI3_compressAI3Msg(tSIRF_UINT8 *in_buf,  tSIRF_UINT8 *out_buf, tSIRF_UINT16 in_len)
+{
+   tSIRF_UINT16 in_ind, out_ind,
+      run_start, run_end, non_run_cnt, run_cnt;
+
+   in_ind  = 0;
+   out_ind = 0;
+
+   if (0 == in_len)
+   {
+      return 0;
+   }
+
+   for (;;)
    {
-      out_buf[out_ind++] = RUN_LENGTH_COMPRESSION_BIT | ((run_cnt + 1) >> 8);
-      out_buf[out_ind++] = (tSIRF_UINT8)(run_cnt + 1);
-      out_buf[out_ind++] = in_buf[in_ind];
+      run_start = SIRF_PROTO_AI3_findRun(in_buf, in_ind, in_len);
+      if (run_start == in_len)
+      {
+         break;
+      }
+      run_end = SIRF_PROTO_AI3_runEnd(in_buf, run_start, in_len);
+
+      non_run_cnt = run_start - in_ind;
+      if (non_run_cnt)
+      {
+         /* copy non run length. 
+            Do not set the RUN_LENGTH_COMPRESSION_BIT */
+         out_buf[out_ind++] = (tSIRF_UINT8)(non_run_cnt >> 8);
+         out_buf[out_ind++] = (tSIRF_UINT8)(non_run_cnt);
+         memcpy(&out_buf[out_ind],&in_buf[in_ind],non_run_cnt);
+         out_ind = out_ind + non_run_cnt;
+      }
+      /* copy run length */
+      run_cnt = run_end - run_start;
+      out_buf[out_ind++] = RUN_LENGTH_COMPRESSION_BIT | (run_cnt >> 8);
+      out_buf[out_ind++] = (tSIRF_UINT8)(run_cnt);
+      out_buf[out_ind++] = in_buf[run_start];
+      in_ind = run_end;
    }
-   else
+   /* copy remaining non run length */
+   if (in_ind < in_len)
    {
-      /* Do not set the RUN_LENGTH_COMPRESSION_BIT */
-      out_buf[out_ind++] = ((non_run_cnt + 1) >> 8);
-      out_buf[out_ind++] = (tSIRF_UINT8)(non_run_cnt + 1);
-      memcpy(&out_buf[out_ind],&in_buf[in_ind],(non_run_cnt + 1));
-      out_ind = out_ind + non_run_cnt + 1;
+      non_run_cnt = in_len - in_ind;
+      out_buf[out_ind++] = (tSIRF_UINT8)(non_run_cnt >> 8);
+      out_buf[out_ind++] = (tSIRF_UINT8)(non_run_cnt);
+      memcpy(&out_buf[out_ind],&in_buf[in_ind],non_run_cnt);
+      out_ind = out_ind + non_run_cnt;
    }
    return out_ind;
 }
@@ -82,6 +82,8 @@ tSIRF_VOID SIRF_PROTO_AI3_Close( tSIRF_VOID );
 tSIRF_RESULT SIRF_PROTO_AI3_PacketInput(tSIRF_UINT8 *pMsg, tSIRF_UINT32 Len);
 tSIRF_RESULT SIRF_PROTO_AI3_Output(tSIRF_UINT32 msg_id, tSIRF_VOID *msg, tSIRF_UINT32 msg_len);
 tSIRF_UINT16 SIRF_PROTO_AI3_compressAI3Msg(tSIRF_UINT8 *in_buf, tSIRF_UINT8 *out_buf, tSIRF_UINT16 in_len);
+tSIRF_UINT32 SIRF_PROTO_AI3_decompressAI3Msg(tSIRF_UINT8 *input, tSIRF_UINT32 inputLen,
+                                             tSIRF_UINT8 *output, tSIRF_UINT32 maxOutLen);
 
 /* Leave C naming convention */
 #ifdef __cplusplus
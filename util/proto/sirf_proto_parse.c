@@ -37,40 +37,18 @@
 /***************************************************************************
  * Include Files
  ***************************************************************************/
+#include <string.h> /* For memcpy and memchr */
+
 #include "sirf_types.h"
 #include "sirf_msg.h"
 
 #include "sirf_proto_parse.h"
 #include "sirf_proto_common.h"
 
-/***************************************************************************
- *   State Machine definitions for the parsing functions
- ***************************************************************************/
-typedef enum Protocol_State_Machine_States_tag {
-   stA0,      /* search for A0 */
-   stA1,      /* search for A1 */
-   stLen1,    /* start packet length bits */
-   stLen2,    /* finish packet length bits */
-   stLCH,     /* SL Protocols only --> find logical channel */
-   stPacket,  /* gather binary data */
-   stChkSm1,  /* start checksum bits */
-   stChkSm2,  /* finish checksum bits */
-   stB0,      /* search for B0 */
-   stB3,      /* search for B3 */
-
-   n_stDollar, /* search for "$" */
-   n_stP,      /* 'P' */
-   n_stS,      /* 'S' */
-   n_stR,      /* 'R' */
-   n_stF,      /* 'F' */
-   n_stCR,     /* carriage return */
-   n_stLF      /* line feed */
-} Protocol_State_Machine_States;
-
 /***************************************************************************
  *   Definitions
  ***************************************************************************/
-#define MAX_BUFFER_SIZE 6000
+#define MAX_BUFFER_SIZE SIRF_PROTO_PARSE_MAX_BUFFER_SIZE
 
 #define   CR  (0x0D)       /* End of Sentence indicator */
 #define   LF  (0x0A)       /* End of sentence indicator */
@@ -80,11 +58,78 @@ typedef enum Protocol_State_Machine_States_tag {
  ***************************************************************************/
 static t_callback_func f_callback = 0;
 
-static Protocol_State_Machine_States pState = stA0; /* initial state for SSB */
-static tSIRF_INT32 PktIndex = 0;  /* current location in the packet */
-static tSIRF_INT32 PktLen = 0;    /* packet length */
-static tSIRF_INT32 PktChksum = 0; /* packet checksum */
-static tSIRF_UINT8 PktBuf[MAX_BUFFER_SIZE]; /* the packet */
+/* parser behind SIRF_PROTO_Parse() and SIRF_PROTO_SLParse() */
+static tSIRF_PROTO_PARSER DefaultParser;
+
+/***************************************************************************
+ * @brief:      Initialize a parser instance
+ * @param[in]:  parser  Parser to initialize
+ * @param[in]:  callback_func  Function called for each complete message
+ * @param[in]:  user_ctx  Passed unchanged to callback_func
+ ***************************************************************************/
+tSIRF_VOID SIRF_PROTO_Parser_Init( tSIRF_PROTO_PARSER *parser,
+                                   t_parser_callback_func callback_func,
+                                   tSIRF_VOID *user_ctx )
+{
+   parser->callback = callback_func;
+   parser->user_ctx = user_ctx;
+   SIRF_PROTO_Parser_Reset( parser );
+}
+
+/***************************************************************************
+ * @brief:      Drop a partially received message and restart the search
+ * @param[in]:  parser  Parser to reset
+ ***************************************************************************/
+tSIRF_VOID SIRF_PROTO_Parser_Reset( tSIRF_PROTO_PARSER *parser )
+{
+   parser->state = stA0;
+   parser->PktIndex = 0;
+   parser->PktLen = 0;
+   parser->PktChksum = 0;
+}
+
+/***************************************************************************
+ * @brief:      Copy the next span of packet data into the packet buffer
+ * @param[in]:  parser  Parser in stPacket state
+ * @param[in]:  Buf  Pointer to the first packet byte to copy
+ * @param[in]:  BytesLeft  Number of bytes available at Buf
+ * @return:     Number of bytes consumed, at least one
+ ***************************************************************************/
+static tSIRF_UINT32 Parse_Packet_Span( tSIRF_PROTO_PARSER *parser,
+                                       tSIRF_UINT8 const *Buf,
+                                       tSIRF_UINT32 BytesLeft )
+{
+   tSIRF_UINT32 span;
+
+   span = (tSIRF_UINT32)(parser->PktLen - (parser->PktIndex + 1));
+   if (span > BytesLeft)
+   {
+      span = BytesLeft;
+   }
+   memcpy(&parser->PktBuf[parser->PktIndex + 1], Buf, span);
+   parser->PktIndex += span;
+   if ( (parser->PktIndex + 1) >= parser->PktLen)
+   {
+      parser->state = stChkSm1;
+   }
+
+   return span;
+}
+
+/* Forwards messages of DefaultParser to the registered callback */
+static tSIRF_RESULT Default_Callback( tSIRF_UINT8 *PktBuf,
+                                      tSIRF_UINT32 PktLen,
+                                      tSIRF_ParserType type,
+                                      tSIRF_VOID *user_ctx )
+{
+   (void)user_ctx;
+
+   if ( f_callback )
+   {
+      return f_callback( PktBuf, PktLen, type );
+   }
+   return SIRF_SUCCESS;
+}
 
 /***************************************************************************
  * @brief:      Registration function for the callback routine
@@ -95,16 +140,20 @@ static tSIRF_UINT8 PktBuf[MAX_BUFFER_SIZE]; /* the packet */
 tSIRF_VOID SIRF_PROTO_Parse_Register( t_callback_func callback_func )
 {
    f_callback = callback_func;
+   DefaultParser.callback = Default_Callback;
 }
 
 #ifdef SIRF_LOC
 
 /***************************************************************************
  * @brief:      The parsing function for SLC messages
+ * @param[in]:  parser  Parser instance
  * @param[in]:  Buf  Pointer to the data stream to process
  * @param[in]:  BytesRead  Number of bytes to process
  ***************************************************************************/
-tSIRF_VOID SIRF_PROTO_SLParse( tSIRF_UINT8 *Buf, tSIRF_UINT32 BytesRead )
+tSIRF_VOID SIRF_PROTO_Parser_SLParse( tSIRF_PROTO_PARSER *parser,
+                                      tSIRF_UINT8 const *Buf,
+                                      tSIRF_UINT32 BytesRead )
 {
    tSIRF_UINT8 Byte = 0; /* holds the next raw data byte */
    tSIRF_UINT32 i = 0;   /* loop counter */
@@ -113,38 +162,47 @@ tSIRF_VOID SIRF_PROTO_SLParse( tSIRF_UINT8 *Buf, tSIRF_UINT32 BytesRead )
    for (i = 0; i < BytesRead; i++)
    {
       Byte = Buf[i]; 
-      switch (pState)
+      switch (parser->state)
       {
          case stA0:
-            if (SIRF_MSG_HEAD0 == Byte)
+            /* skip everything up to the next possible message start */
+            while ( (SIRF_MSG_HEAD0 != Byte) && ((i + 1) < BytesRead) )
             {
-               pState = stA1;
+               Byte = Buf[++i];
             }
-            else
+            if (SIRF_MSG_HEAD0 == Byte)
             {
-               pState = stA0;
+               parser->state = stA1;
             }
             break;
             
          case stA1:
             if (SIRF_MSG_HEAD1 == Byte)
             {
-               pState = stLen1;
+               parser->state = stLen1;
             }
             else
             {
-               pState = stA0;
+               parser->state = stA0;
             }
             break;
             
          case stLen1:   /* assume packet length bits 15:08 */
-            PktLen = Byte;
-            pState = stLen2;
+            parser->PktLen = Byte;
+            parser->state = stLen2;
             break;
             
-         case stLen2:   /* assume packet lenth bits 07:00 */
-            PktLen = (PktLen << 0x08) | Byte;
-            pState = stLCH;
+         case stLen2:   /* assume packet lenth bits 07:00, but check for maximum size */
+            parser->PktLen = (parser->PktLen << 0x08) | Byte;
+            /* the logical channel byte alone is not a message */
+            if ( (parser->PktLen < 2) || (parser->PktLen > MAX_BUFFER_SIZE) )
+            {
+               parser->state = stA0;
+            }
+            else
+            {
+               parser->state = stLCH;
+            }
             break;
             
          case stLCH:
@@ -158,44 +216,38 @@ tSIRF_VOID SIRF_PROTO_SLParse( tSIRF_UINT8 *Buf, tSIRF_UINT32 BytesRead )
                  (SIRF_LC_DEBUG == Byte)      /* Debug Message */
                )
             {
-               pState = stPacket;
+               parser->state = stPacket;
                /* note: the checksum is calculated including this byte */
-               PktIndex = 0;
-               PktBuf [PktIndex] = Byte;
+               parser->PktIndex = 0;
+               parser->PktBuf [parser->PktIndex] = Byte;
             }
             else
             {
-               pState = stA0;
+               parser->state = stA0;
             }
             break;
             
-         case stPacket:   /* count bytes until packet length, then advance the state */
-            PktIndex++;
-            PktBuf [PktIndex] = Byte;
-            if ( (PktIndex + 1) < PktLen)
-            {
-               break;
-            }
-            pState = stChkSm1;
+         case stPacket:   /* copy bytes until packet length, then advance the state */
+            i += Parse_Packet_Span( parser, &Buf[i], BytesRead - i ) - 1;
             break;
             
          case stChkSm1:   /* assume the checksum bits 15:08 and advance the state */
-            PktChksum = Byte;
-            pState = stChkSm2;
+            parser->PktChksum = Byte;
+            parser->state = stChkSm2;
             break;
             
          case stChkSm2:   /* assume the checksum bits 07:00 and validate it */
             {
                tSIRF_UINT16 myChecksum;
-               PktChksum = ((PktChksum << 0x08) | Byte) & 0x7FFF;
-               myChecksum = SIRF_PROTO_ComputeChksum(PktBuf, PktLen);
-               if (myChecksum == PktChksum)
+               parser->PktChksum = ((parser->PktChksum << 0x08) | Byte) & 0x7FFF;
+               myChecksum = SIRF_PROTO_ComputeChksum(parser->PktBuf, parser->PktLen);
+               if (myChecksum == parser->PktChksum)
                {
-                  pState = stB0;
+                  parser->state = stB0;
                }  
                else
                {
-                  pState = stA0;
+                  parser->state = stA0;
                }
             }
             break;
@@ -203,11 +255,11 @@ tSIRF_VOID SIRF_PROTO_SLParse( tSIRF_UINT8 *Buf, tSIRF_UINT32 BytesRead )
          case stB0:   /* if B0, advance the state, else reset */
             if (SIRF_MSG_TAIL0 == Byte)
             {
-               pState = stB3;
+               parser->state = stB3;
             }
             else
             {
-               pState = stA0;
+               parser->state = stA0;
             }
             break;
             
@@ -215,31 +267,44 @@ tSIRF_VOID SIRF_PROTO_SLParse( tSIRF_UINT8 *Buf, tSIRF_UINT32 BytesRead )
             if (SIRF_MSG_TAIL1 == Byte)
             {
                /* Call the callback if it is available to process the message */
-               if ( f_callback ) 
+               if ( parser->callback ) 
                {
-                  f_callback( PktBuf, PktLen, PARSER_SIRFLOC );
+                  parser->callback( parser->PktBuf, parser->PktLen,
+                                    PARSER_SIRFLOC, parser->user_ctx );
                }
             }
-            pState = stA0;
+            parser->state = stA0;
             break;
             
          default:
-            pState = stA0;
+            parser->state = stA0;
             break;            
-         } /* switch (pState) */
+         } /* switch (parser->state) */
    } /* for ( i = 0...*/
 }
 
+/***************************************************************************
+ * @brief:      The parsing function for SLC messages, single stream
+ * @param[in]:  Buf  Pointer to the data stream to process
+ * @param[in]:  BytesRead  Number of bytes to process
+ ***************************************************************************/
+tSIRF_VOID SIRF_PROTO_SLParse( tSIRF_UINT8 *Buf, tSIRF_UINT32 BytesRead )
+{
+   SIRF_PROTO_Parser_SLParse( &DefaultParser, Buf, BytesRead );
+}
+
 #else
 
 /***************************************************************************
  * @brief:      Make a decision on which parser (SSB or NMEA) to enter
+ * @param[in]:  parser  Parser instance
  * @param[in]:  Byte  Data byte to parse
  * @return:     The next parser state
  * @comm:       This function is only for use with non-SLC messages. That is,
  *              messages formatted using either SSB or NMEA only for GSW.
  ***************************************************************************/
-static Protocol_State_Machine_States Parse_Initial_Byte( tSIRF_UINT8 Byte )
+static Protocol_State_Machine_States Parse_Initial_Byte( tSIRF_PROTO_PARSER *parser,
+                                                         tSIRF_UINT8 Byte )
 {
    /* Default to look for SSB messages. If we don't match the initial byte of 
       either the SSB or the NMEA sequence, then stay at the default state. */
@@ -251,8 +316,8 @@ static Protocol_State_Machine_States Parse_Initial_Byte( tSIRF_UINT8 Byte )
    }
    else if ('$' == Byte) /* Switch to NMEA parser */
    {
-      PktIndex = 0;
-      PktBuf[PktIndex++] = Byte;
+      parser->PktIndex = 0;
+      parser->PktBuf[parser->PktIndex++] = Byte;
       newState = n_stP;
    }
    return newState;
@@ -260,10 +325,13 @@ static Protocol_State_Machine_States Parse_Initial_Byte( tSIRF_UINT8 Byte )
 
 /***************************************************************************
  * @brief:      The parsing function for GSW messages (SSB and NMEA)
+ * @param[in]:  parser  Parser instance
  * @param[in]:  Buf  Pointer to the data stream to process
  * @param[in]:  BytesRead  Number of bytes to process
  ***************************************************************************/
-tSIRF_VOID SIRF_PROTO_Parse( tSIRF_UINT8 *Buf, tSIRF_UINT32 BytesRead )
+tSIRF_VOID SIRF_PROTO_Parser_Parse( tSIRF_PROTO_PARSER *parser,
+                                    tSIRF_UINT8 const *Buf,
+                                    tSIRF_UINT32 BytesRead )
 {
    tSIRF_UINT8 Byte = 0; /* holds the next raw data byte */
    tSIRF_UINT32 i = 0;   /* loop counter */
@@ -272,72 +340,80 @@ tSIRF_VOID SIRF_PROTO_Parse( tSIRF_UINT8 *Buf, tSIRF_UINT32 BytesRead )
    {
       Byte = Buf[i];
 
-      switch(pState)
+      switch(parser->state)
       {
          case stA0:   /* if A0, advance the state, else reset */
-            pState = Parse_Initial_Byte( Byte );
+         case n_stDollar:
+            /* skip everything up to the next possible message start */
+            while ( (SIRF_MSG_HEAD0 != Byte) && ('$' != Byte)
+                    && ((i + 1) < BytesRead) )
+            {
+               Byte = Buf[++i];
+            }
+            parser->state = Parse_Initial_Byte( parser, Byte );
             break;
 
          case stA1:   /* if A1, advance the state, else reset */
             if (SIRF_MSG_HEAD1 == Byte)
             {
-               pState = stLen1;
+               parser->state = stLen1;
             }
             else
             {
-               pState = Parse_Initial_Byte( Byte );
+               parser->state = Parse_Initial_Byte( parser, Byte );
             }
             break;
 
          case stLen1:   /* assume packet length bits 15:08 */
-            PktLen = Byte;
-            pState = stLen2;
+            parser->PktLen = Byte;
+            parser->state = stLen2;
             break;
 
          case stLen2:   /* assume packet lenth bits 07:00, but check for maximum size */
-            PktLen = (PktLen << 0x08) | Byte;
-            PktIndex = -1;
-            pState = stPacket;
-            break;
-
-         case stPacket:   /* count bytes until packet length */
-            PktIndex++;
-            PktBuf [PktIndex] = Byte;
-            if ( (PktIndex + 1) < PktLen)
+            parser->PktLen = (parser->PktLen << 0x08) | Byte;
+            if ( (parser->PktLen == 0) || (parser->PktLen > MAX_BUFFER_SIZE) )
             {
-               break;
+               parser->state = Parse_Initial_Byte( parser, Byte );
+            }
+            else
+            {
+               parser->PktIndex = -1;
+               parser->state = stPacket;
             }
-            pState = stChkSm1;
+            break;
+
+         case stPacket:   /* copy bytes until packet length */
+            i += Parse_Packet_Span( parser, &Buf[i], BytesRead - i ) - 1;
             break;
 
          case stChkSm1:   /* assume checksum bits 15:08 */
-            PktChksum = Byte;
-            pState = stChkSm2;
+            parser->PktChksum = Byte;
+            parser->state = stChkSm2;
             break;
 
          case stChkSm2:   /* assume checksum bits 07:00 */
          {
             tSIRF_UINT16 myChecksum;
-            PktChksum = ((PktChksum << 0x08) | Byte) & 0x7FFF;
-            myChecksum = SIRF_PROTO_ComputeChksum(PktBuf, PktLen);
-            if (myChecksum == PktChksum)
+            parser->PktChksum = ((parser->PktChksum << 0x08) | Byte) & 0x7FFF;
+            myChecksum = SIRF_PROTO_ComputeChksum(parser->PktBuf, parser->PktLen);
+            if (myChecksum == parser->PktChksum)
             {
-               pState = stB0;
+               parser->state = stB0;
             }
             else
             {
-               pState = Parse_Initial_Byte( Byte );
+               parser->state = Parse_Initial_Byte( parser, Byte );
             }
             break;
          }
          case stB0:   /* if B0, advance the state, else reset */
             if (SIRF_MSG_TAIL0 == Byte)
             {
-               pState = stB3;
+               parser->state = stB3;
             }
             else
             {
-               pState = Parse_Initial_Byte( Byte );
+               parser->state = Parse_Initial_Byte( parser, Byte );
             }
             break;
 
@@ -345,99 +421,121 @@ tSIRF_VOID SIRF_PROTO_Parse( tSIRF_UINT8 *Buf, tSIRF_UINT32 BytesRead )
             if (SIRF_MSG_TAIL1 == Byte)
             {
                /* Call the callback if it is available to process the message */
-               if ( f_callback ) 
+               if ( parser->callback ) 
                {
-                  f_callback( PktBuf, PktLen, PARSER_SSB );
+                  parser->callback( parser->PktBuf, parser->PktLen,
+                                    PARSER_SSB, parser->user_ctx );
                }   
             }
-            pState = stA0;
-            break;
-
-         case n_stDollar:
-            pState = Parse_Initial_Byte( Byte );
+            parser->state = stA0;
             break;
 
          case n_stP:   /* looking for the SiRF input signature "$P" */
             if ('P' == Byte)
             {
-               pState = n_stS;
-               PktBuf[PktIndex++] = Byte;
+               parser->state = n_stS;
+               parser->PktBuf[parser->PktIndex++] = Byte;
             }
             else
             {
-               pState = Parse_Initial_Byte( Byte );
+               parser->state = Parse_Initial_Byte( parser, Byte );
             }
             break;
 
          case n_stS:   /* looking for the SiRF input signature "$PS" */
             if ('S' == Byte)
             {
-               pState = n_stR;
-               PktBuf[PktIndex++] = Byte;
+               parser->state = n_stR;
+               parser->PktBuf[parser->PktIndex++] = Byte;
             }
             else
             {
-               pState = Parse_Initial_Byte( Byte );
+               parser->state = Parse_Initial_Byte( parser, Byte );
             }
             break;
 
          case n_stR:   /* looking for the SiRF input signature "$PSR" */
             if ('R' == Byte)
             {
-               pState = n_stF;
-               PktBuf[PktIndex++] = Byte;
+               parser->state = n_stF;
+               parser->PktBuf[parser->PktIndex++] = Byte;
             }
             else
             {
-               pState = Parse_Initial_Byte( Byte );
+               parser->state = Parse_Initial_Byte( parser, Byte );
             }
             break;
 
          case n_stF:   /* looking for the SiRF input signature "$PSRF" */
             if ('F' == Byte)
             {
-               pState = n_stCR;
-               PktBuf[PktIndex++] = Byte;
+               parser->state = n_stCR;
+               parser->PktBuf[parser->PktIndex++] = Byte;
             }
             else
             {
-               pState = Parse_Initial_Byte( Byte );
+               parser->state = Parse_Initial_Byte( parser, Byte );
             }
             break;
 
          case n_stCR:   /* looking for the SiRF input signature "$PSRF<cr>" */
-            if (CR == Byte)
+         {
+            tSIRF_UINT8 const *cr;
+            tSIRF_UINT32 span;
+
+            /* copy up to and including <cr> at once */
+            cr = (tSIRF_UINT8 const *)memchr(&Buf[i], CR, BytesRead - i);
+            span = cr ? (tSIRF_UINT32)(cr - &Buf[i]) + 1 : BytesRead - i;
+            /* keep room for <lf>, drop sentences that do not fit */
+            if ( (parser->PktIndex + span) >= MAX_BUFFER_SIZE )
             {
-               pState = n_stLF; 
+               parser->state = stA0;
+               break;
+            }
+            memcpy(&parser->PktBuf[parser->PktIndex], &Buf[i], span);
+            parser->PktIndex += span;
+            i += span - 1;
+            if (cr)
+            {
+               parser->state = n_stLF; 
             }
-            PktBuf[PktIndex++] = Byte;
             break;
+         }
 
          case n_stLF:   /* got the full signature, parse the message */
-            if ((LF == Byte) && (PktIndex >= 0))
+            if ((LF == Byte) && (parser->PktIndex >= 0))
             {
-               PktBuf[PktIndex] = Byte;
+               parser->PktBuf[parser->PktIndex] = Byte;
                /* Call the callback if it is available */
-               if ( f_callback ) 
+               if ( parser->callback ) 
                {
                   /* total length starts from 1 and not zero */
-                  f_callback( PktBuf, PktIndex + 1, PARSER_NMEA );
+                  parser->callback( parser->PktBuf, parser->PktIndex + 1,
+                                    PARSER_NMEA, parser->user_ctx );
                }
             }
-            pState = n_stDollar; 
+            parser->state = n_stDollar; 
             break;
 
          default:
-            pState = Parse_Initial_Byte( Byte );
+            parser->state = Parse_Initial_Byte( parser, Byte );
             break;
       }
    }
 }
 
+/***************************************************************************
+ * @brief:      The parsing function for GSW messages, single stream
+ * @param[in]:  Buf  Pointer to the data stream to process
+ * @param[in]:  BytesRead  Number of bytes to process
+ ***************************************************************************/
+tSIRF_VOID SIRF_PROTO_Parse( tSIRF_UINT8 *Buf, tSIRF_UINT32 BytesRead )
+{
+   SIRF_PROTO_Parser_Parse( &DefaultParser, Buf, BytesRead );
+}
+
 #endif /* SIRF_LOC */
 
 /**
  * @}
  */
-
-
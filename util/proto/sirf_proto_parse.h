@@ -49,9 +49,64 @@ typedef enum {
    PARSER_SIRFLOC
 } tSIRF_ParserType;
 
+/***************************************************************************
+ *   State Machine definitions for the parsing functions
+ ***************************************************************************/
+typedef enum Protocol_State_Machine_States_tag {
+   stA0,      /* search for A0 */
+   stA1,      /* search for A1 */
+   stLen1,    /* start packet length bits */
+   stLen2,    /* finish packet length bits */
+   stLCH,     /* SL Protocols only --> find logical channel */
+   stPacket,  /* gather binary data */
+   stChkSm1,  /* start checksum bits */
+   stChkSm2,  /* finish checksum bits */
+   stB0,      /* search for B0 */
+   stB3,      /* search for B3 */
+
+   n_stDollar, /* search for "$" */
+   n_stP,      /* 'P' */
+   n_stS,      /* 'S' */
+   n_stR,      /* 'R' */
+   n_stF,      /* 'F' */
+   n_stCR,     /* carriage return */
+   n_stLF      /* line feed */
+} Protocol_State_Machine_States;
+
+#define SIRF_PROTO_PARSE_MAX_BUFFER_SIZE 6000
+
 /* Define a callback function that will handle the message processing */
 typedef tSIRF_RESULT (*t_callback_func)(tSIRF_UINT8 *, tSIRF_UINT32, tSIRF_ParserType);
 
+/* Per parser callback. user_ctx is the one given to SIRF_PROTO_Parser_Init() */
+typedef tSIRF_RESULT (*t_parser_callback_func)(tSIRF_UINT8 *, tSIRF_UINT32,
+                                               tSIRF_ParserType, tSIRF_VOID *);
+
+/* Parser instance: one per stream, instances share no state */
+typedef struct tSIRF_PROTO_PARSER_tag
+{
+   Protocol_State_Machine_States state;
+   tSIRF_INT32 PktIndex;  /* current location in the packet */
+   tSIRF_INT32 PktLen;    /* packet length */
+   tSIRF_INT32 PktChksum; /* packet checksum */
+   t_parser_callback_func callback;
+   tSIRF_VOID *user_ctx;
+   tSIRF_UINT8 PktBuf[SIRF_PROTO_PARSE_MAX_BUFFER_SIZE]; /* the packet */
+} tSIRF_PROTO_PARSER;
+
+tSIRF_VOID SIRF_PROTO_Parser_Init( tSIRF_PROTO_PARSER *parser,
+                                   t_parser_callback_func callback_func,
+                                   tSIRF_VOID *user_ctx );
+tSIRF_VOID SIRF_PROTO_Parser_Reset( tSIRF_PROTO_PARSER *parser );
+
+tSIRF_VOID SIRF_PROTO_Parser_SLParse( tSIRF_PROTO_PARSER *parser,
+                                      tSIRF_UINT8 const *Buf,
+                                      tSIRF_UINT32 BytesRead );
+tSIRF_VOID SIRF_PROTO_Parser_Parse( tSIRF_PROTO_PARSER *parser,
+                                    tSIRF_UINT8 const *Buf,
+                                    tSIRF_UINT32 BytesRead );
+
+/* Single stream interface, runs a parser instance owned by the module */
 tSIRF_VOID SIRF_PROTO_Parse_Register( t_callback_func callback_func );
 
 tSIRF_VOID SIRF_PROTO_SLParse( tSIRF_UINT8 *Buf, tSIRF_UINT32 BytesRead );